@@ -1,7 +1,22 @@
 #include <iostream>         // cout, cerr
 #include <cstdlib>          // EXIT_FAILURE
+#include <chrono>           // steady_clock for CPU submission timings
+#include <cmath>            // ceil, sqrt
+#include <cstddef>          // offsetof
+#include <cstdio>           // fopen, remove
+#include <cstring>          // memcpy
+#include <algorithm>        // sort
+#include <deque>            // deque
+#include <thread>           // sleep_for while headless frames wait for textures
+#include <string>           // string
+#include <unordered_map>    // unordered_map
+#include <vector>           // vector
 #include <GL/glew.h>        // GLEW library
 #include <GLFW/glfw3.h>     // GLFW library
+#ifdef __linux__
+#include <EGL/egl.h>        // Headless contexts without a display server
+#include <EGL/eglext.h>
+#endif
 
 // GLM Math Header inclusions
 #include <glm/glm.hpp>
@@ -9,6 +24,17 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "camera.h"
+#include "meshopt.h"       // Vertex welding for the indexed mesh pipeline
+#include "imagequeue.h"    // Worker threads decoding textures off the GL thread
+#include "texturecompress.h" // BC1/BC3/BC7 baker and baked texture files
+#include "profiler.h"     // CPU and GPU timings of each section of a frame
+#include "glstate.h"      // Skips GL calls that would not change the bound state
+#include "json.h"         // Scene files
+#include "frustum.h"      // SIMD view frustum culling
+#include "bvh.h"          // Bounding volume hierarchy for culling and picking
+#include "meshgen.h"      // Procedural cylinders, cones, capsules, tori and boxes
+#include "meshimport.h"   // Multithreaded OBJ and glTF importer
+#include "meshfile.h"     // Binary mesh files, mapped and uploaded without parsing
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"     // Image loading Utility functions
@@ -20,6 +46,11 @@ using namespace std; // Standard namespace
 #define GLSL(Version, Source) "#version " #Version " core \n" #Source
 #endif
 
+/*Shader body Macro: no #version line, for sources completed at runtime with a header*/
+#ifndef GLSL_BODY
+#define GLSL_BODY(Source) #Source
+#endif
+
 // Unnamed namespace
 namespace
 {
@@ -29,44 +60,356 @@ namespace
     const int WINDOW_WIDTH = 800;
     const int WINDOW_HEIGHT = 600;
 
+    // Most levels of detail a mesh holds
+    const GLuint MESH_MAX_LODS = 4;
+
+    // One level of detail: a range of the mesh's index buffer, over vertices of its own
+    struct GLMeshLod
+    {
+        GLuint firstIndex;  // Offset of the level's indices in the mesh's element buffer
+        GLuint nIndices;
+        float error;        // Largest distance between the level and the exact surface, in object units
+    };
+
     // Stores the GL data relative to a given mesh
     struct GLMesh
     {
         GLuint vao;         // Handle for the vertex array object
-        GLuint vbo;        // Handles for the vertex buffer objects
-        GLuint nVertices;   // Number of indices of the mesh
+        GLuint vbo;         // Handle for the vertex buffer object
+        GLuint ebo;         // Handle for the element (index) buffer object
+        GLuint nVertices;   // Number of unique vertices after welding
+        GLuint nIndices;    // Number of indices of the full-detail level (level 0, first in the element buffer)
+        GLenum indexType;   // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+        GLuint instanceVbo; // Handle for the per-instance model matrix buffer
+        GLuint nInstances;  // Number of model matrices in the instance buffer
+        GLuint firstIndex;  // Offset of the mesh indices in the shared arena
+        GLint baseVertex;   // Offset of the mesh vertices in the shared arena
+        GLuint firstInstance; // Offset of the mesh instances in the per-frame model-view-projection buffer
+        const char* section; // Part of the scene the mesh is timed under by the profiler
+        glm::vec3 boundsMin; // Object-space bounding box of the vertices
+        glm::vec3 boundsMax;
+        GLuint positionVbo; // Positions alone, the vertex stream of the depth pre-pass
+        GLuint depthVao;    // Positions and model-view-projection matrices over the mesh's indices
+        GLMeshLod lods[MESH_MAX_LODS]; // Levels of detail, finest first, each coarser than the one before
+        GLuint nLods;
+    };
+
+    // Mesh imported from a model file the scene lists, uploaded once there is a GL context
+    struct GLImportedMesh
+    {
+        GLMesh mesh;
+        ImportedMesh source;    // Its name stays, the vertices and indices are freed once uploaded
+    };
+
+    // Mesh of a mapped mesh file, named by the scene before its buffers are created from the mapping
+    struct GLFileMesh
+    {
+        GLMesh mesh;
+        const unsigned char* file;  // Mapping, until UCloseMeshFiles
+        MeshFileMesh entry;
+    };
+
+    // Objects placed in the scene, one entry per object in each array
+    struct GLScene
+    {
+        vector<GLMesh*> meshes;         // Mesh drawn for the object
+        vector<GLuint> materials;       // Material (texture layer or bindless slot) sampled by the Phong shader
+        vector<glm::mat4> models;       // Model matrix
+        vector<uint64_t> sortKeys;      // Draw order: program, material binding, mesh, then material (see UDrawSortKey)
+    };
+
+    // Consecutive scene objects sharing a mesh, drawn with one instanced call whatever their materials
+    struct GLSceneBatch
+    {
+        GLMesh* mesh;
+        GLuint firstObject;     // Index of the first object in gScene and in the draw records
+        GLuint nObjects;        // Number of instances drawn
+        GLuint baseInstance;    // Offset of the first instance in the mesh's instance buffer
+        GLuint lod;             // Level of detail drawn (always 0 in gSceneBatches)
+    };
+
+    // Layout of one command read by glMultiDrawElementsIndirect
+    struct GLDrawElementsIndirectCommand
+    {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    // Per-object record: instance attributes of the per-object path, SSBO entry of the indirect path (std430, 128 bytes)
+    struct GLDrawRecord
+    {
+        glm::mat4 model;
+        glm::vec4 normalMatrix[3];  // Inverse-transpose of the model's upper 3x3, one padded column per vec4 (std430 mat3)
+        GLuint material;
+        GLuint padding[3];
+    };
+
+    // Per-frame uniform block shared by every program at uniform buffer binding 0 (std140, matches FrameUniforms)
+    struct GLFrameUniforms
+    {
+        glm::mat4 view;
+        glm::mat4 projection;
+        glm::mat4 viewProjection;
+        glm::vec4 viewPosition;     // xyz used
+        glm::vec4 lightPosition;    // xyz used
+        glm::vec4 lightColor;       // rgb used
+        glm::vec4 objectColor;      // rgb used
+        glm::vec2 uvScale;
+        glm::vec2 padding;
+    };
+
+    // Mesh copied into the arena straight from a mapped mesh file instead of from the staging copy
+    struct GLMeshArenaSpan
+    {
+        GLMesh* mesh;
+        const GLfloat* vertices;
+        const GLfloat* positions;
+        const GLuint* indices;
+        GLuint nIndices;
+    };
+
+    // One vertex/index arena shared by every mesh plus the buffers of the multi-draw indirect renderer
+    struct GLMeshArena
+    {
+        GLuint vao;                 // Single VAO over the whole arena
+        GLuint vbo;
+        GLuint ebo;
+        GLuint objectIndexVbo;      // Scene object of each instance (instance order), fetched through each command's baseInstance
+        GLuint recordSsbo;          // One GLDrawRecord per scene object
+        GLuint commandBuffer;       // One GLDrawElementsIndirectCommand per visible run, rewritten every frame
+        GLsizei nCommands;
+        GLuint positionVbo;         // Positions alone, read by the depth pre-pass
+        GLuint depthVao;            // Same commands as vao, but only positions and the model-view-projection matrices
+        vector<GLfloat> vertices;   // Staging copy appended by UCreateIndexedMesh until the arena is uploaded
+        vector<GLuint> indices;
+        vector<GLMeshArenaSpan> spans; // Mesh file meshes, placed after the staged meshes
+    };
+
+    // Frames the occlusion pass's counters wait before they are read back; a slot whose fence has not signalled by
+    // then is skipped rather than waited for
+    const GLuint OCCLUSION_STATISTICS_LATENCY = 3;
+
+    // GPU occlusion culling: a farthest-depth pyramid (Hi-Z) of the frame's depth, and the compute passes that test
+    // every object against it and write the instance lists of the indirect draws
+    struct GLOcclusionCulling
+    {
+        GLuint vao;                 // Arena vertices, with the instance attributes read from the culled lists below
+        GLuint boundsSsbo;          // World-space center and half extent of each object (two vec4s)
+        GLuint objectMeshSsbo;      // Command slot of each object's mesh
+        GLuint visibilitySsbo;      // 1 for the objects the last frame found visible
+        GLuint commandBuffer;       // One command per mesh for phase 1, then as many for phase 2
+        GLuint drawObjectVbo;       // Object of each culled instance: phase 1 in the first half, phase 2 in the second
+        GLuint drawMvpVbo;          // Model-view-projection of each culled instance, written by the cull pass
+        GLuint statisticsSsbo[OCCLUSION_STATISTICS_LATENCY]; // Frustum rejects, phase 1 and phase 2 draws, triangles of a frame
+        GLsync statisticsFences[OCCLUSION_STATISTICS_LATENCY]; // Signalled once the frame that wrote the slot is done
+        vector<GLDrawElementsIndirectCommand> commands;     // Both phases with no instances, copied in every frame
+        GLuint nObjects;
+        GLuint nMeshes;
+        GLuint hiZ;                 // GL_R32F, each texel the farthest depth under its footprint
+        GLsizei hiZWidth;           // Size of the depth it was built from, level 0 is half of it
+        GLsizei hiZHeight;
+        GLsizei hiZLevels;
+        GLuint depthCopy;           // Window only: the default framebuffer's depth copied into a texture
+        GLuint depthCopyFbo;
+        GLuint reduceProgram;       // Level 0 of the pyramid from the depth texture
+        GLuint downsampleProgram;   // Every other level from the one below it
+        GLuint cullProgram;
+        GLint uPhase;
+        GLint uObjectCount;
+        GLint uMeshCount;
+        GLint uHiZLevels;
+        GLint uDepthSize;
+        uint64_t frame;
+    };
+
+    // Textures of every material: layers of one array texture, or bindless handles when supported
+    struct GLMaterialLibrary
+    {
+        bool bindless;              // Sample through ARB_bindless_texture handles instead of array layers
+        GLuint arrayTexture;        // GL_TEXTURE_2D_ARRAY with one layer per material
+        GLuint handleSsbo;          // One 64-bit handle per material (bindless only)
+        vector<GLuint> textures;    // Full resolution texture per material, 0 until resident (bindless only)
+        GLuint placeholder;         // 1x1 texture every handle points to until its material is resident (bindless only)
+        vector<string> filenames;   // Source image of each material, indexed by material
+
+        // Streaming state: decoded pixels land in a persistently mapped pixel unpack buffer
+        GLint param;                            // Wrap mode of every material texture
+        GLuint pbo;                             // 0 once every material is resident
+        unsigned char* pboMemory;
+        vector<size_t> offsets;                 // Start of each material in the buffer (one extra entry = total size)
+        vector<int> widths;
+        vector<int> heights;
+        vector<uint32_t> blockFormats;          // Format of the material's baked file, 0 = decode the PNG/JPG
+        vector<GLsizei> levels;                 // Mip levels stored in the baked file
+        size_t textureBytes;                    // Video memory taken by the resident materials
+        size_t uncompressedBytes;               // Same materials as RGBA8 with full mip chains
+        vector<double> decodeMilliseconds;      // Worker time spent decoding each material
+        vector<double> uploadMilliseconds;      // GL thread time spent uploading each material
+        GLuint nResident;
+        chrono::steady_clock::time_point loadStart;
+    };
+
+    // Every material is resampled to this size to become one layer of the array texture
+    const GLsizei MATERIAL_LAYER_SIZE = 1024;
+
+    // Stores an active uniform reflected from a linked shader program
+    struct GLUniform
+    {
+        GLint location;     // Location resolved once at link time
+        GLenum type;        // GLSL type reported by glGetActiveUniform
+        GLint size;         // Number of array elements (1 for non-arrays)
+    };
+
+    // Table of the active uniforms of a shader program, keyed by name
+    typedef unordered_map<string, GLUniform> GLUniformTable;
+
+    // Pre-resolved uniform locations for the Phong shader program (the rest comes from the frame uniform block)
+    struct GLSceneUniforms
+    {
+        GLint uMaterials;
+    };
+
+    // Pre-resolved uniform locations for the lamp shader program
+    struct GLLampUniforms
+    {
+        GLint model;
     };
 
     // Main GLFW window
     GLFWwindow* gWindow = nullptr;
 
+    // Render this many frames of a scripted camera path offscreen and print their timings (--headless <frames>)
+    int gHeadlessFrames = 0;
+    GLuint gHeadlessFbo = 0;
+    GLuint gHeadlessColor = 0;
+    GLuint gHeadlessDepth = 0;
+#ifdef __linux__
+    EGLDisplay gEglDisplay = EGL_NO_DISPLAY;
+    EGLContext gEglContext = EGL_NO_CONTEXT;
+#endif
+
     // Triangle mesh data
     GLMesh bottleMesh; 
     GLMesh capMesh; 
     GLMesh groundMesh;
-    GLMesh wiperBack1;
-    GLMesh wiperBox1;
-    GLMesh wiperBack2;
-    GLMesh wiperBox2;
+    GLMesh wiperBack;   // Shared by the right and left wiper backs (2 instances)
+    GLMesh wiperBox;    // Shared by both wiper boxes (2 instances)
     GLMesh screwDriverHandle;
     GLMesh screwDriverRod;
     GLMesh screwDriverTip;
 
-    // Texture
-    GLuint groundTextureId;
-    GLuint bottleTextureId;
-    GLuint capTextureId;
-    GLuint wiperBackTextureId;
-    GLuint wiperBoxTextureId;
-    GLuint screwDriverHandleTextureId;
-    GLuint screwDriverTextureId;
+    // Materials
+    GLMaterialLibrary gMaterials;
+
+    // Use bindless textures when the driver exposes them (disable with --no-bindless)
+    bool gUseBindless = true;
+
+    // Decodes material images on worker threads
+    ImageDecodeQueue gImageQueue;
 
     glm::vec2 gUVScale(5.0f, 5.0f);
     GLint gTexWrapMode = GL_REPEAT;
 
+    // Scene objects and the batches they are drawn in
+    GLScene gScene;
+    vector<GLSceneBatch> gSceneBatches;
+
+    // Skip the objects outside the view frustum (disable with --no-cull). The world-space box of every object
+    // is tested each frame; the visible objects of each batch are drawn as runs of consecutive instances.
+    bool gFrustumCulling = true;
+    CullBounds gSceneBounds;
+    vector<unsigned char> gObjectVisible;
+    vector<GLSceneBatch> gVisibleBatches;
+    size_t gVisibleCount = 0;
+    size_t gCulledCount = 0;
+    double gCullMicroseconds = 0.0;
+
+    // Hierarchy over the same boxes, walked by the culling of large scenes and by picking. Objects moved with
+    // USetObjectModel refit it in place.
+    BoundingVolumeHierarchy gSceneBvh;
+    const size_t BVH_CULL_MIN_OBJECTS = 8192;  // Below this the linear SIMD test is faster (see BENCH bvh)
+    vector<GLuint> gObjectInstances;            // Position of each scene object in gInstanceObjects
+
+    // Draw every round object at the coarsest level of detail whose error stays under gLodErrorPixels on screen
+    // (toggle with L or --no-lod, set with --lod-error <pixels>). An object only moves to a coarser level once that
+    // level's error is under LOD_HYSTERESIS of the threshold, so it does not flip back and forth at the boundary.
+    bool gLodSelection = true;
+    float gLodErrorPixels = 1.0f;
+    const float LOD_HYSTERESIS = 0.5f;
+    vector<unsigned char> gObjectLods;  // Level each object was drawn at last frame
+    vector<float> gObjectLodScale;      // Longest axis of each object's model matrix, scales the levels' errors
+
+    // Object picked with the left mouse button (-1 = none), moved with the arrow keys
+    int gPickedObject = -1;
+    glm::mat4 gViewProjection(1.0f);
+
+    // Shared arena used by the multi-draw indirect renderer
+    GLMeshArena gMeshArena;
+
+    // Draw the scene in two phases culled on the GPU against the Hi-Z pyramid (toggle with O or --occlusion).
+    // The counts of the last frame read back land in gVisibleCount and gCulledCount too.
+    bool gOcclusionCulling = false;
+    GLOcclusionCulling gOcclusion;
+    size_t gOccludedCount = 0;     // Objects inside the frustum that neither phase drew
+
+    // Frame uniform block, and the model-view-projection matrix of every scene object, both rewritten each frame.
+    // The matrices are per-instance attributes of both paths, stored mesh after mesh in instance order.
+    GLuint gFrameUbo = 0;
+    GLuint gObjectMvpVbo = 0;
+    vector<GLuint> gInstanceObjects;    // Scene object drawn by each instance
+    vector<glm::mat4> gObjectMvps;
+
     // Shader programs
     GLuint gProgramId;
     GLuint gLampProgramId;
+    GLuint gIndirectProgramId;
+    GLuint gDepthProgramId;
+
+    // Reflected uniforms of each shader program and their resolved handles
+    GLUniformTable gProgramUniforms;
+    GLUniformTable gLampProgramUniforms;
+    GLUniformTable gIndirectProgramUniforms;
+    GLUniformTable gDepthProgramUniforms;
+    GLSceneUniforms gSceneUniforms;
+    GLSceneUniforms gIndirectUniforms;
+    GLLampUniforms gLampUniforms;
+
+    // Submit the whole scene with one glMultiDrawElementsIndirect (toggle with M or --mdi)
+    bool gIndirectRendering = false;
+
+    // Lay down the scene's depth with a position-only pass first, so the Phong pass shades each pixel once
+    // with GL_EQUAL (toggle with Z or --depth-prepass; the occlusion path always draws without it)
+    bool gDepthPrepass = false;
+
+    // Per-frame submission statistics of the scene pass
+    unsigned int gDrawCallCount = 0;
+    size_t gSubmittedTriangles = 0;     // Triangles of the shaded pass (the occlusion path's lag like its other counts)
+    double gSubmitMilliseconds = 0.0;
+
+    // Program, VAO, texture, buffer and capability state bound by the render loop
+    GLStateCache gGLState;
+
+    // Number of scene copies rendered by the --bench-submit comparison (0 = no benchmark)
+    int gBenchSubmitCopies = 0;
+
+    // Subdivisions of each face of the bottle drawn by the --bench-vertex comparison (0 = no benchmark)
+    int gBenchVertexSubdivisions = 0;
+
+    // Time the ways of flipping a decoded image with --bench-flip, then exit
+    bool gBenchFlip = false;
+
+    // Block format the --bake-textures pass compresses the materials to (empty = no baking)
+    string gBakeFormat;
+
+    // CPU/GPU timings of every frame section, written as a Chrome trace with --trace <file> (and the T key)
+    FrameProfiler gProfiler;
+    string gTracePath;
+
+    // Number of uniform name lookups since the start of the current frame (stays 0 in the render loop)
+    unsigned int gUniformLookupCount = 0;
 
     // camera
     Camera gCamera(glm::vec3(0.0f, 1.0f, 3.0f));
@@ -88,6 +431,27 @@ namespace
     // Light position and scale
     glm::vec3 gLightPosition(-1.5f, 20.5f, 0.0f);
     glm::vec3 gLightScale(0.3f);
+
+    // Run the cache/overdraw/fetch optimizer over every index buffer (disable with --no-mesh-opt)
+    bool gOptimizeMeshes = true;
+
+    // Slices around the round meshes (bottle, cap, screwdriver)
+    const int MESH_ROUND_SEGMENTS = 32;
+
+    // Materials and objects of the scene (--scene <file>)
+    string gScenePath = "./resources/scenes/desk.json";
+
+    // Mesh files listed by the scene ("meshFiles") stay mapped until their meshes and the arena are uploaded
+    vector<MeshFileMapping> gMeshFiles;
+    deque<GLFileMesh> gFileMeshes;      // Keeps its elements in place, the scene points at their meshes
+
+    // Meshes of the OBJ and .glb files listed by the scene ("modelFiles")
+    deque<GLImportedMesh> gImportedMeshes;
+
+    // Time loading a mesh from an OBJ file against loading it from a mesh file with --bench-load [file.obj],
+    // then exit (a generated torus without a file)
+    bool gBenchLoad = false;
+    string gBenchLoadPath;
 }
 
 /* User-defined Function prototypes to:
@@ -96,11 +460,16 @@ namespace
  * and render graphics on the screen
  */
 bool UInitialize(int, char* [], GLFWwindow** window);
+bool UInitializeHeadless();
+void UDestroyHeadless();
 void UResizeWindow(GLFWwindow* window, int width, int height);
 void UProcessInput(GLFWwindow* window);
 void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos);
 void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
+void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
+int UPickObject(double xpos, double ypos);
 void UCreateMeshBottle(GLMesh& mesh);
+void UCreateMeshBottleTessellated(GLMesh& mesh, int subdivisions);
 void UCreateMeshCap(GLMesh& mesh);
 void UCreateMeshGround(GLMesh& mesh);
 void UCreateMeshWiperBack(GLMesh& mesh);
@@ -108,12 +477,73 @@ void UCreateMeshWiperBox(GLMesh& mesh);
 void UCreateMeshScrewDriverHandle(GLMesh& mesh);
 void UCreateMeshScrewDriverRod(GLMesh& mesh);
 void UCreateMeshScrewDriverTip(GLMesh& mesh);
+void UCreateMeshShape(GLMesh& mesh, MeshShape shape, int segments, int rings, const char* name);
+void UCreateIndexedMesh(GLMesh& mesh, const GLfloat* verts, size_t nFloats, const char* name);
+void UUploadIndexedMesh(GLMesh& mesh, vector<GLfloat>& vertices, vector<uint32_t>& indices, const GLMeshLod* lods, GLuint nLods, const char* name);
+void USetMeshVertexArrays(GLMesh& mesh);
+bool UOpenMeshFile(const char* path);
+bool UImportModelFile(const char* path);
+void UCreateImportedMeshes();
+bool UMeshFileMatchesLayout(const unsigned char* file);
+void UCreateFileMesh(GLMesh& mesh, const unsigned char* file, const MeshFileMesh& entry);
+void UCreateFileMeshes();
+void UCloseMeshFiles();
+void USetMeshInstances(GLMesh& mesh, const GLDrawRecord* instances, GLuint count);
 void UDestroyMesh(GLMesh& mesh);
+void UUploadPositions(const GLfloat* vertices, size_t nVertices, GLintptr offset);
+void UBuildMeshArena();
+void UDestroyMeshArena();
+void UAddSceneObject(GLMesh& mesh, GLuint material, const glm::mat4& model);
+void USetNormalMatrix(GLDrawRecord& record, const glm::mat4& model);
+GLMesh* UFindMesh(const string& name);
+bool UReadVector(const JsonValue* value, int n, float* out);
+bool ULoadScene(const char* path);
+void UReplicateScene(int copies);
+uint64_t UDrawSortKey(GLuint program, GLuint materialBinding, GLuint mesh, GLuint material);
+bool UDrawsBefore(GLuint a, GLuint b);
+void UUploadScene();
+void UCullScene(const glm::mat4& viewProjection);
+GLuint USelectLod(GLuint object, float pixelsPerUnit);
+float UModelScale(const glm::mat4& model);
+void UComputeObjectBounds(GLuint object, glm::vec3& center, glm::vec3& extent);
+void USetObjectModel(GLuint object, const glm::mat4& model);
 void URender();
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId);
+void UUpdateFrameUniforms(const glm::mat4& view, const glm::mat4& projection);
+void USetMvpAttribute(GLuint vao, GLuint location, GLuint firstInstance);
+void URenderScenePerObject(bool depthOnly);
+void UUploadIndirectCommands();
+void URenderSceneIndirect(GLuint vao);
+bool UCreateOcclusionCulling();
+void UUploadOcclusionScene();
+void UDestroyOcclusionCulling();
+void UBuildHiZ();
+void UDispatchOcclusionCull(GLuint phase);
+void URenderSceneOcclusion();
+void UBindMaterials();
+void UBenchmarkSubmission();
+void UBenchmarkVertexThroughput(int subdivisions, const char* fragmentShaderSource);
+void UBenchmarkFrames(int frames);
+void UBenchmarkImageFlip(const char* filename);
+void UBenchmarkMeshLoad(const string& path);
+bool UWriteBenchmarkObj(const string& path);
+long UFileSize(const string& path);
+void UWriteTrace();
+void UBakeTextures(const string& format);
+bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId, GLUniformTable& uniforms);
+bool UCreateComputeProgram(const char* shaderSource, GLuint& programId, GLUniformTable& uniforms);
+void UReflectUniforms(GLuint programId, GLUniformTable& uniforms);
+GLint UGetUniform(const GLUniformTable& uniforms, const char* name, GLenum type);
 void UDestroyShaderProgram(GLuint programId);
-bool UCreateTexture(const char* filename, GLuint& textureId, GLint param);
 void UDestroyTexture(GLuint textureId);
+GLuint UAddMaterial(const char* filename);
+GLsizei UMipLevels(GLsizei width, GLsizei height);
+string UBakedTexturePath(const string& filename);
+GLenum UCompressedFormat(uint32_t blockFormat);
+bool UDecodeMaterialImage(const ImageDecodeJob& job);
+bool UCreateMaterials(GLint param);
+void UUpdateMaterials();
+void UUploadCompressedLevels(GLenum target, GLuint material, GLsizei width, GLsizei height, GLint layer);
+void UDestroyMaterials();
 
 
 /* Vertex Shader Source Code*/
@@ -121,43 +551,88 @@ const GLchar* vertexShaderSource = GLSL(440,
 layout(location = 0) in vec3 position; // VAP position 0 for vertex position data
 layout(location = 1) in vec3 normal; // VAP position 1 for normals
 layout(location = 2) in vec2 textureCoordinate;
+layout(location = 3) in mat4 model; // Per-instance model matrix (locations 3 to 6)
+layout(location = 7) in uint material; // Per-instance material index
+layout(location = 8) in mat3 normalMatrix; // Per-instance normal matrix computed on the CPU (locations 8 to 10)
+layout(location = 11) in mat4 modelViewProjection; // Per-instance matrix multiplied on the CPU once per frame (locations 11 to 14)
 
 out vec3 vertexNormal; // For outgoing normals to fragment shader
 out vec3 vertexFragmentPos; // For outgoing color / pixels to fragment shader
 out vec2 vertexTextureCoordinate;
+flat out uint vertexMaterial; // Material of the object
 
-//Uniform / Global variables for the  transform matrices
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+invariant gl_Position; // Must match the depth pre-pass bit for bit
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(position, 1.0f); // Transforms vertices into clip coordinates
+    gl_Position = modelViewProjection * vec4(position, 1.0f); // Transforms vertices into clip coordinates
 
     vertexFragmentPos = vec3(model * vec4(position, 1.0f)); // Gets fragment / pixel position in world space only (exclude view and projection)
 
-    vertexNormal = mat3(transpose(inverse(model))) * normal; // get normal vectors in world space only and exclude normal translation properties
+    vertexNormal = normalMatrix * normal; // get normal vectors in world space only and exclude normal translation properties
     vertexTextureCoordinate = textureCoordinate;
+    vertexMaterial = material;
 }
 );
 
 
-/* Fragment Shader Source Code*/
-const GLchar* fragmentShaderSource = GLSL(440,
+/* Per-object vertex shader multiplying the matrices and inverting the model matrix on every vertex: baseline of --bench-vertex only*/
+const GLchar* vertexShaderInverseSource = GLSL(440,
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 textureCoordinate;
+layout(location = 3) in mat4 model;
+layout(location = 7) in uint material;
+
+out vec3 vertexNormal;
+out vec3 vertexFragmentPos;
+out vec2 vertexTextureCoordinate;
+flat out uint vertexMaterial;
+
+layout(std140, binding = 0) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 viewPosition;
+    vec4 lightPosition;
+    vec4 lightColor;
+    vec4 objectColor;
+    vec2 uvScale;
+};
+
+void main()
+{
+    gl_Position = projection * view * model * vec4(position, 1.0f);
+    vertexFragmentPos = vec3(model * vec4(position, 1.0f));
+    vertexNormal = mat3(transpose(inverse(model))) * normal;
+    vertexTextureCoordinate = textureCoordinate;
+    vertexMaterial = material;
+}
+);
+
+
+/* Fragment Shader Source Code: completed with one of the material headers below*/
+const GLchar* fragmentShaderSource = GLSL_BODY(
 in vec3 vertexNormal; // For incoming normals
 in vec3 vertexFragmentPos; // For incoming fragment position
 in vec2 vertexTextureCoordinate;
+flat in uint vertexMaterial; // For incoming material index
 
 out vec4 fragmentColor; // For outgoing cube color to the GPU
 
-// Uniform / Global variables for object color, light color, light position, and camera/view position
-uniform vec3 objectColor;
-uniform vec3 lightColor;
-uniform vec3 lightPos;
-uniform vec3 viewPosition;
-uniform sampler2D uTexture; // Useful when working with multiple textures
-uniform vec2 uvScale;
+// Per-frame camera and light data, written once per frame and shared by every program
+layout(std140, binding = 0) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 viewPosition;
+    vec4 lightPosition;
+    vec4 lightColor;
+    vec4 objectColor;
+    vec2 uvScale;
+};
 
 void main()
 {
@@ -165,25 +640,25 @@ void main()
 
     //Calculate Ambient lighting*/
     float ambientStrength = 0.8f; // Set ambient or global lighting strength
-    vec3 ambient = ambientStrength * lightColor; // Generate ambient light color
+    vec3 ambient = ambientStrength * lightColor.rgb; // Generate ambient light color
 
     //Calculate Diffuse lighting*/
     vec3 norm = normalize(vertexNormal); // Normalize vectors to 1 unit
-    vec3 lightDirection = normalize(lightPos - vertexFragmentPos); // Calculate distance (light direction) between light source and fragments/pixels on cube
+    vec3 lightDirection = normalize(lightPosition.xyz - vertexFragmentPos); // Calculate distance (light direction) between light source and fragments/pixels on cube
     float impact = max(dot(norm, lightDirection), 0.0);// Calculate diffuse impact by generating dot product of normal and light
-    vec3 diffuse = impact * lightColor; // Generate diffuse light color
+    vec3 diffuse = impact * lightColor.rgb; // Generate diffuse light color
 
     //Calculate Specular lighting*/
     float specularIntensity = 0.5f; // Set specular light strength
     float highlightSize = 0.8f; // Set specular highlight size
-    vec3 viewDir = normalize(viewPosition - vertexFragmentPos); // Calculate view direction
+    vec3 viewDir = normalize(viewPosition.xyz - vertexFragmentPos); // Calculate view direction
     vec3 reflectDir = reflect(-lightDirection, norm);// Calculate reflection vector
     //Calculate specular component
     float specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), highlightSize);
-    vec3 specular = specularIntensity * specularComponent * lightColor;
+    vec3 specular = specularIntensity * specularComponent * lightColor.rgb;
 
     // Texture holds the color to be used for all three components
-    vec4 textureColor = texture(uTexture, vertexTextureCoordinate * uvScale);
+    vec4 textureColor = sampleMaterial(vertexMaterial, vertexTextureCoordinate * uvScale);
 
     // Calculate phong result
     vec3 phong = (ambient + diffuse + specular) * textureColor.xyz;
@@ -192,6 +667,85 @@ void main()
 }
 );
 
+/* Material header: every material is one layer of an array texture*/
+const GLchar* materialArrayHeader =
+    "#version 440 core\n"
+    "uniform sampler2DArray uMaterials;\n"
+    "vec4 sampleMaterial(uint material, vec2 uv) { return texture(uMaterials, vec3(uv, float(material))); }\n";
+
+/* Material header: every material is a resident bindless texture whose handle is read from an SSBO*/
+const GLchar* materialBindlessHeader =
+    "#version 440 core\n"
+    "#extension GL_ARB_bindless_texture : require\n"
+    "layout(std430, binding = 1) readonly buffer MaterialHandles { uvec2 materialHandles[]; };\n"
+    "vec4 sampleMaterial(uint material, vec2 uv) { return texture(sampler2D(materialHandles[material]), uv); }\n";
+
+
+/* Indirect Vertex Shader Source Code: the model matrix comes from the draw record of each instance*/
+const GLchar* indirectVertexShaderSource = GLSL(440,
+layout(location = 0) in vec3 position; // VAP position 0 for vertex position data
+layout(location = 1) in vec3 normal; // VAP position 1 for normals
+layout(location = 2) in vec2 textureCoordinate;
+layout(location = 3) in uint objectIndex; // Per-instance index into the draw records (starts at baseInstance)
+layout(location = 4) in mat4 modelViewProjection; // Per-instance matrix multiplied on the CPU once per frame (locations 4 to 7)
+
+struct DrawRecord
+{
+    mat4 model;
+    mat3 normalMatrix;
+    uint material;
+};
+
+layout(std430, binding = 0) readonly buffer DrawRecords
+{
+    DrawRecord records[];
+};
+
+out vec3 vertexNormal; // For outgoing normals to fragment shader
+out vec3 vertexFragmentPos; // For outgoing color / pixels to fragment shader
+out vec2 vertexTextureCoordinate;
+flat out uint vertexMaterial; // Texture index of the object
+
+invariant gl_Position; // Must match the depth pre-pass bit for bit
+
+void main()
+{
+    mat4 model = records[objectIndex].model;
+    mat3 normalMatrix = records[objectIndex].normalMatrix;
+
+    gl_Position = modelViewProjection * vec4(position, 1.0f); // Transforms vertices into clip coordinates
+
+    vertexFragmentPos = vec3(model * vec4(position, 1.0f)); // Gets fragment / pixel position in world space only (exclude view and projection)
+
+    vertexNormal = normalMatrix * normal; // get normal vectors in world space only and exclude normal translation properties
+    vertexTextureCoordinate = textureCoordinate;
+    vertexMaterial = records[objectIndex].material;
+}
+);
+
+
+/* Depth Pre-pass Shader Source Code: positions only, transformed exactly like the scene programs transform them*/
+const GLchar* depthVertexShaderSource = GLSL(440,
+layout(location = 0) in vec3 position;
+layout(location = 1) in mat4 modelViewProjection; // Per-instance matrix, the same buffer the scene programs read (locations 1 to 4)
+
+invariant gl_Position; // The shaded pass tests GL_EQUAL against this depth
+
+void main()
+{
+    gl_Position = modelViewProjection * vec4(position, 1.0f);
+}
+);
+
+
+/* Depth Pre-pass Fragment Shader Source Code: the fixed-function depth write is all the pass needs*/
+const GLchar* depthFragmentShaderSource = GLSL(440,
+void main()
+{
+}
+);
+
+
 /* Lamp Shader Source Code*/
 const GLchar* lampVertexShaderSource = GLSL(440,
 
@@ -199,12 +753,23 @@ const GLchar* lampVertexShaderSource = GLSL(440,
 
 //Uniform / Global variables for the  transform matrices
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+// Per-frame camera and light data, written once per frame and shared by every program
+layout(std140, binding = 0) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 viewPosition;
+    vec4 lightPosition;
+    vec4 lightColor;
+    vec4 objectColor;
+    vec2 uvScale;
+};
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(position, 1.0f); // Transforms vertices into clip coordinates
+    gl_Position = viewProjection * (model * vec4(position, 1.0f)); // Transforms vertices into clip coordinates
 }
 );
 
@@ -220,123 +785,417 @@ void main()
 }
 );
 
-// Images are loaded with Y axis going down, but OpenGL's Y axis goes up, so let's flip it
-void flipImageVertically(unsigned char* image, int width, int height, int channels)
+/* Hi-Z Reduce Shader Source Code: level 0 of the pyramid is the depth buffer at half resolution, rounded up*/
+const GLchar* hiZReduceShaderSource = GLSL(440,
+layout(local_size_x = 8, local_size_y = 8) in;
+
+uniform sampler2D depthTexture;
+layout(r32f, binding = 0) writeonly uniform image2D destination;
+
+void main()
+{
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(texel, imageSize(destination))))
+        return;
+
+    ivec2 last = textureSize(depthTexture, 0) - 1;
+    float depth = max(max(texelFetch(depthTexture, min(texel * 2, last), 0).r, texelFetch(depthTexture, min(texel * 2 + ivec2(1, 0), last), 0).r),
+        max(texelFetch(depthTexture, min(texel * 2 + ivec2(0, 1), last), 0).r, texelFetch(depthTexture, min(texel * 2 + ivec2(1, 1), last), 0).r));
+    imageStore(destination, texel, vec4(depth));
+}
+);
+
+
+/* Hi-Z Downsample Shader Source Code: every texel keeps the farthest depth of the texels it covers one level below*/
+const GLchar* hiZDownsampleShaderSource = GLSL(440,
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(r32f, binding = 0) readonly uniform image2D source;
+layout(r32f, binding = 1) writeonly uniform image2D destination;
+
+void main()
+{
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = imageSize(destination);
+    if (any(greaterThanEqual(texel, size)))
+        return;
+
+    // Odd source sizes leave a row or column over, which the last texel of the level takes in as well
+    ivec2 sourceSize = imageSize(source);
+    ivec2 last = ivec2(equal(texel, size - 1)) * (sourceSize & 1);
+
+    float depth = 0.0;
+    for (int y = 0; y <= 1 + last.y; ++y)
+        for (int x = 0; x <= 1 + last.x; ++x)
+            depth = max(depth, imageLoad(source, min(texel * 2 + ivec2(x, y), sourceSize - 1)).r);
+
+    imageStore(destination, texel, vec4(depth));
+}
+);
+
+
+/* Occlusion Cull Shader Source Code: one invocation per scene object appends it to the indirect draws of its phase.
+ * Phase 1 draws the objects the last frame found visible that are still in the frustum. Phase 2 runs on the Hi-Z
+ * pyramid of that depth: it tests every object, draws the ones phase 1 missed and stores who is visible now.*/
+const GLchar* occlusionCullShaderSource = GLSL(440,
+layout(local_size_x = 64) in;
+
+struct DrawRecord
+{
+    mat4 model;
+    mat3 normalMatrix;
+    uint material;
+};
+
+struct DrawCommand
+{
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+layout(std430, binding = 0) readonly buffer DrawRecords { DrawRecord records[]; };
+layout(std430, binding = 2) readonly buffer ObjectBounds { vec4 bounds[]; };   // Center then half extent of each object
+layout(std430, binding = 3) readonly buffer ObjectMeshes { uint objectMeshes[]; };
+layout(std430, binding = 4) buffer Visibility { uint visibility[]; };
+layout(std430, binding = 5) buffer DrawCommands { DrawCommand commands[]; };
+layout(std430, binding = 6) writeonly buffer DrawObjects { uint drawObjects[]; };
+layout(std430, binding = 7) writeonly buffer DrawMvps { mat4 drawMvps[]; };
+layout(std430, binding = 8) buffer Statistics { uint statistics[]; };  // Frustum rejects, phase 1 draws, phase 2 draws, triangles
+
+layout(std140, binding = 0) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 viewPosition;
+    vec4 lightPosition;
+    vec4 lightColor;
+    vec4 objectColor;
+    vec2 uvScale;
+};
+
+uniform uint phase;
+uniform uint objectCount;
+uniform uint meshCount;
+uniform int hiZLevels;
+uniform vec2 depthSize;     // Level 0 of the pyramid covers 2x2 pixels of a depth buffer this size per texel
+uniform sampler2D hiZ;
+
+// Adds the object as the next instance of a command; its slot in the instance lists follows the command's baseInstance
+void appendDraw(uint object, uint command)
+{
+    uint instance = commands[command].baseInstance + atomicAdd(commands[command].instanceCount, 1u);
+    atomicAdd(statistics[3], commands[command].count / 3u);
+    drawObjects[instance] = object;
+    drawMvps[instance] = viewProjection * records[object].model;
+}
+
+void main()
+{
+    uint object = gl_GlobalInvocationID.x;
+    if (object >= objectCount)
+        return;
+
+    vec3 center = bounds[object * 2u].xyz;
+    vec3 extent = bounds[object * 2u + 1u].xyz;
+
+    // Clip-space corners of the box: it is outside when every corner is beyond the same clip plane. The screen
+    // rectangle and nearest depth only mean something when no corner is behind the eye.
+    ivec3 below = ivec3(0);
+    ivec3 above = ivec3(0);
+    bool behindEye = false;
+    vec3 ndcMin = vec3(1.0);
+    vec3 ndcMax = vec3(-1.0);
+    for (int i = 0; i < 8; ++i)
+    {
+        vec3 corner = center + extent * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+        vec4 clip = viewProjection * vec4(corner, 1.0);
+        below += ivec3(lessThan(clip.xyz, vec3(-clip.w)));
+        above += ivec3(greaterThan(clip.xyz, vec3(clip.w)));
+        if (clip.w <= 0.0)
+            behindEye = true;
+        else
+        {
+            ndcMin = min(ndcMin, clip.xyz / clip.w);
+            ndcMax = max(ndcMax, clip.xyz / clip.w);
+        }
+    }
+    bool inFrustum = all(lessThan(below, ivec3(8))) && all(lessThan(above, ivec3(8)));
+
+    if (phase == 1u)
+    {
+        if (inFrustum && visibility[object] != 0u)
+        {
+            appendDraw(object, objectMeshes[object]);
+            atomicAdd(statistics[1], 1u);
+        }
+        return;
+    }
+
+    if (!inFrustum)
+        atomicAdd(statistics[0], 1u);
+
+    bool visible = inFrustum;
+    if (inFrustum && !behindEye)
+    {
+        // The level where the screen rectangle spans at most 2x2 texels, whose farthest depth bounds everything behind it
+        vec2 size = 0.5 * depthSize;
+        vec2 pixelMin = clamp(ndcMin.xy * 0.5 + 0.5, 0.0, 1.0) * size;
+        vec2 pixelMax = clamp(ndcMax.xy * 0.5 + 0.5, 0.0, 1.0) * size;
+        float span = max(max(pixelMax.x - pixelMin.x, pixelMax.y - pixelMin.y), 1.0);
+        int level = clamp(int(ceil(log2(span))), 0, hiZLevels - 1);
+
+        ivec2 levelSize = textureSize(hiZ, level);
+        ivec2 texelMin = min(ivec2(pixelMin) >> level, levelSize - 1);
+        ivec2 texelMax = min(ivec2(pixelMax) >> level, levelSize - 1);
+        float farthest = 0.0;
+        for (int y = texelMin.y; y <= texelMax.y; ++y)
+            for (int x = texelMin.x; x <= texelMax.x; ++x)
+                farthest = max(farthest, texelFetch(hiZ, ivec2(x, y), level).r);
+
+        visible = ndcMin.z * 0.5 + 0.5 <= farthest;
+    }
+
+    if (visible && visibility[object] == 0u)
+    {
+        appendDraw(object, meshCount + objectMeshes[object]);
+        atomicAdd(statistics[2], 1u);
+    }
+    visibility[object] = visible ? 1u : 0u;
+}
+);
+
+
+// Images are loaded with Y axis going down, but OpenGL's Y axis goes up, so rows are written bottom up
+// while the image is copied to its destination anyway, instead of flipping it in place first
+void copyImageFlipped(const unsigned char* source, int width, int height, int channels, unsigned char* destination)
 {
-    for (int j = 0; j < height / 2; ++j)
+    const size_t rowSize = (size_t)width * channels;
+    for (int j = 0; j < height; ++j)
+        memcpy(destination + (size_t)(height - 1 - j) * rowSize, source + (size_t)j * rowSize, rowSize);
+}
+
+// Resamples an RGBA image with bilinear filtering so textures of any size can share one array texture.
+// With flip set the source is read bottom up, so the flip costs nothing on top of the resample.
+void resizeImage(const unsigned char* source, int sourceWidth, int sourceHeight, unsigned char* destination, int width, int height, bool flip)
+{
+    const float scaleX = (float)sourceWidth / (float)width;
+    const float scaleY = (float)sourceHeight / (float)height;
+
+    for (int j = 0; j < height; ++j)
     {
-        int index1 = j * width * channels;
-        int index2 = (height - 1 - j) * width * channels;
+        float sy = (j + 0.5f) * scaleY - 0.5f;
+        int y0 = sy < 0.0f ? 0 : (int)sy;
+        int y1 = y0 + 1 < sourceHeight ? y0 + 1 : sourceHeight - 1;
+        float fy = sy < 0.0f ? 0.0f : sy - y0;
 
-        for (int i = width * channels; i > 0; --i)
+        const unsigned char* row0 = source + (size_t)(flip ? sourceHeight - 1 - y0 : y0) * sourceWidth * 4;
+        const unsigned char* row1 = source + (size_t)(flip ? sourceHeight - 1 - y1 : y1) * sourceWidth * 4;
+
+        for (int i = 0; i < width; ++i)
         {
-            unsigned char tmp = image[index1];
-            image[index1] = image[index2];
-            image[index2] = tmp;
-            ++index1;
-            ++index2;
+            float sx = (i + 0.5f) * scaleX - 0.5f;
+            int x0 = sx < 0.0f ? 0 : (int)sx;
+            int x1 = x0 + 1 < sourceWidth ? x0 + 1 : sourceWidth - 1;
+            float fx = sx < 0.0f ? 0.0f : sx - x0;
+
+            const unsigned char* p00 = row0 + x0 * 4;
+            const unsigned char* p10 = row0 + x1 * 4;
+            const unsigned char* p01 = row1 + x0 * 4;
+            const unsigned char* p11 = row1 + x1 * 4;
+            unsigned char* out = destination + (j * width + i) * 4;
+
+            for (int c = 0; c < 4; ++c)
+            {
+                float top = p00[c] + (p10[c] - p00[c]) * fx;
+                float bottom = p01[c] + (p11[c] - p01[c]) * fx;
+                out[c] = (unsigned char)(top + (bottom - top) * fy + 0.5f);
+            }
         }
     }
 }
 
 int main(int argc, char* argv[])
 {
-    if (!UInitialize(argc, argv, &gWindow))
+    // Command line options
+    for (int i = 1; i < argc; ++i)
+    {
+        if (string(argv[i]) == "--no-mesh-opt")
+            gOptimizeMeshes = false;
+        else if (string(argv[i]) == "--mdi")
+            gIndirectRendering = true;
+        else if (string(argv[i]) == "--no-bindless")
+            gUseBindless = false;
+        else if (string(argv[i]) == "--bench-submit" && i + 1 < argc)
+            gBenchSubmitCopies = atoi(argv[++i]);
+        else if (string(argv[i]) == "--bench-vertex")
+            gBenchVertexSubdivisions = (i + 1 < argc && argv[i + 1][0] != '-') ? atoi(argv[++i]) : 256;
+        else if (string(argv[i]) == "--bench-flip")
+            gBenchFlip = true;
+        else if (string(argv[i]) == "--headless" && i + 1 < argc)
+            gHeadlessFrames = atoi(argv[++i]);
+        else if (string(argv[i]) == "--bake-textures")
+            gBakeFormat = (i + 1 < argc && argv[i + 1][0] != '-') ? argv[++i] : "bc7";
+        else if (string(argv[i]) == "--trace" && i + 1 < argc)
+            gTracePath = argv[++i];
+        else if (string(argv[i]) == "--scene" && i + 1 < argc)
+            gScenePath = argv[++i];
+        else if (string(argv[i]) == "--no-cull")
+            gFrustumCulling = false;
+        else if (string(argv[i]) == "--occlusion")
+            gOcclusionCulling = true;
+        else if (string(argv[i]) == "--depth-prepass")
+            gDepthPrepass = true;
+        else if (string(argv[i]) == "--no-lod")
+            gLodSelection = false;
+        else if (string(argv[i]) == "--lod-error" && i + 1 < argc)
+            gLodErrorPixels = (float)atof(argv[++i]);
+        else if (string(argv[i]) == "--bench-load")
+        {
+            gBenchLoad = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                gBenchLoadPath = argv[++i];
+        }
+    }
+
+    // Register the materials of the scene file and place its objects; the meshes they refer to are created later
+    if (!ULoadScene(gScenePath.c_str()))
+        return EXIT_FAILURE;
+
+    // The flip benchmark only decodes images, so it runs without a window
+    if (gBenchFlip)
+    {
+        UBenchmarkImageFlip("./resources/textures/concrete.png");
+        return EXIT_SUCCESS;
+    }
+
+    // Baking only compresses files, so it runs without a window too
+    if (!gBakeFormat.empty())
+    {
+        UBakeTextures(gBakeFormat);
+        return EXIT_SUCCESS;
+    }
+
+    // Headless runs render into an offscreen framebuffer of an EGL context instead of a window
+    bool initialized = gHeadlessFrames > 0 ? UInitializeHeadless() : UInitialize(argc, argv, &gWindow);
+    if (!initialized)
         return EXIT_FAILURE;
 
+    // Timer queries need the context, so the profiler starts right after it
+    gProfiler.Enabled = !gTracePath.empty();
+    gProfiler.Initialize();
+
     // Create the mesh
     UCreateMeshGround(groundMesh);
     UCreateMeshBottle(bottleMesh); 
     UCreateMeshCap(capMesh);
-    UCreateMeshWiperBack(wiperBack1);
-    UCreateMeshWiperBox(wiperBox1);
-    UCreateMeshWiperBack(wiperBack2);
-    UCreateMeshWiperBox(wiperBox2);
+    UCreateMeshWiperBack(wiperBack);
+    UCreateMeshWiperBox(wiperBox);
     UCreateMeshScrewDriverHandle(screwDriverHandle);
     UCreateMeshScrewDriverRod(screwDriverRod);
     UCreateMeshScrewDriverTip(screwDriverTip);
-    
+
+    // Meshes of the scene's model files, then those of its mesh files, uploaded from their mappings
+    UCreateImportedMeshes();
+    UCreateFileMeshes();
+
+    // Upload every mesh a second time into the shared arena used by the indirect renderer
+    UBuildMeshArena();
+
+    // The GL has its own copy of the mesh files now
+    UCloseMeshFiles();
+
+    // Both scene programs share the fragment shader, completed with the header of the material path
+    gMaterials.bindless = gUseBindless && GLEW_ARB_bindless_texture;
+    const string sceneFragmentShaderSource = string(gMaterials.bindless ? materialBindlessHeader : materialArrayHeader) + fragmentShaderSource;
+    cout << "INFO: Materials use " << (gMaterials.bindless ? "bindless textures" : "an array texture") << endl;
 
     // Create the shader program
-    if (!UCreateShaderProgram(vertexShaderSource, fragmentShaderSource, gProgramId))
+    if (!UCreateShaderProgram(vertexShaderSource, sceneFragmentShaderSource.c_str(), gProgramId, gProgramUniforms))
         return EXIT_FAILURE;
 
-    if (!UCreateShaderProgram(lampVertexShaderSource, lampFragmentShaderSource, gLampProgramId))
+    if (!UCreateShaderProgram(lampVertexShaderSource, lampFragmentShaderSource, gLampProgramId, gLampProgramUniforms))
         return EXIT_FAILURE;
 
-    // Load ground texture
-    const char* tex0Filename = "./resources/textures/concrete.png";
-    if (!UCreateTexture(tex0Filename, groundTextureId, GL_MIRRORED_REPEAT))
-    {
-        cout << "Failed to load texture concrete " << tex0Filename << endl;
+    // Resolve the uniform handles used by the render loop (only has to be done once)
+    gSceneUniforms.uMaterials = UGetUniform(gProgramUniforms, "uMaterials", GL_SAMPLER_2D_ARRAY);
+
+    if (!UCreateShaderProgram(indirectVertexShaderSource, sceneFragmentShaderSource.c_str(), gIndirectProgramId, gIndirectProgramUniforms))
         return EXIT_FAILURE;
-    }
-     
-    // Load bottle texture
-    const char* tex1Filename = "./resources/textures/whitePlastic.png";
-    if (!UCreateTexture(tex1Filename, bottleTextureId, GL_MIRRORED_REPEAT))
-    {
-        cout << "Failed to load texture bottle " << tex1Filename << endl;
+
+    gIndirectUniforms.uMaterials = UGetUniform(gIndirectProgramUniforms, "uMaterials", GL_SAMPLER_2D_ARRAY);
+
+    gLampUniforms.model = UGetUniform(gLampProgramUniforms, "model", GL_FLOAT_MAT4);
+
+    if (!UCreateShaderProgram(depthVertexShaderSource, depthFragmentShaderSource, gDepthProgramId, gDepthProgramUniforms))
         return EXIT_FAILURE;
-    } 
- 
-    // Load cap texture
-    const char* tex2Filename = "./resources/textures/yellowPlastic.jpg";
-    if (!UCreateTexture(tex2Filename, capTextureId, GL_MIRRORED_REPEAT))
-    {
-        cout << "Failed to load texture bottleCap" << tex2Filename << endl;
+
+    // Compute passes of the occlusion path, which draws with the indirect program over the arena
+    if (!UCreateOcclusionCulling())
         return EXIT_FAILURE;
-    }
 
-    // Load wiper back texture
-    const char* tex3Filename = "./resources/textures/wiperBack.png";
-    if (!UCreateTexture(tex3Filename, wiperBackTextureId, GL_MIRRORED_REPEAT))
-    {
-        cout << "Failed to load texture wiper back " << tex3Filename << endl;
+    // Camera and light data reach every program through one uniform block
+    glGenBuffers(1, &gFrameUbo);
+    glBindBuffer(GL_UNIFORM_BUFFER, gFrameUbo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(GLFrameUniforms), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glGenBuffers(1, &gObjectMvpVbo);
+
+    // Start decoding every material texture in the background; objects use a placeholder until it arrives
+    if (!UCreateMaterials(GL_MIRRORED_REPEAT))
         return EXIT_FAILURE;
-    }
 
-    // Load wiper box texture
-    const char* tex4Filename = "./resources/textures/wiperBox.jpg";
-    if (!UCreateTexture(tex4Filename, wiperBoxTextureId, GL_MIRRORED_REPEAT))
+    // tell opengl which texture unit the material array is read from (only has to be done once, -1 and ignored when bindless)
+    glUseProgram(gProgramId);
+    glUniform1i(gSceneUniforms.uMaterials, 0);
+    glUseProgram(gIndirectProgramId);
+    glUniform1i(gIndirectUniforms.uMaterials, 0);
+
+    // Upload the instance, draw record and indirect command buffers of the loaded objects
+    if (gBenchSubmitCopies > 1)
+        UReplicateScene(gBenchSubmitCopies);
+    UUploadScene();
+
+     // Sets the background color of the window to black (it will be implicitely used by glClear)
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+    // Setup bound state directly, so the render loop's cache starts from scratch
+    gGLState.Invalidate();
+
+    // Compare the per-object and indirect submission paths, then exit
+    if (gBenchSubmitCopies > 0)
     {
-        cout << "Failed to load texture wiper box" << tex4Filename << endl;
-        return EXIT_FAILURE;
+        UBenchmarkSubmission();
+        if (gWindow)
+            glfwSetWindowShouldClose(gWindow, true);
     }
 
-    // Load screw driver handle texture
-    const char* tex5Filename = "./resources/textures/screwDriverHandle.jpg";
-    if (!UCreateTexture(tex5Filename, screwDriverHandleTextureId, GL_MIRRORED_REPEAT))
+    // Compare the vertex shader with and without the per-vertex inverse, then exit
+    if (gBenchVertexSubdivisions > 0)
     {
-        cout << "Failed to load texture screw driver handle " << tex5Filename << endl;
-        return EXIT_FAILURE;
+        UBenchmarkVertexThroughput(gBenchVertexSubdivisions, sceneFragmentShaderSource.c_str());
+        if (gWindow)
+            glfwSetWindowShouldClose(gWindow, true);
     }
 
-    // Load screw driver metal texture
-    const char* tex6Filename = "./resources/textures/screwDriver.png";
-    if (!UCreateTexture(tex6Filename, screwDriverTextureId, GL_MIRRORED_REPEAT))
+    // Compare loading a mesh from an OBJ file and from a mesh file, then exit
+    if (gBenchLoad)
     {
-        cout << "Failed to load texture screw driver metal " << tex6Filename << endl;
-        return EXIT_FAILURE;
+        UBenchmarkMeshLoad(gBenchLoadPath);
+        if (gWindow)
+            glfwSetWindowShouldClose(gWindow, true);
     }
 
-    // tell opengl for each sampler to which texture unit it belongs to (only has to be done once)
-    glUseProgram(gProgramId);
-    // We set the texture as texture units
-    glUniform1i(glGetUniformLocation(gProgramId, "groundTexture"), 0);
-    glUniform1i(glGetUniformLocation(gProgramId, "bottleTexture"), 1);
-    glUniform1i(glGetUniformLocation(gProgramId, "capTexture"), 2);
-    glUniform1i(glGetUniformLocation(gProgramId, "wiperBackTextureId"), 3);
-    glUniform1i(glGetUniformLocation(gProgramId, "wiperBoxTextureId"), 4);
-    glUniform1i(glGetUniformLocation(gProgramId, "screwDriverHandleTextureId"), 5);
-    glUniform1i(glGetUniformLocation(gProgramId, "screwDriverTextureId"), 6);
-
-     // Sets the background color of the window to black (it will be implicitely used by glClear)
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    // Time the scripted camera path, then exit
+    if (gHeadlessFrames > 0)
+        UBenchmarkFrames(gHeadlessFrames);
 
     // render loop
     // -----------
-    while (!glfwWindowShouldClose(gWindow))
+    while (gWindow && !glfwWindowShouldClose(gWindow))
     {
         // per-frame timing
         // --------------------
@@ -348,37 +1207,47 @@ int main(int argc, char* argv[])
         // -----
         UProcessInput(gWindow);
 
+        // Upload the textures decoded since the last frame
+        UUpdateMaterials();
+
         // Render this frame
         URender();
 
         glfwPollEvents();
     }
 
+    // Write the frames still buffered by the profiler
+    UWriteTrace();
+    gProfiler.Destroy();
+
     // Release mesh data
     UDestroyMesh(groundMesh);
     UDestroyMesh(bottleMesh);
     UDestroyMesh(capMesh);
-    UDestroyMesh(wiperBack1);
-    UDestroyMesh(wiperBox1);
-    UDestroyMesh(wiperBack1);
-    UDestroyMesh(wiperBox1);
+    UDestroyMesh(wiperBack);
+    UDestroyMesh(wiperBox);
     UDestroyMesh(screwDriverHandle);
     UDestroyMesh(screwDriverRod);
     UDestroyMesh(screwDriverTip);
-    
+    for (size_t i = 0; i < gImportedMeshes.size(); ++i)
+        UDestroyMesh(gImportedMeshes[i].mesh);
+    for (size_t i = 0; i < gFileMeshes.size(); ++i)
+        UDestroyMesh(gFileMeshes[i].mesh);
+    UDestroyMeshArena();
+    UDestroyOcclusionCulling();
+    glDeleteBuffers(1, &gFrameUbo);
+    glDeleteBuffers(1, &gObjectMvpVbo);
 
     // Release texture
-    UDestroyTexture(groundTextureId);
-    UDestroyTexture(bottleTextureId);
-    UDestroyTexture(capTextureId);
-    UDestroyTexture(wiperBackTextureId);
-    UDestroyTexture(wiperBoxTextureId);
-    UDestroyTexture(screwDriverHandleTextureId);
-    UDestroyTexture(screwDriverTextureId);
+    UDestroyMaterials();
 
     // Release shader program
     UDestroyShaderProgram(gProgramId);
     UDestroyShaderProgram(gLampProgramId);
+    UDestroyShaderProgram(gIndirectProgramId);
+    UDestroyShaderProgram(gDepthProgramId);
+
+    UDestroyHeadless();
 
     exit(EXIT_SUCCESS); // Terminates the program successfully
 }
@@ -411,6 +1280,7 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
     glfwSetFramebufferSizeCallback(*window, UResizeWindow);
     glfwSetCursorPosCallback(*window, UMousePositionCallback);
     glfwSetScrollCallback(*window, UMouseScrollCallback);
+    glfwSetMouseButtonCallback(*window, UMouseButtonCallback);
 
     // GLEW: initialize
     // ----------------
@@ -431,20 +1301,124 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
 }
 
 
-// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
-void UProcessInput(GLFWwindow* window)
+// Create an OpenGL 4.4 core context without a window (EGL surfaceless, works on Mesa llvmpipe) and an offscreen framebuffer
+bool UInitializeHeadless()
 {
-    static const float cameraSpeed = 2.5f;
+#ifdef __linux__
+    // Mesa's surfaceless platform needs no display server; other drivers get the default display
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay)
+        gEglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    if (gEglDisplay == EGL_NO_DISPLAY)
+        gEglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    EGLint major, minor;
+    if (gEglDisplay == EGL_NO_DISPLAY || !eglInitialize(gEglDisplay, &major, &minor))
+    {
+        cout << "Failed to initialize EGL" << endl;
+        return false;
+    }
 
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
-        glfwSetWindowShouldClose(window, true);
+    const EGLint configAttributes[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+    const EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 4,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE };
+
+    EGLConfig config;
+    EGLint nConfigs = 0;
+    eglBindAPI(EGL_OPENGL_API);
+    if (!eglChooseConfig(gEglDisplay, configAttributes, &config, 1, &nConfigs) || nConfigs == 0)
+    {
+        cout << "Failed to find an EGL config for desktop OpenGL" << endl;
+        return false;
+    }
 
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(FORWARD, gDeltaTime);
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(BACKWARD, gDeltaTime);
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(LEFT, gDeltaTime);
+    gEglContext = eglCreateContext(gEglDisplay, config, EGL_NO_CONTEXT, contextAttributes);
+    if (gEglContext == EGL_NO_CONTEXT || !eglMakeCurrent(gEglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, gEglContext))
+    {
+        cout << "Failed to create a surfaceless OpenGL 4.4 context" << endl;
+        return false;
+    }
+
+    // GLEW: glewInit() expects a GLX context, glewContextInit() only loads the current context's entry points
+    glewExperimental = GL_TRUE;
+    GLenum GlewInitResult = glewContextInit();
+
+    if (GLEW_OK != GlewInitResult)
+    {
+        std::cerr << glewGetErrorString(GlewInitResult) << std::endl;
+        return false;
+    }
+
+    // Offscreen render target with the size of the window
+    glGenRenderbuffers(1, &gHeadlessColor);
+    glBindRenderbuffer(GL_RENDERBUFFER, gHeadlessColor);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, WINDOW_WIDTH, WINDOW_HEIGHT);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    // Depth is a texture so the occlusion path can build its Hi-Z pyramid straight from it
+    glGenTextures(1, &gHeadlessDepth);
+    glBindTexture(GL_TEXTURE_2D, gHeadlessDepth);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH24_STENCIL8, WINDOW_WIDTH, WINDOW_HEIGHT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &gHeadlessFbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, gHeadlessFbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, gHeadlessColor);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, gHeadlessDepth, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        cout << "Offscreen framebuffer is incomplete" << endl;
+        return false;
+    }
+    glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
+
+    // Displays GPU OpenGL version
+    cout << "INFO: OpenGL Version: " << glGetString(GL_VERSION) << " (headless, " << glGetString(GL_RENDERER) << ")" << endl;
+
+    return true;
+#else
+    cout << "Headless rendering needs EGL, which is only wired up on Linux" << endl;
+    return false;
+#endif
+}
+
+
+void UDestroyHeadless()
+{
+    glDeleteFramebuffers(1, &gHeadlessFbo);
+    glDeleteRenderbuffers(1, &gHeadlessColor);
+    glDeleteTextures(1, &gHeadlessDepth);
+
+#ifdef __linux__
+    if (gEglDisplay != EGL_NO_DISPLAY)
+    {
+        eglMakeCurrent(gEglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(gEglDisplay, gEglContext);
+        eglTerminate(gEglDisplay);
+    }
+#endif
+}
+
+
+// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
+void UProcessInput(GLFWwindow* window)
+{
+    static const float cameraSpeed = 2.5f;
+
+    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+        glfwSetWindowShouldClose(window, true);
+
+    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+        gCamera.ProcessKeyboard(FORWARD, gDeltaTime);
+    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+        gCamera.ProcessKeyboard(BACKWARD, gDeltaTime);
+    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+        gCamera.ProcessKeyboard(LEFT, gDeltaTime);
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
         gCamera.ProcessKeyboard(RIGHT, gDeltaTime);
     if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS) {
@@ -459,6 +1433,69 @@ void UProcessInput(GLFWwindow* window)
         else
             cameraMode = 1;
     }
+
+    // Toggle between the per-object and the multi-draw indirect renderer on key release
+    static bool indirectKeyDown = false;
+    bool indirectKeyPressed = glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS;
+    if (indirectKeyDown && !indirectKeyPressed)
+    {
+        gIndirectRendering = !gIndirectRendering;
+        cout << "INFO: " << (gIndirectRendering ? "Multi-draw indirect" : "Per-object") << " rendering" << endl;
+    }
+    indirectKeyDown = indirectKeyPressed;
+
+    // Toggle the GPU occlusion culling path on key release
+    static bool occlusionKeyDown = false;
+    bool occlusionKeyPressed = glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS;
+    if (occlusionKeyDown && !occlusionKeyPressed)
+    {
+        gOcclusionCulling = !gOcclusionCulling;
+        cout << "INFO: Occlusion culling " << (gOcclusionCulling ? "on" : "off") << endl;
+    }
+    occlusionKeyDown = occlusionKeyPressed;
+
+    // Toggle the depth pre-pass on key release
+    static bool prepassKeyDown = false;
+    bool prepassKeyPressed = glfwGetKey(window, GLFW_KEY_Z) == GLFW_PRESS;
+    if (prepassKeyDown && !prepassKeyPressed)
+    {
+        gDepthPrepass = !gDepthPrepass;
+        cout << "INFO: Depth pre-pass " << (gDepthPrepass ? "on" : "off") << endl;
+    }
+    prepassKeyDown = prepassKeyPressed;
+
+    // Toggle level of detail selection on key release
+    static bool lodKeyDown = false;
+    bool lodKeyPressed = glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS;
+    if (lodKeyDown && !lodKeyPressed)
+    {
+        gLodSelection = !gLodSelection;
+        cout << "INFO: Level of detail selection " << (gLodSelection ? "on" : "off") << endl;
+    }
+    lodKeyDown = lodKeyPressed;
+
+    // Write the profiler's trace so far on key release
+    static bool traceKeyDown = false;
+    bool traceKeyPressed = glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS;
+    if (traceKeyDown && !traceKeyPressed)
+        UWriteTrace();
+    traceKeyDown = traceKeyPressed;
+
+    // Slide the picked object over the ground; its bounds refit the hierarchy instead of rebuilding it
+    if (gPickedObject >= 0)
+    {
+        glm::vec3 offset(0.0f);
+        if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
+            offset.x -= 1.0f;
+        if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
+            offset.x += 1.0f;
+        if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS)
+            offset.z -= 1.0f;
+        if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS)
+            offset.z += 1.0f;
+        if (offset != glm::vec3(0.0f))
+            USetObjectModel(gPickedObject, glm::translate(offset * gCamera.MovementSpeed * gDeltaTime) * gScene.models[gPickedObject]);
+    }
 }
 
 // glfw: Whenever the mouse moves, this callback is called.
@@ -490,6 +1527,44 @@ void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
     }
 }
 
+// glfw: whenever a mouse button is pressed or released, this callback is called
+// ---------------------------------------------------------------------------
+void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
+{
+    if (button != GLFW_MOUSE_BUTTON_LEFT || action != GLFW_PRESS)
+        return;
+
+    double xpos, ypos;
+    glfwGetCursorPos(window, &xpos, &ypos);
+    gPickedObject = UPickObject(xpos, ypos);
+    if (gPickedObject >= 0)
+        cout << "INFO: Picked object " << gPickedObject << " (" << gScene.meshes[gPickedObject]->section << "), move it with the arrow keys" << endl;
+    else
+        cout << "INFO: Nothing picked" << endl;
+}
+
+
+// Casts a ray from the camera through a window position into the hierarchy and returns the nearest object
+// whose bounding box it hits, -1 when none. Boxes are coarser than the meshes, so a near miss can still pick.
+int UPickObject(double xpos, double ypos)
+{
+    int width = WINDOW_WIDTH, height = WINDOW_HEIGHT;
+    if (gWindow)
+        glfwGetWindowSize(gWindow, &width, &height);
+
+    // Window position to the near and far planes in normalized device coordinates, back to world space
+    const float x = 2.0f * (float)xpos / width - 1.0f;
+    const float y = 1.0f - 2.0f * (float)ypos / height;
+    const glm::mat4 inverse = glm::inverse(gViewProjection);
+    glm::vec4 nearPoint = inverse * glm::vec4(x, y, -1.0f, 1.0f);
+    glm::vec4 farPoint = inverse * glm::vec4(x, y, 1.0f, 1.0f);
+    const glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+    const glm::vec3 direction = glm::vec3(farPoint) / farPoint.w - origin;
+
+    float distance;
+    return gSceneBvh.Raycast(glm::value_ptr(origin), glm::value_ptr(direction), distance);
+}
+
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
 void UResizeWindow(GLFWwindow* window, int width, int height)
 {
@@ -499,11 +1574,20 @@ void UResizeWindow(GLFWwindow* window, int width, int height)
 // Functioned called to render a frame
 void URender()
 {
+    // Every uniform is pre-resolved, so this must still read 0 when the frame ends
+    gUniformLookupCount = 0;
+
+    gProfiler.BeginFrame();
+    int frameSection = gProfiler.BeginSection("frame");
+
+    // Count the state changes of this frame and the calls the cache skipped
+    gGLState.ResetCounters();
+
     // Enable z-depth
-    glEnable(GL_DEPTH_TEST);
+    gGLState.Enable(GL_DEPTH_TEST);
 
     // Clear the frame and z buffers
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    gGLState.ClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     // camera/view transformation
@@ -523,388 +1607,1577 @@ void URender()
         projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
     }
     
-    // Set the shader to be used
-    glUseProgram(gProgramId);
+    // Draw the scene with the selected submission path and time the CPU side of it
+    chrono::steady_clock::time_point submitStart = chrono::steady_clock::now();
+    gDrawCallCount = 0;
+    gSubmittedTriangles = 0;
+    int sceneSection = gProfiler.BeginSection(gOcclusionCulling ? "scene (occlusion)" : gIndirectRendering ? "scene (indirect)" : "scene");
+
+    // Every material is reachable from one binding, so no texture is rebound between draws
+    UBindMaterials();
+
+    // Keep only the objects inside the view frustum (the occlusion path tests them on the GPU instead)
+    gViewProjection = projection * view;
+    if (!gOcclusionCulling)
+    {
+        int cullSection = gProfiler.BeginSection("cull");
+        UCullScene(gViewProjection);
+        gProfiler.EndSection(cullSection);
+        gOccludedCount = 0;
+    }
+
+    // Camera, light and object transforms are written once for every program
+    UUpdateFrameUniforms(view, projection);
+
+    if (gIndirectRendering && !gOcclusionCulling)
+        UUploadIndirectCommands();
+
+    // Depth only first: color writes off, then the shaded pass keeps the fragments whose depth is the one stored
+    const bool depthPrepass = gDepthPrepass && !gOcclusionCulling;
+    if (depthPrepass)
+    {
+        int prepassSection = gProfiler.BeginSection("depth pre-pass");
+        gGLState.UseProgram(gDepthProgramId);
+        gGLState.ColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        if (gIndirectRendering)
+            URenderSceneIndirect(gMeshArena.depthVao);
+        else
+            URenderScenePerObject(true);
+        gGLState.ColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        gGLState.DepthFunc(GL_EQUAL);
+        gGLState.DepthMask(GL_FALSE);
+        gProfiler.EndSection(prepassSection);
+    }
+
+    if (gOcclusionCulling)
+        URenderSceneOcclusion();
+    else if (gIndirectRendering)
+    {
+        gGLState.UseProgram(gIndirectProgramId);
+        URenderSceneIndirect(gMeshArena.vao);
+    }
+    else
+    {
+        gGLState.UseProgram(gProgramId);
+        URenderScenePerObject(false);
+    }
+
+    // The lamp and the next frame's clear need the usual depth test and writes back
+    if (depthPrepass)
+    {
+        gGLState.DepthFunc(GL_LESS);
+        gGLState.DepthMask(GL_TRUE);
+    }
 
-    // Retrieves and passes transform matrices to the Shader program
-    GLint modelLoc = glGetUniformLocation(gProgramId, "model");
-    GLint viewLoc = glGetUniformLocation(gProgramId, "view");
-    GLint projLoc = glGetUniformLocation(gProgramId, "projection");
-  
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-    // Reference matrix uniforms from the Cube Shader program for the cub color, light color, light position, and camera position
-    GLint objectColorLoc = glGetUniformLocation(gProgramId, "objectColor");
-    GLint lightColorLoc = glGetUniformLocation(gProgramId, "lightColor");
-    GLint lightPositionLoc = glGetUniformLocation(gProgramId, "lightPos");
-    GLint viewPositionLoc = glGetUniformLocation(gProgramId, "viewPosition");
-
-    // Pass color, light, and camera data to the Cube Shader program's corresponding uniforms
-    glUniform3f(objectColorLoc, gObjectColor.r, gObjectColor.g, gObjectColor.b);
-    glUniform3f(lightColorLoc, gLightColor.r, gLightColor.g, gLightColor.b);
-    glUniform3f(lightPositionLoc, gLightPosition.x, gLightPosition.y, gLightPosition.z);
-    const glm::vec3 cameraPosition = gCamera.Position;
-    glUniform3f(viewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
-
-    GLint UVScaleLoc = glGetUniformLocation(gProgramId, "uvScale");
-    glUniform2fv(UVScaleLoc, 1, glm::value_ptr(gUVScale));
-
-
-    glm::mat4  model = glm::mat4(1.0f);
-    glm::mat4  scale = glm::mat4(1.0f);
-    glm::mat4  rotation = glm::mat4(1.0f);
-    glm::mat4  mtranslation = glm::mat4(1.0f);
-
-    // Ground
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(groundMesh.vao);
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    // Bind the texture
-    glBindTexture(GL_TEXTURE_2D, groundTextureId);
-    // Draws the vertices array
-    glDrawArrays(GL_TRIANGLES, 0, groundMesh.nVertices); 
-
-    // Bottle
-    // 1. Scales the object 
-    scale = glm::scale(glm::vec3(0.5f, 1.0f, 0.5f));
-    // 2. Rotates shape by 15 degrees in the x axis
-    rotation = glm::rotate(glm::radians(45.0f), glm::vec3(0.0f, 0.1f, 0.0f));
-    // 3. Place object at the origin
-    mtranslation = glm::translate(glm::vec3(0.5f, 0.5f, 0.0f));
-    // Model matrix: transformations are applied right-to-left order
-    model = scale * rotation * mtranslation;
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(bottleMesh.vao);
-    // Bind the texture
-    glBindTexture(GL_TEXTURE_2D, bottleTextureId);
-    // Draws the vertices array
-    glDrawArrays(GL_TRIANGLES, 0, bottleMesh.nVertices);
-
-    // Cap
-    // 1. Scales the object
-    scale = glm::scale(glm::vec3(0.3f, 0.3f, 0.3f));
-    // 2. Rotates shape by 15 degrees in the x axis
-    rotation = glm::rotate(glm::radians(25.0f), glm::vec3(0.0f, 0.1f, 0.0f));
-    // 3. Place object at the origin
-    mtranslation = glm::translate(glm::vec3(0.5f, 3.5f, -0.5f));
-    // Model matrix: transformations are applied right-to-left order
-    model = scale * rotation * mtranslation;
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    // Bind the vertices
-    glBindVertexArray(capMesh.vao);   
-    // Bind the texture
-    glBindTexture(GL_TEXTURE_2D, capTextureId);
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, capMesh.nVertices);
-
-
-    // Wiper Back Right
-    model = glm::mat4(1.0f);
-    // 1. Scales the object
-    scale = glm::scale(glm::vec3(0.5f, 0.5f, 2.0f));
-    // 2. Rotates shape by 15 degrees in the x axis
-    rotation = glm::rotate(glm::radians(0.0f), glm::vec3(1.1f, 0.0f, 0.0f));
-    // 3. Place object at the origin
-    mtranslation = glm::translate(glm::vec3(4.0f, 0.1f, 0.0f));
-    // Model matrix: transformations are applied right-to-left order
-    model = scale * rotation * mtranslation;
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    // Bind the vertices
-    glBindVertexArray(wiperBack1.vao);
-    // Bind the texture
-    glBindTexture(GL_TEXTURE_2D, wiperBackTextureId);
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, wiperBack1.nVertices);
-
-    // Wiper Back Left
-    model = glm::mat4(1.0f);
-    // 1. Scales the object
-    scale = glm::scale(glm::vec3(0.5f, 0.5f, 2.0f));
-    // 2. Rotates shape by 15 degrees in the x axis
-    rotation = glm::rotate(glm::radians(0.0f), glm::vec3(-1.1f, 0.0f, 0.0f));
-    // 3. Place object at the origin
-    mtranslation = glm::translate(glm::vec3(-4.0f, 0.1f, 0.0f));
-    // Model matrix: transformations are applied right-to-left order
-    model = scale * rotation * mtranslation;
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    // Bind the vertices
-    glBindVertexArray(wiperBack2.vao);
-    // Bind the texture
-    glBindTexture(GL_TEXTURE_2D, wiperBackTextureId);
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, wiperBack2.nVertices);
-
-
-    // Wiper Box 1
-    model = glm::mat4(1.0f);
-    // 1. Scales the object
-    scale = glm::scale(glm::vec3(0.35f, 0.1f, 3.3f));
-    // 2. Rotates shape by 15 degrees in the x axis
-    rotation = glm::rotate(glm::radians(0.0f), glm::vec3(9.1f, 0.1f, 0.0f));
-    // 3. Place object at the origin
-    mtranslation = glm::translate(glm::vec3(-2.0f, 0.1f, 2.0f));
-    // Model matrix: transformations are applied right-to-left order
-    model = mtranslation * scale * rotation;
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    // Bind the vertices
-    glBindVertexArray(wiperBox1.vao);
-    // Bind the texture
-    glBindTexture(GL_TEXTURE_2D, wiperBoxTextureId);
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, wiperBox1.nVertices);
-
-    // Wiper Box 2
-    model = glm::mat4(1.0f);
-    // 1. Scales the object
-    scale = glm::scale(glm::vec3(0.35f, 0.1f, 3.3f));
-    // 2. Rotates shape by 15 degrees in the x axis
-    rotation = glm::rotate(glm::radians(0.0f), glm::vec3(-9.1f, 0.0f, 0.0f));
-    // 3. Place object at the origin
-    mtranslation = glm::translate(glm::vec3(2.0f, 0.1f, 2.0f));
-    // Model matrix: transformations are applied right-to-left order
-    model = mtranslation * rotation * scale;
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    // Bind the vertices
-    glBindVertexArray(wiperBox2.vao);
-    // Bind the texture
-    glBindTexture(GL_TEXTURE_2D, wiperBoxTextureId);
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, wiperBox2.nVertices);
-
-    // Screw Driver Handle
-    model = glm::mat4(1.0f);
-    // 1. Scales the object
-    scale = glm::scale(glm::vec3(0.3f, 0.f, 0.3f));
-    // 2. Rotates shape by 15 degrees in the x axis
-    rotation = glm::rotate(glm::radians(25.0f), glm::vec3(0.0f, 0.1f, 0.0f));
-    // 3. Place object at the origin
-    mtranslation = glm::translate(glm::vec3(1.5f, 0.0f, -2.0f));
-    // Model matrix: transformations are applied right-to-left order
-    model = scale * rotation * mtranslation;
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    // Bind the vertices
-    glBindVertexArray(screwDriverHandle.vao);
-    // Bind the texture
-    glBindTexture(GL_TEXTURE_2D, screwDriverHandleTextureId);
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, screwDriverHandle.nVertices);
-
-    // Screw Driver Rod
-    model = glm::mat4(1.0f);
-    // 1. Scales the object
-    scale = glm::scale(glm::vec3(0.1f, 0.0f, 0.0f));
-    // 2. Rotates shape by 15 degrees in the x axis
-    rotation = glm::rotate(glm::radians(25.0f), glm::vec3(0.0f, 0.1f, 0.0f));
-    // 3. Place object at the origin
-    mtranslation = glm::translate(glm::vec3(3.5f, 3.0f, -2.5f));
-    // Model matrix: transformations are applied right-to-left order
-    model = scale * rotation * mtranslation;
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    // Bind the vertices
-    glBindVertexArray(screwDriverRod.vao);
-    // Bind the texture
-    glBindTexture(GL_TEXTURE_2D, screwDriverTextureId);
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, screwDriverRod.nVertices);
-
-    // Screw Driver Tip
-    model = glm::mat4(1.0f);
-    // 1. Scales the object
-    scale = glm::scale(glm::vec3(0.3f, 0.3f, 0.3f));
-    // 2. Rotates shape by 15 degrees in the x axis
-    rotation = glm::rotate(glm::radians(25.0f), glm::vec3(0.0f, 0.1f, 0.0f));
-    // 3. Place object at the origin
-    mtranslation = glm::translate(glm::vec3(1.5f, 0.0f, -2.5f));
-    // Model matrix: transformations are applied right-to-left order
-    model = scale * rotation * mtranslation;
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    // Bind the vertices
-    glBindVertexArray(screwDriverTip.vao);
-    // Bind the texture
-    glBindTexture(GL_TEXTURE_2D, screwDriverTextureId);
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, screwDriverTip.nVertices); 
+    gProfiler.EndSection(sceneSection);
+    gSubmitMilliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - submitStart).count();
 
     // LAMP: draw lamp
-    glUseProgram(gLampProgramId);
+    int lampSection = gProfiler.BeginSection("lamp");
+    gGLState.UseProgram(gLampProgramId);
     //Transform the smaller cube used as a visual que for the light source
-    model = glm::translate(gLightPosition) * glm::scale(gLightScale);
-    // Reference matrix uniforms from the Lamp Shader program
-    modelLoc = glGetUniformLocation(gLampProgramId, "model");
-    viewLoc = glGetUniformLocation(gLampProgramId, "view");
-    projLoc = glGetUniformLocation(gLampProgramId, "projection");
-    // Pass matrix data to the Lamp Shader program's matrix uniforms
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-    glDrawArrays(GL_TRIANGLES, 0, groundMesh.nVertices);
-
-    // Deactivate the Vertex Array Object
-    glBindVertexArray(0);
-    glUseProgram(0);
+    glm::mat4 model = glm::translate(gLightPosition) * glm::scale(gLightScale);
+    // Pass the model matrix to the Lamp Shader program, view and projection come from the frame uniform block
+    glUniformMatrix4fv(gLampUniforms.model, 1, GL_FALSE, glm::value_ptr(model));
+    gGLState.BindVertexArray(groundMesh.vao);
+    glDrawElements(GL_TRIANGLES, groundMesh.nIndices, groundMesh.indexType, 0);
+    gProfiler.EndSection(lampSection);
+
+    // The VAO and program stay bound: the next frame rebinds only what differs
+    gProfiler.EndSection(frameSection);
 
     // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-    glfwSwapBuffers(gWindow); // Flips the the back buffer with the front buffer every frame.
+    // Headless frames stay in the offscreen framebuffer
+    if (gWindow)
+        glfwSwapBuffers(gWindow); // Flips the the back buffer with the front buffer every frame.
+
+    gProfiler.EndFrame();
 }
 
-void UCreateMeshBottle(GLMesh& mesh)
+// Writes the frame uniform block and the model-view-projection matrix of every scene object
+void UUpdateFrameUniforms(const glm::mat4& view, const glm::mat4& projection)
 {
+    GLFrameUniforms frame;
+    frame.view = view;
+    frame.projection = projection;
+    frame.viewProjection = projection * view;
+    frame.viewPosition = glm::vec4(gCamera.Position, 1.0f);
+    frame.lightPosition = glm::vec4(gLightPosition, 1.0f);
+    frame.lightColor = glm::vec4(gLightColor, 1.0f);
+    frame.objectColor = glm::vec4(gObjectColor, 1.0f);
+    frame.uvScale = gUVScale;
+    frame.padding = glm::vec2(0.0f);
+
+    glBindBuffer(GL_UNIFORM_BUFFER, gFrameUbo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(GLFrameUniforms), &frame);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    gGLState.BindBufferBase(GL_UNIFORM_BUFFER, 0, gFrameUbo);
+
+    // The occlusion path's cull pass multiplies the matrices of the instances it keeps
+    if (gOcclusionCulling)
+        return;
+
+    // One matrix product per visible object here instead of two per vertex in the shaders
+    gObjectMvps.resize(gInstanceObjects.size());
+    for (size_t i = 0; i < gInstanceObjects.size(); ++i)
+    {
+        if (gObjectVisible[gInstanceObjects[i]])
+            gObjectMvps[i] = frame.viewProjection * gScene.models[gInstanceObjects[i]];
+    }
 
-    // Position and texture data
-    GLfloat verts[] = {
-        // Vertex Positions   // Normals           // Texture Coordinates    
-         0.5f,  0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  0.0f, 0.0f, // 0 
-         0.5f, -0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  1.0f, 0.0f, // 1  
-        -0.5f,  0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  1.0f, 1.0f, // 3  
-         0.5f, -0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  1.0f, 0.0f, // 1 
-        -0.5f, -0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  0.0f, 1.0f, // 2 
-        -0.5f,  0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  0.0f, 0.0f, // 3 
+    // Respecify the whole store so the driver can orphan the copy the GPU may still be reading
+    glBindBuffer(GL_ARRAY_BUFFER, gObjectMvpVbo);
+    glBufferData(GL_ARRAY_BUFFER, gObjectMvps.size() * sizeof(glm::mat4), gObjectMvps.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
-         0.5f,  0.5f, 0.0f,   -1.0f,  0.0f,  0.0f,  0.0f, 0.0f, // 0 
-         0.5f, -0.5f, 0.0f,   -1.0f,  0.0f,  0.0f,  1.0f, 0.0f, // 1 
-         0.5f, -0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  1.0f, 1.0f, // 4 
-         0.5f,  0.5f, 0.0f,   -1.0f,  0.0f,  0.0f,  1.0f, 1.0f, // 0 
-         0.5f, -0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  0.0f, 1.0f, // 4 
-         0.5f,  0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  0.0f, 0.0f, // 5 
 
-         0.5f,  0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  1.0f, 0.0f, // 0 
-         0.5f,  0.5f, -1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 1.0f, // 5 
-        -0.5f,  0.5f, -1.0f,  1.0f,  0.0f,  0.0f,  0.0f, 1.0f, // 6 
-         0.5f,  0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  0.0f, 1.0f, // 0 
-        -0.5f,  0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  0.0f, 0.0f, // 3 
-        -0.5f,  0.5f, -1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f, // 6 
+// Points the model-view-projection attribute of a VAO at the per-frame buffer, starting at firstInstance
+void USetMvpAttribute(GLuint vao, GLuint location, GLuint firstInstance)
+{
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, gObjectMvpVbo);
+    for (GLuint column = 0; column < 4; ++column)
+    {
+        glVertexAttribPointer(location + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(sizeof(glm::mat4) * firstInstance + sizeof(glm::vec4) * column));
+        glEnableVertexAttribArray(location + column);
+        glVertexAttribDivisor(location + column, 1);
+    }
+    glBindVertexArray(0);
+}
 
-         0.5f, -0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  1.0f, 0.0f, // 4 
-         0.5f,  0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  1.0f, 1.0f, // 5 
-        -0.5f,  0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  0.0f, 1.0f, // 6
-         0.5f, -0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  0.0f, 1.0f, // 4 
-        -0.5f,  0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  0.0f, 0.0f, // 6
-        -0.5f, -0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  1.0f, 0.0f, // 7 
 
-        -0.5f, -0.5f, 0.0f,   0.0f,  1.0f,  0.0f,  0.0f, 1.0f, // 2 
-        -0.5f,  0.5f, 0.0f,   0.0f,  1.0f,  0.0f,  1.0f, 1.0f, // 3 
-        -0.5f,  0.5f, -1.0f,  0.0f,  1.0f,  0.0f,  1.0f, 0.0f, // 6
-        -0.5f, -0.5f, 0.0f,   0.0f,  1.0f,  0.0f,  1.0f, 0.0f, // 2 
-        -0.5f,  0.5f, -1.0f,  0.0f,  1.0f,  0.0f,  0.0f, 0.0f, // 6
-        -0.5f, -0.5f, -1.0f,  0.0f,  1.0f,  0.0f,  0.0f, 1.0f, // 7
+// Per-object path: one VAO bind and instanced draw for every batch, over the position-only VAOs for the depth pre-pass
+void URenderScenePerObject(bool depthOnly)
+{
+    // Consecutive batches of the same part of the scene are timed as one profiler section
+    const char* sectionName = nullptr;
+    int section = -1;
 
-         0.5f, -0.5f, 0.0f,   0.0f,  1.0f,  0.0f,  0.0f, 1.0f, // 1
-         0.5f, -0.5f, -1.0f,  0.0f,  1.0f,  0.0f,  1.0f, 1.0f, // 4
-        -0.5f, -0.5f, -1.0f,  0.0f,  1.0f,  0.0f,  1.0f, 0.0f, // 7 
-         0.5f, -0.5f, 0.0f,   0.0f,  1.0f,  0.0f,  1.0f, 0.0f, // 1
-        -0.5f, -0.5f, 0.0f,   0.0f,  1.0f,  0.0f,  0.0f, 0.0f, // 2
-        -0.5f, -0.5f, -1.0f,  0.0f,  1.0f,  0.0f,  0.0f, 1.0f, // 7 
+    for (size_t i = 0; i < gVisibleBatches.size(); ++i)
+    {
+        const GLSceneBatch& batch = gVisibleBatches[i];
 
-    };
+        if (!depthOnly && (!sectionName || strcmp(batch.mesh->section, sectionName) != 0))
+        {
+            gProfiler.EndSection(section);
+            sectionName = batch.mesh->section;
+            section = gProfiler.BeginSection(sectionName);
+        }
 
-    const GLuint floatsPerVertex = 3;
-    const GLuint floatsPerNormal = 3;
-    const GLuint floatsPerUV = 2;
+        // Activate the VBOs contained within the mesh's VAO
+        gGLState.BindVertexArray(depthOnly ? batch.mesh->depthVao : batch.mesh->vao);
+        // Draws every instance of the batch at its level of detail, each one selects its own material
+        const GLMeshLod& lod = batch.mesh->lods[batch.lod];
+        const size_t indexSize = batch.mesh->indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+        glDrawElementsInstancedBaseInstance(GL_TRIANGLES, lod.nIndices, batch.mesh->indexType, (void*)(lod.firstIndex * indexSize), batch.nObjects, batch.baseInstance);
+        ++gDrawCallCount;
+        if (!depthOnly)
+            gSubmittedTriangles += (size_t)lod.nIndices / 3 * batch.nObjects;
+    }
 
-    mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
+    gProfiler.EndSection(section);
+}
 
-    glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.vao);
 
-    // Create 2 buffers: first one for the vertex data; second one for the indices
-    glGenBuffers(1, &mesh.vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
+// Rewrites the indirect path's command buffer from the visible runs of this frame
+void UUploadIndirectCommands()
+{
+    // One command per visible run, its baseInstance selects the first instance in the mesh's range of the
+    // instance order, whose object index selects the draw record
+    vector<GLDrawElementsIndirectCommand> commands(gVisibleBatches.size());
+    for (size_t i = 0; i < gVisibleBatches.size(); ++i)
+    {
+        const GLSceneBatch& batch = gVisibleBatches[i];
+        const GLMeshLod& lod = batch.mesh->lods[batch.lod];
+        commands[i].count = lod.nIndices;
+        commands[i].instanceCount = batch.nObjects;
+        commands[i].firstIndex = batch.mesh->firstIndex + lod.firstIndex;
+        commands[i].baseVertex = batch.mesh->baseVertex;
+        commands[i].baseInstance = batch.mesh->firstInstance + batch.baseInstance;
+    }
+    gMeshArena.nCommands = (GLsizei)commands.size();
+    for (size_t i = 0; i < commands.size(); ++i)
+        gSubmittedTriangles += (size_t)commands[i].count / 3 * commands[i].instanceCount;
 
-    // Strides between vertex coordinates is 6 (x, y, z, r, g, b, a). A tightly packed stride is 0.
-    GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);// The number of floats before each
+    gGLState.BindDrawIndirectBuffer(gMeshArena.commandBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(GLDrawElementsIndirectCommand), commands.data(), GL_STREAM_DRAW);
+}
 
-    // Create Vertex Attribute Pointers
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
 
-    glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-    glEnableVertexAttribArray(1);
+// Indirect path: the whole scene is one glMultiDrawElementsIndirect over the shared arena, through the arena VAO
+// or its position-only twin for the depth pre-pass
+void URenderSceneIndirect(GLuint vao)
+{
+    gGLState.BindVertexArray(vao);
+    gGLState.BindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, gMeshArena.recordSsbo);
+    gGLState.BindDrawIndirectBuffer(gMeshArena.commandBuffer);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, gMeshArena.nCommands, 0);
+    ++gDrawCallCount;
+}
 
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
+
+// Creates the compute programs, buffers and VAO of the occlusion path; the pyramid is sized by the first frame
+bool UCreateOcclusionCulling()
+{
+    GLOcclusionCulling& occlusion = gOcclusion;
+    GLUniformTable uniforms;
+
+    if (!UCreateComputeProgram(hiZReduceShaderSource, occlusion.reduceProgram, uniforms))
+        return false;
+    glUniform1i(UGetUniform(uniforms, "depthTexture", GL_SAMPLER_2D), 1);
+
+    if (!UCreateComputeProgram(hiZDownsampleShaderSource, occlusion.downsampleProgram, uniforms))
+        return false;
+
+    if (!UCreateComputeProgram(occlusionCullShaderSource, occlusion.cullProgram, uniforms))
+        return false;
+    glUniform1i(UGetUniform(uniforms, "hiZ", GL_SAMPLER_2D), 1);
+    occlusion.uPhase = UGetUniform(uniforms, "phase", GL_UNSIGNED_INT);
+    occlusion.uObjectCount = UGetUniform(uniforms, "objectCount", GL_UNSIGNED_INT);
+    occlusion.uMeshCount = UGetUniform(uniforms, "meshCount", GL_UNSIGNED_INT);
+    occlusion.uHiZLevels = UGetUniform(uniforms, "hiZLevels", GL_INT);
+    occlusion.uDepthSize = UGetUniform(uniforms, "depthSize", GL_FLOAT_VEC2);
+
+    glGenBuffers(1, &occlusion.boundsSsbo);
+    glGenBuffers(1, &occlusion.objectMeshSsbo);
+    glGenBuffers(1, &occlusion.visibilitySsbo);
+    glGenBuffers(1, &occlusion.commandBuffer);
+    glGenBuffers(1, &occlusion.drawObjectVbo);
+    glGenBuffers(1, &occlusion.drawMvpVbo);
+    glGenBuffers(OCCLUSION_STATISTICS_LATENCY, occlusion.statisticsSsbo);
+    for (GLuint i = 0; i < OCCLUSION_STATISTICS_LATENCY; ++i)
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, occlusion.statisticsSsbo[i]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, 4 * sizeof(GLuint), NULL, GL_DYNAMIC_READ);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    // Same vertices and indices as the arena VAO, but the instances come from the lists the cull pass writes
+    glGenVertexArrays(1, &occlusion.vao);
+    glBindVertexArray(occlusion.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, gMeshArena.vbo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gMeshArena.ebo);
+    const GLint stride = sizeof(float) * 8;
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, 0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * 3));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * 6));
     glEnableVertexAttribArray(2);
+
+    glBindBuffer(GL_ARRAY_BUFFER, occlusion.drawObjectVbo);
+    glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(GLuint), 0);
+    glEnableVertexAttribArray(3);
+    glVertexAttribDivisor(3, 1);
+
+    glBindBuffer(GL_ARRAY_BUFFER, occlusion.drawMvpVbo);
+    for (GLuint column = 0; column < 4; ++column)
+    {
+        glVertexAttribPointer(4 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(sizeof(glm::vec4) * column));
+        glEnableVertexAttribArray(4 + column);
+        glVertexAttribDivisor(4 + column, 1);
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    occlusion.nObjects = 0;
+    occlusion.nMeshes = 0;
+    occlusion.hiZ = 0;
+    occlusion.hiZWidth = 0;
+    occlusion.hiZHeight = 0;
+    occlusion.hiZLevels = 0;
+    occlusion.depthCopy = 0;
+    occlusion.depthCopyFbo = 0;
+    occlusion.frame = 0;
+
+    return true;
 }
 
-void UCreateMeshCap(GLMesh& mesh)
+
+// Uploads the boxes, mesh slots and command templates of the scene objects (called by UUploadScene)
+void UUploadOcclusionScene()
+{
+    GLOcclusionCulling& occlusion = gOcclusion;
+    occlusion.nObjects = (GLuint)gScene.models.size();
+
+    // One command per mesh and phase, always over the mesh's full-detail level. Phase 1 instances start at the
+    // mesh's offset in the instance order, phase 2 instances as far into the second half of the lists, so no two
+    // commands can write the same slot.
+    unordered_map<GLMesh*, GLuint> meshSlots;
+    vector<GLuint> objectMeshes(occlusion.nObjects);
+    vector<glm::vec4> bounds(occlusion.nObjects * 2);
+    vector<GLMesh*> meshes;
+    for (GLuint i = 0; i < occlusion.nObjects; ++i)
+    {
+        GLMesh* mesh = gScene.meshes[i];
+        if (meshSlots.find(mesh) == meshSlots.end())
+        {
+            meshSlots[mesh] = (GLuint)meshes.size();
+            meshes.push_back(mesh);
+        }
+        objectMeshes[i] = meshSlots[mesh];
+        bounds[i * 2] = glm::vec4(gSceneBounds.centerX[i], gSceneBounds.centerY[i], gSceneBounds.centerZ[i], 0.0f);
+        bounds[i * 2 + 1] = glm::vec4(gSceneBounds.extentX[i], gSceneBounds.extentY[i], gSceneBounds.extentZ[i], 0.0f);
+    }
+    occlusion.nMeshes = (GLuint)meshes.size();
+
+    occlusion.commands.resize(meshes.size() * 2);
+    for (size_t i = 0; i < meshes.size(); ++i)
+    {
+        for (GLuint phase = 0; phase < 2; ++phase)
+        {
+            GLDrawElementsIndirectCommand& command = occlusion.commands[phase * meshes.size() + i];
+            command.count = meshes[i]->nIndices;
+            command.instanceCount = 0;
+            command.firstIndex = meshes[i]->firstIndex;
+            command.baseVertex = meshes[i]->baseVertex;
+            command.baseInstance = phase * occlusion.nObjects + meshes[i]->firstInstance;
+        }
+    }
+
+    // Every object starts visible, so the first frame's phase 1 draws whatever is in the frustum
+    const vector<GLuint> visibility(occlusion.nObjects, 1);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, occlusion.boundsSsbo);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, bounds.size() * sizeof(glm::vec4), bounds.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, occlusion.objectMeshSsbo);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, objectMeshes.size() * sizeof(GLuint), objectMeshes.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, occlusion.visibilitySsbo);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, visibility.size() * sizeof(GLuint), visibility.data(), GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, occlusion.commandBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, occlusion.commands.size() * sizeof(GLDrawElementsIndirectCommand), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    glBindBuffer(GL_ARRAY_BUFFER, occlusion.drawObjectVbo);
+    glBufferData(GL_ARRAY_BUFFER, 2 * occlusion.nObjects * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_ARRAY_BUFFER, occlusion.drawMvpVbo);
+    glBufferData(GL_ARRAY_BUFFER, 2 * occlusion.nObjects * sizeof(glm::mat4), NULL, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glProgramUniform1ui(occlusion.cullProgram, occlusion.uObjectCount, occlusion.nObjects);
+    glProgramUniform1ui(occlusion.cullProgram, occlusion.uMeshCount, occlusion.nMeshes);
+}
+
+
+void UDestroyOcclusionCulling()
 {
+    GLOcclusionCulling& occlusion = gOcclusion;
+    glDeleteVertexArrays(1, &occlusion.vao);
+    glDeleteBuffers(1, &occlusion.boundsSsbo);
+    glDeleteBuffers(1, &occlusion.objectMeshSsbo);
+    glDeleteBuffers(1, &occlusion.visibilitySsbo);
+    glDeleteBuffers(1, &occlusion.commandBuffer);
+    glDeleteBuffers(1, &occlusion.drawObjectVbo);
+    glDeleteBuffers(1, &occlusion.drawMvpVbo);
+    glDeleteBuffers(OCCLUSION_STATISTICS_LATENCY, occlusion.statisticsSsbo);
+    for (GLuint i = 0; i < OCCLUSION_STATISTICS_LATENCY; ++i)
+        glDeleteSync(occlusion.statisticsFences[i]);
+    UDestroyTexture(occlusion.hiZ);
+    UDestroyTexture(occlusion.depthCopy);
+    glDeleteFramebuffers(1, &occlusion.depthCopyFbo);
+    UDestroyShaderProgram(occlusion.reduceProgram);
+    UDestroyShaderProgram(occlusion.downsampleProgram);
+    UDestroyShaderProgram(occlusion.cullProgram);
+}
 
-    // Position and texture data
-    GLfloat verts[] = {
-        // Vertex Positions   // Normals           // Texture Coordinates    
-         0.5f,  0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  0.0f, 0.0f, // 0 
-         0.5f, -0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  1.0f, 0.0f, // 1  
-        -0.5f,  0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  1.0f, 1.0f, // 3  
-         0.5f, -0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  1.0f, 0.0f, // 1 
-        -0.5f, -0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  0.0f, 1.0f, // 2 
-        -0.5f,  0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  0.0f, 0.0f, // 3 
 
-         0.5f,  0.5f, 0.0f,   -1.0f,  0.0f,  0.0f,  0.0f, 0.0f, // 0 
-         0.5f, -0.5f, 0.0f,   -1.0f,  0.0f,  0.0f,  1.0f, 0.0f, // 1 
-         0.5f, -0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  1.0f, 1.0f, // 4 
-         0.5f,  0.5f, 0.0f,   -1.0f,  0.0f,  0.0f,  1.0f, 1.0f, // 0 
-         0.5f, -0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  0.0f, 1.0f, // 4 
-         0.5f,  0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  0.0f, 0.0f, // 5 
+// Builds the Hi-Z pyramid from the depth drawn so far this frame, then leaves it bound to texture unit 1
+void UBuildHiZ()
+{
+    GLOcclusionCulling& occlusion = gOcclusion;
+
+    // Headless frames render into a depth texture already; a window's depth has to be copied out first
+    GLsizei width = WINDOW_WIDTH;
+    GLsizei height = WINDOW_HEIGHT;
+    if (gWindow)
+        glfwGetFramebufferSize(gWindow, &width, &height);
 
-         0.5f,  0.5f, 0.0f,   0.0f,  0.0f,  1.0f,  1.0f, 0.0f, // 0 
-         0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  1.0f,  1.0f, 1.0f, // 5 
-        -0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  1.0f,  0.0f, 1.0f, // 6 
-         0.5f,  0.5f, 0.0f,   0.0f,  0.0f,  1.0f,  0.0f, 1.0f, // 0 
-        -0.5f,  0.5f, 0.0f,   0.0f,  0.0f,  1.0f,  0.0f, 0.0f, // 3 
-        -0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  1.0f,  1.0f, 0.0f, // 6 
+    if (width != occlusion.hiZWidth || height != occlusion.hiZHeight)
+    {
+        UDestroyTexture(occlusion.hiZ);
+        occlusion.hiZWidth = width;
+        occlusion.hiZHeight = height;
+        occlusion.hiZLevels = UMipLevels((width + 1) / 2, (height + 1) / 2);
+        glGenTextures(1, &occlusion.hiZ);
+        glBindTexture(GL_TEXTURE_2D, occlusion.hiZ);
+        glTexStorage2D(GL_TEXTURE_2D, occlusion.hiZLevels, GL_R32F, (width + 1) / 2, (height + 1) / 2);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glProgramUniform1i(occlusion.cullProgram, occlusion.uHiZLevels, occlusion.hiZLevels);
+        glProgramUniform2f(occlusion.cullProgram, occlusion.uDepthSize, (GLfloat)width, (GLfloat)height);
+
+        if (gWindow)
+        {
+            UDestroyTexture(occlusion.depthCopy);
+            glGenTextures(1, &occlusion.depthCopy);
+            glBindTexture(GL_TEXTURE_2D, occlusion.depthCopy);
+            glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH24_STENCIL8, width, height);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+            if (!occlusion.depthCopyFbo)
+                glGenFramebuffers(1, &occlusion.depthCopyFbo);
+            glBindFramebuffer(GL_FRAMEBUFFER, occlusion.depthCopyFbo);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, occlusion.depthCopy, 0);
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        }
+        gGLState.Invalidate();
+    }
 
-         0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  -1.0f,  1.0f, 0.0f, // 4 
-         0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  -1.0f,  1.0f, 1.0f, // 5 
-        -0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  -1.0f,  0.0f, 1.0f, // 6
-         0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  -1.0f,  0.0f, 1.0f, // 4 
-        -0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  -1.0f,  0.0f, 0.0f, // 6
-        -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  -1.0f,  1.0f, 0.0f, // 7 
+    GLuint depthTexture = gHeadlessDepth;
+    if (gWindow)
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, occlusion.depthCopyFbo);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        depthTexture = occlusion.depthCopy;
+    }
 
-        -0.5f, -0.5f, 0.0f,   0.0f,  1.0f,  0.0f,  0.0f, 1.0f, // 2 
-        -0.5f,  0.5f, 0.0f,   0.0f,  1.0f,  0.0f,  1.0f, 1.0f, // 3 
-        -0.5f,  0.5f, -1.0f,  0.0f,  1.0f,  0.0f,  1.0f, 0.0f, // 6
-        -0.5f, -0.5f, 0.0f,   0.0f,  1.0f,  0.0f,  1.0f, 0.0f, // 2 
-        -0.5f,  0.5f, -1.0f,  0.0f,  1.0f,  0.0f,  0.0f, 0.0f, // 6
-        -0.5f, -0.5f, -1.0f,  0.0f,  1.0f,  0.0f,  0.0f, 1.0f, // 7
+    gGLState.UseProgram(occlusion.reduceProgram);
+    gGLState.BindTexture(1, GL_TEXTURE_2D, depthTexture);
+    glBindImageTexture(0, occlusion.hiZ, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    glDispatchCompute((width + 15) / 16, (height + 15) / 16, 1);
 
-         0.5f, -0.5f, 0.0f,   0.0f,  1.0f,  0.0f,  0.0f, 1.0f, // 1
-         0.5f, -0.5f, -1.0f,  0.0f,  1.0f,  0.0f,  1.0f, 1.0f, // 4
-        -0.5f, -0.5f, -1.0f,  0.0f,  1.0f,  0.0f,  1.0f, 0.0f, // 7 
-         0.5f, -0.5f, 0.0f,   0.0f,  1.0f,  0.0f,  1.0f, 0.0f, // 1
-        -0.5f, -0.5f, 0.0f,   0.0f,  1.0f,  0.0f,  0.0f, 0.0f, // 2
-        -0.5f, -0.5f, -1.0f,  0.0f,  1.0f,  0.0f,  0.0f, 1.0f, // 7 
+    gGLState.UseProgram(occlusion.downsampleProgram);
+    for (GLsizei level = 1; level < occlusion.hiZLevels; ++level)
+    {
+        // Each level reads the one the previous dispatch wrote
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        GLsizei levelWidth = max(((width + 1) / 2) >> level, 1);
+        GLsizei levelHeight = max(((height + 1) / 2) >> level, 1);
+        glBindImageTexture(0, occlusion.hiZ, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        glBindImageTexture(1, occlusion.hiZ, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        glDispatchCompute((levelWidth + 7) / 8, (levelHeight + 7) / 8, 1);
+    }
 
-    };
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    gGLState.BindTexture(1, GL_TEXTURE_2D, occlusion.hiZ);
+}
 
-    const GLuint floatsPerVertex = 3;
-    const GLuint floatsPerNormal = 3;
-    const GLuint floatsPerUV = 2;
 
-    mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
+// Runs one phase of the cull pass over every scene object
+void UDispatchOcclusionCull(GLuint phase)
+{
+    gGLState.UseProgram(gOcclusion.cullProgram);
+    glProgramUniform1ui(gOcclusion.cullProgram, gOcclusion.uPhase, phase);
+    glDispatchCompute((gOcclusion.nObjects + 63) / 64, 1, 1);
+}
 
-    glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.vao);
 
-    // Create 2 buffers: first one for the vertex data; second one for the indices
-    glGenBuffers(1, &mesh.vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
+// Occlusion path: phase 1 redraws what the last frame found visible, the Hi-Z pyramid is built from that depth,
+// and phase 2 draws the objects it shows were missed. Both phases are one glMultiDrawElementsIndirect whose
+// instance counts and lists the GPU wrote, so the CPU never waits for the cull results.
+void URenderSceneOcclusion()
+{
+    GLOcclusionCulling& occlusion = gOcclusion;
+    const GLuint slot = occlusion.frame % OCCLUSION_STATISTICS_LATENCY;
+    const GLuint statistics = occlusion.statisticsSsbo[slot];
+
+    // The counters in this slot were written OCCLUSION_STATISTICS_LATENCY frames ago. They are read only if that
+    // frame is done on the GPU; otherwise the last counts stay, as reading them would wait for it.
+    GLsync& fence = occlusion.statisticsFences[slot];
+    if (fence)
+    {
+        const GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+        {
+            GLuint counts[4];
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, statistics);
+            glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(counts), counts);
+            gVisibleCount = counts[1] + counts[2];
+            gCulledCount = occlusion.nObjects - gVisibleCount;
+            gOccludedCount = gCulledCount - counts[0];
+            gSubmittedTriangles = counts[3];
+        }
+        glDeleteSync(fence);
+        fence = 0;
+    }
+    const GLuint zeros[4] = { 0, 0, 0, 0 };
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, statistics);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zeros), zeros);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    ++occlusion.frame;
+
+    gGLState.BindDrawIndirectBuffer(occlusion.commandBuffer);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, occlusion.commands.size() * sizeof(GLDrawElementsIndirectCommand), occlusion.commands.data());
+
+    gGLState.BindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, gMeshArena.recordSsbo);
+    gGLState.BindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, occlusion.boundsSsbo);
+    gGLState.BindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, occlusion.objectMeshSsbo);
+    gGLState.BindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, occlusion.visibilitySsbo);
+    gGLState.BindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, occlusion.commandBuffer);
+    gGLState.BindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, occlusion.drawObjectVbo);
+    gGLState.BindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, occlusion.drawMvpVbo);
+    gGLState.BindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, statistics);
+
+    int section = gProfiler.BeginSection("occlusion phase 1");
+    // Phase 1 reads the visibility the last frame's phase 2 wrote
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+    UDispatchOcclusionCull(1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    gGLState.UseProgram(gIndirectProgramId);
+    gGLState.BindVertexArray(occlusion.vao);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, occlusion.nMeshes, 0);
+    ++gDrawCallCount;
+    gProfiler.EndSection(section);
+
+    section = gProfiler.BeginSection("hi-z");
+    UBuildHiZ();
+    gProfiler.EndSection(section);
+
+    section = gProfiler.BeginSection("occlusion phase 2");
+    UDispatchOcclusionCull(2);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    gGLState.UseProgram(gIndirectProgramId);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(occlusion.nMeshes * sizeof(GLDrawElementsIndirectCommand)), occlusion.nMeshes, 0);
+    ++gDrawCallCount;
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    gProfiler.EndSection(section);
+}
+
+
+// Makes every material visible to the Phong shader for the rest of the frame
+void UBindMaterials()
+{
+    if (gMaterials.bindless)
+        gGLState.BindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, gMaterials.handleSsbo);
+    else
+        gGLState.BindTexture(0, GL_TEXTURE_2D_ARRAY, gMaterials.arrayTexture);
+}
+
+
+// Renders the same frames with both submission paths and prints the average CPU submission time
+void UBenchmarkSubmission()
+{
+    const int frames = 200;
+    const bool indirectRendering = gIndirectRendering;
+    const bool occlusionCulling = gOcclusionCulling;
+    gOcclusionCulling = false;
+
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        gIndirectRendering = (pass == 1);
+
+        double totalMilliseconds = 0.0;
+        for (int frame = 0; frame < frames; ++frame)
+        {
+            URender();
+            if (gWindow)
+                glfwPollEvents();
+            totalMilliseconds += gSubmitMilliseconds;
+        }
+        glFinish();
+
+        cout << "BENCH submit path=" << (gIndirectRendering ? "indirect" : "per-object")
+            << " objects=" << gScene.models.size()
+            << " visible=" << gVisibleCount
+            << " culled=" << gCulledCount
+            << " draw_calls=" << gDrawCallCount
+            << " triangles=" << gSubmittedTriangles
+            << " state_calls=" << gGLState.Calls
+            << " state_skipped=" << gGLState.Skipped
+            << " uniform_lookups=" << gUniformLookupCount
+            << " cpu_ms_per_frame=" << totalMilliseconds / frames << endl;
+    }
+
+    gIndirectRendering = indirectRendering;
+    gOcclusionCulling = occlusionCulling;
+}
+
+
+// Draws a grid of tessellated bottles with the per-object vertex shader, once multiplying the matrices and
+// inverting the model matrix per vertex as it used to and once reading the precomputed model-view-projection
+// and normal matrices. Rasterization is discarded so the time is spent in vertex work only.
+void UBenchmarkVertexThroughput(int subdivisions, const char* fragmentShaderSource)
+{
+    const int frames = 20;
+    const int side = 4;
+
+    GLMesh mesh;
+    UCreateMeshBottleTessellated(mesh, subdivisions);
+
+    // Same transform and material as the scene's bottle, repeated on a grid
+    GLuint material = 0;
+    for (size_t i = 0; i < gScene.meshes.size(); ++i)
+    {
+        if (gScene.meshes[i] == &bottleMesh)
+        {
+            material = gScene.materials[i];
+            break;
+        }
+    }
+
+    vector<GLDrawRecord> instances(side * side);
+    glm::mat4 bottle = glm::scale(glm::vec3(0.5f, 1.0f, 0.5f)) * glm::rotate(glm::radians(45.0f), glm::vec3(0.0f, 0.1f, 0.0f));
+    for (int i = 0; i < side * side; ++i)
+    {
+        instances[i].model = glm::translate(glm::vec3(1.5f * (i % side), 0.0f, -1.5f * (i / side))) * bottle;
+        USetNormalMatrix(instances[i], instances[i].model);
+        instances[i].material = material;
+    }
+    USetMeshInstances(mesh, instances.data(), (GLuint)instances.size());
+
+    GLuint inverseProgramId;
+    GLUniformTable inverseProgramUniforms;
+    if (!UCreateShaderProgram(vertexShaderInverseSource, fragmentShaderSource, inverseProgramId, inverseProgramUniforms))
+        return;
+
+    const char* names[2] = { "per_vertex", "precomputed" };
+    const GLuint programs[2] = { inverseProgramId, gProgramId };
+
+    glm::mat4 view = glm::lookAt(glm::vec3(2.0f, 4.0f, 6.0f), glm::vec3(2.0f, 0.0f, -2.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
+
+    // The frame uniform block feeds the baseline, the instances' own transforms replace the scene's
+    UUpdateFrameUniforms(view, projection);
+    vector<glm::mat4> mvps(instances.size());
+    for (size_t i = 0; i < instances.size(); ++i)
+        mvps[i] = projection * view * instances[i].model;
+    glBindBuffer(GL_ARRAY_BUFFER, gObjectMvpVbo);
+    glBufferData(GL_ARRAY_BUFFER, mvps.size() * sizeof(glm::mat4), mvps.data(), GL_STREAM_DRAW);
+    USetMvpAttribute(mesh.vao, 11, 0);
+    gGLState.Invalidate();
+
+    gGLState.Enable(GL_RASTERIZER_DISCARD);
+    gGLState.BindVertexArray(mesh.vao);
+
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        gGLState.UseProgram(programs[pass]);
+
+        // One untimed draw so shader compilation and buffer uploads are done
+        glDrawElementsInstanced(GL_TRIANGLES, mesh.nIndices, mesh.indexType, 0, mesh.nInstances);
+        glFinish();
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for (int frame = 0; frame < frames; ++frame)
+            glDrawElementsInstanced(GL_TRIANGLES, mesh.nIndices, mesh.indexType, 0, mesh.nInstances);
+        glFinish();
+        double milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / frames;
+
+        const double vertices = (double)mesh.nVertices * mesh.nInstances;
+        cout << "BENCH vertex shader=" << names[pass]
+            << " instances=" << mesh.nInstances
+            << " triangles=" << (size_t)mesh.nIndices / 3 * mesh.nInstances
+            << " vertices=" << (size_t)vertices
+            << " ms_per_frame=" << milliseconds
+            << " mvertices_per_s=" << vertices / (milliseconds * 1000.0) << endl;
+    }
+
+    gGLState.Disable(GL_RASTERIZER_DISCARD);
+    gGLState.BindVertexArray(0);
+    gGLState.UseProgram(0);
+
+    UDestroyShaderProgram(inverseProgramId);
+    UDestroyMesh(mesh);
+}
+
+
+// Times loading a mesh from an OBJ file (parse, index, optimize, upload) against mapping the same mesh, already
+// optimized, from a mesh file and uploading it from the mapping. Both read a file the first run brought into the
+// page cache, so the times compare the work done on the data rather than the disk. Without a path, a generated
+// torus is written to an OBJ file first.
+void UBenchmarkMeshLoad(const string& path)
+{
+    const int runs = 3;
+    const string objPath = path.empty() ? "bench_load.obj" : path;
+    const string meshPath = objPath + ".bmesh";
+    if (path.empty() && !UWriteBenchmarkObj(objPath))
+    {
+        cout << "ERROR: cannot write " << objPath << endl;
+        return;
+    }
+
+    vector<GLfloat> vertices;
+    vector<uint32_t> indices;
+    double objMilliseconds = 0.0;
+    for (int run = 0; run < runs; ++run)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        ImportedMesh imported;
+        if (!importObj(objPath.c_str(), imported))
+        {
+            cout << "ERROR: " << objPath << " is not a triangle mesh" << endl;
+            return;
+        }
+        vertices.swap(imported.vertices);
+        indices.swap(imported.indices);
+
+        GLMesh mesh;
+        GLMeshLod lod = { 0, (GLuint)indices.size(), 0.0f };
+        UUploadIndexedMesh(mesh, vertices, indices, &lod, 1, objPath.c_str());
+        glFinish();
+        double milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        objMilliseconds = run == 0 ? milliseconds : min(objMilliseconds, milliseconds);
+
+        // The arena was built already, nothing will upload what the mesh staged in it
+        UDestroyMesh(mesh);
+        vector<GLfloat>().swap(gMeshArena.vertices);
+        vector<GLuint>().swap(gMeshArena.indices);
+    }
+
+    // The same mesh as UUploadIndexedMesh left it
+    MeshFileLod lod = { 0, (uint32_t)indices.size(), 0.0f, 0 };
+    MeshFileSource source = { "bench", vertices.data(), (uint32_t)(vertices.size() / MESH_VERTEX_FLOATS), indices.data(), (uint32_t)indices.size(), &lod, 1 };
+    if (!writeMeshFile(meshPath.c_str(), &source, 1))
+    {
+        cout << "ERROR: cannot write " << meshPath << endl;
+        return;
+    }
+
+    double meshMilliseconds = 0.0;
+    for (int run = 0; run < runs; ++run)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        MeshFileMapping mapping;
+        if (!mapMeshFile(meshPath.c_str(), mapping))
+            return;
+        if (!validateMeshFile(mapping.data, mapping.size) || !UMeshFileMatchesLayout(mapping.data))
+        {
+            unmapMeshFile(mapping);
+            return;
+        }
+
+        GLMesh mesh;
+        UCreateFileMesh(mesh, mapping.data, meshFileMeshes(mapping.data)[0]);
+        glFinish();
+        unmapMeshFile(mapping);
+        double milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        meshMilliseconds = run == 0 ? milliseconds : min(meshMilliseconds, milliseconds);
+        UDestroyMesh(mesh);
+    }
+
+    const char* formats[2] = { "obj", "bmesh" };
+    const long bytes[2] = { UFileSize(objPath), UFileSize(meshPath) };
+    const double milliseconds[2] = { objMilliseconds, meshMilliseconds };
+    for (int format = 0; format < 2; ++format)
+    {
+        cout << "BENCH load format=" << formats[format]
+            << " bytes=" << bytes[format]
+            << " vertices=" << vertices.size() / MESH_VERTEX_FLOATS
+            << " triangles=" << indices.size() / 3
+            << " ms=" << milliseconds[format]
+            << " mb_per_s=" << bytes[format] / (milliseconds[format] * 1000.0) << endl;
+    }
+    cout << "BENCH load speedup=" << objMilliseconds / meshMilliseconds << endl;
+
+    remove(meshPath.c_str());
+    if (path.empty())
+        remove(objPath.c_str());
+}
+
+
+// Writes a finely tessellated torus as an OBJ file with positions, texture coordinates and normals
+bool UWriteBenchmarkObj(const string& path)
+{
+    const MeshSize size = meshShapeSize(MESH_TORUS, 512, 256);
+    vector<float> vertices(size.vertices * MESH_VERTEX_FLOATS);
+    vector<uint32_t> indices(size.indices);
+    MeshWriter writer = meshWriter(vertices.data(), indices.data());
+    generateMeshShape(writer, MESH_TORUS, 512, 256);
+
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file)
+        return false;
+
+    for (size_t i = 0; i < vertices.size(); i += MESH_VERTEX_FLOATS)
+    {
+        const float* v = &vertices[i];
+        fprintf(file, "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn %.6f %.6f %.6f\n", v[0], v[1], v[2], v[6], v[7], v[3], v[4], v[5]);
+    }
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        const uint32_t a = indices[i] + 1, b = indices[i + 1] + 1, c = indices[i + 2] + 1;
+        fprintf(file, "f %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, b, b, b, c, c, c);
+    }
+    return fclose(file) == 0;
+}
+
+
+// Size of a file in bytes, -1 when it cannot be opened
+long UFileSize(const string& path)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file)
+        return -1;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+
+// Renders a fixed orbit around the scene and prints min, median and p99 frame times.
+// Every frame ends with glFinish so the time covers the GPU work, as a swap would.
+void UBenchmarkFrames(int frames)
+{
+    const int warmupFrames = 10;
+    const glm::vec3 target(0.0f, 1.0f, 0.0f);
+
+    // Every texture must be resident so each frame samples the same data
+    while (gMaterials.pbo)
+    {
+        UUpdateMaterials();
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+
+    vector<double> frameMilliseconds;
+    double submitMilliseconds = 0.0;
+    unsigned int stateCalls = 0;
+    unsigned int stateSkipped = 0;
+    size_t visibleObjects = 0;
+    size_t culledObjects = 0;
+    size_t occludedObjects = 0;
+    size_t submittedTriangles = 0;
+    size_t uniformLookups = 0;
+    double cullMicroseconds = 0.0;
+    frameMilliseconds.reserve(frames);
+
+    for (int frame = -warmupFrames; frame < frames; ++frame)
+    {
+        // One full turn over the measured frames, 9 units out and 4 up
+        float angle = 6.2831853f * frame / frames;
+        gCamera.Position = glm::vec3(9.0f * sin(angle), 4.0f, 9.0f * cos(angle));
+        gCamera.Front = glm::normalize(target - gCamera.Position);
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        URender();
+        glFinish();
+
+        if (frame >= 0)
+        {
+            frameMilliseconds.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+            submitMilliseconds += gSubmitMilliseconds;
+            stateCalls += gGLState.Calls;
+            stateSkipped += gGLState.Skipped;
+            visibleObjects += gVisibleCount;
+            culledObjects += gCulledCount;
+            occludedObjects += gOccludedCount;
+            submittedTriangles += gSubmittedTriangles;
+            uniformLookups += gUniformLookupCount;
+            cullMicroseconds += gOcclusionCulling ? 0.0 : gCullMicroseconds;
+        }
+    }
+
+    double totalMilliseconds = 0.0;
+    for (size_t i = 0; i < frameMilliseconds.size(); ++i)
+        totalMilliseconds += frameMilliseconds[i];
+    sort(frameMilliseconds.begin(), frameMilliseconds.end());
+
+    // The occlusion path's counts lag OCCLUSION_STATISTICS_LATENCY frames behind, well inside the warmup. Its reject
+    // rate is the share of the draws frustum culling alone would have issued.
+    cout << "BENCH frames path=" << (gOcclusionCulling ? "occlusion" : gIndirectRendering ? "indirect" : "per-object")
+        << " prepass=" << (gDepthPrepass && !gOcclusionCulling ? 1 : 0)
+        << " lod=" << (gLodSelection && !gOcclusionCulling ? 1 : 0)
+        << " frames=" << frames
+        << " width=" << WINDOW_WIDTH
+        << " height=" << WINDOW_HEIGHT
+        << " objects=" << gScene.models.size()
+        << " min_ms=" << frameMilliseconds.front()
+        << " median_ms=" << frameMilliseconds[frames / 2]
+        << " p99_ms=" << frameMilliseconds[(size_t)(frames * 0.99)]
+        << " mean_ms=" << totalMilliseconds / frames
+        << " submit_ms=" << submitMilliseconds / frames
+        << " state_calls=" << (double)stateCalls / frames
+        << " state_skipped=" << (double)stateSkipped / frames
+        << " uniform_lookups=" << uniformLookups
+        << " visible=" << (double)visibleObjects / frames
+        << " culled=" << (double)culledObjects / frames
+        << " cull_us=" << cullMicroseconds / frames
+        << " occluded=" << (double)occludedObjects / frames
+        << " triangles=" << (double)submittedTriangles / frames
+        << " occlusion_rejected_pct=" << (visibleObjects + occludedObjects > 0 ? 100.0 * occludedObjects / (visibleObjects + occludedObjects) : 0.0) << endl;
+}
+
+
+// Writes the profiler's buffered sections to the --trace file and prints their mean CPU and GPU times
+void UWriteTrace()
+{
+    if (!gProfiler.Enabled)
+        return;
+
+    gProfiler.Flush();
+    if (!gProfiler.WriteChromeTrace(gTracePath.c_str()))
+    {
+        cout << "Failed to write trace " << gTracePath << endl;
+        return;
+    }
+    cout << "INFO: Wrote " << gProfiler.EventCount() << " sections to " << gTracePath
+        << " (" << gProfiler.DroppedFrames << " frames dropped)" << endl;
+
+    // Sections in the order they first appear in the buffer
+    vector<const char*> names;
+    vector<double> cpuMilliseconds, gpuMilliseconds;
+    vector<int> counts;
+    for (size_t i = 0; i < gProfiler.EventCount(); ++i)
+    {
+        const ProfileEvent& e = gProfiler.Event(i);
+        size_t n = 0;
+        while (n < names.size() && strcmp(names[n], e.Name) != 0)
+            ++n;
+        if (n == names.size())
+        {
+            names.push_back(e.Name);
+            cpuMilliseconds.push_back(0.0);
+            gpuMilliseconds.push_back(0.0);
+            counts.push_back(0);
+        }
+        cpuMilliseconds[n] += e.CpuDuration / 1000.0;
+        gpuMilliseconds[n] += e.GpuDuration / 1000.0;
+        ++counts[n];
+    }
+
+    for (size_t n = 0; n < names.size(); ++n)
+    {
+        cout << "BENCH section name=\"" << names[n] << "\""
+            << " frames=" << counts[n]
+            << " cpu_ms=" << cpuMilliseconds[n] / counts[n]
+            << " gpu_ms=" << gpuMilliseconds[n] / counts[n] << endl;
+    }
+}
+
+
+// Times the ways of turning a decoded image upside down on a real texture, in milliseconds per image
+void UBenchmarkImageFlip(const char* filename)
+{
+    const int decodes = 5;
+    const int flips = 50;
+
+    int width, height, channels;
+    unsigned char* image = stbi_load(filename, &width, &height, &channels, 4);
+    if (!image)
+    {
+        cout << "Failed to load texture " << filename << endl;
+        return;
+    }
+
+    const size_t rowSize = (size_t)width * 4;
+    const size_t imageSize = rowSize * height;
+    vector<unsigned char> destination(imageSize);
+    vector<unsigned char> scratch(rowSize);
+    chrono::steady_clock::time_point start;
+
+    // Decoding without and with stb_image's own flip; the difference is the flip it adds to the decoder
+    for (int flip = 0; flip < 2; ++flip)
+    {
+        stbi_set_flip_vertically_on_load_thread(flip);
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < decodes; ++i)
+            stbi_image_free(stbi_load(filename, &width, &height, &channels, 4));
+        double milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / decodes;
+
+        cout << "BENCH flip method=" << (flip ? "stbi-flip-on-load" : "stbi-decode-only")
+            << " image=" << width << "x" << height << " ms=" << milliseconds << endl;
+    }
+    stbi_set_flip_vertically_on_load_thread(0);
+
+    // The former in-place pass: swaps the rows one byte at a time
+    start = chrono::steady_clock::now();
+    for (int n = 0; n < flips; ++n)
+    {
+        for (int j = 0; j < height / 2; ++j)
+        {
+            unsigned char* row1 = image + j * rowSize;
+            unsigned char* row2 = image + (height - 1 - j) * rowSize;
+            for (size_t i = 0; i < rowSize; ++i)
+            {
+                unsigned char tmp = row1[i];
+                row1[i] = row2[i];
+                row2[i] = tmp;
+            }
+        }
+    }
+    cout << "BENCH flip method=byte-swap-in-place ms=" << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / flips << endl;
+
+    // In place, whole rows swapped through a reusable scratch row
+    start = chrono::steady_clock::now();
+    for (int n = 0; n < flips; ++n)
+    {
+        for (int j = 0; j < height / 2; ++j)
+        {
+            unsigned char* row1 = image + j * rowSize;
+            unsigned char* row2 = image + (height - 1 - j) * rowSize;
+            memcpy(scratch.data(), row1, rowSize);
+            memcpy(row1, row2, rowSize);
+            memcpy(row2, scratch.data(), rowSize);
+        }
+    }
+    cout << "BENCH flip method=row-swap-in-place ms=" << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / flips << endl;
+
+    // The loader copies every image to its upload buffer anyway: a straight copy against a flipped one
+    start = chrono::steady_clock::now();
+    for (int n = 0; n < flips; ++n)
+        memcpy(destination.data(), image, imageSize);
+    cout << "BENCH flip method=copy-unflipped ms=" << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / flips << endl;
+
+    start = chrono::steady_clock::now();
+    for (int n = 0; n < flips; ++n)
+        copyImageFlipped(image, width, height, 4, destination.data());
+    cout << "BENCH flip method=copy-flipped ms=" << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / flips << endl;
+
+    stbi_image_free(image);
+}
+
+
+// Compresses every material to the given block format with its mip chain and writes it next to the source image.
+// Materials are resampled to the array layer size so both material paths can use the baked files.
+void UBakeTextures(const string& format)
+{
+    uint32_t blockFormat;
+    if (format == "bc1")
+        blockFormat = TEXTURE_BC1;
+    else if (format == "bc3")
+        blockFormat = TEXTURE_BC3;
+    else if (format == "bc7")
+        blockFormat = TEXTURE_BC7;
+    else
+    {
+        cout << "Unknown texture format " << format << " (expected bc1, bc3 or bc7)" << endl;
+        return;
+    }
+
+    vector<unsigned char> layer((size_t)MATERIAL_LAYER_SIZE * MATERIAL_LAYER_SIZE * 4);
+    vector<unsigned char> data;
+
+    for (size_t i = 0; i < gMaterials.filenames.size(); ++i)
+    {
+        const string& filename = gMaterials.filenames[i];
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+        int width, height, channels;
+        unsigned char* image = stbi_load(filename.c_str(), &width, &height, &channels, 4);
+        if (!image)
+        {
+            cout << "Failed to load texture " << filename << endl;
+            continue;
+        }
+
+        resizeImage(image, width, height, layer.data(), MATERIAL_LAYER_SIZE, MATERIAL_LAYER_SIZE, true);
+        stbi_image_free(image);
+
+        if (blockFormat == TEXTURE_BC1 && imageHasAlpha(layer.data(), (size_t)MATERIAL_LAYER_SIZE * MATERIAL_LAYER_SIZE))
+            cout << "WARNING: " << filename << " has transparent pixels, BC1 drops its alpha" << endl;
+
+        CompressedTextureHeader header;
+        compressTexture(layer.data(), MATERIAL_LAYER_SIZE, MATERIAL_LAYER_SIZE, blockFormat, header, data);
+
+        const string path = UBakedTexturePath(filename);
+        if (!writeCompressedTexture(path.c_str(), header, data))
+        {
+            cout << "Failed to write " << path << endl;
+            continue;
+        }
+
+        cout << "INFO: Baked " << path << ": " << format << ", " << header.levels << " levels, " << data.size() << " bytes in "
+            << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms" << endl;
+    }
+}
+
+
+// Mesh a scene file refers to by name (the name UCreateIndexedMesh logs, or a mesh of one of the scene's
+// model or mesh files), nullptr when unknown
+GLMesh* UFindMesh(const string& name)
+{
+    struct NamedMesh
+    {
+        const char* name;
+        GLMesh* mesh;
+    };
+    const NamedMesh meshes[] = {
+        { "ground", &groundMesh },
+        { "bottle", &bottleMesh },
+        { "cap", &capMesh },
+        { "wiper back", &wiperBack },
+        { "wiper box", &wiperBox },
+        { "screw driver handle", &screwDriverHandle },
+        { "screw driver rod", &screwDriverRod },
+        { "screw driver tip", &screwDriverTip }
+    };
+
+    for (size_t i = 0; i < sizeof(meshes) / sizeof(meshes[0]); ++i)
+    {
+        if (name == meshes[i].name)
+            return meshes[i].mesh;
+    }
+    for (size_t i = 0; i < gImportedMeshes.size(); ++i)
+    {
+        if (name == gImportedMeshes[i].source.name)
+            return &gImportedMeshes[i].mesh;
+    }
+    for (size_t i = 0; i < gFileMeshes.size(); ++i)
+    {
+        if (name == gFileMeshes[i].entry.name)
+            return &gFileMeshes[i].mesh;
+    }
+    return nullptr;
+}
+
+
+// Reads a JSON array of n numbers
+bool UReadVector(const JsonValue* value, int n, float* out)
+{
+    if (!value || value->type != JSON_ARRAY || value->elements.size() != (size_t)n)
+        return false;
+
+    for (int i = 0; i < n; ++i)
+    {
+        if (value->elements[i].type != JSON_NUMBER)
+            return false;
+        out[i] = (float)value->elements[i].number;
+    }
+    return true;
+}
+
+
+// Loads a scene file: imports its model files, maps its mesh files, registers its materials (in file order, each index selects an array
+// layer or bindless handle) and adds its objects. An object's transform is a list of scale, rotate (degrees then axis) and
+// translate steps multiplied in the order listed, so the last one is applied to the vertices first.
+bool ULoadScene(const char* path)
+{
+    JsonValue root;
+    string error;
+    if (!readJsonFile(path, root, error))
+    {
+        cout << "Failed to load scene " << path << ": " << error << endl;
+        return false;
+    }
+
+    const JsonValue* materials = root.find("materials");
+    const JsonValue* objects = root.find("objects");
+    if (!materials || materials->type != JSON_ARRAY || !objects || objects->type != JSON_ARRAY)
+    {
+        cout << "Failed to load scene " << path << ": expected \"materials\" and \"objects\" arrays" << endl;
+        return false;
+    }
+
+    // Optional: OBJ and .glb files whose meshes objects can name like the built-in ones
+    const JsonValue* modelFiles = root.find("modelFiles");
+    if (modelFiles && modelFiles->type != JSON_ARRAY)
+    {
+        cout << "Failed to load scene " << path << ": \"modelFiles\" must be an array" << endl;
+        return false;
+    }
+    for (size_t i = 0; modelFiles && i < modelFiles->elements.size(); ++i)
+    {
+        if (modelFiles->elements[i].type != JSON_STRING || !UImportModelFile(modelFiles->elements[i].string.c_str()))
+        {
+            cout << "Failed to load scene " << path << ": model file " << i << " cannot be imported" << endl;
+            return false;
+        }
+    }
+
+    // Optional: mesh files whose meshes objects can name like the built-in ones
+    const JsonValue* meshFiles = root.find("meshFiles");
+    if (meshFiles && meshFiles->type != JSON_ARRAY)
+    {
+        cout << "Failed to load scene " << path << ": \"meshFiles\" must be an array" << endl;
+        return false;
+    }
+    for (size_t i = 0; meshFiles && i < meshFiles->elements.size(); ++i)
+    {
+        if (meshFiles->elements[i].type != JSON_STRING || !UOpenMeshFile(meshFiles->elements[i].string.c_str()))
+        {
+            cout << "Failed to load scene " << path << ": mesh file " << i << " cannot be opened" << endl;
+            return false;
+        }
+    }
+
+    unordered_map<string, GLuint> materialIds;
+    for (size_t i = 0; i < materials->elements.size(); ++i)
+    {
+        const JsonValue* name = materials->elements[i].find("name");
+        const JsonValue* texture = materials->elements[i].find("texture");
+        if (!name || name->type != JSON_STRING || !texture || texture->type != JSON_STRING)
+        {
+            cout << "Failed to load scene " << path << ": material " << i << " needs a name and a texture" << endl;
+            return false;
+        }
+        materialIds[name->string] = UAddMaterial(texture->string.c_str());
+    }
+
+    for (size_t i = 0; i < objects->elements.size(); ++i)
+    {
+        const JsonValue& object = objects->elements[i];
+        const JsonValue* meshName = object.find("mesh");
+        const JsonValue* materialName = object.find("material");
+
+        GLMesh* mesh = meshName && meshName->type == JSON_STRING ? UFindMesh(meshName->string) : nullptr;
+        unordered_map<string, GLuint>::const_iterator material = materialName && materialName->type == JSON_STRING ?
+            materialIds.find(materialName->string) : materialIds.end();
+        if (!mesh || material == materialIds.end())
+        {
+            cout << "Failed to load scene " << path << ": object " << i << " has an unknown mesh or material" << endl;
+            return false;
+        }
+
+        glm::mat4 model(1.0f);
+        const JsonValue* transform = object.find("transform");
+        if (transform && transform->type != JSON_ARRAY)
+        {
+            cout << "Failed to load scene " << path << ": object " << i << " has a transform that is not an array" << endl;
+            return false;
+        }
+        for (size_t step = 0; transform && step < transform->elements.size(); ++step)
+        {
+            const JsonValue& t = transform->elements[step];
+            float v[4];
+            if (UReadVector(t.find("scale"), 3, v))
+                model = model * glm::scale(glm::vec3(v[0], v[1], v[2]));
+            else if (UReadVector(t.find("rotate"), 4, v))
+                model = model * glm::rotate(glm::radians(v[0]), glm::vec3(v[1], v[2], v[3]));
+            else if (UReadVector(t.find("translate"), 3, v))
+                model = model * glm::translate(glm::vec3(v[0], v[1], v[2]));
+            else
+            {
+                cout << "Failed to load scene " << path << ": object " << i << " has an invalid transform step " << step << endl;
+                return false;
+            }
+        }
+
+        UAddSceneObject(*mesh, material->second, model);
+    }
+
+    cout << "INFO: Loaded scene " << path << ": " << gScene.models.size() << " objects, " << materialIds.size() << " materials" << endl;
+    return true;
+}
+
+
+// Adds one object to the scene; objects sharing a mesh back to back are instanced together
+void UAddSceneObject(GLMesh& mesh, GLuint material, const glm::mat4& model)
+{
+    gScene.meshes.push_back(&mesh);
+    gScene.materials.push_back(material);
+    gScene.models.push_back(model);
+    gScene.sortKeys.push_back(0);
+}
+
+
+// Stores the normal matrix of a model matrix in a draw record. Rotations with a uniform scale keep
+// normals perpendicular, so their upper 3x3 is used as is (the fragment shader normalizes); any other
+// transform needs the inverse-transpose.
+void USetNormalMatrix(GLDrawRecord& record, const glm::mat4& model)
+{
+    const glm::vec3 x(model[0]), y(model[1]), z(model[2]);
+    const float scale = glm::dot(x, x);
+    const float tolerance = 1e-5f * scale;
+
+    bool rigid = fabs(glm::dot(y, y) - scale) <= tolerance && fabs(glm::dot(z, z) - scale) <= tolerance &&
+        fabs(glm::dot(x, y)) <= tolerance && fabs(glm::dot(y, z)) <= tolerance && fabs(glm::dot(z, x)) <= tolerance;
+
+    glm::mat3 normalMatrix = rigid ? glm::mat3(model) : glm::transpose(glm::inverse(glm::mat3(model)));
+    for (int column = 0; column < 3; ++column)
+        record.normalMatrix[column] = glm::vec4(normalMatrix[column], 0.0f);
+}
+
+
+// Repeats the scene on a square grid so the submission benchmark can scale the object count
+void UReplicateScene(int copies)
+{
+    const size_t nObjects = gScene.models.size();
+    const int side = (int)ceil(sqrt((double)copies));
+    const float spacing = 12.0f;
+
+    for (int copy = 1; copy < copies; ++copy)
+    {
+        glm::mat4 offset = glm::translate(glm::vec3(spacing * (copy % side), 0.0f, -spacing * (copy / side)));
+        for (size_t i = 0; i < nObjects; ++i)
+            UAddSceneObject(*gScene.meshes[i], gScene.materials[i], offset * gScene.models[i]);
+    }
+}
+
+
+// Packs the state a draw needs into a key whose order is the cheapest order to issue draws in: programs change
+// least often, then the texture or buffer the material is bound through, then the mesh's VAO. The material
+// index itself is per instance and costs no state change, it only makes the order deterministic.
+uint64_t UDrawSortKey(GLuint program, GLuint materialBinding, GLuint mesh, GLuint material)
+{
+    return ((uint64_t)(program & 0xFFFF) << 48) | ((uint64_t)(materialBinding & 0xFFFF) << 32) |
+        ((uint64_t)(mesh & 0xFFFF) << 16) | (uint64_t)(material & 0xFFFF);
+}
+
+
+// Orders scene object indices by their sort keys
+bool UDrawsBefore(GLuint a, GLuint b)
+{
+    return gScene.sortKeys[a] < gScene.sortKeys[b];
+}
+
+
+// Groups the scene objects into batches and uploads the instance, draw record and indirect command buffers
+void UUploadScene()
+{
+    // Sort the objects so consecutive draws change as little state as possible. Every material is reached
+    // through the same binding, so in practice objects end up grouped by mesh, whatever the scene order.
+    const GLuint materialBinding = gMaterials.bindless ? gMaterials.handleSsbo : gMaterials.arrayTexture;
+    const GLuint nObjects = (GLuint)gScene.models.size();
+    vector<GLuint> order(nObjects);
+    for (GLuint i = 0; i < nObjects; ++i)
+    {
+        gScene.sortKeys[i] = UDrawSortKey(gProgramId, materialBinding, gScene.meshes[i]->vao, gScene.materials[i]);
+        order[i] = i;
+    }
+    stable_sort(order.begin(), order.end(), UDrawsBefore);
+
+    // Apply the order to every array of the scene
+    GLScene sorted;
+    sorted.meshes.resize(nObjects);
+    sorted.materials.resize(nObjects);
+    sorted.models.resize(nObjects);
+    sorted.sortKeys.resize(nObjects);
+    for (GLuint i = 0; i < nObjects; ++i)
+    {
+        sorted.meshes[i] = gScene.meshes[order[i]];
+        sorted.materials[i] = gScene.materials[order[i]];
+        sorted.models[i] = gScene.models[order[i]];
+        sorted.sortKeys[i] = gScene.sortKeys[order[i]];
+    }
+    gScene.meshes.swap(sorted.meshes);
+    gScene.materials.swap(sorted.materials);
+    gScene.models.swap(sorted.models);
+    gScene.sortKeys.swap(sorted.sortKeys);
+
+    gSceneBatches.clear();
+
+    vector<GLDrawRecord> records(nObjects);
+    unordered_map<GLMesh*, vector<GLDrawRecord> > meshInstances;
+    unordered_map<GLMesh*, vector<GLuint> > meshObjects;
+
+    for (GLuint i = 0; i < nObjects; ++i)
+    {
+        GLMesh* mesh = gScene.meshes[i];
+
+        records[i].model = gScene.models[i];
+        USetNormalMatrix(records[i], gScene.models[i]);
+        records[i].material = gScene.materials[i];
+
+        vector<GLDrawRecord>& instances = meshInstances[mesh];
+        if (gSceneBatches.empty() || gSceneBatches.back().mesh != mesh)
+        {
+            GLSceneBatch batch;
+            batch.mesh = mesh;
+            batch.firstObject = i;
+            batch.nObjects = 0;
+            batch.baseInstance = (GLuint)instances.size();
+            batch.lod = 0;
+            gSceneBatches.push_back(batch);
+        }
+        ++gSceneBatches.back().nObjects;
+        instances.push_back(records[i]);
+        meshObjects[mesh].push_back(i);
+    }
+
+    // Per-object path: every instance of a mesh lives in that mesh's instance buffer, and its
+    // model-view-projection matrices in that mesh's range of the per-frame buffer
+    gInstanceObjects.clear();
+    for (unordered_map<GLMesh*, vector<GLDrawRecord> >::iterator it = meshInstances.begin(); it != meshInstances.end(); ++it)
+    {
+        GLMesh& mesh = *it->first;
+        USetMeshInstances(mesh, it->second.data(), (GLuint)it->second.size());
+
+        mesh.firstInstance = (GLuint)gInstanceObjects.size();
+        gInstanceObjects.insert(gInstanceObjects.end(), meshObjects[&mesh].begin(), meshObjects[&mesh].end());
+        USetMvpAttribute(mesh.vao, 11, mesh.firstInstance);
+        USetMvpAttribute(mesh.depthVao, 1, mesh.firstInstance);
+    }
+    USetMvpAttribute(gMeshArena.vao, 4, 0);
+    USetMvpAttribute(gMeshArena.depthVao, 1, 0);
+
+    gObjectInstances.resize(nObjects);
+    for (GLuint i = 0; i < gInstanceObjects.size(); ++i)
+        gObjectInstances[gInstanceObjects[i]] = i;
+
+    // World-space box of every object for the frustum test and the hierarchy over them
+    resizeCullBounds(gSceneBounds, nObjects);
+    gObjectVisible.assign(nObjects, 1);
+    gObjectLods.assign(nObjects, 0);
+    gObjectLodScale.resize(nObjects);
+    for (GLuint i = 0; i < nObjects; ++i)
+    {
+        glm::vec3 center, extent;
+        UComputeObjectBounds(i, center, extent);
+        setCullBounds(gSceneBounds, i, glm::value_ptr(center), glm::value_ptr(extent));
+        gObjectLodScale[i] = UModelScale(gScene.models[i]);
+    }
+    gSceneBvh.Build(gSceneBounds);
+    gVisibleBatches = gSceneBatches;
+    gVisibleCount = nObjects;
+    gCulledCount = 0;
+
+    glBindBuffer(GL_ARRAY_BUFFER, gMeshArena.objectIndexVbo);
+    glBufferData(GL_ARRAY_BUFFER, gInstanceObjects.size() * sizeof(GLuint), gInstanceObjects.data(), GL_STATIC_DRAW);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, gMeshArena.recordSsbo);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, records.size() * sizeof(GLDrawRecord), records.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    UUploadOcclusionScene();
+
+    cout << "INFO: Scene: " << nObjects << " objects in " << gSceneBatches.size() << " batches, " << gMaterials.filenames.size() << " materials" << endl;
+}
+
+
+// World-space box of a scene object: the mesh box's center moves with the model matrix, its half extent grows
+// to enclose the rotated box
+void UComputeObjectBounds(GLuint object, glm::vec3& center, glm::vec3& extent)
+{
+    const glm::mat4& model = gScene.models[object];
+    const GLMesh& mesh = *gScene.meshes[object];
+    const glm::vec3 halfExtent = (mesh.boundsMax - mesh.boundsMin) * 0.5f;
+
+    center = glm::vec3(model * glm::vec4((mesh.boundsMin + mesh.boundsMax) * 0.5f, 1.0f));
+    extent = glm::abs(glm::vec3(model[0])) * halfExtent.x + glm::abs(glm::vec3(model[1])) * halfExtent.y +
+        glm::abs(glm::vec3(model[2])) * halfExtent.z;
+}
+
+
+// Moves one object after the scene was uploaded: rewrites its draw record in both paths' buffers and its box,
+// and refits the hierarchy along the path to its leaf (and the occlusion path's copy of the box)
+void USetObjectModel(GLuint object, const glm::mat4& model)
+{
+    gScene.models[object] = model;
+
+    GLDrawRecord record;
+    record.model = model;
+    USetNormalMatrix(record, model);
+    record.material = gScene.materials[object];
+
+    const GLMesh& mesh = *gScene.meshes[object];
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.instanceVbo);
+    glBufferSubData(GL_ARRAY_BUFFER, (gObjectInstances[object] - mesh.firstInstance) * sizeof(GLDrawRecord), sizeof(GLDrawRecord), &record);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, gMeshArena.recordSsbo);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, object * sizeof(GLDrawRecord), sizeof(GLDrawRecord), &record);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glm::vec3 center, extent;
+    UComputeObjectBounds(object, center, extent);
+    setCullBounds(gSceneBounds, object, glm::value_ptr(center), glm::value_ptr(extent));
+    gSceneBvh.Refit(object, glm::value_ptr(center), glm::value_ptr(extent));
+    gObjectLodScale[object] = UModelScale(model);
+
+    const glm::vec4 bounds[2] = { glm::vec4(center, 0.0f), glm::vec4(extent, 0.0f) };
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, gOcclusion.boundsSsbo);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, object * sizeof(bounds), sizeof(bounds), bounds);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+
+// Tests every object against the view frustum (through the hierarchy for large scenes), picks the level of detail
+// of the visible ones and splits each batch into runs of consecutive visible objects drawn at the same level
+void UCullScene(const glm::mat4& viewProjection)
+{
+    if (!gFrustumCulling && !gLodSelection)
+    {
+        gVisibleBatches = gSceneBatches;
+        return;
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    if (gFrustumCulling)
+    {
+        Frustum frustum;
+        extractFrustum(glm::value_ptr(viewProjection), frustum);
+        gVisibleCount = gSceneBounds.count >= BVH_CULL_MIN_OBJECTS ? gSceneBvh.Cull(frustum, gObjectVisible.data()) :
+            cullBounds(frustum, gSceneBounds, gObjectVisible.data());
+        gCulledCount = gSceneBounds.count - gVisibleCount;
+    }
+
+    // Screen pixels covered by one world unit: one unit away for the perspective projection (the level selection
+    // divides by each object's distance), anywhere for the orthographic one
+    const float pixelsPerUnit = cameraMode == 2 ? WINDOW_HEIGHT / 3.0f :
+        0.5f * WINDOW_HEIGHT / tan(glm::radians(gCamera.Zoom) * 0.5f);
+
+    // The instances of a run are consecutive in the mesh's instance buffer, so each run is still one instanced draw
+    gVisibleBatches.clear();
+    for (size_t i = 0; i < gSceneBatches.size(); ++i)
+    {
+        const GLSceneBatch& batch = gSceneBatches[i];
+        for (GLuint object = 0; object < batch.nObjects; ++object)
+        {
+            if (!gObjectVisible[batch.firstObject + object])
+                continue;
+
+            const GLuint lod = USelectLod(batch.firstObject + object, pixelsPerUnit);
+            if (!gVisibleBatches.empty() && gVisibleBatches.back().mesh == batch.mesh && gVisibleBatches.back().lod == lod &&
+                gVisibleBatches.back().firstObject + gVisibleBatches.back().nObjects == batch.firstObject + object)
+            {
+                ++gVisibleBatches.back().nObjects;
+                continue;
+            }
+
+            GLSceneBatch run;
+            run.mesh = batch.mesh;
+            run.firstObject = batch.firstObject + object;
+            run.nObjects = 1;
+            run.baseInstance = batch.baseInstance + object;
+            run.lod = lod;
+            gVisibleBatches.push_back(run);
+        }
+    }
+
+    gCullMicroseconds = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+}
+
+
+// Coarsest level of an object whose error projects under gLodErrorPixels, measured from the nearest point of the
+// object's bounding sphere. Finer levels are taken as soon as they are needed, coarser ones only past the hysteresis.
+GLuint USelectLod(GLuint object, float pixelsPerUnit)
+{
+    const GLMesh& mesh = *gScene.meshes[object];
+    if (!gLodSelection || mesh.nLods < 2)
+    {
+        gObjectLods[object] = 0;
+        return 0;
+    }
+
+    float pixels = pixelsPerUnit * gObjectLodScale[object];
+    if (cameraMode != 2)
+    {
+        const glm::vec3 center(gSceneBounds.centerX[object], gSceneBounds.centerY[object], gSceneBounds.centerZ[object]);
+        const glm::vec3 extent(gSceneBounds.extentX[object], gSceneBounds.extentY[object], gSceneBounds.extentZ[object]);
+        pixels /= max(glm::length(center - gCamera.Position) - glm::length(extent), 0.1f);
+    }
+
+    GLuint lod = 0;
+    while (lod + 1 < mesh.nLods && mesh.lods[lod + 1].error * pixels <= gLodErrorPixels)
+        ++lod;
+    while (lod > gObjectLods[object] && mesh.lods[lod].error * pixels > gLodErrorPixels * LOD_HYSTERESIS)
+        --lod;
+
+    gObjectLods[object] = (unsigned char)lod;
+    return lod;
+}
 
-    // Strides between vertex coordinates is 6 (x, y, z, r, g, b, a). A tightly packed stride is 0.
-    GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);// The number of floats before each
 
-    // Create Vertex Attribute Pointers
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
+// Longest of the three axes of a model matrix: how much it can stretch an object-space distance
+float UModelScale(const glm::mat4& model)
+{
+    return max(glm::length(glm::vec3(model[0])), max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+}
 
-    glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-    glEnableVertexAttribArray(1);
+void UCreateMeshBottle(GLMesh& mesh)
+{
+    mesh.section = "bottle";
+    UCreateMeshShape(mesh, MESH_CYLINDER, MESH_ROUND_SEGMENTS, 1, "bottle");
+}
 
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
-    glEnableVertexAttribArray(2);
+
+// The bottle's cylinder with 6 x subdivisions slices and subdivisions rings up its side, for the vertex benchmark
+void UCreateMeshBottleTessellated(GLMesh& mesh, int subdivisions)
+{
+    mesh.section = "bottle";
+    UCreateMeshShape(mesh, MESH_CYLINDER, 6 * subdivisions, subdivisions, "bottle (tessellated)");
+}
+
+void UCreateMeshCap(GLMesh& mesh)
+{
+    mesh.section = "cap";
+    UCreateMeshShape(mesh, MESH_CYLINDER, MESH_ROUND_SEGMENTS, 1, "cap");
 }
 
 void UCreateMeshGround(GLMesh& mesh)
@@ -921,32 +3194,9 @@ void UCreateMeshGround(GLMesh& mesh)
         -5.0f,0.0f, 5.0f,    0.0f,  1.0f,  0.0f,  0.0f,  1.0f  // Top Left Vertex 3
     };
 
-    const GLuint floatsPerVertex = 3;
-    const GLuint floatsPerNormal = 3;
-    const GLuint floatsPerUV = 2;
-
-    mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-
-    glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.vao);
-
-    // Create 2 buffers: first one for the vertex data; second one for the indices
-    glGenBuffers(1, &mesh.vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-    // Strides between vertex coordinates is 6 (x, y, z, r, g, b, a). A tightly packed stride is 0.
-    GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);// The number of floats before each
-
-    // Create Vertex Attribute Pointers
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
-
-    glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-    glEnableVertexAttribArray(1);
-
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
-    glEnableVertexAttribArray(2);
+    // Weld duplicate vertices and upload them with an element buffer
+    mesh.section = "ground";
+    UCreateIndexedMesh(mesh, verts, sizeof(verts) / sizeof(verts[0]), "ground");
 }
 
 void UCreateMeshWiperBack(GLMesh& mesh)
@@ -963,32 +3213,9 @@ void UCreateMeshWiperBack(GLMesh& mesh)
         -0.5f, 0.0f, 1.0f,    0.0f,  1.0f,  0.0f,  0.0f,  1.0f  // Top Left Vertex 3
     };
 
-    const GLuint floatsPerVertex = 3;
-    const GLuint floatsPerNormal = 3;
-    const GLuint floatsPerUV = 2;
-
-    mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-
-    glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.vao);
-
-    // Create 2 buffers: first one for the vertex data; second one for the indices
-    glGenBuffers(1, &mesh.vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-    // Strides between vertex coordinates is 6 (x, y, z, r, g, b, a). A tightly packed stride is 0.
-    GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);// The number of floats before each
-
-    // Create Vertex Attribute Pointers
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
-
-    glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-    glEnableVertexAttribArray(1);
-
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
-    glEnableVertexAttribArray(2);
+    // Weld duplicate vertices and upload them with an element buffer
+    mesh.section = "wipers";
+    UCreateIndexedMesh(mesh, verts, sizeof(verts) / sizeof(verts[0]), "wiper back");
 }
 
 void UCreateMeshWiperBox(GLMesh& mesh)
@@ -1041,99 +3268,183 @@ void UCreateMeshWiperBox(GLMesh& mesh)
 
     };
 
+    // Weld duplicate vertices and upload them with an element buffer
+    mesh.section = "wipers";
+    UCreateIndexedMesh(mesh, verts, sizeof(verts) / sizeof(verts[0]), "wiper box");
+}
+
+void UCreateMeshScrewDriverHandle(GLMesh& mesh)
+{
+    mesh.section = "screwdriver";
+    UCreateMeshShape(mesh, MESH_CAPSULE, MESH_ROUND_SEGMENTS, MESH_ROUND_SEGMENTS / 4, "screw driver handle");
+}
+
+void UCreateMeshScrewDriverRod(GLMesh& mesh)
+{
+    mesh.section = "screwdriver";
+    UCreateMeshShape(mesh, MESH_CYLINDER, MESH_ROUND_SEGMENTS / 2, 1, "screw driver rod");
+}
+
+void UCreateMeshScrewDriverTip(GLMesh& mesh)
+{
+    mesh.section = "screwdriver";
+    UCreateMeshShape(mesh, MESH_CONE, MESH_ROUND_SEGMENTS, 1, "screw driver tip");
+}
+
+// Generates a unit shape and its levels of detail straight into their final vertex and index buffers and uploads
+// them. Each level halves the tessellation of the one before, down to 4 slices; exact shapes (boxes) get one level.
+// The shape is moved into the box the scene's transforms were written for: x and y from -0.5 to 0.5, z from 0 to -1.
+void UCreateMeshShape(GLMesh& mesh, MeshShape shape, int segments, int rings, const char* name)
+{
+    const int minRings = shape == MESH_TORUS ? 3 : 1;
+    int levelSegments[MESH_MAX_LODS];
+    int levelRings[MESH_MAX_LODS];
+    GLuint nLods = 0;
+    MeshSize size = { 0, 0 };
+    do
+    {
+        levelSegments[nLods] = segments >> nLods;
+        levelRings[nLods] = max(rings >> nLods, minRings);
+        const MeshSize levelSize = meshShapeSize(shape, levelSegments[nLods], levelRings[nLods]);
+        size.vertices += levelSize.vertices;
+        size.indices += levelSize.indices;
+        ++nLods;
+    } while (nLods < MESH_MAX_LODS && (segments >> nLods) >= 4 &&
+        meshShapeError(shape, levelSegments[nLods - 1], levelRings[nLods - 1]) > 0.0f);
+
+    vector<GLfloat> vertices(size.vertices * MESH_VERTEX_FLOATS);
+    vector<uint32_t> indices(size.indices);
+
+    GLMeshLod lods[MESH_MAX_LODS];
+    MeshWriter writer = meshWriter(vertices.data(), indices.data());
+    for (GLuint level = 0; level < nLods; ++level)
+    {
+        lods[level].firstIndex = (GLuint)(writer.indices - indices.data());
+        generateMeshShape(writer, shape, levelSegments[level], levelRings[level]);
+        lods[level].nIndices = (GLuint)(writer.indices - indices.data()) - lods[level].firstIndex;
+        lods[level].error = meshShapeError(shape, levelSegments[level], levelRings[level]);
+    }
+    translateMeshVertices(vertices.data(), size.vertices, 0.0f, 0.0f, -0.5f);
+
+    cout << "INFO: Mesh " << name << ": generated " << size.vertices << " vertices, " << size.indices << " indices in " << nLods << " levels" << endl;
+    UUploadIndexedMesh(mesh, vertices, indices, lods, nLods, name);
+}
+
+// Welds an interleaved position/normal/UV triangle list and uploads it as an indexed mesh
+void UCreateIndexedMesh(GLMesh& mesh, const GLfloat* verts, size_t nFloats, const char* name)
+{
     const GLuint floatsPerVertex = 3;
     const GLuint floatsPerNormal = 3;
     const GLuint floatsPerUV = 2;
 
-    mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
+    const size_t nInputVertices = nFloats / (floatsPerVertex + floatsPerNormal + floatsPerUV);
 
-    glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.vao);
+    vector<GLfloat> vertices;
+    vector<uint32_t> indices;
+    weldVertices(verts, nInputVertices, vertices, indices);
 
-    // Create 2 buffers: first one for the vertex data; second one for the indices
-    glGenBuffers(1, &mesh.vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
+    cout << "INFO: Mesh " << name << ": " << nInputVertices << " -> " << vertices.size() / (floatsPerVertex + floatsPerNormal + floatsPerUV) << " vertices, " << indices.size() << " indices" << endl;
 
-    // Strides between vertex coordinates is 6 (x, y, z, r, g, b, a). A tightly packed stride is 0.
-    GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);// The number of floats before each
+    const GLMeshLod lod = { 0, (GLuint)indices.size(), 0.0f };
+    UUploadIndexedMesh(mesh, vertices, indices, &lod, 1, name);
+}
 
-    // Create Vertex Attribute Pointers
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
 
-    glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-    glEnableVertexAttribArray(1);
+// Uploads interleaved position/normal/UV vertices and their triangle indices, reordering both first unless
+// --no-mesh-opt. The vectors are optimized in place. Every level of detail is a range of the indices, finest
+// first; triangles are only reordered within their level.
+void UUploadIndexedMesh(GLMesh& mesh, vector<GLfloat>& vertices, vector<uint32_t>& indices, const GLMeshLod* lods, GLuint nLods, const char* name)
+{
+    const GLuint floatsPerVertex = 3;
+    const GLuint floatsPerNormal = 3;
+    const GLuint floatsPerUV = 2;
 
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
-    glEnableVertexAttribArray(2);
-}
+    mesh.nVertices = (GLuint)(vertices.size() / (floatsPerVertex + floatsPerNormal + floatsPerUV));
+    mesh.nIndices = lods[0].nIndices;
+    mesh.nLods = nLods;
+    for (GLuint level = 0; level < nLods; ++level)
+        mesh.lods[level] = lods[level];
 
-void UCreateMeshScrewDriverHandle(GLMesh& mesh)
-{
+    // Reorder triangles for the post-transform cache and overdraw, then vertices for fetch locality
+    if (gOptimizeMeshes)
+    {
+        float acmrBefore = computeACMR(indices, mesh.nVertices);
 
-    // Position and texture data
-    GLfloat verts[] = {
-        // Vertex Positions   // Normals           // Texture Coordinates    
-         0.5f,  0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  0.0f, 0.0f, // 0 
-         0.5f, -0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  1.0f, 0.0f, // 1  
-        -0.5f,  0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  1.0f, 1.0f, // 3  
-         0.5f, -0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  1.0f, 0.0f, // 1 
-        -0.5f, -0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  0.0f, 1.0f, // 2 
-        -0.5f,  0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  0.0f, 0.0f, // 3 
+        for (GLuint level = 0; level < nLods; ++level)
+        {
+            vector<uint32_t> levelIndices(indices.begin() + lods[level].firstIndex, indices.begin() + lods[level].firstIndex + lods[level].nIndices);
+            vector<uint32_t> clusters;
+            optimizeVertexCache(levelIndices, mesh.nVertices, &clusters);
+            optimizeOverdraw(levelIndices, vertices, clusters);
+            copy(levelIndices.begin(), levelIndices.end(), indices.begin() + lods[level].firstIndex);
+        }
+        optimizeVertexFetch(vertices, indices);
 
-         0.5f,  0.5f, 0.0f,   -1.0f,  0.0f,  0.0f,  0.0f, 0.0f, // 0 
-         0.5f, -0.5f, 0.0f,   -1.0f,  0.0f,  0.0f,  1.0f, 0.0f, // 1 
-         0.5f, -0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  1.0f, 1.0f, // 4 
-         0.5f,  0.5f, 0.0f,   -1.0f,  0.0f,  0.0f,  1.0f, 1.0f, // 0 
-         0.5f, -0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  0.0f, 1.0f, // 4 
-         0.5f,  0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  0.0f, 0.0f, // 5 
+        // Vertices no index uses (a glTF accessor may hold some) were dropped by the fetch reordering
+        mesh.nVertices = (GLuint)(vertices.size() / (floatsPerVertex + floatsPerNormal + floatsPerUV));
 
-         0.5f,  0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  1.0f, 0.0f, // 0 
-         0.5f,  0.5f, -1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 1.0f, // 5 
-        -0.5f,  0.5f, -1.0f,  1.0f,  0.0f,  0.0f,  0.0f, 1.0f, // 6 
-         0.5f,  0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  0.0f, 1.0f, // 0 
-        -0.5f,  0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  0.0f, 0.0f, // 3 
-        -0.5f,  0.5f, -1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f, // 6 
+        cout << "INFO: Mesh " << name << ": ACMR " << acmrBefore << " -> " << computeACMR(indices, mesh.nVertices) << endl;
+    }
 
-         0.5f, -0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  1.0f, 0.0f, // 4 
-         0.5f,  0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  1.0f, 1.0f, // 5 
-        -0.5f,  0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  0.0f, 1.0f, // 6
-         0.5f, -0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  0.0f, 1.0f, // 4 
-        -0.5f,  0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  0.0f, 0.0f, // 6
-        -0.5f, -0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  1.0f, 0.0f, // 7 
+    // Bounding box for frustum culling
+    mesh.boundsMin = mesh.boundsMax = mesh.nVertices > 0 ? glm::vec3(vertices[0], vertices[1], vertices[2]) : glm::vec3(0.0f);
+    for (size_t i = 0; i < vertices.size(); i += floatsPerVertex + floatsPerNormal + floatsPerUV)
+    {
+        const glm::vec3 position(vertices[i], vertices[i + 1], vertices[i + 2]);
+        mesh.boundsMin = glm::min(mesh.boundsMin, position);
+        mesh.boundsMax = glm::max(mesh.boundsMax, position);
+    }
 
-        -0.5f, -0.5f, 0.0f,   0.0f,  1.0f,  0.0f,  0.0f, 1.0f, // 2 
-        -0.5f,  0.5f, 0.0f,   0.0f,  1.0f,  0.0f,  1.0f, 1.0f, // 3 
-        -0.5f,  0.5f, -1.0f,  0.0f,  1.0f,  0.0f,  1.0f, 0.0f, // 6
-        -0.5f, -0.5f, 0.0f,   0.0f,  1.0f,  0.0f,  1.0f, 0.0f, // 2 
-        -0.5f,  0.5f, -1.0f,  0.0f,  1.0f,  0.0f,  0.0f, 0.0f, // 6
-        -0.5f, -0.5f, -1.0f,  0.0f,  1.0f,  0.0f,  0.0f, 1.0f, // 7
+    // Create 2 buffers: first one for the vertex data; second one for the indices
+    glGenBuffers(1, &mesh.vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo); // Activates the buffer
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
 
-         0.5f, -0.5f, 0.0f,   0.0f,  1.0f,  0.0f,  0.0f, 1.0f, // 1
-         0.5f, -0.5f, -1.0f,  0.0f,  1.0f,  0.0f,  1.0f, 1.0f, // 4
-        -0.5f, -0.5f, -1.0f,  0.0f,  1.0f,  0.0f,  1.0f, 0.0f, // 7 
-         0.5f, -0.5f, 0.0f,   0.0f,  1.0f,  0.0f,  1.0f, 0.0f, // 1
-        -0.5f, -0.5f, 0.0f,   0.0f,  1.0f,  0.0f,  0.0f, 0.0f, // 2
-        -0.5f, -0.5f, -1.0f,  0.0f,  1.0f,  0.0f,  0.0f, 1.0f, // 7 
+    // Use 16-bit indices whenever every vertex can be addressed with them. No vertex array is bound yet, so the
+    // element buffer is filled through the copy target.
+    glGenBuffers(1, &mesh.ebo);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, mesh.ebo);
+    if (mesh.nVertices <= 0x10000)
+    {
+        vector<GLushort> shortIndices(indices.begin(), indices.end());
+        mesh.indexType = GL_UNSIGNED_SHORT;
+        glBufferData(GL_COPY_WRITE_BUFFER, shortIndices.size() * sizeof(GLushort), shortIndices.data(), GL_STATIC_DRAW);
+    }
+    else
+    {
+        mesh.indexType = GL_UNSIGNED_INT;
+        glBufferData(GL_COPY_WRITE_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+    }
 
-    };
+    // Depth pre-pass: 3 of the 8 floats of each vertex, over the same indices
+    glGenBuffers(1, &mesh.positionVbo);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.positionVbo);
+    glBufferData(GL_ARRAY_BUFFER, mesh.nVertices * 3 * sizeof(GLfloat), NULL, GL_STATIC_DRAW);
+    UUploadPositions(vertices.data(), mesh.nVertices, 0);
+
+    // Sub-allocate the mesh in the shared arena; its indices stay local and are offset by baseVertex
+    mesh.baseVertex = (GLint)(gMeshArena.vertices.size() / (floatsPerVertex + floatsPerNormal + floatsPerUV));
+    mesh.firstIndex = (GLuint)gMeshArena.indices.size();
+    gMeshArena.vertices.insert(gMeshArena.vertices.end(), vertices.begin(), vertices.end());
+    gMeshArena.indices.insert(gMeshArena.indices.end(), indices.begin(), indices.end());
+
+    USetMeshVertexArrays(mesh);
+}
 
+
+// Describes a mesh's vertex, element, position and new instance buffers with its two vertex arrays
+void USetMeshVertexArrays(GLMesh& mesh)
+{
     const GLuint floatsPerVertex = 3;
     const GLuint floatsPerNormal = 3;
     const GLuint floatsPerUV = 2;
 
-    mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-
     glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
     glBindVertexArray(mesh.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
 
-    // Create 2 buffers: first one for the vertex data; second one for the indices
-    glGenBuffers(1, &mesh.vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-    // Strides between vertex coordinates is 6 (x, y, z, r, g, b, a). A tightly packed stride is 0.
+    // Strides between vertex coordinates is 8 (x, y, z, nx, ny, nz, u, v). A tightly packed stride is 0.
     GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);// The number of floats before each
 
     // Create Vertex Attribute Pointers
@@ -1145,154 +3456,270 @@ void UCreateMeshScrewDriverHandle(GLMesh& mesh)
 
     glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
     glEnableVertexAttribArray(2);
+
+    // Per-instance draw record: the mat4 takes four vec4 attribute slots, the material one more and the normal matrix
+    // three vec3 slots read from its padded columns, all advancing once per instance
+    glGenBuffers(1, &mesh.instanceVbo);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.instanceVbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLDrawRecord), NULL, GL_DYNAMIC_DRAW);
+    mesh.nInstances = 0;
+
+    for (GLuint column = 0; column < 4; ++column)
+    {
+        glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(GLDrawRecord), (void*)(sizeof(glm::vec4) * column));
+        glEnableVertexAttribArray(3 + column);
+        glVertexAttribDivisor(3 + column, 1);
+    }
+
+    glVertexAttribIPointer(7, 1, GL_UNSIGNED_INT, sizeof(GLDrawRecord), (void*)offsetof(GLDrawRecord, material));
+    glEnableVertexAttribArray(7);
+    glVertexAttribDivisor(7, 1);
+
+    for (GLuint column = 0; column < 3; ++column)
+    {
+        glVertexAttribPointer(8 + column, 3, GL_FLOAT, GL_FALSE, sizeof(GLDrawRecord), (void*)(offsetof(GLDrawRecord, normalMatrix) + sizeof(glm::vec4) * column));
+        glEnableVertexAttribArray(8 + column);
+        glVertexAttribDivisor(8 + column, 1);
+    }
+
+    // Depth pre-pass: the position-only buffer over the same indices
+    glGenVertexArrays(1, &mesh.depthVao);
+    glBindVertexArray(mesh.depthVao);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.positionVbo);
+    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, 0, 0);
+    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
+
+    glBindVertexArray(0);
 }
 
-void UCreateMeshScrewDriverRod(GLMesh& mesh)
+
+// Creates a mesh of a mapped mesh file. The file holds the vertices, positions and indices exactly as the GL
+// takes them, so each buffer's immutable store is filled straight from the mapping, without a parse or a copy.
+void UCreateFileMesh(GLMesh& mesh, const unsigned char* file, const MeshFileMesh& entry)
 {
+    const MeshFileHeader& header = *meshFileHeader(file);
 
-    // Position and texture data
-    GLfloat verts[] = {
-        // Vertex Positions   // Normals           // Texture Coordinates    
-         0.5f,  0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  0.0f, 0.0f, // 0 
-         0.5f, -0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  1.0f, 0.0f, // 1  
-        -0.5f,  0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  1.0f, 1.0f, // 3  
-         0.5f, -0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  1.0f, 0.0f, // 1 
-        -0.5f, -0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  0.0f, 1.0f, // 2 
-        -0.5f,  0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  0.0f, 0.0f, // 3 
+    mesh.nVertices = entry.vertexCount;
+    mesh.nIndices = entry.lods[0].indexCount;
+    mesh.nLods = entry.lodCount;
+    for (GLuint level = 0; level < entry.lodCount; ++level)
+    {
+        mesh.lods[level].firstIndex = entry.lods[level].firstIndex;
+        mesh.lods[level].nIndices = entry.lods[level].indexCount;
+        mesh.lods[level].error = entry.lods[level].error;
+    }
+    mesh.boundsMin = glm::vec3(entry.boundsMin[0], entry.boundsMin[1], entry.boundsMin[2]);
+    mesh.boundsMax = glm::vec3(entry.boundsMax[0], entry.boundsMax[1], entry.boundsMax[2]);
+    mesh.indexType = GL_UNSIGNED_INT;
 
-         0.5f,  0.5f, 0.0f,   -1.0f,  0.0f,  0.0f,  0.0f, 0.0f, // 0 
-         0.5f, -0.5f, 0.0f,   -1.0f,  0.0f,  0.0f,  1.0f, 0.0f, // 1 
-         0.5f, -0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  1.0f, 1.0f, // 4 
-         0.5f,  0.5f, 0.0f,   -1.0f,  0.0f,  0.0f,  1.0f, 1.0f, // 0 
-         0.5f, -0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  0.0f, 1.0f, // 4 
-         0.5f,  0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  0.0f, 0.0f, // 5 
+    glGenBuffers(1, &mesh.vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+    glBufferStorage(GL_ARRAY_BUFFER, (GLsizeiptr)entry.vertexCount * header.vertexStride,
+        file + header.vertexOffset + (size_t)entry.firstVertex * header.vertexStride, 0);
 
-         0.5f,  0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  1.0f, 0.0f, // 0 
-         0.5f,  0.5f, -1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 1.0f, // 5 
-        -0.5f,  0.5f, -1.0f,  1.0f,  0.0f,  0.0f,  0.0f, 1.0f, // 6 
-         0.5f,  0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  0.0f, 1.0f, // 0 
-        -0.5f,  0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  0.0f, 0.0f, // 3 
-        -0.5f,  0.5f, -1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f, // 6 
+    glGenBuffers(1, &mesh.positionVbo);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.positionVbo);
+    glBufferStorage(GL_ARRAY_BUFFER, (GLsizeiptr)entry.vertexCount * 3 * sizeof(GLfloat),
+        file + header.positionOffset + (size_t)entry.firstVertex * 3 * sizeof(GLfloat), 0);
 
-         0.5f, -0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  1.0f, 0.0f, // 4 
-         0.5f,  0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  1.0f, 1.0f, // 5 
-        -0.5f,  0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  0.0f, 1.0f, // 6
-         0.5f, -0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  0.0f, 1.0f, // 4 
-        -0.5f,  0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  0.0f, 0.0f, // 6
-        -0.5f, -0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  1.0f, 0.0f, // 7 
+    glGenBuffers(1, &mesh.ebo);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, mesh.ebo);
+    glBufferStorage(GL_COPY_WRITE_BUFFER, (GLsizeiptr)entry.indexCount * sizeof(GLuint),
+        file + header.indexOffset + (size_t)entry.firstIndex * sizeof(GLuint), 0);
 
-        -0.5f, -0.5f, 0.0f,   0.0f,  1.0f,  0.0f,  0.0f, 1.0f, // 2 
-        -0.5f,  0.5f, 0.0f,   0.0f,  1.0f,  0.0f,  1.0f, 1.0f, // 3 
-        -0.5f,  0.5f, -1.0f,  0.0f,  1.0f,  0.0f,  1.0f, 0.0f, // 6
-        -0.5f, -0.5f, 0.0f,   0.0f,  1.0f,  0.0f,  1.0f, 0.0f, // 2 
-        -0.5f,  0.5f, -1.0f,  0.0f,  1.0f,  0.0f,  0.0f, 0.0f, // 6
-        -0.5f, -0.5f, -1.0f,  0.0f,  1.0f,  0.0f,  0.0f, 1.0f, // 7
+    USetMeshVertexArrays(mesh);
+}
 
-         0.5f, -0.5f, 0.0f,   0.0f,  1.0f,  0.0f,  0.0f, 1.0f, // 1
-         0.5f, -0.5f, -1.0f,  0.0f,  1.0f,  0.0f,  1.0f, 1.0f, // 4
-        -0.5f, -0.5f, -1.0f,  0.0f,  1.0f,  0.0f,  1.0f, 0.0f, // 7 
-         0.5f, -0.5f, 0.0f,   0.0f,  1.0f,  0.0f,  1.0f, 0.0f, // 1
-        -0.5f, -0.5f, 0.0f,   0.0f,  1.0f,  0.0f,  0.0f, 0.0f, // 2
-        -0.5f, -0.5f, -1.0f,  0.0f,  1.0f,  0.0f,  0.0f, 1.0f, // 7 
 
-    };
+// Imports the meshes of an OBJ or .glb file for the scene; they are uploaded once there is a GL context
+bool UImportModelFile(const char* path)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    vector<ImportedMesh> meshes;
+    if (!importMeshes(path, meshes))
+        return false;
 
-    const GLuint floatsPerVertex = 3;
-    const GLuint floatsPerNormal = 3;
-    const GLuint floatsPerUV = 2;
+    size_t triangles = 0;
+    for (size_t i = 0; i < meshes.size(); ++i)
+    {
+        triangles += meshes[i].indices.size() / 3;
+        gImportedMeshes.push_back(GLImportedMesh());
+        gImportedMeshes.back().source.name = meshes[i].name;
+        gImportedMeshes.back().source.vertices.swap(meshes[i].vertices);
+        gImportedMeshes.back().source.indices.swap(meshes[i].indices);
+    }
 
-    mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
+    cout << "INFO: Imported " << path << ": " << meshes.size() << " meshes, " << triangles << " triangles in "
+        << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms" << endl;
+    return true;
+}
 
-    glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.vao);
 
-    // Create 2 buffers: first one for the vertex data; second one for the indices
-    glGenBuffers(1, &mesh.vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
+// Uploads the imported meshes like the built-in ones, each a single level of detail
+void UCreateImportedMeshes()
+{
+    for (size_t i = 0; i < gImportedMeshes.size(); ++i)
+    {
+        GLImportedMesh& imported = gImportedMeshes[i];
+        GLMeshLod lod = { 0, (GLuint)imported.source.indices.size(), 0.0f };
+        UUploadIndexedMesh(imported.mesh, imported.source.vertices, imported.source.indices, &lod, 1, imported.source.name.c_str());
+        imported.mesh.section = imported.source.name.c_str();
+
+        vector<float>().swap(imported.source.vertices);
+        vector<uint32_t>().swap(imported.source.indices);
+    }
+}
+
+
+// Maps a mesh file and names its meshes for the scene; their buffers are created once there is a GL context
+bool UOpenMeshFile(const char* path)
+{
+    MeshFileMapping mapping;
+    if (!mapMeshFile(path, mapping))
+        return false;
+    if (!validateMeshFile(mapping.data, mapping.size) || !UMeshFileMatchesLayout(mapping.data))
+    {
+        unmapMeshFile(mapping);
+        return false;
+    }
+
+    gMeshFiles.push_back(mapping);
+    const MeshFileHeader& header = *meshFileHeader(mapping.data);
+    const MeshFileMesh* meshes = meshFileMeshes(mapping.data);
+    for (uint32_t i = 0; i < header.meshCount; ++i)
+    {
+        GLFileMesh fileMesh = {};
+        fileMesh.file = mapping.data;
+        fileMesh.entry = meshes[i];
+        gFileMeshes.push_back(fileMesh);
+    }
 
-    // Strides between vertex coordinates is 6 (x, y, z, r, g, b, a). A tightly packed stride is 0.
-    GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);// The number of floats before each
+    cout << "INFO: Mapped mesh file " << path << ": " << header.meshCount << " meshes, " << mapping.size << " bytes" << endl;
+    return true;
+}
 
-    // Create Vertex Attribute Pointers
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
 
-    glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-    glEnableVertexAttribArray(1);
+// True when a mesh file's vertices are in the layout USetMeshVertexArrays describes
+bool UMeshFileMatchesLayout(const unsigned char* file)
+{
+    const MeshFileHeader& header = *meshFileHeader(file);
+    const MeshFileAttribute* attributes = meshFileAttributes(file);
+    const GLuint components[3] = { 3, 3, 2 };
+    const GLuint offsets[3] = { 0, 3 * sizeof(float), 6 * sizeof(float) };
 
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
-    glEnableVertexAttribArray(2);
+    if (header.vertexStride != 8 * sizeof(float) || header.attributeCount != 3)
+        return false;
+    for (GLuint i = 0; i < 3; ++i)
+    {
+        if (attributes[i].location != i || attributes[i].components != components[i] || attributes[i].offset != offsets[i])
+            return false;
+    }
+    return true;
 }
 
-void UCreateMeshScrewDriverTip(GLMesh& mesh)
-{
 
-    // Position and texture data
-    GLfloat verts[] = {
-        // Vertex Positions   // Normals           // Texture Coordinates    
-         0.5f,  0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  0.0f, 0.0f, // 0 
-         0.5f, -0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  1.0f, 0.0f, // 1  
-        -0.5f,  0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  1.0f, 1.0f, // 3  
-         0.5f, -0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  1.0f, 0.0f, // 1 
-        -0.5f, -0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  0.0f, 1.0f, // 2 
-        -0.5f,  0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  0.0f, 0.0f, // 3 
+// Creates the buffers of every mesh of the scene's mesh files and places them in the arena after the staged meshes
+void UCreateFileMeshes()
+{
+    for (size_t i = 0; i < gFileMeshes.size(); ++i)
+    {
+        GLFileMesh& fileMesh = gFileMeshes[i];
+        UCreateFileMesh(fileMesh.mesh, fileMesh.file, fileMesh.entry);
+        fileMesh.mesh.section = fileMesh.entry.name;   // The copy of the entry outlives the mapping
+
+        const MeshFileHeader& header = *meshFileHeader(fileMesh.file);
+        GLMeshArenaSpan span;
+        span.mesh = &fileMesh.mesh;
+        span.vertices = (const GLfloat*)(fileMesh.file + header.vertexOffset) + (size_t)fileMesh.entry.firstVertex * 8;
+        span.positions = (const GLfloat*)(fileMesh.file + header.positionOffset) + (size_t)fileMesh.entry.firstVertex * 3;
+        span.indices = (const GLuint*)(fileMesh.file + header.indexOffset) + fileMesh.entry.firstIndex;
+        span.nIndices = fileMesh.entry.indexCount;
+        gMeshArena.spans.push_back(span);
+    }
+}
 
-         0.5f,  0.5f, 0.0f,   -1.0f,  0.0f,  0.0f,  0.0f, 0.0f, // 0 
-         0.5f, -0.5f, 0.0f,   -1.0f,  0.0f,  0.0f,  1.0f, 0.0f, // 1 
-         0.5f, -0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  1.0f, 1.0f, // 4 
-         0.5f,  0.5f, 0.0f,   -1.0f,  0.0f,  0.0f,  1.0f, 1.0f, // 0 
-         0.5f, -0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  0.0f, 1.0f, // 4 
-         0.5f,  0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  0.0f, 0.0f, // 5 
 
-         0.5f,  0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  1.0f, 0.0f, // 0 
-         0.5f,  0.5f, -1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 1.0f, // 5 
-        -0.5f,  0.5f, -1.0f,  1.0f,  0.0f,  0.0f,  0.0f, 1.0f, // 6 
-         0.5f,  0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  0.0f, 1.0f, // 0 
-        -0.5f,  0.5f, 0.0f,   1.0f,  0.0f,  0.0f,  0.0f, 0.0f, // 3 
-        -0.5f,  0.5f, -1.0f,  1.0f,  0.0f,  0.0f,  1.0f, 0.0f, // 6 
+// Unmaps the mesh files once the GL holds everything read from them
+void UCloseMeshFiles()
+{
+    for (size_t i = 0; i < gFileMeshes.size(); ++i)
+        gFileMeshes[i].file = 0;
+    for (size_t i = 0; i < gMeshFiles.size(); ++i)
+        unmapMeshFile(gMeshFiles[i]);
+    gMeshFiles.clear();
+    gMeshArena.spans.clear();
+}
 
-         0.5f, -0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  1.0f, 0.0f, // 4 
-         0.5f,  0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  1.0f, 1.0f, // 5 
-        -0.5f,  0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  0.0f, 1.0f, // 6
-         0.5f, -0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  0.0f, 1.0f, // 4 
-        -0.5f,  0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  0.0f, 0.0f, // 6
-        -0.5f, -0.5f, -1.0f,  -1.0f,  0.0f,  0.0f,  1.0f, 0.0f, // 7 
 
-        -0.5f, -0.5f, 0.0f,   0.0f,  1.0f,  0.0f,  0.0f, 1.0f, // 2 
-        -0.5f,  0.5f, 0.0f,   0.0f,  1.0f,  0.0f,  1.0f, 1.0f, // 3 
-        -0.5f,  0.5f, -1.0f,  0.0f,  1.0f,  0.0f,  1.0f, 0.0f, // 6
-        -0.5f, -0.5f, 0.0f,   0.0f,  1.0f,  0.0f,  1.0f, 0.0f, // 2 
-        -0.5f,  0.5f, -1.0f,  0.0f,  1.0f,  0.0f,  0.0f, 0.0f, // 6
-        -0.5f, -0.5f, -1.0f,  0.0f,  1.0f,  0.0f,  0.0f, 1.0f, // 7
+// Copies the positions out of interleaved position/normal/UV vertices into the bound GL_ARRAY_BUFFER, from
+// offset bytes on
+void UUploadPositions(const GLfloat* vertices, size_t nVertices, GLintptr offset)
+{
+    vector<GLfloat> positions(nVertices * 3);
+    for (size_t i = 0; i < nVertices; ++i)
+        memcpy(&positions[i * 3], vertices + i * 8, 3 * sizeof(GLfloat));
+    glBufferSubData(GL_ARRAY_BUFFER, offset, positions.size() * sizeof(GLfloat), positions.data());
+}
 
-         0.5f, -0.5f, 0.0f,   0.0f,  1.0f,  0.0f,  0.0f, 1.0f, // 1
-         0.5f, -0.5f, -1.0f,  0.0f,  1.0f,  0.0f,  1.0f, 1.0f, // 4
-        -0.5f, -0.5f, -1.0f,  0.0f,  1.0f,  0.0f,  1.0f, 0.0f, // 7 
-         0.5f, -0.5f, 0.0f,   0.0f,  1.0f,  0.0f,  1.0f, 0.0f, // 1
-        -0.5f, -0.5f, 0.0f,   0.0f,  1.0f,  0.0f,  0.0f, 0.0f, // 2
-        -0.5f, -0.5f, -1.0f,  0.0f,  1.0f,  0.0f,  0.0f, 1.0f, // 7 
 
-    };
+// Uploads the draw records (model matrix and material) of every instance of a mesh
+void USetMeshInstances(GLMesh& mesh, const GLDrawRecord* instances, GLuint count)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.instanceVbo);
+    // Respecify the whole store so the driver can orphan the copy the GPU may still be reading
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLDrawRecord) * count, instances, GL_DYNAMIC_DRAW);
+    mesh.nInstances = count;
+}
 
+// Uploads the arena staged by UCreateIndexedMesh, followed by the mesh file meshes straight from their mappings,
+// and describes it with a single VAO
+void UBuildMeshArena()
+{
     const GLuint floatsPerVertex = 3;
     const GLuint floatsPerNormal = 3;
     const GLuint floatsPerUV = 2;
+    const GLuint floatsPerArenaVertex = floatsPerVertex + floatsPerNormal + floatsPerUV;
 
-    mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
+    // Place the mesh file meshes after the staged ones
+    const size_t nStagedVertices = gMeshArena.vertices.size() / floatsPerArenaVertex;
+    size_t nArenaVertices = nStagedVertices;
+    size_t nArenaIndices = gMeshArena.indices.size();
+    for (size_t i = 0; i < gMeshArena.spans.size(); ++i)
+    {
+        GLMeshArenaSpan& span = gMeshArena.spans[i];
+        span.mesh->baseVertex = (GLint)nArenaVertices;
+        span.mesh->firstIndex = (GLuint)nArenaIndices;
+        nArenaVertices += span.mesh->nVertices;
+        nArenaIndices += span.nIndices;
+    }
 
-    glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.vao);
+    glGenVertexArrays(1, &gMeshArena.vao);
+    glBindVertexArray(gMeshArena.vao);
 
-    // Create 2 buffers: first one for the vertex data; second one for the indices
-    glGenBuffers(1, &mesh.vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
+    glGenBuffers(1, &gMeshArena.vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, gMeshArena.vbo);
+    glBufferData(GL_ARRAY_BUFFER, nArenaVertices * floatsPerArenaVertex * sizeof(GLfloat), NULL, GL_STATIC_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, gMeshArena.vertices.size() * sizeof(GLfloat), gMeshArena.vertices.data());
+    for (size_t i = 0; i < gMeshArena.spans.size(); ++i)
+    {
+        const GLMeshArenaSpan& span = gMeshArena.spans[i];
+        glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)span.mesh->baseVertex * floatsPerArenaVertex * sizeof(GLfloat),
+            span.mesh->nVertices * floatsPerArenaVertex * sizeof(GLfloat), span.vertices);
+    }
 
-    // Strides between vertex coordinates is 6 (x, y, z, r, g, b, a). A tightly packed stride is 0.
-    GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);// The number of floats before each
+    glGenBuffers(1, &gMeshArena.ebo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gMeshArena.ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, nArenaIndices * sizeof(GLuint), NULL, GL_STATIC_DRAW);
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, gMeshArena.indices.size() * sizeof(GLuint), gMeshArena.indices.data());
+    for (size_t i = 0; i < gMeshArena.spans.size(); ++i)
+    {
+        const GLMeshArenaSpan& span = gMeshArena.spans[i];
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, (GLintptr)span.mesh->firstIndex * sizeof(GLuint), span.nIndices * sizeof(GLuint), span.indices);
+    }
+
+    GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);
 
-    // Create Vertex Attribute Pointers
     glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
     glEnableVertexAttribArray(0);
 
@@ -1301,17 +3728,68 @@ void UCreateMeshScrewDriverTip(GLMesh& mesh)
 
     glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
     glEnableVertexAttribArray(2);
+
+    // Object index: advances once per instance, starting at the command's baseInstance
+    glGenBuffers(1, &gMeshArena.objectIndexVbo);
+    glBindBuffer(GL_ARRAY_BUFFER, gMeshArena.objectIndexVbo);
+    glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(GLuint), 0);
+    glEnableVertexAttribArray(3);
+    glVertexAttribDivisor(3, 1);
+
+    // Position-only twin for the depth pre-pass, drawn with the same commands
+    glGenVertexArrays(1, &gMeshArena.depthVao);
+    glBindVertexArray(gMeshArena.depthVao);
+    glGenBuffers(1, &gMeshArena.positionVbo);
+    glBindBuffer(GL_ARRAY_BUFFER, gMeshArena.positionVbo);
+    glBufferData(GL_ARRAY_BUFFER, nArenaVertices * floatsPerVertex * sizeof(GLfloat), NULL, GL_STATIC_DRAW);
+    UUploadPositions(gMeshArena.vertices.data(), nStagedVertices, 0);
+    for (size_t i = 0; i < gMeshArena.spans.size(); ++i)
+    {
+        const GLMeshArenaSpan& span = gMeshArena.spans[i];
+        glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)span.mesh->baseVertex * floatsPerVertex * sizeof(GLfloat),
+            span.mesh->nVertices * floatsPerVertex * sizeof(GLfloat), span.positions);
+    }
+    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, 0, 0);
+    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gMeshArena.ebo);
+
+    glBindVertexArray(0);
+
+    glGenBuffers(1, &gMeshArena.recordSsbo);
+    glGenBuffers(1, &gMeshArena.commandBuffer);
+
+    cout << "INFO: Mesh arena: " << nArenaVertices << " vertices, " << nArenaIndices << " indices" << endl;
+
+    // The GPU copy is all the renderer needs from now on
+    vector<GLfloat>().swap(gMeshArena.vertices);
+    vector<GLuint>().swap(gMeshArena.indices);
+}
+
+void UDestroyMeshArena()
+{
+    glDeleteVertexArrays(1, &gMeshArena.vao);
+    glDeleteBuffers(1, &gMeshArena.vbo);
+    glDeleteBuffers(1, &gMeshArena.ebo);
+    glDeleteBuffers(1, &gMeshArena.objectIndexVbo);
+    glDeleteBuffers(1, &gMeshArena.recordSsbo);
+    glDeleteBuffers(1, &gMeshArena.commandBuffer);
+    glDeleteVertexArrays(1, &gMeshArena.depthVao);
+    glDeleteBuffers(1, &gMeshArena.positionVbo);
 }
 
 void UDestroyMesh(GLMesh& mesh)
 {
     glDeleteVertexArrays(1, &mesh.vao);
     glDeleteBuffers(1, &mesh.vbo);
+    glDeleteBuffers(1, &mesh.ebo);
+    glDeleteBuffers(1, &mesh.instanceVbo);
+    glDeleteVertexArrays(1, &mesh.depthVao);
+    glDeleteBuffers(1, &mesh.positionVbo);
 }
 
 
 // Implements the UCreateShaders function
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId)
+bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId, GLUniformTable& uniforms)
 {
     // Compilation and linkage error reporting
     int success = 0;
@@ -1368,59 +3846,518 @@ bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSou
 
     glUseProgram(programId);    // Uses the shader program
 
+    // Enumerate the active uniforms once so the render loop never looks them up by name
+    UReflectUniforms(programId, uniforms);
+
+    return true;
+}
+
+
+// Compiles and links a compute shader program, reflecting its uniforms like UCreateShaderProgram
+bool UCreateComputeProgram(const char* shaderSource, GLuint& programId, GLUniformTable& uniforms)
+{
+    int success = 0;
+    char infoLog[512];
+
+    programId = glCreateProgram();
+    GLuint shaderId = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(shaderId, 1, &shaderSource, NULL);
+
+    glCompileShader(shaderId);
+    glGetShaderiv(shaderId, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        glGetShaderInfoLog(shaderId, sizeof(infoLog), NULL, infoLog);
+        std::cout << "ERROR::SHADER::COMPUTE::COMPILATION_FAILED\n" << infoLog << std::endl;
+
+        return false;
+    }
+
+    glAttachShader(programId, shaderId);
+    glLinkProgram(programId);
+    glGetProgramiv(programId, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
+        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+
+        return false;
+    }
+
+    glUseProgram(programId);
+    UReflectUniforms(programId, uniforms);
+
     return true;
 }
 
 
+// Builds the uniform table of a linked program from glGetActiveUniform
+void UReflectUniforms(GLuint programId, GLUniformTable& uniforms)
+{
+    GLint count = 0;
+    GLint maxNameLength = 0;
+    glGetProgramiv(programId, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(programId, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+    uniforms.clear();
+    string name(maxNameLength > 0 ? maxNameLength : 1, '\0');
+
+    for (GLint i = 0; i < count; ++i)
+    {
+        GLsizei length = 0;
+        GLUniform uniform;
+        glGetActiveUniform(programId, (GLuint)i, (GLsizei)name.size(), &length, &uniform.size, &uniform.type, &name[0]);
+
+        string uniformName(name.c_str(), length);
+        // Arrays are reported as "name[0]"; store them under their base name
+        size_t bracket = uniformName.find('[');
+        if (bracket != string::npos)
+            uniformName.erase(bracket);
+
+        uniform.location = glGetUniformLocation(programId, uniformName.c_str());
+        uniforms[uniformName] = uniform;
+    }
+}
+
+
+// Returns the pre-resolved location of a uniform, or -1 when it is not active in the program
+GLint UGetUniform(const GLUniformTable& uniforms, const char* name, GLenum type)
+{
+    ++gUniformLookupCount;
+
+    GLUniformTable::const_iterator it = uniforms.find(name);
+    if (it == uniforms.end())
+        return -1;
+
+    if (it->second.type != type)
+    {
+        cout << "WARNING: uniform " << name << " has type 0x" << hex << it->second.type << ", expected 0x" << type << dec << endl;
+    }
+
+    return it->second.location;
+}
+
+
 void UDestroyShaderProgram(GLuint programId)
 {
     glDeleteProgram(programId);
 }
 
 
-/*Generate and load the texture*/
-bool UCreateTexture(const char* filename, GLuint& textureId, GLint param)
+// Decodes one material image into its slot of the pixel unpack buffer (runs on a worker thread)
+bool UDecodeMaterialImage(const ImageDecodeJob& job)
 {
+    // Baked materials are already compressed, flipped and mipmapped: the file is read as is
+    if (gMaterials.blockFormats[job.Id])
+        return readCompressedTextureData(UBakedTexturePath(job.Filename).c_str(), job.Destination, gMaterials.offsets[job.Id + 1] - gMaterials.offsets[job.Id]);
+
     int width, height, channels;
-    unsigned char* image = stbi_load(filename, &width, &height, &channels, 0);
-    if (image)
+    unsigned char* image = stbi_load(job.Filename.c_str(), &width, &height, &channels, 4);
+    if (!image)
+        return false;
+
+    // Array layers have a fixed size, bindless textures keep the size stbi_info reported; both flip on the way
+    if (width == job.Width && height == job.Height)
+        copyImageFlipped(image, width, height, 4, job.Destination);
+    else
+        resizeImage(image, width, height, job.Destination, job.Width, job.Height, true);
+
+    stbi_image_free(image);
+    return true;
+}
+
+
+void UDestroyTexture(GLuint textureId)
+{
+    glDeleteTextures(1, &textureId);
+}
+
+
+// Registers a texture file as a material and returns its index
+GLuint UAddMaterial(const char* filename)
+{
+    gMaterials.filenames.push_back(filename);
+    return (GLuint)gMaterials.filenames.size() - 1;
+}
+
+
+// Baked textures live next to their source image
+string UBakedTexturePath(const string& filename)
+{
+    return filename + ".btex";
+}
+
+
+// OpenGL internal format of a baked block format, 0 when the driver cannot sample it
+GLenum UCompressedFormat(uint32_t blockFormat)
+{
+    if (blockFormat == TEXTURE_BC1 && GLEW_EXT_texture_compression_s3tc)
+        return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    if (blockFormat == TEXTURE_BC3 && GLEW_EXT_texture_compression_s3tc)
+        return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    if (blockFormat == TEXTURE_BC7)
+        return GL_COMPRESSED_RGBA_BPTC_UNORM; // core since OpenGL 4.2
+    return 0;
+}
+
+
+// Number of mip levels of a full chain for a width x height texture
+GLsizei UMipLevels(GLsizei width, GLsizei height)
+{
+    GLsizei levels = 1;
+    while ((width >> levels) > 0 || (height >> levels) > 0)
+        ++levels;
+    return levels;
+}
+
+
+/*Start loading every registered material: objects show a placeholder until UUpdateMaterials() makes their texture resident*/
+bool UCreateMaterials(GLint param)
+{
+    const GLsizei nMaterials = (GLsizei)gMaterials.filenames.size();
+    const GLubyte placeholder[4] = { 128, 128, 128, 255 };
+
+    gMaterials.param = param;
+    gMaterials.nResident = 0;
+    gMaterials.loadStart = chrono::steady_clock::now();
+    gMaterials.widths.resize(nMaterials);
+    gMaterials.heights.resize(nMaterials);
+    gMaterials.offsets.resize(nMaterials + 1);
+    gMaterials.blockFormats.assign(nMaterials, 0);
+    gMaterials.levels.assign(nMaterials, 0);
+    gMaterials.decodeMilliseconds.assign(nMaterials, 0.0);
+    gMaterials.uploadMilliseconds.assign(nMaterials, 0.0);
+    gMaterials.textureBytes = 0;
+    gMaterials.uncompressedBytes = 0;
+
+    // Use the baked file of a material when it exists and the driver can sample its format
+    const GLsizei layerLevels = UMipLevels(MATERIAL_LAYER_SIZE, MATERIAL_LAYER_SIZE);
+    bool allBaked = true;
+    for (GLsizei i = 0; i < nMaterials; ++i)
+    {
+        CompressedTextureHeader header;
+        if (readCompressedTextureHeader(UBakedTexturePath(gMaterials.filenames[i]).c_str(), header) && UCompressedFormat(header.format))
+        {
+            gMaterials.blockFormats[i] = header.format;
+            gMaterials.levels[i] = header.levels;
+            gMaterials.widths[i] = header.width;
+            gMaterials.heights[i] = header.height;
+        }
+
+        // Array layers share one format, size and mip chain
+        allBaked = allBaked && gMaterials.blockFormats[i] == gMaterials.blockFormats[0] && gMaterials.blockFormats[i]
+            && header.width == MATERIAL_LAYER_SIZE && header.height == MATERIAL_LAYER_SIZE && (GLsizei)header.levels == layerLevels;
+    }
+
+    if (!gMaterials.bindless && !allBaked)
+    {
+        gMaterials.blockFormats.assign(nMaterials, 0);
+        cout << "INFO: Not every material has a matching baked texture (run with --bake-textures), decoding PNG/JPG" << endl;
+    }
+
+    // Size of every image, read from the file headers only, gives its slot in the pixel unpack buffer
+    gMaterials.offsets[0] = 0;
+    for (GLsizei i = 0; i < nMaterials; ++i)
+    {
+        int channels;
+        if (gMaterials.blockFormats[i])
+        {
+            CompressedTextureHeader header;
+            header.format = gMaterials.blockFormats[i];
+            header.width = gMaterials.widths[i];
+            header.height = gMaterials.heights[i];
+            header.levels = gMaterials.levels[i];
+            gMaterials.offsets[i + 1] = gMaterials.offsets[i] + compressedTextureSize(header);
+            continue;
+        }
+        else if (gMaterials.bindless)
+        {
+            if (!stbi_info(gMaterials.filenames[i].c_str(), &gMaterials.widths[i], &gMaterials.heights[i], &channels))
+            {
+                cout << "Failed to load texture " << gMaterials.filenames[i] << endl;
+                return false;
+            }
+        }
+        else
+        {
+            gMaterials.widths[i] = MATERIAL_LAYER_SIZE;
+            gMaterials.heights[i] = MATERIAL_LAYER_SIZE;
+        }
+        gMaterials.offsets[i + 1] = gMaterials.offsets[i] + (size_t)gMaterials.widths[i] * gMaterials.heights[i] * 4;
+    }
+
+    // Workers write the decoded pixels straight into this persistently mapped buffer, the GL thread uploads from it
+    const GLbitfield mapFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &gMaterials.pbo);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, gMaterials.pbo);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, gMaterials.offsets[nMaterials], NULL, mapFlags);
+    gMaterials.pboMemory = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, gMaterials.offsets[nMaterials], mapFlags);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    if (!gMaterials.pboMemory)
+    {
+        cout << "Failed to map the texture upload buffer" << endl;
+        return false;
+    }
+
+    if (gMaterials.bindless)
+    {
+        // Every handle points at a 1x1 placeholder until the material's own texture is resident
+        glGenTextures(1, &gMaterials.placeholder);
+        glBindTexture(GL_TEXTURE_2D, gMaterials.placeholder);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, 1, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        GLuint64 placeholderHandle = glGetTextureHandleARB(gMaterials.placeholder);
+        glMakeTextureHandleResidentARB(placeholderHandle);
+
+        vector<GLuint64> handles(nMaterials, placeholderHandle);
+        gMaterials.textures.assign(nMaterials, 0);
+
+        glGenBuffers(1, &gMaterials.handleSsbo);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, gMaterials.handleSsbo);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, handles.size() * sizeof(GLuint64), handles.data(), GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+    else
     {
-        flipImageVertically(image, width, height, channels);
+        // Array texture: every layer starts as the placeholder color and is replaced once decoded
+        const uint32_t blockFormat = gMaterials.blockFormats[0];
 
-        glGenTextures(1, &textureId);
-        glBindTexture(GL_TEXTURE_2D, textureId);
+        glGenTextures(1, &gMaterials.arrayTexture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, gMaterials.arrayTexture);
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, layerLevels, blockFormat ? UCompressedFormat(blockFormat) : GL_RGBA8, MATERIAL_LAYER_SIZE, MATERIAL_LAYER_SIZE, nMaterials);
 
         // set the texture wrapping parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, param);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, param);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, param);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, param);
         // set texture filtering parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-        if (channels == 3)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-        else if (channels == 4)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
+        if (blockFormat)
+        {
+            // Compressed textures cannot be cleared: every level is filled with the placeholder color encoded as blocks
+            unsigned char block[64];
+            for (int p = 0; p < 16; ++p)
+                memcpy(block + p * 4, placeholder, 4);
+
+            vector<unsigned char> encoded(compressedBlockBytes(blockFormat));
+            compressImage(block, 4, 4, blockFormat, encoded.data());
+
+            vector<unsigned char> levelData;
+            for (GLsizei level = 0; level < layerLevels; ++level)
+            {
+                GLsizei size = max(MATERIAL_LAYER_SIZE >> level, 1);
+                size_t levelSize = compressedLevelSize(blockFormat, size, size) * nMaterials;
+                levelData.resize(levelSize);
+                for (size_t offset = 0; offset < levelSize; offset += encoded.size())
+                    memcpy(levelData.data() + offset, encoded.data(), encoded.size());
+
+                glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, size, size, nMaterials, UCompressedFormat(blockFormat), (GLsizei)levelSize, levelData.data());
+            }
+        }
         else
         {
-            cout << "Not implemented to handle image with " << channels << " channels" << endl;
-            return false;
+            for (GLsizei level = 0; level < layerLevels; ++level)
+                glClearTexImage(gMaterials.arrayTexture, level, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
         }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
 
-        glGenerateMipmap(GL_TEXTURE_2D);
+    // Hand every image to the decode workers
+    gImageQueue.Start(UDecodeMaterialImage);
+    for (GLsizei i = 0; i < nMaterials; ++i)
+    {
+        ImageDecodeJob job;
+        job.Id = i;
+        job.Filename = gMaterials.filenames[i];
+        job.Width = gMaterials.widths[i];
+        job.Height = gMaterials.heights[i];
+        job.Destination = gMaterials.pboMemory + gMaterials.offsets[i];
+        job.Succeeded = false;
+        job.DecodeMilliseconds = 0.0;
+        gImageQueue.Push(job);
+    }
 
-        stbi_image_free(image);
-        glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
+    return true;
+}
+
+
+/*Upload every material the workers finished decoding since the last frame*/
+void UUpdateMaterials()
+{
+    const GLuint nMaterials = (GLuint)gMaterials.filenames.size();
+    if (!gMaterials.pbo)
+        return;
+
+    bool layersChanged = false;
+    ImageDecodeJob job;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, gMaterials.pbo);
+
+    while (gImageQueue.Poll(job))
+    {
+        const GLuint i = job.Id;
+        gMaterials.decodeMilliseconds[i] = job.DecodeMilliseconds;
+        ++gMaterials.nResident;
+
+        if (!job.Succeeded)
+        {
+            cout << "Failed to load texture " << job.Filename << ", keeping the placeholder" << endl;
+            continue;
+        }
+
+        chrono::steady_clock::time_point uploadStart = chrono::steady_clock::now();
+        // With a pixel unpack buffer bound the data pointer is an offset into it
+        const void* pixels = (const void*)gMaterials.offsets[i];
+        const uint32_t blockFormat = gMaterials.blockFormats[i];
+        const GLsizei levels = blockFormat ? gMaterials.levels[i] : UMipLevels(job.Width, job.Height);
+
+        gMaterials.uncompressedBytes += (size_t)job.Width * job.Height * 4 * 4 / 3;
+        gMaterials.textureBytes += blockFormat ? gMaterials.offsets[i + 1] - gMaterials.offsets[i] : (size_t)job.Width * job.Height * 4 * 4 / 3;
+
+        if (gMaterials.bindless)
+        {
+            GLuint& texture = gMaterials.textures[i];
+            glGenTextures(1, &texture);
+            gGLState.BindTexture(0, GL_TEXTURE_2D, texture);
+            glTexStorage2D(GL_TEXTURE_2D, levels, blockFormat ? UCompressedFormat(blockFormat) : GL_RGBA8, job.Width, job.Height);
+            if (blockFormat)
+                UUploadCompressedLevels(GL_TEXTURE_2D, i, job.Width, job.Height, 0);
+            else
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, job.Width, job.Height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+
+            // set the texture wrapping parameters
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, gMaterials.param);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, gMaterials.param);
+            // set texture filtering parameters
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+            if (!blockFormat)
+                glGenerateMipmap(GL_TEXTURE_2D);
+            gGLState.BindTexture(0, GL_TEXTURE_2D, 0);
+
+            // Swap the placeholder handle for the real one
+            GLuint64 handle = glGetTextureHandleARB(texture);
+            glMakeTextureHandleResidentARB(handle);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, gMaterials.handleSsbo);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, i * sizeof(GLuint64), sizeof(GLuint64), &handle);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        }
+        else
+        {
+            gGLState.BindTexture(0, GL_TEXTURE_2D_ARRAY, gMaterials.arrayTexture);
+            if (blockFormat)
+            {
+                UUploadCompressedLevels(GL_TEXTURE_2D_ARRAY, i, job.Width, job.Height, i);
+            }
+            else
+            {
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, job.Width, job.Height, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+                layersChanged = true;
+            }
+            gGLState.BindTexture(0, GL_TEXTURE_2D_ARRAY, 0);
+        }
 
-        return true;
+        gMaterials.uploadMilliseconds[i] = chrono::duration<double, milli>(chrono::steady_clock::now() - uploadStart).count();
+        cout << "INFO: Texture " << job.Filename << " (" << job.Width << "x" << job.Height << (blockFormat ? ", baked" : "") << "): decode "
+            << gMaterials.decodeMilliseconds[i] << " ms, upload " << gMaterials.uploadMilliseconds[i] << " ms" << endl;
     }
 
-    // Error loading the image
-    return false;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    // Mipmaps of the array are rebuilt once for all the layers that arrived this frame
+    if (layersChanged)
+    {
+        gGLState.BindTexture(0, GL_TEXTURE_2D_ARRAY, gMaterials.arrayTexture);
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        gGLState.BindTexture(0, GL_TEXTURE_2D_ARRAY, 0);
+    }
+
+    if (gMaterials.nResident < nMaterials)
+        return;
+
+    // Everything is resident: stop the workers and release the upload buffer
+    gImageQueue.Stop();
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, gMaterials.pbo);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &gMaterials.pbo);
+    gMaterials.pbo = 0;
+    gMaterials.pboMemory = NULL;
+
+    double slowestDecode = 0.0;
+    double totalDecode = 0.0;
+    double totalUpload = 0.0;
+    for (GLuint i = 0; i < nMaterials; ++i)
+    {
+        slowestDecode = max(slowestDecode, gMaterials.decodeMilliseconds[i]);
+        totalDecode += gMaterials.decodeMilliseconds[i];
+        totalUpload += gMaterials.uploadMilliseconds[i];
+    }
+
+    double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - gMaterials.loadStart).count();
+    cout << "INFO: " << nMaterials << " textures resident after " << elapsed << " ms (slowest decode " << slowestDecode
+        << " ms, sum of decodes " << totalDecode << " ms, sum of uploads " << totalUpload << " ms)" << endl;
+    cout << "INFO: Texture memory " << gMaterials.textureBytes / (1024.0 * 1024.0) << " MB ("
+        << gMaterials.uncompressedBytes / (1024.0 * 1024.0) << " MB as RGBA8)" << endl;
 }
 
 
-void UDestroyTexture(GLuint textureId)
+// Uploads every mip level of a baked material from the bound pixel unpack buffer; layer is ignored for 2D textures
+void UUploadCompressedLevels(GLenum target, GLuint material, GLsizei width, GLsizei height, GLint layer)
+{
+    const uint32_t blockFormat = gMaterials.blockFormats[material];
+    const GLenum format = UCompressedFormat(blockFormat);
+    size_t offset = gMaterials.offsets[material];
+
+    for (GLsizei level = 0; level < gMaterials.levels[material]; ++level)
+    {
+        GLsizei levelWidth = max(width >> level, 1);
+        GLsizei levelHeight = max(height >> level, 1);
+        GLsizei size = (GLsizei)compressedLevelSize(blockFormat, levelWidth, levelHeight);
+
+        if (target == GL_TEXTURE_2D_ARRAY)
+            glCompressedTexSubImage3D(target, level, 0, 0, layer, levelWidth, levelHeight, 1, format, size, (const void*)offset);
+        else
+            glCompressedTexSubImage2D(target, level, 0, 0, levelWidth, levelHeight, format, size, (const void*)offset);
+
+        offset += size;
+    }
+}
+
+
+void UDestroyMaterials()
 {
-    glGenTextures(1, &textureId);
+    // Stops the workers first if the window closed before every texture arrived
+    gImageQueue.Stop();
+    if (gMaterials.pbo)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, gMaterials.pbo);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &gMaterials.pbo);
+    }
+
+    for (size_t i = 0; i < gMaterials.textures.size(); ++i)
+    {
+        if (!gMaterials.textures[i])
+            continue;
+
+        glMakeTextureHandleNonResidentARB(glGetTextureHandleARB(gMaterials.textures[i]));
+        UDestroyTexture(gMaterials.textures[i]);
+    }
+
+    if (gMaterials.placeholder)
+    {
+        glMakeTextureHandleNonResidentARB(glGetTextureHandleARB(gMaterials.placeholder));
+        UDestroyTexture(gMaterials.placeholder);
+    }
+
+    glDeleteBuffers(1, &gMaterials.handleSsbo);
+    glDeleteTextures(1, &gMaterials.arrayTexture);
 }
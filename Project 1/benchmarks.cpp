@@ -0,0 +1,703 @@
+#include <iostream>         // cout
+#include <cstdlib>          // EXIT_SUCCESS, atoi
+#include <chrono>           // steady_clock
+#include <cmath>            // sin, cos
+#include <cstdio>           // fopen, fprintf, remove
+#include <cstring>          // memcpy
+#include <string>           // string
+#include <thread>           // sleep_for
+#include <vector>           // vector
+
+#include "meshopt.h"        // Vertex welding and cache/overdraw/fetch optimization
+#include "imagequeue.h"     // Worker threads decoding textures
+#include "texturecompress.h" // BC1/BC3/BC7 encoders
+#include "frustum.h"        // SIMD view frustum culling
+#include "bvh.h"            // Bounding volume hierarchy
+#include "meshgen.h"        // Procedural meshes
+#include "simplify.h"       // Quadric error simplification
+#include "meshimport.h"     // OBJ and glTF importer
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"      // Image loading Utility functions
+
+using namespace std; // Standard namespace
+
+// CPU benchmarks of the pipelines the renderer runs at startup. Every result is one
+// "BENCH <name> key=value ..." line, like the renderer's own --bench-* and --headless modes.
+
+// Unnamed namespace
+namespace
+{
+    // Texture files loaded by the renderer
+    const char* const TEXTURE_FILES[] = {
+        "./resources/textures/concrete.png",
+        "./resources/textures/whitePlastic.png",
+        "./resources/textures/yellowPlastic.jpg",
+        "./resources/textures/wiperBack.png",
+        "./resources/textures/wiperBox.jpg",
+        "./resources/textures/screwDriverHandle.jpg",
+        "./resources/textures/screwDriver.png"
+    };
+    const int TEXTURE_COUNT = sizeof(TEXTURE_FILES) / sizeof(TEXTURE_FILES[0]);
+}
+
+/* User-defined Function prototypes */
+void UBuildTriangleListSphere(int rings, int segments, vector<float>& verts);
+void UBenchmarkMeshPipeline(int rings, int segments);
+void UBenchmarkMeshGeneration(MeshShape shape, const char* name, int segments, int rings);
+void UBenchmarkSimplification(int rings, int segments);
+bool UWriteObj(const char* path, const vector<float>& vertices, const vector<uint32_t>& indices);
+bool UWriteGlb(const char* path, const ImportedMesh& mesh);
+long UFileSize(const char* path);
+void UBenchmarkImport(int megabytes);
+void UBenchmarkFloatParsing(const char* path);
+bool UDecodeImage(const ImageDecodeJob& job);
+void UBenchmarkTextureDecode();
+void UBenchmarkTextureCompression(const char* filename);
+void UBuildRandomBounds(size_t objects, float side, CullBounds& bounds);
+void UBenchmarkFrustumCulling(size_t objects);
+void UBenchmarkBvh(size_t objects);
+double UMillisecondsSince(chrono::steady_clock::time_point start);
+
+
+int main(int argc, char* argv[])
+{
+    // Tessellation of the benchmark mesh (--rings <n>, default 256 rings of 512 segments)
+    int rings = 256;
+    // Size of the OBJ file the importer reads (--import-mb <n>, default 100 MB)
+    int importMegabytes = 100;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (string(argv[i]) == "--rings" && i + 1 < argc)
+            rings = atoi(argv[++i]);
+        else if (string(argv[i]) == "--import-mb" && i + 1 < argc)
+            importMegabytes = atoi(argv[++i]);
+    }
+
+    UBenchmarkMeshPipeline(rings, rings * 2);
+    UBenchmarkMeshGeneration(MESH_CYLINDER, "cylinder", rings * 2, rings);
+    UBenchmarkMeshGeneration(MESH_CONE, "cone", rings * 2, rings);
+    UBenchmarkMeshGeneration(MESH_CAPSULE, "capsule", rings * 2, rings / 2);
+    UBenchmarkMeshGeneration(MESH_TORUS, "torus", rings * 2, rings);
+    UBenchmarkMeshGeneration(MESH_BOX, "box", rings / 2, 1);
+    UBenchmarkSimplification(rings, rings * 2);
+    UBenchmarkImport(importMegabytes);
+    UBenchmarkTextureDecode();
+    UBenchmarkTextureCompression(TEXTURE_FILES[0]);
+    UBenchmarkFrustumCulling(10000);
+    UBenchmarkFrustumCulling(100000);
+    for (size_t objects = 10; objects <= 1000000; objects *= 10)
+        UBenchmarkBvh(objects);
+
+    return EXIT_SUCCESS;
+}
+
+
+double UMillisecondsSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+
+// Unindexed UV sphere in the renderer's vertex layout (position, normal, texture coordinate), six vertices per quad
+void UBuildTriangleListSphere(int rings, int segments, vector<float>& verts)
+{
+    const float pi = 3.14159265f;
+    verts.clear();
+    verts.reserve((size_t)rings * segments * 6 * MESH_VERTEX_FLOATS);
+
+    for (int r = 0; r < rings; ++r)
+    {
+        for (int s = 0; s < segments; ++s)
+        {
+            // Corners of the quad in the order of the two triangles
+            const int corners[6][2] = { { r, s }, { r + 1, s }, { r + 1, s + 1 }, { r, s }, { r + 1, s + 1 }, { r, s + 1 } };
+            for (int c = 0; c < 6; ++c)
+            {
+                float u = (float)corners[c][1] / segments;
+                float v = (float)corners[c][0] / rings;
+                float x = sin(v * pi) * cos(u * 2.0f * pi);
+                float y = cos(v * pi);
+                float z = sin(v * pi) * sin(u * 2.0f * pi);
+                const float vertex[MESH_VERTEX_FLOATS] = { x, y, z, x, y, z, u, v };
+                verts.insert(verts.end(), vertex, vertex + MESH_VERTEX_FLOATS);
+            }
+        }
+    }
+}
+
+
+// Times every stage UCreateIndexedMesh runs on a mesh: welding, cache, overdraw and fetch optimization
+void UBenchmarkMeshPipeline(int rings, int segments)
+{
+    vector<float> verts;
+    vector<float> vertices;
+    vector<uint32_t> indices;
+    vector<uint32_t> clusters;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    UBuildTriangleListSphere(rings, segments, verts);
+    double buildMilliseconds = UMillisecondsSince(start);
+
+    const size_t vertexCount = verts.size() / MESH_VERTEX_FLOATS;
+
+    start = chrono::steady_clock::now();
+    weldVertices(verts.data(), vertexCount, vertices, indices);
+    double weldMilliseconds = UMillisecondsSince(start);
+
+    const size_t uniqueCount = vertices.size() / MESH_VERTEX_FLOATS;
+    float acmrBefore = computeACMR(indices, uniqueCount);
+
+    start = chrono::steady_clock::now();
+    optimizeVertexCache(indices, uniqueCount, &clusters);
+    double cacheMilliseconds = UMillisecondsSince(start);
+
+    start = chrono::steady_clock::now();
+    optimizeOverdraw(indices, vertices, clusters);
+    double overdrawMilliseconds = UMillisecondsSince(start);
+
+    start = chrono::steady_clock::now();
+    optimizeVertexFetch(vertices, indices);
+    double fetchMilliseconds = UMillisecondsSince(start);
+
+    cout << "BENCH mesh triangles=" << indices.size() / 3
+        << " vertices_in=" << vertexCount
+        << " vertices_out=" << vertices.size() / MESH_VERTEX_FLOATS
+        << " build_ms=" << buildMilliseconds
+        << " weld_ms=" << weldMilliseconds
+        << " cache_ms=" << cacheMilliseconds
+        << " overdraw_ms=" << overdrawMilliseconds
+        << " fetch_ms=" << fetchMilliseconds
+        << " acmr_before=" << acmrBefore
+        << " acmr_after=" << computeACMR(indices, vertices.size() / MESH_VERTEX_FLOATS) << endl;
+}
+
+
+// Generates one shape repeatedly into buffers allocated once from its size, the way the renderer builds its round meshes
+void UBenchmarkMeshGeneration(MeshShape shape, const char* name, int segments, int rings)
+{
+    const int repeats = 20;
+
+    const MeshSize size = meshShapeSize(shape, segments, rings);
+    vector<float> vertices(size.vertices * MESH_VERTEX_FLOATS);
+    vector<uint32_t> indices(size.indices);
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int r = 0; r < repeats; ++r)
+    {
+        MeshWriter writer = meshWriter(vertices.data(), indices.data());
+        generateMeshShape(writer, shape, segments, rings);
+    }
+    double milliseconds = UMillisecondsSince(start) / repeats;
+
+    cout << "BENCH meshgen shape=" << name
+        << " vertices=" << size.vertices
+        << " triangles=" << size.indices / 3
+        << " acmr=" << computeACMR(indices, size.vertices)
+        << " ms=" << milliseconds
+        << " mvertices_per_s=" << size.vertices / (milliseconds * 1000.0) << endl;
+}
+
+
+// Level of detail chain of the welded sphere at the ratios meshlod uses by default; the sphere's seam at u = 0
+// and its poles stay in place while its rings and slices collapse
+void UBenchmarkSimplification(int rings, int segments)
+{
+    vector<float> verts;
+    vector<float> vertices;
+    vector<uint32_t> indices;
+    UBuildTriangleListSphere(rings, segments, verts);
+    weldVertices(verts.data(), verts.size() / MESH_VERTEX_FLOATS, vertices, indices);
+
+    const float ratios[] = { 0.5f, 0.25f, 0.125f };
+    vector<MeshLodLevel> levels;
+    vector<uint32_t> lodIndices;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    buildMeshLods(vertices, indices, ratios, sizeof(ratios) / sizeof(ratios[0]), levels, lodIndices);
+    double milliseconds = UMillisecondsSince(start);
+
+    for (size_t i = 0; i < levels.size(); ++i)
+    {
+        cout << "BENCH simplify_level level=" << i
+            << " triangles=" << levels[i].indexCount / 3
+            << " ratio=" << levels[i].ratio
+            << " error=" << levels[i].error << endl;
+    }
+    cout << "BENCH simplify triangles=" << indices.size() / 3
+        << " levels=" << levels.size()
+        << " ms=" << milliseconds
+        << " ktriangles_per_s=" << indices.size() / 3 / milliseconds << endl;
+}
+
+
+// Writes a mesh in the renderer's vertex layout as an OBJ file with positions, texture coordinates and normals
+bool UWriteObj(const char* path, const vector<float>& vertices, const vector<uint32_t>& indices)
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+        return false;
+
+    for (size_t i = 0; i < vertices.size(); i += MESH_VERTEX_FLOATS)
+    {
+        const float* v = &vertices[i];
+        fprintf(file, "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn %.6f %.6f %.6f\n", v[0], v[1], v[2], v[6], v[7], v[3], v[4], v[5]);
+    }
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        const uint32_t a = indices[i] + 1, b = indices[i + 1] + 1, c = indices[i + 2] + 1;
+        fprintf(file, "f %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, b, b, b, c, c, c);
+    }
+    return fclose(file) == 0;
+}
+
+
+// Writes a mesh as a binary glTF file: one mesh of one primitive, with its attributes and 32-bit indices in
+// the binary chunk one after the other
+bool UWriteGlb(const char* path, const ImportedMesh& mesh)
+{
+    const size_t vertexCount = mesh.vertices.size() / MESH_VERTEX_FLOATS;
+    vector<float> attributes(vertexCount * MESH_VERTEX_FLOATS);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        const float* vertex = &mesh.vertices[v * MESH_VERTEX_FLOATS];
+        memcpy(&attributes[v * 3], vertex, 3 * sizeof(float));
+        memcpy(&attributes[vertexCount * 3 + v * 3], vertex + 3, 3 * sizeof(float));
+        attributes[vertexCount * 6 + v * 2] = vertex[6];
+        attributes[vertexCount * 6 + v * 2 + 1] = 1.0f - vertex[7];
+    }
+
+    const size_t positionBytes = vertexCount * 3 * sizeof(float);
+    const size_t texCoordBytes = vertexCount * 2 * sizeof(float);
+    const size_t indexBytes = mesh.indices.size() * sizeof(uint32_t);
+    const size_t binBytes = positionBytes * 2 + texCoordBytes + indexBytes;
+    string json = "{\"asset\":{\"version\":\"2.0\"},\"buffers\":[{\"byteLength\":" + to_string(binBytes) + "}],"
+        "\"bufferViews\":["
+        "{\"buffer\":0,\"byteOffset\":0,\"byteLength\":" + to_string(positionBytes * 2 + texCoordBytes) + "},"
+        "{\"buffer\":0,\"byteOffset\":" + to_string(positionBytes * 2 + texCoordBytes) + ",\"byteLength\":" + to_string(indexBytes) + "}],"
+        "\"accessors\":["
+        "{\"bufferView\":0,\"byteOffset\":0,\"componentType\":5126,\"count\":" + to_string(vertexCount) + ",\"type\":\"VEC3\"},"
+        "{\"bufferView\":0,\"byteOffset\":" + to_string(positionBytes) + ",\"componentType\":5126,\"count\":" + to_string(vertexCount) + ",\"type\":\"VEC3\"},"
+        "{\"bufferView\":0,\"byteOffset\":" + to_string(positionBytes * 2) + ",\"componentType\":5126,\"count\":" + to_string(vertexCount) + ",\"type\":\"VEC2\"},"
+        "{\"bufferView\":1,\"componentType\":5125,\"count\":" + to_string(mesh.indices.size()) + ",\"type\":\"SCALAR\"}],"
+        "\"meshes\":[{\"name\":\"" + mesh.name + "\",\"primitives\":[{\"attributes\":{\"POSITION\":0,\"NORMAL\":1,\"TEXCOORD_0\":2},\"indices\":3}]}]}";
+    while (json.size() % 4 != 0)
+        json += ' ';
+
+    const uint32_t header[5] = { 0x46546C67u, 2, (uint32_t)(12 + 8 + json.size() + 8 + binBytes), (uint32_t)json.size(), 0x4E4F534Au };
+    const uint32_t binHeader[2] = { (uint32_t)binBytes, 0x004E4942u };
+    FILE* file = fopen(path, "wb");
+    if (!file)
+        return false;
+    bool written = fwrite(header, sizeof(header), 1, file) == 1
+        && fwrite(json.data(), 1, json.size(), file) == json.size()
+        && fwrite(binHeader, sizeof(binHeader), 1, file) == 1
+        && fwrite(attributes.data(), sizeof(float), attributes.size(), file) == attributes.size()
+        && fwrite(mesh.indices.data(), sizeof(uint32_t), mesh.indices.size(), file) == mesh.indices.size();
+    return fclose(file) == 0 && written;
+}
+
+
+// Size of a file in bytes, -1 when it cannot be opened
+long UFileSize(const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return -1;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    return size;
+}
+
+
+// Import throughput of an OBJ file of about the given size (a torus, about 200 bytes per vertex) on one thread and
+// on every core, then of the same mesh as a .glb file. The files are read from the page cache after the first run.
+void UBenchmarkImport(int megabytes)
+{
+    const int runs = 3;
+    const char* objPath = "bench_import.obj";
+    const char* glbPath = "bench_import.glb";
+
+    const int rings = (int)sqrt(megabytes * 1000000.0 / 200.0 / 2.0);
+    const MeshSize size = meshShapeSize(MESH_TORUS, rings * 2, rings);
+    vector<float> vertices(size.vertices * MESH_VERTEX_FLOATS);
+    vector<uint32_t> indices(size.indices);
+    MeshWriter writer = meshWriter(vertices.data(), indices.data());
+    generateMeshShape(writer, MESH_TORUS, rings * 2, rings);
+    if (!UWriteObj(objPath, vertices, indices))
+    {
+        cout << "ERROR: cannot write " << objPath << endl;
+        return;
+    }
+    UBenchmarkFloatParsing(objPath);
+
+    vector<unsigned int> threadCounts(1, 1);
+    if (thread::hardware_concurrency() > 1)
+        threadCounts.push_back(thread::hardware_concurrency());
+
+    ImportedMesh mesh;
+    for (size_t t = 0; t < threadCounts.size(); ++t)
+    {
+        double milliseconds = 0.0;
+        for (int run = 0; run < runs; ++run)
+        {
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            if (!importObj(objPath, mesh, threadCounts[t]))
+            {
+                cout << "ERROR: cannot import " << objPath << endl;
+                remove(objPath);
+                return;
+            }
+            milliseconds = run == 0 ? UMillisecondsSince(start) : min(milliseconds, UMillisecondsSince(start));
+        }
+
+        const long bytes = UFileSize(objPath);
+        cout << "BENCH import format=obj threads=" << threadCounts[t]
+            << " bytes=" << bytes
+            << " vertices=" << mesh.vertices.size() / MESH_VERTEX_FLOATS
+            << " triangles=" << mesh.indices.size() / 3
+            << " ms=" << milliseconds
+            << " mb_per_s=" << bytes / (milliseconds * 1000.0) << endl;
+    }
+
+    if (!UWriteGlb(glbPath, mesh))
+    {
+        cout << "ERROR: cannot write " << glbPath << endl;
+        remove(objPath);
+        return;
+    }
+    vector<ImportedMesh> meshes;
+    double milliseconds = 0.0;
+    for (int run = 0; run < runs; ++run)
+    {
+        meshes.clear();
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        const bool imported = importGlb(glbPath, meshes);
+        milliseconds = run == 0 ? UMillisecondsSince(start) : min(milliseconds, UMillisecondsSince(start));
+        if (!imported)
+        {
+            cout << "ERROR: cannot import " << glbPath << endl;
+            break;
+        }
+    }
+    if (!meshes.empty())
+    {
+        const long bytes = UFileSize(glbPath);
+        cout << "BENCH import format=glb threads=1"
+            << " bytes=" << bytes
+            << " vertices=" << meshes[0].vertices.size() / MESH_VERTEX_FLOATS
+            << " triangles=" << meshes[0].indices.size() / 3
+            << " ms=" << milliseconds
+            << " mb_per_s=" << bytes / (milliseconds * 1000.0) << endl;
+    }
+
+    remove(objPath);
+    remove(glbPath);
+}
+
+
+// The importer's number parser against strtof over the numbers of an OBJ file's vertex lines, with the count of
+// numbers the two read differently
+void UBenchmarkFloatParsing(const char* path)
+{
+    vector<char> data;
+    if (!importReadFile(path, data))
+        return;
+
+    // Start of every number of the v, vt and vn lines
+    vector<const char*> numbers;
+    for (const char* c = data.data(); *c; c = importNextLine(c, data.data() + data.size() - 1))
+    {
+        if (c[0] != 'v')
+            continue;
+        for (const char* n = c + 1; *n && *n != '\n'; ++n)
+        {
+            if (n[-1] == ' ' && *n != ' ')
+                numbers.push_back(n);
+        }
+    }
+
+    vector<float> parsed(numbers.size()), reference(numbers.size());
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (size_t i = 0; i < numbers.size(); ++i)
+        importParseFloat(numbers[i], parsed[i]);
+    const double parseMilliseconds = UMillisecondsSince(start);
+
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < numbers.size(); ++i)
+        reference[i] = strtof(numbers[i], 0);
+    const double strtofMilliseconds = UMillisecondsSince(start);
+
+    size_t differ = 0;
+    for (size_t i = 0; i < numbers.size(); ++i)
+        differ += memcmp(&parsed[i], &reference[i], sizeof(float)) != 0;
+
+    const char* names[2] = { "import", "strtof" };
+    const double milliseconds[2] = { parseMilliseconds, strtofMilliseconds };
+    for (int parser = 0; parser < 2; ++parser)
+    {
+        cout << "BENCH import_float parser=" << names[parser]
+            << " numbers=" << numbers.size()
+            << " ms=" << milliseconds[parser]
+            << " mnumbers_per_s=" << numbers.size() / (milliseconds[parser] * 1000.0)
+            << " differ=" << differ << endl;
+    }
+}
+
+
+// Decodes one image into the job's buffer (runs on a worker thread)
+bool UDecodeImage(const ImageDecodeJob& job)
+{
+    int width, height, channels;
+    unsigned char* image = stbi_load(job.Filename.c_str(), &width, &height, &channels, 4);
+    if (!image)
+        return false;
+
+    memcpy(job.Destination, image, (size_t)width * height * 4);
+    stbi_image_free(image);
+    return true;
+}
+
+
+// Decodes every texture of the scene one after another, then through the worker pool the renderer uses
+void UBenchmarkTextureDecode()
+{
+    vector<vector<unsigned char> > images(TEXTURE_COUNT);
+    vector<int> widths(TEXTURE_COUNT);
+    vector<int> heights(TEXTURE_COUNT);
+
+    for (int i = 0; i < TEXTURE_COUNT; ++i)
+    {
+        int channels;
+        if (!stbi_info(TEXTURE_FILES[i], &widths[i], &heights[i], &channels))
+        {
+            cout << "Failed to load texture " << TEXTURE_FILES[i] << " (run from the directory holding resources/)" << endl;
+            return;
+        }
+        images[i].resize((size_t)widths[i] * heights[i] * 4);
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int i = 0; i < TEXTURE_COUNT; ++i)
+    {
+        ImageDecodeJob job;
+        job.Filename = TEXTURE_FILES[i];
+        job.Width = widths[i];
+        job.Height = heights[i];
+        job.Destination = images[i].data();
+        UDecodeImage(job);
+    }
+    double serialMilliseconds = UMillisecondsSince(start);
+
+    ImageDecodeQueue queue;
+    start = chrono::steady_clock::now();
+    queue.Start(UDecodeImage);
+    for (int i = 0; i < TEXTURE_COUNT; ++i)
+    {
+        ImageDecodeJob job;
+        job.Id = i;
+        job.Filename = TEXTURE_FILES[i];
+        job.Width = widths[i];
+        job.Height = heights[i];
+        job.Destination = images[i].data();
+        job.Succeeded = false;
+        job.DecodeMilliseconds = 0.0;
+        queue.Push(job);
+    }
+
+    double slowestMilliseconds = 0.0;
+    ImageDecodeJob job;
+    for (int finished = 0; finished < TEXTURE_COUNT; )
+    {
+        // Give the core back to the workers while nothing has finished
+        if (!queue.Poll(job))
+        {
+            this_thread::sleep_for(chrono::microseconds(200));
+            continue;
+        }
+        slowestMilliseconds = job.DecodeMilliseconds > slowestMilliseconds ? job.DecodeMilliseconds : slowestMilliseconds;
+        ++finished;
+    }
+    double pooledMilliseconds = UMillisecondsSince(start);
+    queue.Stop();
+
+    cout << "BENCH texture_decode textures=" << TEXTURE_COUNT
+        << " serial_ms=" << serialMilliseconds
+        << " pooled_ms=" << pooledMilliseconds
+        << " slowest_decode_ms=" << slowestMilliseconds << endl;
+}
+
+
+// Compresses one texture with its mip chain to every format the texture baker supports
+void UBenchmarkTextureCompression(const char* filename)
+{
+    int width, height, channels;
+    unsigned char* image = stbi_load(filename, &width, &height, &channels, 4);
+    if (!image)
+    {
+        cout << "Failed to load texture " << filename << " (run from the directory holding resources/)" << endl;
+        return;
+    }
+
+    const uint32_t formats[] = { TEXTURE_BC1, TEXTURE_BC3, TEXTURE_BC7 };
+    CompressedTextureHeader header;
+    vector<unsigned char> data;
+
+    for (int i = 0; i < 3; ++i)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        compressTexture(image, width, height, formats[i], header, data);
+        double milliseconds = UMillisecondsSince(start);
+
+        cout << "BENCH texture_compress format=bc" << formats[i]
+            << " image=" << width << "x" << height
+            << " levels=" << header.levels
+            << " bytes=" << data.size()
+            << " ms=" << milliseconds
+            << " mpixels_per_s=" << (double)width * height / (milliseconds * 1000.0) << endl;
+    }
+
+    stbi_image_free(image);
+}
+
+
+// Boxes of up to 2 units scattered over a cube of the given side around the origin, deterministic from run to run
+void UBuildRandomBounds(size_t objects, float side, CullBounds& bounds)
+{
+    resizeCullBounds(bounds, objects);
+    unsigned int seed = 12345;
+    for (size_t i = 0; i < objects; ++i)
+    {
+        float values[6];
+        for (int v = 0; v < 6; ++v)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            values[v] = (seed >> 8) / 16777216.0f;
+        }
+        const float center[3] = { (values[0] - 0.5f) * side, (values[1] - 0.5f) * side, (values[2] - 0.5f) * side };
+        const float extent[3] = { values[3], values[4], values[5] };
+        setCullBounds(bounds, i, center, extent);
+    }
+}
+
+
+// Culls a field of random boxes around the renderer's camera, one box at a time and with the SIMD test
+void UBenchmarkFrustumCulling(size_t objects)
+{
+    const int repeats = 100;
+
+    CullBounds bounds;
+    UBuildRandomBounds(objects, 200.0f, bounds);
+
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 1.0f, 3.0f), glm::vec3(0.0f, 1.0f, 2.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+    Frustum frustum;
+    extractFrustum(glm::value_ptr(projection * view), frustum);
+
+    vector<unsigned char> visible(objects);
+    size_t scalarVisible = 0, simdVisible = 0;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int r = 0; r < repeats; ++r)
+        scalarVisible = cullBoundsScalar(frustum, bounds, visible.data());
+    double scalarMicroseconds = UMillisecondsSince(start) * 1000.0 / repeats;
+
+    start = chrono::steady_clock::now();
+    for (int r = 0; r < repeats; ++r)
+        simdVisible = cullBounds(frustum, bounds, visible.data());
+    double simdMicroseconds = UMillisecondsSince(start) * 1000.0 / repeats;
+
+    cout << "BENCH frustum_cull objects=" << objects
+        << " width=" << FRUSTUM_SIMD_WIDTH
+        << " visible=" << simdVisible
+        << " scalar_visible=" << scalarVisible
+        << " scalar_us=" << scalarMicroseconds
+        << " simd_us=" << simdMicroseconds
+        << " mobjects_per_s=" << objects / simdMicroseconds << endl;
+}
+
+
+// Culls a growing world at a constant density, linearly with the SIMD test and through the hierarchy, then moves
+// 1% of the objects and refits the hierarchy. The frustum sees about the same number of objects whatever the count.
+void UBenchmarkBvh(size_t objects)
+{
+    const int repeats = objects >= 100000 ? 10 : 100;
+
+    CullBounds bounds;
+    UBuildRandomBounds(objects, 10.0f * cbrt((float)objects), bounds);
+
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 1.0f, 3.0f), glm::vec3(0.0f, 1.0f, 2.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+    Frustum frustum;
+    extractFrustum(glm::value_ptr(projection * view), frustum);
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    BoundingVolumeHierarchy bvh;
+    bvh.Build(bounds);
+    double buildMilliseconds = UMillisecondsSince(start);
+
+    vector<unsigned char> linearVisible(objects), bvhVisible(objects);
+    size_t nVisible = 0;
+
+    start = chrono::steady_clock::now();
+    for (int r = 0; r < repeats; ++r)
+        nVisible = cullBounds(frustum, bounds, linearVisible.data());
+    double linearMicroseconds = UMillisecondsSince(start) * 1000.0 / repeats;
+
+    start = chrono::steady_clock::now();
+    for (int r = 0; r < repeats; ++r)
+        bvh.Cull(frustum, bvhVisible.data());
+    double bvhMicroseconds = UMillisecondsSince(start) * 1000.0 / repeats;
+
+    // Both walks run the same test, so they only disagree on rounding for boxes touching a plane
+    size_t mismatches = 0;
+    for (size_t i = 0; i < objects; ++i)
+        mismatches += linearVisible[i] != bvhVisible[i];
+
+    // Picking: rays from the camera through a grid of window positions
+    start = chrono::steady_clock::now();
+    const float origin[3] = { 0.0f, 1.0f, 3.0f };
+    int hits = 0;
+    for (int i = 0; i < 100; ++i)
+    {
+        const float direction[3] = { (i % 10 - 4.5f) * 0.08f, (i / 10 - 4.5f) * 0.06f, -1.0f };
+        float distance;
+        hits += bvh.Raycast(origin, direction, distance) >= 0;
+    }
+    double raycastMicroseconds = UMillisecondsSince(start) * 1000.0 / 100;
+
+    // Move 1% of the objects (at least one) by up to a unit and refit after each
+    const size_t moved = objects / 100 > 0 ? objects / 100 : 1;
+    start = chrono::steady_clock::now();
+    for (size_t m = 0; m < moved; ++m)
+    {
+        const size_t i = (m * 7919) % objects;
+        const float center[3] = { bounds.centerX[i] + 1.0f, bounds.centerY[i], bounds.centerZ[i] - 0.5f };
+        const float extent[3] = { bounds.extentX[i], bounds.extentY[i], bounds.extentZ[i] };
+        setCullBounds(bounds, i, center, extent);
+        bvh.Refit((int)i, center, extent);
+    }
+    double refitMicroseconds = UMillisecondsSince(start) * 1000.0;
+
+    // The refitted hierarchy must still agree with the linear test over the moved boxes
+    cullBounds(frustum, bounds, linearVisible.data());
+    bvh.Cull(frustum, bvhVisible.data());
+    for (size_t i = 0; i < objects; ++i)
+        mismatches += linearVisible[i] != bvhVisible[i];
+
+    cout << "BENCH bvh objects=" << objects
+        << " nodes=" << bvh.NodeCount()
+        << " visible=" << nVisible
+        << " mismatches=" << mismatches
+        << " build_ms=" << buildMilliseconds
+        << " linear_cull_us=" << linearMicroseconds
+        << " bvh_cull_us=" << bvhMicroseconds
+        << " refit_objects=" << moved
+        << " refit_us=" << refitMicroseconds
+        << " raycast_us=" << raycastMicroseconds
+        << " raycast_hits=" << hits << endl;
+}
@@ -0,0 +1,339 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "frustum.h"
+
+// Most objects kept in one leaf
+const int BVH_LEAF_SIZE = 4;
+
+// One box of the hierarchy. Every node covers a contiguous range of the object order, so a node found
+// entirely inside the frustum marks its range visible without visiting its children.
+struct BvhNode
+{
+    float Min[3];
+    float Max[3];
+    int Left;       // First of the two children (the second is Left + 1), -1 for a leaf
+    int Parent;     // -1 for the root
+    int First;      // Range of the node in the object order
+    int Count;
+};
+
+// Orders objects by their centroid along one axis (compares min + max, twice the centroid)
+struct BvhCentroidLess
+{
+    const float* objectMin;
+    const float* objectMax;
+    int axis;
+
+    bool operator()(int a, int b) const
+    {
+        return objectMin[a * 3 + axis] + objectMax[a * 3 + axis] < objectMin[b * 3 + axis] + objectMax[b * 3 + axis];
+    }
+};
+
+// Bounding volume hierarchy over axis-aligned object boxes, built top down by splitting at the median
+// centroid on the longest axis. Moving an object refits the boxes on the path from its leaf to the root
+// instead of rebuilding, which keeps the tree valid but lets its quality drift as objects travel far.
+class BoundingVolumeHierarchy
+{
+public:
+    // builds the tree over the first bounds.count boxes of a cull set
+    void Build(const CullBounds& bounds)
+    {
+        const int count = (int)bounds.count;
+        ObjectMin.resize(count * 3);
+        ObjectMax.resize(count * 3);
+        Objects.resize(count);
+        ObjectLeaf.resize(count);
+        for (int i = 0; i < count; ++i)
+        {
+            SetObject(i, bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i], bounds.extentX[i], bounds.extentY[i], bounds.extentZ[i]);
+            Objects[i] = i;
+        }
+
+        Nodes.clear();
+        Nodes.reserve(count > 0 ? 2 * (count / BVH_LEAF_SIZE + 1) : 0);
+        if (count == 0)
+            return;
+
+        BvhNode root;
+        root.Parent = -1;
+        root.First = 0;
+        root.Count = count;
+        Nodes.push_back(root);
+        Split(0);
+    }
+
+    // moves one object to a new box and refits its ancestors, stopping as soon as a box does not change
+    void Refit(int object, const float* center, const float* extent)
+    {
+        SetObject(object, center[0], center[1], center[2], extent[0], extent[1], extent[2]);
+
+        for (int node = ObjectLeaf[object]; node >= 0; node = Nodes[node].Parent)
+        {
+            BvhNode& n = Nodes[node];
+            float oldMin[3], oldMax[3];
+            memcpy(oldMin, n.Min, sizeof(oldMin));
+            memcpy(oldMax, n.Max, sizeof(oldMax));
+
+            if (n.Left < 0)
+                ComputeLeafBounds(node);
+            else
+            {
+                const BvhNode& a = Nodes[n.Left];
+                const BvhNode& b = Nodes[n.Left + 1];
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    n.Min[axis] = std::min(a.Min[axis], b.Min[axis]);
+                    n.Max[axis] = std::max(a.Max[axis], b.Max[axis]);
+                }
+            }
+
+            if (memcmp(oldMin, n.Min, sizeof(oldMin)) == 0 && memcmp(oldMax, n.Max, sizeof(oldMax)) == 0)
+                break;
+        }
+    }
+
+    // same test as cullBoundsScalar over the boxes the tree holds: sets visible[i] to 0 or 1 for every object
+    // and returns the visible count. Planes a node lies fully inside of are not tested again below it.
+    size_t Cull(const Frustum& frustum, unsigned char* visible) const
+    {
+        memset(visible, 0, Objects.size());
+        if (Nodes.empty())
+            return 0;
+
+        size_t nVisible = 0;
+        Stack.clear();
+        Stack.push_back(std::make_pair(0, 0x3F));
+        while (!Stack.empty())
+        {
+            const int node = Stack.back().first;
+            int planes = Stack.back().second;
+            Stack.pop_back();
+
+            const BvhNode& n = Nodes[node];
+            if (!TestPlanes(frustum, n.Min, n.Max, planes))
+                continue;
+
+            // Inside every plane: the whole range is visible
+            if (planes == 0)
+            {
+                for (int i = n.First; i < n.First + n.Count; ++i)
+                    visible[Objects[i]] = 1;
+                nVisible += n.Count;
+                continue;
+            }
+
+            if (n.Left >= 0)
+            {
+                Stack.push_back(std::make_pair(n.Left + 1, planes));
+                Stack.push_back(std::make_pair(n.Left, planes));
+                continue;
+            }
+
+            for (int i = n.First; i < n.First + n.Count; ++i)
+            {
+                const int object = Objects[i];
+                int objectPlanes = planes;
+                if (TestPlanes(frustum, &ObjectMin[object * 3], &ObjectMax[object * 3], objectPlanes))
+                {
+                    visible[object] = 1;
+                    ++nVisible;
+                }
+            }
+        }
+        return nVisible;
+    }
+
+    // nearest object whose box the ray enters at a distance of 0 or more (in units of direction), -1 when none
+    int Raycast(const float* origin, const float* direction, float& distance) const
+    {
+        float inverse[3];
+        for (int axis = 0; axis < 3; ++axis)
+            inverse[axis] = 1.0f / direction[axis];   // Infinite for axis-parallel rays, which the slab test handles
+
+        int hit = -1;
+        distance = INFINITY;
+        if (Nodes.empty())
+            return hit;
+
+        std::vector<int> stack(1, 0);
+        while (!stack.empty())
+        {
+            const int node = stack.back();
+            stack.pop_back();
+
+            const BvhNode& n = Nodes[node];
+            float t;
+            if (!RayBox(origin, inverse, n.Min, n.Max, t) || t >= distance)
+                continue;
+
+            if (n.Left >= 0)
+            {
+                // Visit the nearer child first so the farther one is often skipped
+                float tLeft, tRight;
+                bool hitLeft = RayBox(origin, inverse, Nodes[n.Left].Min, Nodes[n.Left].Max, tLeft);
+                bool hitRight = RayBox(origin, inverse, Nodes[n.Left + 1].Min, Nodes[n.Left + 1].Max, tRight);
+                if (hitLeft && hitRight)
+                {
+                    stack.push_back(tLeft < tRight ? n.Left + 1 : n.Left);
+                    stack.push_back(tLeft < tRight ? n.Left : n.Left + 1);
+                }
+                else if (hitLeft)
+                    stack.push_back(n.Left);
+                else if (hitRight)
+                    stack.push_back(n.Left + 1);
+                continue;
+            }
+
+            for (int i = n.First; i < n.First + n.Count; ++i)
+            {
+                const int object = Objects[i];
+                if (RayBox(origin, inverse, &ObjectMin[object * 3], &ObjectMax[object * 3], t) && t < distance)
+                {
+                    distance = t;
+                    hit = object;
+                }
+            }
+        }
+        return hit;
+    }
+
+    size_t NodeCount() const
+    {
+        return Nodes.size();
+    }
+
+private:
+    std::vector<BvhNode> Nodes;
+    std::vector<int> Objects;           // Object order: every node covers Objects[First, First + Count)
+    std::vector<int> ObjectLeaf;        // Leaf holding each object
+    std::vector<float> ObjectMin;       // xyz per object
+    std::vector<float> ObjectMax;
+    mutable std::vector<std::pair<int, int> > Stack;   // Cull traversal: node and planes still to test
+
+    void SetObject(int object, float cx, float cy, float cz, float ex, float ey, float ez)
+    {
+        ObjectMin[object * 3 + 0] = cx - ex;
+        ObjectMin[object * 3 + 1] = cy - ey;
+        ObjectMin[object * 3 + 2] = cz - ez;
+        ObjectMax[object * 3 + 0] = cx + ex;
+        ObjectMax[object * 3 + 1] = cy + ey;
+        ObjectMax[object * 3 + 2] = cz + ez;
+    }
+
+    void ComputeLeafBounds(int node)
+    {
+        BvhNode& n = Nodes[node];
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            n.Min[axis] = INFINITY;
+            n.Max[axis] = -INFINITY;
+        }
+        for (int i = n.First; i < n.First + n.Count; ++i)
+        {
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                n.Min[axis] = std::min(n.Min[axis], ObjectMin[Objects[i] * 3 + axis]);
+                n.Max[axis] = std::max(n.Max[axis], ObjectMax[Objects[i] * 3 + axis]);
+            }
+        }
+    }
+
+    // computes the bounds of a node and splits it until its leaves hold at most BVH_LEAF_SIZE objects
+    void Split(int node)
+    {
+        ComputeLeafBounds(node);
+        const int first = Nodes[node].First;
+        const int count = Nodes[node].Count;
+        if (count <= BVH_LEAF_SIZE)
+        {
+            Nodes[node].Left = -1;
+            for (int i = first; i < first + count; ++i)
+                ObjectLeaf[Objects[i]] = node;
+            return;
+        }
+
+        // Longest axis of the centroids (twice the centroid, the halving does not change the order)
+        float centroidMin[3] = { INFINITY, INFINITY, INFINITY };
+        float centroidMax[3] = { -INFINITY, -INFINITY, -INFINITY };
+        for (int i = first; i < first + count; ++i)
+        {
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                float c = ObjectMin[Objects[i] * 3 + axis] + ObjectMax[Objects[i] * 3 + axis];
+                centroidMin[axis] = std::min(centroidMin[axis], c);
+                centroidMax[axis] = std::max(centroidMax[axis], c);
+            }
+        }
+        int axis = 0;
+        for (int a = 1; a < 3; ++a)
+        {
+            if (centroidMax[a] - centroidMin[a] > centroidMax[axis] - centroidMin[axis])
+                axis = a;
+        }
+
+        const int half = count / 2;
+        BvhCentroidLess less = { ObjectMin.data(), ObjectMax.data(), axis };
+        std::nth_element(Objects.begin() + first, Objects.begin() + first + half, Objects.begin() + first + count, less);
+
+        const int left = (int)Nodes.size();
+        Nodes[node].Left = left;
+        BvhNode child;
+        child.Parent = node;
+        child.First = first;
+        child.Count = half;
+        Nodes.push_back(child);
+        child.First = first + half;
+        child.Count = count - half;
+        Nodes.push_back(child);
+
+        Split(left);
+        Split(left + 1);
+    }
+
+    // false when the box is behind one of the planes set in planes; clears the bits of the planes it is fully inside of
+    static bool TestPlanes(const Frustum& frustum, const float* min, const float* max, int& planes)
+    {
+        for (int p = 0; p < 6; ++p)
+        {
+            if (!(planes & (1 << p)))
+                continue;
+
+            const float cx = (min[0] + max[0]) * 0.5f, cy = (min[1] + max[1]) * 0.5f, cz = (min[2] + max[2]) * 0.5f;
+            const float distance = frustum.a[p] * cx + frustum.b[p] * cy + frustum.c[p] * cz + frustum.d[p];
+            const float radius = std::fabs(frustum.a[p]) * (max[0] - cx) + std::fabs(frustum.b[p]) * (max[1] - cy) + std::fabs(frustum.c[p]) * (max[2] - cz);
+            if (distance + radius < 0.0f)
+                return false;
+            if (distance - radius >= 0.0f)
+                planes &= ~(1 << p);
+        }
+        return true;
+    }
+
+    // slab test; t is where the ray enters the box, 0 when it starts inside
+    static bool RayBox(const float* origin, const float* inverse, const float* min, const float* max, float& t)
+    {
+        float tNear = 0.0f, tFar = INFINITY;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            float t0 = (min[axis] - origin[axis]) * inverse[axis];
+            float t1 = (max[axis] - origin[axis]) * inverse[axis];
+            if (t0 > t1)
+                std::swap(t0, t1);
+            // NaN when the ray lies in a slab plane: fmax/fmin keep the other operand
+            tNear = std::fmax(tNear, t0);
+            tFar = std::fmin(tFar, t1);
+        }
+        t = tNear;
+        return tNear <= tFar;
+    }
+};
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define FRUSTUM_SIMD_WIDTH 8
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define FRUSTUM_SIMD_WIDTH 4
+#else
+#define FRUSTUM_SIMD_WIDTH 1
+#endif
+
+// Number of bounds tested together; bound arrays are padded to a multiple of 8 whatever the width
+const size_t FRUSTUM_BATCH = 8;
+
+// The six planes of a view frustum, ax + by + cz + d >= 0 inside, one plane per element of each array
+struct Frustum
+{
+    float a[6];
+    float b[6];
+    float c[6];
+    float d[6];
+};
+
+// World-space axis-aligned boxes as centers and half extents, one array per component so the test
+// reads FRUSTUM_SIMD_WIDTH boxes per load
+struct CullBounds
+{
+    size_t count;               // Boxes in use; the arrays hold count rounded up to FRUSTUM_BATCH
+    std::vector<float> centerX;
+    std::vector<float> centerY;
+    std::vector<float> centerZ;
+    std::vector<float> extentX;
+    std::vector<float> extentY;
+    std::vector<float> extentZ;
+};
+
+// Planes of the clip volume of a column-major view-projection (or model-view-projection) matrix, read off its
+// rows (Gribb and Hartmann). The planes are not normalized: the culling test only looks at signs.
+inline void extractFrustum(const float* m, Frustum& frustum)
+{
+    // Row r of the matrix is (m[r], m[4 + r], m[8 + r], m[12 + r])
+    const int rows[6] = { 0, 0, 1, 1, 2, 2 };
+    const float signs[6] = { 1.0f, -1.0f, 1.0f, -1.0f, 1.0f, -1.0f };  // left, right, bottom, top, near, far
+    for (int p = 0; p < 6; ++p)
+    {
+        const int r = rows[p];
+        frustum.a[p] = m[3] + signs[p] * m[r];
+        frustum.b[p] = m[7] + signs[p] * m[4 + r];
+        frustum.c[p] = m[11] + signs[p] * m[8 + r];
+        frustum.d[p] = m[15] + signs[p] * m[12 + r];
+    }
+}
+
+inline void resizeCullBounds(CullBounds& bounds, size_t count)
+{
+    const size_t padded = (count + FRUSTUM_BATCH - 1) / FRUSTUM_BATCH * FRUSTUM_BATCH;
+    bounds.count = count;
+    bounds.centerX.assign(padded, 0.0f);
+    bounds.centerY.assign(padded, 0.0f);
+    bounds.centerZ.assign(padded, 0.0f);
+    bounds.extentX.assign(padded, 0.0f);
+    bounds.extentY.assign(padded, 0.0f);
+    bounds.extentZ.assign(padded, 0.0f);
+}
+
+inline void setCullBounds(CullBounds& bounds, size_t i, const float* center, const float* extent)
+{
+    bounds.centerX[i] = center[0];
+    bounds.centerY[i] = center[1];
+    bounds.centerZ[i] = center[2];
+    bounds.extentX[i] = extent[0];
+    bounds.extentY[i] = extent[1];
+    bounds.extentZ[i] = extent[2];
+}
+
+// Reference test, one box at a time. A box is outside when it lies entirely behind one plane: its corner
+// furthest along the plane normal, center + |normal| * extent, is still behind. Boxes crossing a plane
+// near a frustum corner are kept, which only costs a draw. Sets visible[i] to 0 or 1, returns the visible count.
+inline size_t cullBoundsScalar(const Frustum& frustum, const CullBounds& bounds, unsigned char* visible)
+{
+    size_t nVisible = 0;
+    for (size_t i = 0; i < bounds.count; ++i)
+    {
+        bool inside = true;
+        for (int p = 0; p < 6 && inside; ++p)
+        {
+            float distance = frustum.a[p] * bounds.centerX[i] + frustum.b[p] * bounds.centerY[i] + frustum.c[p] * bounds.centerZ[i] + frustum.d[p] +
+                std::fabs(frustum.a[p]) * bounds.extentX[i] + std::fabs(frustum.b[p]) * bounds.extentY[i] + std::fabs(frustum.c[p]) * bounds.extentZ[i];
+            inside = distance >= 0.0f;
+        }
+        visible[i] = inside ? 1 : 0;
+        nVisible += visible[i];
+    }
+    return nVisible;
+}
+
+// Same test as cullBoundsScalar, FRUSTUM_SIMD_WIDTH boxes per instruction (AVX when the compiler targets it, SSE otherwise)
+inline size_t cullBounds(const Frustum& frustum, const CullBounds& bounds, unsigned char* visible)
+{
+#if FRUSTUM_SIMD_WIDTH == 1
+    return cullBoundsScalar(frustum, bounds, visible);
+#else
+    // The arrays are padded to a multiple of FRUSTUM_BATCH, so the last group loads padding instead of running short
+    size_t nVisible = 0;
+    for (size_t i = 0; i < bounds.count; i += FRUSTUM_SIMD_WIDTH)
+    {
+#if FRUSTUM_SIMD_WIDTH == 8
+        const __m256 cx = _mm256_loadu_ps(&bounds.centerX[i]), cy = _mm256_loadu_ps(&bounds.centerY[i]), cz = _mm256_loadu_ps(&bounds.centerZ[i]);
+        const __m256 ex = _mm256_loadu_ps(&bounds.extentX[i]), ey = _mm256_loadu_ps(&bounds.extentY[i]), ez = _mm256_loadu_ps(&bounds.extentZ[i]);
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int p = 0; p < 6; ++p)
+        {
+            __m256 distance = _mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(frustum.a[p]), cx), _mm256_mul_ps(_mm256_set1_ps(frustum.b[p]), cy)),
+                _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(frustum.c[p]), cz), _mm256_set1_ps(frustum.d[p])));
+            __m256 radius = _mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(std::fabs(frustum.a[p])), ex), _mm256_mul_ps(_mm256_set1_ps(std::fabs(frustum.b[p])), ey)),
+                _mm256_mul_ps(_mm256_set1_ps(std::fabs(frustum.c[p])), ez));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+        const int mask = _mm256_movemask_ps(inside);
+#else
+        const __m128 cx = _mm_loadu_ps(&bounds.centerX[i]), cy = _mm_loadu_ps(&bounds.centerY[i]), cz = _mm_loadu_ps(&bounds.centerZ[i]);
+        const __m128 ex = _mm_loadu_ps(&bounds.extentX[i]), ey = _mm_loadu_ps(&bounds.extentY[i]), ez = _mm_loadu_ps(&bounds.extentZ[i]);
+        __m128 inside = _mm_cmpeq_ps(cx, cx);
+        for (int p = 0; p < 6; ++p)
+        {
+            __m128 distance = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(frustum.a[p]), cx), _mm_mul_ps(_mm_set1_ps(frustum.b[p]), cy)),
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(frustum.c[p]), cz), _mm_set1_ps(frustum.d[p])));
+            __m128 radius = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(std::fabs(frustum.a[p])), ex), _mm_mul_ps(_mm_set1_ps(std::fabs(frustum.b[p])), ey)),
+                _mm_mul_ps(_mm_set1_ps(std::fabs(frustum.c[p])), ez));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+        }
+        const int mask = _mm_movemask_ps(inside);
+#endif
+        for (size_t lane = 0; lane < FRUSTUM_SIMD_WIDTH && i + lane < bounds.count; ++lane)
+        {
+            visible[i + lane] = (unsigned char)((mask >> lane) & 1);
+            nVisible += visible[i + lane];
+        }
+    }
+
+    return nVisible;
+#endif
+}
+
+#endif
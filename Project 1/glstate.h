@@ -0,0 +1,225 @@
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Texture units and indexed buffer binding points tracked by the cache; others go straight to GL
+const GLuint GLSTATE_TEXTURE_UNITS = 8;
+const GLuint GLSTATE_BUFFER_BINDINGS = 8;
+
+// Remembers the program, VAO, texture, buffer, capability, clear color, color mask and depth state it last set, and skips
+// the GL calls that would set it to the same value again. Code that changes any of this state behind
+// its back must call Invalidate() afterwards.
+class GLStateCache
+{
+public:
+    unsigned int Calls;     // State changes passed on to GL since ResetCounters()
+    unsigned int Skipped;   // Redundant calls dropped since ResetCounters()
+
+    GLStateCache()
+    {
+        Invalidate();
+        ResetCounters();
+    }
+
+    // forgets everything, so the next call of each kind reaches GL
+    void Invalidate()
+    {
+        Program = UNKNOWN;
+        VertexArray = UNKNOWN;
+        ActiveUnit = UNKNOWN;
+        for (GLuint unit = 0; unit < GLSTATE_TEXTURE_UNITS; ++unit)
+        {
+            Texture2D[unit] = UNKNOWN;
+            Texture2DArray[unit] = UNKNOWN;
+        }
+        for (GLuint index = 0; index < GLSTATE_BUFFER_BINDINGS; ++index)
+        {
+            UniformBuffers[index] = UNKNOWN;
+            StorageBuffers[index] = UNKNOWN;
+        }
+        DrawIndirectBuffer = UNKNOWN;
+        Capabilities.clear();
+        ClearColorKnown = false;
+        ColorMaskBits = UNKNOWN;
+        DepthFuncValue = UNKNOWN;
+        DepthMaskValue = UNKNOWN;
+    }
+
+    void ResetCounters()
+    {
+        Calls = 0;
+        Skipped = 0;
+    }
+
+    void UseProgram(GLuint program)
+    {
+        if (Changed(Program, program))
+            glUseProgram(program);
+    }
+
+    void BindVertexArray(GLuint vao)
+    {
+        if (Changed(VertexArray, vao))
+            glBindVertexArray(vao);
+    }
+
+    // binds a GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY texture to a unit, selecting the unit only when needed
+    void BindTexture(GLuint unit, GLenum target, GLuint texture)
+    {
+        GLuint* bound = TextureSlot(unit, target);
+        if (bound && *bound == texture)
+        {
+            ++Skipped;
+            return;
+        }
+
+        if (Changed(ActiveUnit, unit))
+            glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(target, texture);
+        ++Calls;
+        if (bound)
+            *bound = texture;
+    }
+
+    // glBindBufferBase for GL_UNIFORM_BUFFER and GL_SHADER_STORAGE_BUFFER; also binds the generic target
+    void BindBufferBase(GLenum target, GLuint index, GLuint buffer)
+    {
+        GLuint* bound = index < GLSTATE_BUFFER_BINDINGS ? (target == GL_UNIFORM_BUFFER ? &UniformBuffers[index] :
+            target == GL_SHADER_STORAGE_BUFFER ? &StorageBuffers[index] : 0) : 0;
+        if (bound && *bound == buffer)
+        {
+            ++Skipped;
+            return;
+        }
+
+        glBindBufferBase(target, index, buffer);
+        ++Calls;
+        if (bound)
+            *bound = buffer;
+    }
+
+    void BindDrawIndirectBuffer(GLuint buffer)
+    {
+        if (Changed(DrawIndirectBuffer, buffer))
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffer);
+    }
+
+    void Enable(GLenum capability)
+    {
+        if (SetCapability(capability, true))
+            glEnable(capability);
+    }
+
+    void Disable(GLenum capability)
+    {
+        if (SetCapability(capability, false))
+            glDisable(capability);
+    }
+
+    void ClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
+    {
+        if (ClearColorKnown && ClearColorValue[0] == red && ClearColorValue[1] == green && ClearColorValue[2] == blue && ClearColorValue[3] == alpha)
+        {
+            ++Skipped;
+            return;
+        }
+
+        glClearColor(red, green, blue, alpha);
+        ++Calls;
+        ClearColorKnown = true;
+        ClearColorValue[0] = red;
+        ClearColorValue[1] = green;
+        ClearColorValue[2] = blue;
+        ClearColorValue[3] = alpha;
+    }
+
+    void ColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha)
+    {
+        GLuint bits = (red ? 1u : 0u) | (green ? 2u : 0u) | (blue ? 4u : 0u) | (alpha ? 8u : 0u);
+        if (Changed(ColorMaskBits, bits))
+            glColorMask(red, green, blue, alpha);
+    }
+
+    void DepthFunc(GLenum func)
+    {
+        if (Changed(DepthFuncValue, func))
+            glDepthFunc(func);
+    }
+
+    void DepthMask(GLboolean flag)
+    {
+        if (Changed(DepthMaskValue, flag ? 1u : 0u))
+            glDepthMask(flag);
+    }
+
+private:
+    static const GLuint UNKNOWN = 0xFFFFFFFFu;
+
+    GLuint Program;
+    GLuint VertexArray;
+    GLuint ActiveUnit;
+    GLuint Texture2D[GLSTATE_TEXTURE_UNITS];
+    GLuint Texture2DArray[GLSTATE_TEXTURE_UNITS];
+    GLuint UniformBuffers[GLSTATE_BUFFER_BINDINGS];
+    GLuint StorageBuffers[GLSTATE_BUFFER_BINDINGS];
+    GLuint DrawIndirectBuffer;
+    std::vector<std::pair<GLenum, bool> > Capabilities;
+    bool ClearColorKnown;
+    GLfloat ClearColorValue[4];
+    GLuint ColorMaskBits;   // Red, green, blue and alpha write flags in bits 0 to 3
+    GLuint DepthFuncValue;
+    GLuint DepthMaskValue;
+
+    // records value and returns true when it differs from the cached one
+    bool Changed(GLuint& cached, GLuint value)
+    {
+        if (cached == value)
+        {
+            ++Skipped;
+            return false;
+        }
+
+        cached = value;
+        ++Calls;
+        return true;
+    }
+
+    GLuint* TextureSlot(GLuint unit, GLenum target)
+    {
+        if (unit >= GLSTATE_TEXTURE_UNITS)
+            return 0;
+        if (target == GL_TEXTURE_2D)
+            return &Texture2D[unit];
+        if (target == GL_TEXTURE_2D_ARRAY)
+            return &Texture2DArray[unit];
+        return 0;
+    }
+
+    bool SetCapability(GLenum capability, bool enabled)
+    {
+        for (size_t i = 0; i < Capabilities.size(); ++i)
+        {
+            if (Capabilities[i].first != capability)
+                continue;
+            if (Capabilities[i].second == enabled)
+            {
+                ++Skipped;
+                return false;
+            }
+            Capabilities[i].second = enabled;
+            ++Calls;
+            return true;
+        }
+
+        Capabilities.push_back(std::make_pair(capability, enabled));
+        ++Calls;
+        return true;
+    }
+};
+
+#endif
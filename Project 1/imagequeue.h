@@ -0,0 +1,126 @@
+#ifndef IMAGEQUEUE_H
+#define IMAGEQUEUE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// One image decoded by a worker thread straight into memory owned by the caller
+struct ImageDecodeJob
+{
+    unsigned int Id;                // Caller's identifier, returned untouched
+    std::string Filename;
+    int Width;                      // Size the image must have once decoded into Destination
+    int Height;
+    unsigned char* Destination;     // Width * Height * 4 bytes of RGBA written by the worker
+    bool Succeeded;
+    double DecodeMilliseconds;      // Time the worker spent in the decode function
+};
+
+// Decodes job.Filename into job.Destination; called on a worker thread, so it must not touch OpenGL
+typedef bool (*ImageDecodeFunction)(const ImageDecodeJob& job);
+
+// A fixed pool of worker threads decoding images in parallel. The GL thread pushes jobs and collects
+// the finished ones with Poll() once per frame, so it never waits on a decode.
+class ImageDecodeQueue
+{
+public:
+    ImageDecodeQueue() : Decode(0), Stopping(false)
+    {
+    }
+
+    ~ImageDecodeQueue()
+    {
+        Stop();
+    }
+
+    // starts the workers running decode; 0 threads uses one per hardware thread
+    void Start(ImageDecodeFunction decode, unsigned int threadCount = 0)
+    {
+        Decode = decode;
+        if (threadCount == 0)
+            threadCount = std::thread::hardware_concurrency();
+        if (threadCount == 0)
+            threadCount = 1;
+
+        Stopping = false;
+        for (unsigned int i = 0; i < threadCount; ++i)
+            Workers.push_back(std::thread(&ImageDecodeQueue::Work, this));
+    }
+
+    void Push(const ImageDecodeJob& job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(Mutex);
+            Pending.push_back(job);
+        }
+        WorkAvailable.notify_one();
+    }
+
+    // moves one finished job into job; returns false when none has finished since the last call
+    bool Poll(ImageDecodeJob& job)
+    {
+        std::lock_guard<std::mutex> lock(Mutex);
+        if (Finished.empty())
+            return false;
+
+        job = Finished.front();
+        Finished.pop_front();
+        return true;
+    }
+
+    // joins the workers; jobs that were not started yet are dropped
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(Mutex);
+            Stopping = true;
+            Pending.clear();
+        }
+        WorkAvailable.notify_all();
+
+        for (size_t i = 0; i < Workers.size(); ++i)
+            Workers[i].join();
+        Workers.clear();
+    }
+
+private:
+    ImageDecodeFunction Decode;
+    std::vector<std::thread> Workers;
+    std::deque<ImageDecodeJob> Pending;
+    std::deque<ImageDecodeJob> Finished;
+    std::mutex Mutex;
+    std::condition_variable WorkAvailable;
+    bool Stopping;
+
+    void Work()
+    {
+        for (;;)
+        {
+            ImageDecodeJob job;
+            {
+                std::unique_lock<std::mutex> lock(Mutex);
+                while (!Stopping && Pending.empty())
+                    WorkAvailable.wait(lock);
+                if (Stopping)
+                    return;
+
+                job = Pending.front();
+                Pending.pop_front();
+            }
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            job.Succeeded = Decode(job);
+            job.DecodeMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            std::lock_guard<std::mutex> lock(Mutex);
+            Finished.push_back(job);
+        }
+    }
+};
+
+#endif
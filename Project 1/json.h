@@ -0,0 +1,322 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Kinds of JSON values
+enum JsonType
+{
+    JSON_NULL,
+    JSON_BOOLEAN,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+    JSON_OBJECT
+};
+
+// One parsed JSON value; only the members matching its type are used
+struct JsonValue
+{
+    JsonType type;
+    bool boolean;
+    double number;
+    std::string string;
+    std::vector<JsonValue> elements;                            // JSON_ARRAY
+    std::vector<std::pair<std::string, JsonValue> > members;    // JSON_OBJECT, in file order
+
+    JsonValue() : type(JSON_NULL), boolean(false), number(0.0)
+    {
+    }
+
+    // member of an object by name, null when missing or when this is not an object
+    const JsonValue* find(const char* name) const
+    {
+        for (size_t i = 0; i < members.size(); ++i)
+        {
+            if (members[i].first == name)
+                return &members[i].second;
+        }
+        return 0;
+    }
+};
+
+// Cursor over the text being parsed; error is set by the first failure
+struct JsonParser
+{
+    const char* text;
+    const char* end;
+    int line;
+    std::string error;
+};
+
+inline bool jsonFail(JsonParser& parser, const char* message)
+{
+    if (parser.error.empty())
+        parser.error = "line " + std::to_string(parser.line) + ": " + message;
+    return false;
+}
+
+inline void jsonSkipSpace(JsonParser& parser)
+{
+    while (parser.text < parser.end && (*parser.text == ' ' || *parser.text == '\t' || *parser.text == '\r' || *parser.text == '\n'))
+    {
+        if (*parser.text == '\n')
+            ++parser.line;
+        ++parser.text;
+    }
+}
+
+inline bool jsonConsume(JsonParser& parser, const char* literal)
+{
+    const char* p = parser.text;
+    for (; *literal; ++literal, ++p)
+    {
+        if (p == parser.end || *p != *literal)
+            return false;
+    }
+    parser.text = p;
+    return true;
+}
+
+// Appends a code point as UTF-8
+inline void jsonAppendUtf8(std::string& out, unsigned int codePoint)
+{
+    if (codePoint < 0x80)
+        out += (char)codePoint;
+    else if (codePoint < 0x800)
+    {
+        out += (char)(0xC0 | (codePoint >> 6));
+        out += (char)(0x80 | (codePoint & 0x3F));
+    }
+    else
+    {
+        out += (char)(0xE0 | (codePoint >> 12));
+        out += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+        out += (char)(0x80 | (codePoint & 0x3F));
+    }
+}
+
+inline bool jsonParseString(JsonParser& parser, std::string& out)
+{
+    ++parser.text; // opening quote
+    out.clear();
+    while (parser.text < parser.end && *parser.text != '"')
+    {
+        char c = *parser.text++;
+        if (c == '\n')
+            return jsonFail(parser, "unterminated string");
+        if (c != '\\')
+        {
+            out += c;
+            continue;
+        }
+
+        if (parser.text == parser.end)
+            break;
+        c = *parser.text++;
+        switch (c)
+        {
+        case '"': out += '"'; break;
+        case '\\': out += '\\'; break;
+        case '/': out += '/'; break;
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u':
+        {
+            if (parser.end - parser.text < 4)
+                return jsonFail(parser, "truncated \\u escape");
+            char digits[5] = { parser.text[0], parser.text[1], parser.text[2], parser.text[3], 0 };
+            char* digitsEnd;
+            unsigned long codePoint = strtoul(digits, &digitsEnd, 16);
+            if (digitsEnd != digits + 4)
+                return jsonFail(parser, "invalid \\u escape");
+            jsonAppendUtf8(out, (unsigned int)codePoint);
+            parser.text += 4;
+            break;
+        }
+        default:
+            return jsonFail(parser, "invalid escape in string");
+        }
+    }
+
+    if (parser.text == parser.end)
+        return jsonFail(parser, "unterminated string");
+    ++parser.text; // closing quote
+    return true;
+}
+
+inline bool jsonParseValue(JsonParser& parser, JsonValue& value, int depth);
+
+inline bool jsonParseArray(JsonParser& parser, JsonValue& value, int depth)
+{
+    value.type = JSON_ARRAY;
+    ++parser.text; // [
+    jsonSkipSpace(parser);
+    if (parser.text < parser.end && *parser.text == ']')
+    {
+        ++parser.text;
+        return true;
+    }
+
+    for (;;)
+    {
+        value.elements.push_back(JsonValue());
+        if (!jsonParseValue(parser, value.elements.back(), depth + 1))
+            return false;
+
+        jsonSkipSpace(parser);
+        if (parser.text < parser.end && *parser.text == ',')
+            ++parser.text;
+        else if (parser.text < parser.end && *parser.text == ']')
+        {
+            ++parser.text;
+            return true;
+        }
+        else
+            return jsonFail(parser, "expected ',' or ']' in array");
+    }
+}
+
+inline bool jsonParseObject(JsonParser& parser, JsonValue& value, int depth)
+{
+    value.type = JSON_OBJECT;
+    ++parser.text; // {
+    jsonSkipSpace(parser);
+    if (parser.text < parser.end && *parser.text == '}')
+    {
+        ++parser.text;
+        return true;
+    }
+
+    for (;;)
+    {
+        jsonSkipSpace(parser);
+        if (parser.text == parser.end || *parser.text != '"')
+            return jsonFail(parser, "expected a member name");
+
+        value.members.push_back(std::make_pair(std::string(), JsonValue()));
+        if (!jsonParseString(parser, value.members.back().first))
+            return false;
+
+        jsonSkipSpace(parser);
+        if (parser.text == parser.end || *parser.text != ':')
+            return jsonFail(parser, "expected ':' after member name");
+        ++parser.text;
+
+        if (!jsonParseValue(parser, value.members.back().second, depth + 1))
+            return false;
+
+        jsonSkipSpace(parser);
+        if (parser.text < parser.end && *parser.text == ',')
+            ++parser.text;
+        else if (parser.text < parser.end && *parser.text == '}')
+        {
+            ++parser.text;
+            return true;
+        }
+        else
+            return jsonFail(parser, "expected ',' or '}' in object");
+    }
+}
+
+inline bool jsonParseValue(JsonParser& parser, JsonValue& value, int depth)
+{
+    // Scene files are shallow; the limit only stops runaway recursion on bad input
+    if (depth > 64)
+        return jsonFail(parser, "nested too deeply");
+
+    jsonSkipSpace(parser);
+    if (parser.text == parser.end)
+        return jsonFail(parser, "unexpected end of file");
+
+    const char c = *parser.text;
+    if (c == '{')
+        return jsonParseObject(parser, value, depth);
+    if (c == '[')
+        return jsonParseArray(parser, value, depth);
+    if (c == '"')
+    {
+        value.type = JSON_STRING;
+        return jsonParseString(parser, value.string);
+    }
+    if (jsonConsume(parser, "true"))
+    {
+        value.type = JSON_BOOLEAN;
+        value.boolean = true;
+        return true;
+    }
+    if (jsonConsume(parser, "false"))
+    {
+        value.type = JSON_BOOLEAN;
+        value.boolean = false;
+        return true;
+    }
+    if (jsonConsume(parser, "null"))
+    {
+        value.type = JSON_NULL;
+        return true;
+    }
+
+    // strtod accepts a superset of JSON numbers, which is fine for hand-written files
+    std::string number;
+    while (parser.text < parser.end && ((*parser.text >= '0' && *parser.text <= '9') || *parser.text == '-' || *parser.text == '+' || *parser.text == '.' || *parser.text == 'e' || *parser.text == 'E'))
+        number += *parser.text++;
+    if (number.empty())
+        return jsonFail(parser, "unexpected character");
+
+    char* numberEnd;
+    value.type = JSON_NUMBER;
+    value.number = strtod(number.c_str(), &numberEnd);
+    if (*numberEnd != '\0')
+        return jsonFail(parser, "invalid number");
+    return true;
+}
+
+// Parses a whole document; returns false with error holding the line and reason on malformed input
+inline bool parseJson(const char* text, size_t length, JsonValue& value, std::string& error)
+{
+    JsonParser parser;
+    parser.text = text;
+    parser.end = text + length;
+    parser.line = 1;
+
+    value = JsonValue();
+    bool parsed = jsonParseValue(parser, value, 0);
+    if (parsed)
+    {
+        jsonSkipSpace(parser);
+        if (parser.text != parser.end)
+            parsed = jsonFail(parser, "unexpected text after the document");
+    }
+
+    error = parser.error;
+    return parsed;
+}
+
+inline bool readJsonFile(const char* path, JsonValue& value, std::string& error)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+    {
+        error = "cannot open file";
+        return false;
+    }
+
+    std::string text;
+    char buffer[4096];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        text.append(buffer, read);
+    fclose(file);
+
+    return parseJson(text.data(), text.size(), value, error);
+}
+
+#endif
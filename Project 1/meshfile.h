@@ -0,0 +1,360 @@
+#ifndef MESHFILE_H
+#define MESHFILE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "meshopt.h"
+
+// Binary mesh container (.bmesh). It holds what the renderer uploads, laid out the way it uploads it, so loading
+// a file is mapping it and handing ranges of the mapping to the GL:
+//
+//     MeshFileHeader
+//     MeshFileAttribute[attributeCount]    layout of a vertex in the vertex blob
+//     MeshFileMesh[meshCount]              ranges, levels of detail and bounds of each mesh
+//     vertex blob                          interleaved vertices of every mesh, one mesh after the other
+//     position blob                        the positions alone (the depth pre-pass stream), same order
+//     index blob                           32-bit indices, local to each mesh's vertices
+//
+// Every blob starts at a multiple of MESH_FILE_ALIGNMENT bytes. Offsets and counts are checked when a file is
+// opened; index values are not, so files are trusted like baked textures.
+
+// Alignment of the blobs in the file (and so in a page-aligned mapping of it)
+const uint64_t MESH_FILE_ALIGNMENT = 64;
+
+// Levels of detail a mesh can hold, like the renderer's meshes
+const uint32_t MESH_FILE_MAX_LODS = 4;
+
+const uint32_t MESH_FILE_VERSION = 1;
+
+// Component type of an attribute, with the value of the matching GL enum
+const uint32_t MESH_FILE_FLOAT = 0x1406;    // GL_FLOAT
+
+struct MeshFileHeader
+{
+    char magic[4];          // "BMSH"
+    uint32_t version;
+    uint32_t meshCount;
+    uint32_t attributeCount;
+    uint32_t vertexStride;  // Bytes per vertex in the vertex blob
+    uint32_t indexSize;     // Bytes per index (4)
+    uint64_t vertexOffset;  // Blobs, as byte ranges of the file
+    uint64_t vertexBytes;
+    uint64_t positionOffset;
+    uint64_t positionBytes;
+    uint64_t indexOffset;
+    uint64_t indexBytes;
+};
+
+// One vertex attribute: the shader location it feeds, and where it lies in a vertex
+struct MeshFileAttribute
+{
+    uint32_t location;
+    uint32_t components;
+    uint32_t type;          // MESH_FILE_FLOAT
+    uint32_t offset;        // Bytes from the start of the vertex
+};
+
+struct MeshFileLod
+{
+    uint32_t firstIndex;    // Relative to the mesh's first index
+    uint32_t indexCount;
+    float error;            // Largest distance between the level and the full mesh, in object units
+    uint32_t reserved;
+};
+
+struct MeshFileMesh
+{
+    char name[48];          // Null-terminated
+    uint32_t firstVertex;   // In vertices of the vertex and position blobs
+    uint32_t vertexCount;
+    uint32_t firstIndex;    // In indices of the index blob; the mesh's levels follow one another from there
+    uint32_t indexCount;    // Of all levels together
+    uint32_t lodCount;      // 1 to MESH_FILE_MAX_LODS, finest first
+    uint32_t reserved;
+    MeshFileLod lods[MESH_FILE_MAX_LODS];
+    float boundsMin[3];     // Object-space bounding box of the vertices
+    float boundsMax[3];
+};
+
+// A mesh to write: welded vertices in the renderer's layout and the indices of all of its levels
+struct MeshFileSource
+{
+    std::string name;
+    const float* vertices;
+    uint32_t vertexCount;
+    const uint32_t* indices;
+    uint32_t indexCount;
+    const MeshFileLod* lods;
+    uint32_t lodCount;
+};
+
+// Read-only mapping of a whole file
+struct MeshFileMapping
+{
+    const unsigned char* data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
+
+inline uint64_t meshFileAlign(uint64_t offset)
+{
+    return (offset + MESH_FILE_ALIGNMENT - 1) / MESH_FILE_ALIGNMENT * MESH_FILE_ALIGNMENT;
+}
+
+inline const MeshFileHeader* meshFileHeader(const unsigned char* data)
+{
+    return (const MeshFileHeader*)data;
+}
+
+inline const MeshFileAttribute* meshFileAttributes(const unsigned char* data)
+{
+    return (const MeshFileAttribute*)(data + sizeof(MeshFileHeader));
+}
+
+inline const MeshFileMesh* meshFileMeshes(const unsigned char* data)
+{
+    return (const MeshFileMesh*)(data + sizeof(MeshFileHeader) + meshFileHeader(data)->attributeCount * sizeof(MeshFileAttribute));
+}
+
+// Writes meshes in the renderer's layout (position, normal, texture coordinate as MESH_VERTEX_FLOATS floats).
+// Nothing is reordered: optimize the vertices and indices before writing them.
+inline bool writeMeshFile(const char* path, const MeshFileSource* meshes, size_t meshCount)
+{
+    const MeshFileAttribute attributes[3] = {
+        { 0, 3, MESH_FILE_FLOAT, 0 },
+        { 1, 3, MESH_FILE_FLOAT, 3 * sizeof(float) },
+        { 2, 2, MESH_FILE_FLOAT, 6 * sizeof(float) }
+    };
+
+    MeshFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "BMSH", 4);
+    header.version = MESH_FILE_VERSION;
+    header.meshCount = (uint32_t)meshCount;
+    header.attributeCount = 3;
+    header.vertexStride = MESH_VERTEX_FLOATS * sizeof(float);
+    header.indexSize = sizeof(uint32_t);
+
+    std::vector<MeshFileMesh> table(meshCount);
+    uint64_t vertexCount = 0, indexCount = 0;
+    for (size_t m = 0; m < meshCount; ++m)
+    {
+        const MeshFileSource& source = meshes[m];
+        if (source.lodCount == 0 || source.lodCount > MESH_FILE_MAX_LODS)
+            return false;
+
+        MeshFileMesh& mesh = table[m];
+        memset(&mesh, 0, sizeof(mesh));
+        strncpy(mesh.name, source.name.c_str(), sizeof(mesh.name) - 1);
+        mesh.firstVertex = (uint32_t)vertexCount;
+        mesh.vertexCount = source.vertexCount;
+        mesh.firstIndex = (uint32_t)indexCount;
+        mesh.indexCount = source.indexCount;
+        mesh.lodCount = source.lodCount;
+        memcpy(mesh.lods, source.lods, source.lodCount * sizeof(MeshFileLod));
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            mesh.boundsMin[axis] = source.vertexCount ? source.vertices[axis] : 0.0f;
+            mesh.boundsMax[axis] = mesh.boundsMin[axis];
+        }
+        for (uint32_t v = 0; v < source.vertexCount; ++v)
+        {
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                const float value = source.vertices[(size_t)v * MESH_VERTEX_FLOATS + axis];
+                mesh.boundsMin[axis] = value < mesh.boundsMin[axis] ? value : mesh.boundsMin[axis];
+                mesh.boundsMax[axis] = value > mesh.boundsMax[axis] ? value : mesh.boundsMax[axis];
+            }
+        }
+
+        vertexCount += source.vertexCount;
+        indexCount += source.indexCount;
+    }
+
+    const uint64_t tableEnd = sizeof(header) + sizeof(attributes) + meshCount * sizeof(MeshFileMesh);
+    header.vertexOffset = meshFileAlign(tableEnd);
+    header.vertexBytes = vertexCount * header.vertexStride;
+    header.positionOffset = meshFileAlign(header.vertexOffset + header.vertexBytes);
+    header.positionBytes = vertexCount * 3 * sizeof(float);
+    header.indexOffset = meshFileAlign(header.positionOffset + header.positionBytes);
+    header.indexBytes = indexCount * sizeof(uint32_t);
+
+    FILE* file = fopen(path, "wb");
+    if (!file)
+        return false;
+
+    const unsigned char padding[MESH_FILE_ALIGNMENT] = {};
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(attributes, sizeof(attributes), 1, file) == 1
+        && fwrite(table.data(), sizeof(MeshFileMesh), table.size(), file) == table.size()
+        && fwrite(padding, 1, header.vertexOffset - tableEnd, file) == header.vertexOffset - tableEnd;
+    for (size_t m = 0; m < meshCount && written; ++m)
+        written = fwrite(meshes[m].vertices, header.vertexStride, meshes[m].vertexCount, file) == meshes[m].vertexCount;
+
+    const uint64_t vertexEnd = header.vertexOffset + header.vertexBytes;
+    written = written && fwrite(padding, 1, header.positionOffset - vertexEnd, file) == header.positionOffset - vertexEnd;
+    std::vector<float> positions;
+    for (size_t m = 0; m < meshCount && written; ++m)
+    {
+        positions.resize((size_t)meshes[m].vertexCount * 3);
+        for (uint32_t v = 0; v < meshes[m].vertexCount; ++v)
+            memcpy(&positions[(size_t)v * 3], meshes[m].vertices + (size_t)v * MESH_VERTEX_FLOATS, 3 * sizeof(float));
+        written = fwrite(positions.data(), sizeof(float), positions.size(), file) == positions.size();
+    }
+
+    const uint64_t positionEnd = header.positionOffset + header.positionBytes;
+    written = written && fwrite(padding, 1, header.indexOffset - positionEnd, file) == header.indexOffset - positionEnd;
+    for (size_t m = 0; m < meshCount && written; ++m)
+        written = fwrite(meshes[m].indices, sizeof(uint32_t), meshes[m].indexCount, file) == meshes[m].indexCount;
+
+    fclose(file);
+    return written;
+}
+
+// True when bytes bytes from offset end at or before limit, without the sum wrapping around
+inline bool meshFileRangeInside(uint64_t offset, uint64_t bytes, uint64_t limit)
+{
+    return bytes <= limit && offset <= limit - bytes;
+}
+
+// Checks that the header, the tables and every range they give lie inside size bytes of data; false for
+// anything that is not a mesh file of this version
+inline bool validateMeshFile(const unsigned char* data, size_t size)
+{
+    if (size < sizeof(MeshFileHeader))
+        return false;
+
+    const MeshFileHeader& header = *meshFileHeader(data);
+    if (memcmp(header.magic, "BMSH", 4) != 0 || header.version != MESH_FILE_VERSION || header.indexSize != sizeof(uint32_t)
+        || header.vertexStride == 0 || header.vertexStride % sizeof(float) != 0)
+        return false;
+
+    // Each blob has to end before the next one starts, and the last before the end of the file
+    const uint64_t tableEnd = sizeof(MeshFileHeader) + (uint64_t)header.attributeCount * sizeof(MeshFileAttribute) + (uint64_t)header.meshCount * sizeof(MeshFileMesh);
+    if (tableEnd > header.vertexOffset || header.vertexOffset % MESH_FILE_ALIGNMENT != 0 || header.positionOffset % MESH_FILE_ALIGNMENT != 0
+        || header.indexOffset % MESH_FILE_ALIGNMENT != 0 || !meshFileRangeInside(header.vertexOffset, header.vertexBytes, header.positionOffset)
+        || !meshFileRangeInside(header.positionOffset, header.positionBytes, header.indexOffset) || !meshFileRangeInside(header.indexOffset, header.indexBytes, size))
+        return false;
+
+    // The blobs lie inside the file, so these counts are bounded by its size and the products below cannot wrap
+    const uint64_t vertexCount = header.vertexBytes / header.vertexStride;
+    const uint64_t indexCount = header.indexBytes / sizeof(uint32_t);
+    if (header.positionBytes != vertexCount * 3 * sizeof(float))
+        return false;
+
+    const MeshFileAttribute* attributes = meshFileAttributes(data);
+    for (uint32_t a = 0; a < header.attributeCount; ++a)
+    {
+        if (attributes[a].type != MESH_FILE_FLOAT || (uint64_t)attributes[a].offset + (uint64_t)attributes[a].components * sizeof(float) > header.vertexStride)
+            return false;
+    }
+
+    const MeshFileMesh* meshes = meshFileMeshes(data);
+    for (uint32_t m = 0; m < header.meshCount; ++m)
+    {
+        const MeshFileMesh& mesh = meshes[m];
+        if ((uint64_t)mesh.firstVertex + mesh.vertexCount > vertexCount || (uint64_t)mesh.firstIndex + mesh.indexCount > indexCount
+            || mesh.vertexCount == 0 || mesh.indexCount == 0 || mesh.lodCount == 0 || mesh.lodCount > MESH_FILE_MAX_LODS
+            || memchr(mesh.name, 0, sizeof(mesh.name)) == 0)
+            return false;
+        for (uint32_t level = 0; level < mesh.lodCount; ++level)
+        {
+            if ((uint64_t)mesh.lods[level].firstIndex + mesh.lods[level].indexCount > mesh.indexCount)
+                return false;
+        }
+    }
+    return true;
+}
+
+// Maps a whole file read-only and asks the system to start reading it in; false when it cannot be opened
+inline bool mapMeshFile(const char* path, MeshFileMapping& mapping)
+{
+    mapping.data = 0;
+    mapping.size = 0;
+#ifdef _WIN32
+    mapping.file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    mapping.mapping = NULL;
+    if (mapping.file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(mapping.file, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(mapping.file);
+        return false;
+    }
+    mapping.mapping = CreateFileMappingA(mapping.file, NULL, PAGE_READONLY, 0, 0, NULL);
+    mapping.data = mapping.mapping ? (const unsigned char*)MapViewOfFile(mapping.mapping, FILE_MAP_READ, 0, 0, 0) : 0;
+    if (!mapping.data)
+    {
+        if (mapping.mapping)
+            CloseHandle(mapping.mapping);
+        CloseHandle(mapping.file);
+        return false;
+    }
+    mapping.size = (size_t)size.QuadPart;
+    return true;
+#else
+    int file = open(path, O_RDONLY);
+    if (file < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(file, &info) != 0 || info.st_size == 0)
+    {
+        close(file);
+        return false;
+    }
+
+    // The mapping keeps the file open by itself
+    void* data = mmap(0, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (data == MAP_FAILED)
+        return false;
+
+    madvise(data, (size_t)info.st_size, MADV_WILLNEED);
+    mapping.data = (const unsigned char*)data;
+    mapping.size = (size_t)info.st_size;
+    return true;
+#endif
+}
+
+inline void unmapMeshFile(MeshFileMapping& mapping)
+{
+    if (!mapping.data)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(mapping.data);
+    CloseHandle(mapping.mapping);
+    CloseHandle(mapping.file);
+#else
+    munmap((void*)mapping.data, mapping.size);
+#endif
+    mapping.data = 0;
+    mapping.size = 0;
+}
+
+#endif
@@ -0,0 +1,333 @@
+#ifndef MESHGEN_H
+#define MESHGEN_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "meshopt.h"
+
+// Procedural meshes in the renderer's interleaved layout (position, normal, texture coordinate). Every shape
+// is centered on the origin with its axis along Y. Its vertex and index counts are known up front, so the
+// caller allocates once and the generator writes straight into that memory. Normals and UVs come from the
+// shape's parametric form rather than from the triangles. Triangles are counter-clockwise seen from outside.
+
+// Vertex and index counts of a generated mesh
+struct MeshSize
+{
+    size_t vertices;
+    size_t indices;
+};
+
+// Write cursor into preallocated vertex and index memory; several shapes can follow each other in one buffer
+struct MeshWriter
+{
+    float* vertices;    // Next vertex, MESH_VERTEX_FLOATS floats each
+    uint32_t* indices;  // Next index
+    uint32_t vertex;    // Index the next vertex will have
+};
+
+// Unit-sized shapes: each fits the box from -0.5 to 0.5 on every axis
+enum MeshShape
+{
+    MESH_CYLINDER,
+    MESH_CONE,
+    MESH_CAPSULE,
+    MESH_TORUS,
+    MESH_BOX
+};
+
+const float MESH_PI = 3.14159265358979f;
+
+inline MeshWriter meshWriter(float* vertices, uint32_t* indices)
+{
+    MeshWriter writer = { vertices, indices, 0 };
+    return writer;
+}
+
+inline void meshWriteVertex(MeshWriter& writer, float px, float py, float pz, float nx, float ny, float nz, float u, float v)
+{
+    float* out = writer.vertices;
+    out[0] = px;
+    out[1] = py;
+    out[2] = pz;
+    out[3] = nx;
+    out[4] = ny;
+    out[5] = nz;
+    out[6] = u;
+    out[7] = v;
+    writer.vertices += MESH_VERTEX_FLOATS;
+    ++writer.vertex;
+}
+
+inline void meshWriteTriangle(MeshWriter& writer, uint32_t a, uint32_t b, uint32_t c)
+{
+    writer.indices[0] = a;
+    writer.indices[1] = b;
+    writer.indices[2] = c;
+    writer.indices += 3;
+}
+
+// Triangles between two rows of columns + 1 vertices, the upper row above the lower one on the surface. A row
+// that collapses to a point (a pole or an apex) gets one triangle per column instead of two.
+inline void meshWriteStrip(MeshWriter& writer, uint32_t lower, uint32_t upper, int columns, bool lowerPole, bool upperPole)
+{
+    for (int i = 0; i < columns; ++i)
+    {
+        if (!lowerPole)
+            meshWriteTriangle(writer, lower + i, lower + i + 1, upper + i + 1);
+        if (!upperPole)
+            meshWriteTriangle(writer, lower + i, upper + i + 1, upper + i);
+    }
+}
+
+// Row of segments + 1 vertices around the Y axis at height y. The first and last vertex share a position so the
+// texture wraps once. (nr, ny) is the normal in the plane of the profile: nr away from the axis, ny along it.
+inline void meshWriteRing(MeshWriter& writer, float radius, float y, float nr, float ny, float v, int segments)
+{
+    for (int i = 0; i <= segments; ++i)
+    {
+        const float angle = 2.0f * MESH_PI * i / segments;
+        const float c = std::cos(angle);
+        const float s = -std::sin(angle);
+        meshWriteVertex(writer, radius * c, y, radius * s, nr * c, ny, nr * s, (float)i / segments, v);
+    }
+}
+
+// Flat disc facing +Y (up) or -Y at height y: a center vertex and a ring, textured as a top view
+inline void meshWriteDisc(MeshWriter& writer, float radius, float y, bool up, int segments)
+{
+    const uint32_t center = writer.vertex;
+    const float ny = up ? 1.0f : -1.0f;
+    meshWriteVertex(writer, 0.0f, y, 0.0f, 0.0f, ny, 0.0f, 0.5f, 0.5f);
+    for (int i = 0; i < segments; ++i)
+    {
+        const float angle = 2.0f * MESH_PI * i / segments;
+        const float c = std::cos(angle);
+        const float s = -std::sin(angle);
+        meshWriteVertex(writer, radius * c, y, radius * s, 0.0f, ny, 0.0f, 0.5f + 0.5f * c, 0.5f - 0.5f * s);
+    }
+
+    for (int i = 0; i < segments; ++i)
+    {
+        const uint32_t a = center + 1 + i;
+        const uint32_t b = center + 1 + (i + 1) % segments;
+        if (up)
+            meshWriteTriangle(writer, center, a, b);
+        else
+            meshWriteTriangle(writer, center, b, a);
+    }
+}
+
+inline MeshSize discMeshSize(int segments)
+{
+    MeshSize size = { (size_t)segments + 1, (size_t)segments * 3 };
+    return size;
+}
+
+// Closed cylinder: rings rows of quads around the side, a disc at each end
+inline MeshSize cylinderMeshSize(int segments, int rings)
+{
+    MeshSize size = { (size_t)(rings + 1) * (segments + 1) + 2 * discMeshSize(segments).vertices,
+        (size_t)rings * segments * 6 + 2 * discMeshSize(segments).indices };
+    return size;
+}
+
+inline void generateCylinder(MeshWriter& writer, float radius, float height, int segments, int rings)
+{
+    const uint32_t first = writer.vertex;
+    for (int r = 0; r <= rings; ++r)
+        meshWriteRing(writer, radius, height * ((float)r / rings - 0.5f), 1.0f, 0.0f, (float)r / rings, segments);
+    for (int r = 0; r < rings; ++r)
+        meshWriteStrip(writer, first + r * (segments + 1), first + (r + 1) * (segments + 1), segments, false, false);
+
+    meshWriteDisc(writer, radius, -0.5f * height, false, segments);
+    meshWriteDisc(writer, radius, 0.5f * height, true, segments);
+}
+
+// Cone with its apex up and a disc under its base. The apex row keeps one vertex per column, so each triangle
+// there gets the normal halfway between its two base vertices.
+inline MeshSize coneMeshSize(int segments, int rings)
+{
+    MeshSize size = { (size_t)(rings + 1) * (segments + 1) + discMeshSize(segments).vertices,
+        (size_t)(rings - 1) * segments * 6 + (size_t)segments * 3 + discMeshSize(segments).indices };
+    return size;
+}
+
+inline void generateCone(MeshWriter& writer, float radius, float height, int segments, int rings)
+{
+    // The side's normal leans up by the cone's half angle
+    const float slant = std::sqrt(radius * radius + height * height);
+    const float nr = height / slant;
+    const float ny = radius / slant;
+
+    const uint32_t first = writer.vertex;
+    for (int r = 0; r < rings; ++r)
+    {
+        const float t = (float)r / rings;
+        meshWriteRing(writer, radius * (1.0f - t), height * (t - 0.5f), nr, ny, t, segments);
+    }
+    for (int i = 0; i <= segments; ++i)
+    {
+        const float angle = 2.0f * MESH_PI * (i + 0.5f) / segments;
+        meshWriteVertex(writer, 0.0f, 0.5f * height, 0.0f, nr * std::cos(angle), ny, -nr * std::sin(angle), (i + 0.5f) / segments, 1.0f);
+    }
+    for (int r = 0; r < rings; ++r)
+        meshWriteStrip(writer, first + r * (segments + 1), first + (r + 1) * (segments + 1), segments, false, r == rings - 1);
+
+    meshWriteDisc(writer, radius, -0.5f * height, false, segments);
+}
+
+// Cylinder of the given length between two hemispheres of rings rows each; height = length + 2 * radius
+inline MeshSize capsuleMeshSize(int segments, int rings)
+{
+    const size_t rows = 2 * ((size_t)rings + 1);
+    MeshSize size = { rows * (segments + 1), ((rows - 1) * 2 - 2) * (size_t)segments * 3 };
+    return size;
+}
+
+inline void generateCapsule(MeshWriter& writer, float radius, float length, int segments, int rings)
+{
+    const float height = length + 2.0f * radius;
+    const uint32_t first = writer.vertex;
+
+    // Bottom hemisphere from the pole up to the equator, then the top one from its equator to the pole
+    for (int hemisphere = 0; hemisphere < 2; ++hemisphere)
+    {
+        for (int r = 0; r <= rings; ++r)
+        {
+            const float latitude = 0.5f * MESH_PI * ((float)(r + hemisphere * rings) / rings - 1.0f);
+            const float nr = std::cos(latitude);
+            const float ny = std::sin(latitude);
+            const float y = radius * ny + (hemisphere ? 0.5f : -0.5f) * length;
+            meshWriteRing(writer, radius * nr, y, nr, ny, y / height + 0.5f, segments);
+        }
+    }
+
+    const int rows = 2 * (rings + 1);
+    for (int r = 0; r < rows - 1; ++r)
+        meshWriteStrip(writer, first + r * (segments + 1), first + (r + 1) * (segments + 1), segments, r == 0, r == rows - 2);
+}
+
+// Ring torus around the Y axis: segments around the axis, sides around the tube
+inline MeshSize torusMeshSize(int segments, int sides)
+{
+    MeshSize size = { (size_t)(sides + 1) * (segments + 1), (size_t)sides * segments * 6 };
+    return size;
+}
+
+inline void generateTorus(MeshWriter& writer, float majorRadius, float minorRadius, int segments, int sides)
+{
+    const uint32_t first = writer.vertex;
+    for (int j = 0; j <= sides; ++j)
+    {
+        // One row per angle around the tube, starting at its outer equator and going up
+        const float angle = 2.0f * MESH_PI * j / sides;
+        const float nr = std::cos(angle);
+        const float ny = std::sin(angle);
+        meshWriteRing(writer, majorRadius + minorRadius * nr, minorRadius * ny, nr, ny, (float)j / sides, segments);
+    }
+    for (int j = 0; j < sides; ++j)
+        meshWriteStrip(writer, first + j * (segments + 1), first + (j + 1) * (segments + 1), segments, false, false);
+}
+
+// Box with every face split into subdivisions x subdivisions quads, each face textured 0 to 1
+inline MeshSize boxMeshSize(int subdivisions)
+{
+    MeshSize size = { (size_t)6 * (subdivisions + 1) * (subdivisions + 1), (size_t)6 * subdivisions * subdivisions * 6 };
+    return size;
+}
+
+inline void generateBox(MeshWriter& writer, float width, float height, float depth, int subdivisions)
+{
+    // Corner, edge directions (u x v points outward) and normal of each face of the unit cube
+    static const float faces[6][4][3] = {
+        { {  0.5f, -0.5f,  0.5f }, {  0.0f, 0.0f, -1.0f }, { 0.0f, 1.0f,  0.0f }, {  1.0f,  0.0f,  0.0f } },
+        { { -0.5f, -0.5f, -0.5f }, {  0.0f, 0.0f,  1.0f }, { 0.0f, 1.0f,  0.0f }, { -1.0f,  0.0f,  0.0f } },
+        { { -0.5f,  0.5f,  0.5f }, {  1.0f, 0.0f,  0.0f }, { 0.0f, 0.0f, -1.0f }, {  0.0f,  1.0f,  0.0f } },
+        { { -0.5f, -0.5f, -0.5f }, {  1.0f, 0.0f,  0.0f }, { 0.0f, 0.0f,  1.0f }, {  0.0f, -1.0f,  0.0f } },
+        { { -0.5f, -0.5f,  0.5f }, {  1.0f, 0.0f,  0.0f }, { 0.0f, 1.0f,  0.0f }, {  0.0f,  0.0f,  1.0f } },
+        { {  0.5f, -0.5f, -0.5f }, { -1.0f, 0.0f,  0.0f }, { 0.0f, 1.0f,  0.0f }, {  0.0f,  0.0f, -1.0f } }
+    };
+    const float scale[3] = { width, height, depth };
+
+    for (int face = 0; face < 6; ++face)
+    {
+        const float (*f)[3] = faces[face];
+        const uint32_t first = writer.vertex;
+        for (int j = 0; j <= subdivisions; ++j)
+        {
+            const float t = (float)j / subdivisions;
+            for (int i = 0; i <= subdivisions; ++i)
+            {
+                const float s = (float)i / subdivisions;
+                meshWriteVertex(writer,
+                    (f[0][0] + f[1][0] * s + f[2][0] * t) * scale[0],
+                    (f[0][1] + f[1][1] * s + f[2][1] * t) * scale[1],
+                    (f[0][2] + f[1][2] * s + f[2][2] * t) * scale[2],
+                    f[3][0], f[3][1], f[3][2], s, t);
+            }
+        }
+        for (int j = 0; j < subdivisions; ++j)
+            meshWriteStrip(writer, first + j * (subdivisions + 1), first + (j + 1) * (subdivisions + 1), subdivisions, false, false);
+    }
+}
+
+// Size of a unit shape; segments go around the axis (or along each box edge), rings along it
+inline MeshSize meshShapeSize(MeshShape shape, int segments, int rings)
+{
+    switch (shape)
+    {
+    case MESH_CYLINDER: return cylinderMeshSize(segments, rings);
+    case MESH_CONE: return coneMeshSize(segments, rings);
+    case MESH_CAPSULE: return capsuleMeshSize(segments, rings);
+    case MESH_TORUS: return torusMeshSize(segments, rings);
+    default: return boxMeshSize(segments);
+    }
+}
+
+// Writes a unit shape, see meshShapeSize
+inline void generateMeshShape(MeshWriter& writer, MeshShape shape, int segments, int rings)
+{
+    switch (shape)
+    {
+    case MESH_CYLINDER: generateCylinder(writer, 0.5f, 1.0f, segments, rings); break;
+    case MESH_CONE: generateCone(writer, 0.5f, 1.0f, segments, rings); break;
+    case MESH_CAPSULE: generateCapsule(writer, 0.25f, 0.5f, segments, rings); break;
+    case MESH_TORUS: generateTorus(writer, 0.375f, 0.125f, segments, rings); break;
+    default: generateBox(writer, 1.0f, 1.0f, 1.0f, segments); break;
+    }
+}
+
+// Largest distance between a unit shape's triangles and its exact surface: the sagitta of one slice of its widest
+// ring, plus that of one step of the profile for the round ones. Boxes are exact.
+inline float meshShapeError(MeshShape shape, int segments, int rings)
+{
+    const float around = 1.0f - std::cos(MESH_PI / segments);
+    switch (shape)
+    {
+    case MESH_CYLINDER:
+    case MESH_CONE: return 0.5f * around;
+    case MESH_CAPSULE:
+    {
+        const float along = 1.0f - std::cos(0.25f * MESH_PI / rings);
+        return 0.25f * (around > along ? around : along);
+    }
+    case MESH_TORUS: return 0.5f * around + 0.125f * (1.0f - std::cos(MESH_PI / rings));
+    default: return 0.0f;
+    }
+}
+
+// Moves vertices already written, e.g. to place a shape off center
+inline void translateMeshVertices(float* vertices, size_t count, float x, float y, float z)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        float* position = vertices + i * MESH_VERTEX_FLOATS;
+        position[0] += x;
+        position[1] += y;
+        position[2] += z;
+    }
+}
+
+#endif
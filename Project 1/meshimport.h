@@ -0,0 +1,642 @@
+#ifndef MESHIMPORT_H
+#define MESHIMPORT_H
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "json.h"
+#include "meshopt.h"
+
+// Importers of Wavefront OBJ and binary glTF 2.0 (.glb) files into indexed meshes in the renderer's vertex layout
+// (MESH_VERTEX_FLOATS floats: position, normal, texture coordinate). Texture coordinates have their origin at the
+// bottom left, like the renderer's textures. Vertices without a normal get the area-weighted average of the normals
+// of the faces around them.
+//
+// OBJ files are split into chunks of whole lines, parsed on one thread each with their own number parsers, then
+// joined: a vertex is made for every distinct position/texture coordinate/normal triple the faces use.
+
+// Smallest OBJ chunk worth a thread of its own
+const size_t IMPORT_MIN_CHUNK_BYTES = 1 << 20;
+
+// Index of an absent element, and the end of a list of vertices
+const uint32_t IMPORT_NONE = 0xFFFFFFFFu;
+
+// Texture coordinate or normal a face corner does not give; never the value of an index, however it resolves
+const int IMPORT_ABSENT = INT_MIN;
+
+// glTF accessor component types
+const uint32_t GLTF_UNSIGNED_BYTE = 5121;
+const uint32_t GLTF_UNSIGNED_SHORT = 5123;
+const uint32_t GLTF_UNSIGNED_INT = 5125;
+const uint32_t GLTF_FLOAT = 5126;
+
+// One imported mesh, as the renderer uploads it
+struct ImportedMesh
+{
+    std::string name;
+    std::vector<float> vertices;
+    std::vector<uint32_t> indices;
+};
+
+// Lines of an OBJ file parsed by one thread, and what they held
+struct ObjImportChunk
+{
+    const char* begin;
+    const char* end;
+    std::vector<float> positions;
+    std::vector<float> texCoords;
+    std::vector<float> normals;
+    std::vector<int> corners;       // Position, texture coordinate and normal of every triangle corner from 0, IMPORT_ABSENT when absent
+    std::vector<size_t> relative;   // Entries of corners counted from this chunk's first element, made absolute once joined
+    bool valid;
+};
+
+// Typed view of part of a .glb file's binary chunk
+struct GltfAccessor
+{
+    const unsigned char* data;
+    size_t stride;
+    size_t count;
+    uint32_t componentType;
+    uint32_t components;
+    bool normalized;
+};
+
+// Name of the mesh of a file that does not name its meshes: the file name without its extension
+inline std::string importMeshName(const std::string& path)
+{
+    const size_t slash = path.find_last_of("/\\");
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    const size_t dot = name.find('.');
+    return dot == std::string::npos || dot == 0 ? name : name.substr(0, dot);
+}
+
+// Reads a whole file followed by a zero, which stops the parsers at its end
+inline bool importReadFile(const char* path, std::vector<char>& data)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return false;
+
+    fseek(file, 0, SEEK_END);
+    const long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size < 0)
+    {
+        fclose(file);
+        return false;
+    }
+
+    data.resize((size_t)size + 1);
+    const bool read = fread(data.data(), 1, (size_t)size, file) == (size_t)size;
+    fclose(file);
+    data[(size_t)size] = 0;
+    return read;
+}
+
+inline double importPowerOfTen(int exponent)
+{
+    static const double powers[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    if (exponent >= 0 && exponent <= 22)
+        return powers[exponent];
+    return std::pow(10.0, exponent);
+}
+
+// Reads a decimal number (sign, digits, fraction, exponent) like strtof, without its locale lookups. The first 19
+// significant digits are kept exactly and scaled once by an exact power of ten, which leaves the float within one
+// unit of strtof's. Returns the character after the number, or c when there is none.
+inline const char* importParseFloat(const char* c, float& value)
+{
+    const char* start = c;
+    const bool negative = *c == '-';
+    if (*c == '-' || *c == '+')
+        ++c;
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool any = false;
+    for (; *c >= '0' && *c <= '9'; ++c, any = true)
+    {
+        if (digits < 19)
+        {
+            mantissa = mantissa * 10 + (uint64_t)(*c - '0');
+            digits += mantissa != 0;
+        }
+        else
+            ++exponent;
+    }
+    if (*c == '.')
+    {
+        for (++c; *c >= '0' && *c <= '9'; ++c, any = true)
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (uint64_t)(*c - '0');
+                digits += mantissa != 0;
+                --exponent;
+            }
+        }
+    }
+    if (!any)
+    {
+        value = 0.0f;
+        return start;
+    }
+
+    if (*c == 'e' || *c == 'E')
+    {
+        const char* e = c + 1;
+        const bool negativeExponent = *e == '-';
+        if (*e == '-' || *e == '+')
+            ++e;
+        if (*e >= '0' && *e <= '9')
+        {
+            int power = 0;
+            for (; *e >= '0' && *e <= '9'; ++e)
+                power = power < 10000 ? power * 10 + (*e - '0') : power;
+            exponent += negativeExponent ? -power : power;
+            c = e;
+        }
+    }
+
+    const double magnitude = exponent < 0 ? (double)mantissa / importPowerOfTen(-exponent) : (double)mantissa * importPowerOfTen(exponent);
+    value = (float)(negative ? -magnitude : magnitude);
+    return c;
+}
+
+// Reads a decimal integer with an optional sign; returns the character after it, or c when there is none
+inline const char* importParseInt(const char* c, int& value)
+{
+    const char* start = c;
+    const bool negative = *c == '-';
+    if (*c == '-' || *c == '+')
+        ++c;
+
+    int magnitude = 0;
+    const char* digits = c;
+    for (; *c >= '0' && *c <= '9'; ++c)
+        magnitude = magnitude * 10 + (*c - '0');
+    if (c == digits)
+    {
+        value = 0;
+        return start;
+    }
+    value = negative ? -magnitude : magnitude;
+    return c;
+}
+
+// Reads count numbers of a line into target; missing ones are 0
+inline const char* importParseVector(const char* c, int count, std::vector<float>& target)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        while (*c == ' ' || *c == '\t')
+            ++c;
+        float value;
+        c = importParseFloat(c, value);
+        target.push_back(value);
+    }
+    return c;
+}
+
+// First character of the line after c's
+inline const char* importNextLine(const char* c, const char* end)
+{
+    while (c < end && *c != '\n')
+        ++c;
+    return c < end ? c + 1 : end;
+}
+
+// Parses the v, vt, vn and f lines of a chunk; polygons are split into fans. Indices are checked against the
+// file's element counts once the chunks are joined.
+inline void importObjChunk(ObjImportChunk* chunk)
+{
+    std::vector<int> polygon;
+    std::vector<char> polygonRelative;
+    const char* c = chunk->begin;
+    chunk->valid = true;
+    while (c < chunk->end)
+    {
+        while (*c == ' ' || *c == '\t')
+            ++c;
+
+        if (c[0] == 'v' && (c[1] == ' ' || c[1] == '\t'))
+            c = importParseVector(c + 2, 3, chunk->positions);
+        else if (c[0] == 'v' && c[1] == 't' && (c[2] == ' ' || c[2] == '\t'))
+            c = importParseVector(c + 3, 2, chunk->texCoords);
+        else if (c[0] == 'v' && c[1] == 'n' && (c[2] == ' ' || c[2] == '\t'))
+            c = importParseVector(c + 3, 3, chunk->normals);
+        else if (c[0] == 'f' && (c[1] == ' ' || c[1] == '\t'))
+        {
+            const int counts[3] = { (int)(chunk->positions.size() / 3), (int)(chunk->texCoords.size() / 2), (int)(chunk->normals.size() / 3) };
+            polygon.clear();
+            polygonRelative.clear();
+            for (c += 2; ; )
+            {
+                while (*c == ' ' || *c == '\t')
+                    ++c;
+
+                int index[3] = { 0, 0, 0 };
+                const char* next = importParseInt(c, index[0]);
+                if (next == c)
+                    break;
+                c = next;
+                for (int i = 1; i < 3 && *c == '/'; ++i)
+                    c = importParseInt(c + 1, index[i]);
+
+                // Negative indices count back from the last element read, which may be in an earlier chunk
+                for (int i = 0; i < 3; ++i)
+                {
+                    if (index[i] == 0 && i == 0)
+                    {
+                        chunk->valid = false;
+                        return;
+                    }
+                    polygon.push_back(index[i] > 0 ? index[i] - 1 : (index[i] < 0 ? counts[i] + index[i] : IMPORT_ABSENT));
+                    polygonRelative.push_back(index[i] < 0);
+                }
+            }
+
+            for (size_t corner = 2; corner * 3 < polygon.size(); ++corner)
+            {
+                const size_t fan[3] = { 0, (corner - 1) * 3, corner * 3 };
+                for (int i = 0; i < 3; ++i)
+                {
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        if (polygonRelative[fan[i] + k])
+                            chunk->relative.push_back(chunk->corners.size());
+                        chunk->corners.push_back(polygon[fan[i] + k]);
+                    }
+                }
+            }
+        }
+        c = importNextLine(c, chunk->end);
+    }
+}
+
+// Gives the vertices marked in missing the area-weighted average of the normals of the triangles around their
+// group (OBJ vertices are grouped by position, so vertices split by a texture seam get the same normal)
+inline void importSmoothNormals(ImportedMesh& mesh, const std::vector<uint32_t>& group, size_t groupCount, const std::vector<char>& missing)
+{
+    std::vector<float> sums(groupCount * 3, 0.0f);
+    for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3)
+    {
+        const float* p[3];
+        for (int i = 0; i < 3; ++i)
+            p[i] = &mesh.vertices[(size_t)mesh.indices[t + i] * MESH_VERTEX_FLOATS];
+        const float e1[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+        const float e2[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] };
+        const float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+        for (int i = 0; i < 3; ++i)
+            for (int k = 0; k < 3; ++k)
+                sums[(size_t)group[mesh.indices[t + i]] * 3 + k] += n[k];
+    }
+
+    for (size_t v = 0; v < missing.size(); ++v)
+    {
+        if (!missing[v])
+            continue;
+        const float* n = &sums[(size_t)group[v] * 3];
+        const float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        for (int k = 0; k < 3; ++k)
+            mesh.vertices[v * MESH_VERTEX_FLOATS + 3 + k] = length > 0.0f ? n[k] / length : 0.0f;
+    }
+}
+
+// Imports the triangles of a Wavefront OBJ file as one mesh named after the file, on up to threadCount threads
+// (0: one per core). False when the file cannot be read, has an index out of range or holds no triangle.
+inline bool importObj(const char* path, ImportedMesh& mesh, unsigned int threadCount = 0)
+{
+    std::vector<char> data;
+    if (!importReadFile(path, data))
+        return false;
+
+    const char* text = data.data();
+    const size_t size = data.size() - 1;
+    if (threadCount == 0)
+        threadCount = std::thread::hardware_concurrency();
+    size_t chunkCount = size / IMPORT_MIN_CHUNK_BYTES;
+    chunkCount = chunkCount < threadCount ? chunkCount : threadCount;
+    chunkCount = chunkCount > 0 ? chunkCount : 1;
+
+    // Chunks of about the same size, each ending after a line break
+    std::vector<ObjImportChunk> chunks(chunkCount);
+    for (size_t i = 0; i < chunkCount; ++i)
+    {
+        chunks[i].begin = i == 0 ? text : chunks[i - 1].end;
+        chunks[i].end = i + 1 == chunkCount ? text + size : importNextLine(text + size * (i + 1) / chunkCount, text + size);
+        if (chunks[i].end < chunks[i].begin)
+            chunks[i].end = chunks[i].begin;
+    }
+
+    // The first chunk is parsed on this thread
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < chunkCount; ++i)
+        workers.push_back(std::thread(importObjChunk, &chunks[i]));
+    importObjChunk(&chunks[0]);
+    for (size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+
+    // Join the elements, each chunk's after those of the chunks before it
+    std::vector<float> positions, texCoords, normals;
+    std::vector<size_t> bases(chunkCount * 3);
+    for (size_t i = 0; i < chunkCount; ++i)
+    {
+        if (!chunks[i].valid)
+            return false;
+        bases[i * 3] = positions.size() / 3;
+        bases[i * 3 + 1] = texCoords.size() / 2;
+        bases[i * 3 + 2] = normals.size() / 3;
+        positions.insert(positions.end(), chunks[i].positions.begin(), chunks[i].positions.end());
+        texCoords.insert(texCoords.end(), chunks[i].texCoords.begin(), chunks[i].texCoords.end());
+        normals.insert(normals.end(), chunks[i].normals.begin(), chunks[i].normals.end());
+        std::vector<float>().swap(chunks[i].positions);
+        std::vector<float>().swap(chunks[i].texCoords);
+        std::vector<float>().swap(chunks[i].normals);
+    }
+
+    // One vertex per distinct corner; the vertices of a position are chained from firstVertex through nextVertex
+    const int counts[3] = { (int)(positions.size() / 3), (int)(texCoords.size() / 2), (int)(normals.size() / 3) };
+    std::vector<uint32_t> firstVertex(counts[0], IMPORT_NONE);
+    std::vector<uint32_t> nextVertex;
+    std::vector<int> vertexCorners;
+    mesh.name = importMeshName(path);
+    mesh.indices.clear();
+    for (size_t i = 0; i < chunkCount; ++i)
+    {
+        std::vector<int>& corners = chunks[i].corners;
+        for (size_t r = 0; r < chunks[i].relative.size(); ++r)
+            corners[chunks[i].relative[r]] += (int)bases[i * 3 + chunks[i].relative[r] % 3];
+
+        for (size_t k = 0; k < corners.size(); k += 3)
+        {
+            const int p = corners[k], t = corners[k + 1], n = corners[k + 2];
+            // A relative index that resolves before the first element is out of range like any other
+            if (p < 0 || p >= counts[0] || (t != IMPORT_ABSENT && (t < 0 || t >= counts[1])) || (n != IMPORT_ABSENT && (n < 0 || n >= counts[2])))
+                return false;
+
+            uint32_t vertex = firstVertex[p];
+            while (vertex != IMPORT_NONE && (vertexCorners[vertex * 3 + 1] != t || vertexCorners[vertex * 3 + 2] != n))
+                vertex = nextVertex[vertex];
+            if (vertex == IMPORT_NONE)
+            {
+                vertex = (uint32_t)nextVertex.size();
+                nextVertex.push_back(firstVertex[p]);
+                firstVertex[p] = vertex;
+                vertexCorners.insert(vertexCorners.end(), &corners[k], &corners[k] + 3);
+            }
+            mesh.indices.push_back(vertex);
+        }
+        std::vector<int>().swap(corners);
+    }
+    if (mesh.indices.empty())
+        return false;
+
+    const size_t vertexCount = nextVertex.size();
+    std::vector<uint32_t> group(vertexCount);
+    std::vector<char> missing(vertexCount, 0);
+    bool anyMissing = false;
+    mesh.vertices.resize(vertexCount * MESH_VERTEX_FLOATS);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        const int p = vertexCorners[v * 3], t = vertexCorners[v * 3 + 1], n = vertexCorners[v * 3 + 2];
+        float* vertex = &mesh.vertices[v * MESH_VERTEX_FLOATS];
+        memcpy(vertex, &positions[(size_t)p * 3], 3 * sizeof(float));
+        if (n >= 0)
+            memcpy(vertex + 3, &normals[(size_t)n * 3], 3 * sizeof(float));
+        vertex[6] = t >= 0 ? texCoords[(size_t)t * 2] : 0.0f;
+        vertex[7] = t >= 0 ? texCoords[(size_t)t * 2 + 1] : 0.0f;
+        group[v] = (uint32_t)p;
+        missing[v] = n < 0;
+        anyMissing = anyMissing || n < 0;
+    }
+    if (anyMissing)
+        importSmoothNormals(mesh, group, counts[0], missing);
+    return true;
+}
+
+// Number member of a glTF object, fallback when it is absent
+inline double importGltfNumber(const JsonValue& object, const char* name, double fallback)
+{
+    const JsonValue* value = object.find(name);
+    return value && value->type == JSON_NUMBER ? value->number : fallback;
+}
+
+// Resolves accessor index of a .glb file against its binary chunk; false for anything outside of it, sparse
+// accessors and buffers other than the binary chunk
+inline bool importGltfAccessor(const JsonValue& root, const JsonValue* index, const unsigned char* bin, size_t binSize, GltfAccessor& accessor)
+{
+    const JsonValue* accessors = root.find("accessors");
+    const JsonValue* views = root.find("bufferViews");
+    if (!index || index->type != JSON_NUMBER || !accessors || !views || (size_t)index->number >= accessors->elements.size())
+        return false;
+
+    const JsonValue& a = accessors->elements[(size_t)index->number];
+    const JsonValue* type = a.find("type");
+    const size_t viewIndex = (size_t)importGltfNumber(a, "bufferView", -1.0);
+    if (a.find("sparse") || !type || type->type != JSON_STRING || viewIndex >= views->elements.size())
+        return false;
+
+    accessor.componentType = (uint32_t)importGltfNumber(a, "componentType", 0.0);
+    accessor.count = (size_t)importGltfNumber(a, "count", 0.0);
+    const JsonValue* normalized = a.find("normalized");
+    accessor.normalized = normalized && normalized->type == JSON_BOOLEAN && normalized->boolean;
+    accessor.components = type->string == "SCALAR" ? 1 : type->string == "VEC2" ? 2 : type->string == "VEC3" ? 3 : type->string == "VEC4" ? 4 : 0;
+    const size_t componentSize = accessor.componentType == GLTF_UNSIGNED_BYTE ? 1 : accessor.componentType == GLTF_UNSIGNED_SHORT ? 2
+        : accessor.componentType == GLTF_UNSIGNED_INT || accessor.componentType == GLTF_FLOAT ? 4 : 0;
+    if (accessor.components == 0 || componentSize == 0)
+        return false;
+
+    const JsonValue& view = views->elements[viewIndex];
+    const size_t viewOffset = (size_t)importGltfNumber(view, "byteOffset", 0.0);
+    const size_t viewLength = (size_t)importGltfNumber(view, "byteLength", 0.0);
+    const size_t offset = (size_t)importGltfNumber(a, "byteOffset", 0.0);
+    const size_t elementSize = componentSize * accessor.components;
+    accessor.stride = (size_t)importGltfNumber(view, "byteStride", (double)elementSize);
+    if (importGltfNumber(view, "buffer", 0.0) != 0.0 || viewOffset + viewLength > binSize || accessor.stride < elementSize
+        || (accessor.count > 0 && offset + (accessor.count - 1) * accessor.stride + elementSize > viewLength))
+        return false;
+
+    accessor.data = bin + viewOffset + offset;
+    return true;
+}
+
+// One component of one element of an accessor, as a float (glTF data is little-endian, like the targets)
+inline float importGltfComponent(const GltfAccessor& accessor, size_t element, uint32_t component)
+{
+    const unsigned char* p = accessor.data + element * accessor.stride;
+    switch (accessor.componentType)
+    {
+    case GLTF_FLOAT:
+    {
+        float value;
+        memcpy(&value, p + component * 4, 4);
+        return value;
+    }
+    case GLTF_UNSIGNED_BYTE:
+        return accessor.normalized ? p[component] / 255.0f : (float)p[component];
+    case GLTF_UNSIGNED_SHORT:
+    {
+        uint16_t value;
+        memcpy(&value, p + component * 2, 2);
+        return accessor.normalized ? value / 65535.0f : (float)value;
+    }
+    default:
+    {
+        uint32_t value;
+        memcpy(&value, p + component * 4, 4);
+        return (float)value;
+    }
+    }
+}
+
+inline uint32_t importGltfIndex(const GltfAccessor& accessor, size_t element)
+{
+    const unsigned char* p = accessor.data + element * accessor.stride;
+    if (accessor.componentType == GLTF_UNSIGNED_BYTE)
+        return p[0];
+    if (accessor.componentType == GLTF_UNSIGNED_SHORT)
+    {
+        uint16_t value;
+        memcpy(&value, p, 2);
+        return value;
+    }
+    uint32_t value;
+    memcpy(&value, p, 4);
+    return value;
+}
+
+// Imports the meshes of a binary glTF 2.0 file, one per glTF mesh with its triangle primitives one after the other.
+// Positions are in the mesh's own space: node transforms are left to the scene. Unnamed meshes are named after the
+// file and their index. False when the file is not a valid .glb or holds no triangle.
+inline bool importGlb(const char* path, std::vector<ImportedMesh>& meshes)
+{
+    std::vector<char> data;
+    if (!importReadFile(path, data))
+        return false;
+
+    // Header (magic, version, length), then chunks of a length, a type and the data: JSON first, binary next
+    const unsigned char* file = (const unsigned char*)data.data();
+    const size_t size = data.size() - 1;
+    uint32_t header[5];
+    if (size < sizeof(header))
+        return false;
+    memcpy(header, file, sizeof(header));
+    if (memcmp(file, "glTF", 4) != 0 || header[1] != 2 || header[2] > size || header[4] != 0x4E4F534Au || 20 + (size_t)header[3] > header[2])
+        return false;
+
+    JsonValue root;
+    std::string error;
+    if (!parseJson((const char*)file + 20, header[3], root, error))
+        return false;
+
+    const unsigned char* bin = 0;
+    size_t binSize = 0;
+    const size_t binChunk = 20 + (size_t)((header[3] + 3) & ~3u);
+    uint32_t chunk[2];
+    if (binChunk + sizeof(chunk) <= header[2])
+    {
+        memcpy(chunk, file + binChunk, sizeof(chunk));
+        if (chunk[1] == 0x004E4942u && binChunk + sizeof(chunk) + chunk[0] <= header[2])
+        {
+            bin = file + binChunk + sizeof(chunk);
+            binSize = chunk[0];
+        }
+    }
+
+    const JsonValue* gltfMeshes = root.find("meshes");
+    for (size_t m = 0; gltfMeshes && m < gltfMeshes->elements.size(); ++m)
+    {
+        const JsonValue& gltfMesh = gltfMeshes->elements[m];
+        const JsonValue* name = gltfMesh.find("name");
+        const JsonValue* primitives = gltfMesh.find("primitives");
+
+        ImportedMesh mesh;
+        mesh.name = name && name->type == JSON_STRING && !name->string.empty() ? name->string : importMeshName(path) + " " + std::to_string(m);
+        std::vector<char> missing;
+        for (size_t p = 0; primitives && p < primitives->elements.size(); ++p)
+        {
+            // Triangle lists only (mode 4, the default)
+            const JsonValue& primitive = primitives->elements[p];
+            const JsonValue* attributes = primitive.find("attributes");
+            if (importGltfNumber(primitive, "mode", 4.0) != 4.0 || !attributes)
+                continue;
+
+            GltfAccessor position, normal, texCoord, indices;
+            const bool hasNormal = attributes->find("NORMAL") != 0;
+            const bool hasTexCoord = attributes->find("TEXCOORD_0") != 0;
+            const bool hasIndices = primitive.find("indices") != 0;
+            if (!importGltfAccessor(root, attributes->find("POSITION"), bin, binSize, position) || position.components != 3
+                || (hasNormal && (!importGltfAccessor(root, attributes->find("NORMAL"), bin, binSize, normal) || normal.components != 3 || normal.count != position.count))
+                || (hasTexCoord && (!importGltfAccessor(root, attributes->find("TEXCOORD_0"), bin, binSize, texCoord) || texCoord.components != 2 || texCoord.count != position.count))
+                || (hasIndices && (!importGltfAccessor(root, primitive.find("indices"), bin, binSize, indices) || indices.components != 1 || indices.componentType == GLTF_FLOAT)))
+                return false;
+
+            const uint32_t base = (uint32_t)(mesh.vertices.size() / MESH_VERTEX_FLOATS);
+            for (size_t v = 0; v < position.count; ++v)
+            {
+                float vertex[MESH_VERTEX_FLOATS] = {};
+                for (uint32_t k = 0; k < 3; ++k)
+                {
+                    vertex[k] = importGltfComponent(position, v, k);
+                    vertex[3 + k] = hasNormal ? importGltfComponent(normal, v, k) : 0.0f;
+                }
+                // glTF puts the texture origin at the top left
+                vertex[6] = hasTexCoord ? importGltfComponent(texCoord, v, 0) : 0.0f;
+                vertex[7] = hasTexCoord ? 1.0f - importGltfComponent(texCoord, v, 1) : 0.0f;
+                mesh.vertices.insert(mesh.vertices.end(), vertex, vertex + MESH_VERTEX_FLOATS);
+                missing.push_back(!hasNormal);
+            }
+
+            const size_t indexCount = (hasIndices ? indices.count : position.count) / 3 * 3;
+            for (size_t i = 0; i < indexCount; ++i)
+            {
+                const uint32_t index = hasIndices ? importGltfIndex(indices, i) : (uint32_t)i;
+                if (index >= position.count)
+                    return false;
+                mesh.indices.push_back(base + index);
+            }
+        }
+        if (mesh.indices.empty())
+            continue;
+
+        if (std::find(missing.begin(), missing.end(), 1) != missing.end())
+        {
+            std::vector<uint32_t> group(missing.size());
+            for (size_t v = 0; v < group.size(); ++v)
+                group[v] = (uint32_t)v;
+            importSmoothNormals(mesh, group, group.size(), missing);
+        }
+        meshes.push_back(mesh);
+    }
+    return !meshes.empty();
+}
+
+// Imports the meshes of an OBJ or .glb file, told apart by the extension
+inline bool importMeshes(const char* path, std::vector<ImportedMesh>& meshes, unsigned int threadCount = 0)
+{
+    const size_t length = strlen(path);
+    const char* extension = length >= 4 ? path + length - 4 : path;
+    if (length >= 4 && extension[0] == '.' && (extension[1] | 0x20) == 'g' && (extension[2] | 0x20) == 'l' && (extension[3] | 0x20) == 'b')
+        return importGlb(path, meshes);
+
+    meshes.push_back(ImportedMesh());
+    if (importObj(path, meshes.back(), threadCount))
+        return true;
+    meshes.pop_back();
+    return false;
+}
+
+#endif
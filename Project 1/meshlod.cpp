@@ -0,0 +1,266 @@
+#include <iostream>         // cout, cerr
+#include <cstdlib>          // EXIT_SUCCESS, EXIT_FAILURE, atoi, atof
+#include <chrono>           // steady_clock
+#include <cstring>          // memset, memcpy
+#include <algorithm>        // copy
+#include <atomic>           // atomic
+#include <mutex>            // mutex, lock_guard
+#include <sstream>          // istringstream
+#include <string>           // string, getline
+#include <thread>           // thread, hardware_concurrency
+#include <vector>           // vector
+#include <sys/stat.h>       // stat
+
+#include "meshopt.h"        // Cache, overdraw and fetch optimization
+#include "meshimport.h"     // OBJ reader
+#include "simplify.h"       // Quadric error simplification and the .lods cache
+#include "meshfile.h"       // Binary mesh files
+
+using namespace std; // Standard namespace
+
+// Offline level of detail builder. Every mesh named on the command line is simplified into a chain of levels,
+// one mesh per worker thread, and the chain is cached next to the source as <source>.lods. Sources that did not
+// change since their chain was written are skipped unless --force is given. With --pack, every chain is also
+// optimized for the renderer and written into one mesh file, each mesh named after its source's file name.
+//
+//     meshlod [--ratios 0.5,0.25,0.125] [--threads <n>] [--force] [--pack <out.bmesh>] mesh.obj ...
+
+// Unnamed namespace
+namespace
+{
+    // Triangles kept by each level after the full mesh, as shares of the full mesh's
+    vector<float> gRatios;
+
+    vector<string> gSources;
+    bool gForce = false;
+
+    // Chain of each source, kept for the mesh file written by --pack
+    struct MeshChain
+    {
+        vector<float> vertices;
+        vector<uint32_t> indices;
+        vector<MeshLodLevel> levels;
+    };
+    vector<MeshChain> gChains;
+    string gPackPath;
+
+    // Next source for a worker to take, and the lock that keeps their output lines whole
+    atomic<size_t> gNextSource(0);
+    atomic<int> gFailures(0);
+    mutex gOutputMutex;
+}
+
+/* User-defined Function prototypes */
+bool USourceStamp(const string& path, uint64_t& size, int64_t& time);
+string UMeshLodPath(const string& source);
+void UBuildLods(size_t sourceIndex);
+void UWorker();
+void UOptimizeChain(MeshChain& chain);
+bool UPackChains();
+double UMillisecondsSince(chrono::steady_clock::time_point start);
+
+
+int main(int argc, char* argv[])
+{
+    unsigned int threadCount = thread::hardware_concurrency();
+    string ratios = "0.5,0.25,0.125";
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--ratios" && i + 1 < argc)
+            ratios = argv[++i];
+        else if (arg == "--threads" && i + 1 < argc)
+            threadCount = (unsigned int)atoi(argv[++i]);
+        else if (arg == "--force")
+            gForce = true;
+        else if (arg == "--pack" && i + 1 < argc)
+            gPackPath = argv[++i];
+        else
+            gSources.push_back(arg);
+    }
+
+    istringstream ratioStream(ratios);
+    string ratio;
+    while (getline(ratioStream, ratio, ','))
+    {
+        float value = (float)atof(ratio.c_str());
+        if (value > 0.0f && value < 1.0f)
+            gRatios.push_back(value);
+    }
+    if (gSources.empty() || gRatios.empty())
+    {
+        cerr << "usage: meshlod [--ratios 0.5,0.25,0.125] [--threads <n>] [--force] [--pack <out.bmesh>] mesh.obj ..." << endl;
+        return EXIT_FAILURE;
+    }
+
+    // Simplification of one mesh is sequential (each level starts from the one before), so meshes are the unit of work
+    if (threadCount == 0)
+        threadCount = 1;
+    if (threadCount > gSources.size())
+        threadCount = (unsigned int)gSources.size();
+
+    auto start = chrono::steady_clock::now();
+    gChains.resize(gSources.size());
+    vector<thread> workers;
+    for (unsigned int i = 0; i < threadCount; ++i)
+        workers.push_back(thread(UWorker));
+    for (size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+
+    cout << "INFO: " << gSources.size() << " mesh(es) on " << threadCount << " thread(s) in " << UMillisecondsSince(start) << " ms" << endl;
+    if (!gPackPath.empty() && gFailures.load() == 0 && !UPackChains())
+    {
+        cerr << "ERROR: cannot write " << gPackPath << endl;
+        return EXIT_FAILURE;
+    }
+    return gFailures.load() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+double UMillisecondsSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+
+void UWorker()
+{
+    for (size_t i = gNextSource++; i < gSources.size(); i = gNextSource++)
+        UBuildLods(i);
+}
+
+
+string UMeshLodPath(const string& source)
+{
+    return source + ".lods";
+}
+
+
+// Size and modification time of a file, which the cache records to tell when it went stale
+bool USourceStamp(const string& path, uint64_t& size, int64_t& time)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+        return false;
+
+    size = (uint64_t)info.st_size;
+    time = (int64_t)info.st_mtime;
+    return true;
+}
+
+
+// Simplifies one source into <source>.lods, unless the cache already matches the source, and keeps the chain
+// for --pack
+void UBuildLods(size_t sourceIndex)
+{
+    const string& source = gSources[sourceIndex];
+    MeshChain& chain = gChains[sourceIndex];
+    const string lodPath = UMeshLodPath(source);
+    MeshLodHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "LODS", 4);
+    header.version = MESH_LOD_VERSION;
+    if (!USourceStamp(source, header.sourceSize, header.sourceTime))
+    {
+        lock_guard<mutex> lock(gOutputMutex);
+        cerr << "ERROR: cannot open " << source << endl;
+        ++gFailures;
+        return;
+    }
+
+    MeshLodHeader cached;
+    if (!gForce && readMeshLodHeader(lodPath.c_str(), cached) && cached.sourceSize == header.sourceSize && cached.sourceTime == header.sourceTime
+        && (gPackPath.empty() || readMeshLods(lodPath.c_str(), cached, chain.levels, chain.vertices, chain.indices)))
+    {
+        lock_guard<mutex> lock(gOutputMutex);
+        cout << "INFO: " << lodPath << " is up to date" << endl;
+        return;
+    }
+
+    auto start = chrono::steady_clock::now();
+    ImportedMesh mesh;
+    vector<float>& vertices = chain.vertices;
+    vector<uint32_t>& lodIndices = chain.indices;
+    vector<MeshLodLevel>& levels = chain.levels;
+    // One thread per mesh already
+    if (!importObj(source.c_str(), mesh, 1))
+    {
+        lock_guard<mutex> lock(gOutputMutex);
+        cerr << "ERROR: " << source << " is not a triangle mesh" << endl;
+        ++gFailures;
+        return;
+    }
+    vertices.swap(mesh.vertices);
+    buildMeshLods(vertices, mesh.indices, gRatios.data(), gRatios.size(), levels, lodIndices);
+
+    header.vertexCount = (uint32_t)(vertices.size() / MESH_VERTEX_FLOATS);
+    header.indexCount = (uint32_t)lodIndices.size();
+    header.levelCount = (uint32_t)levels.size();
+    const bool written = writeMeshLods(lodPath.c_str(), header, levels, vertices, lodIndices);
+
+    lock_guard<mutex> lock(gOutputMutex);
+    if (!written)
+    {
+        cerr << "ERROR: cannot write " << lodPath << endl;
+        ++gFailures;
+        return;
+    }
+    cout << "INFO: " << lodPath << ":";
+    for (size_t i = 0; i < levels.size(); ++i)
+        cout << " " << levels[i].indexCount / 3 << " (error " << levels[i].error << ")";
+    cout << " triangles in " << UMillisecondsSince(start) << " ms" << endl;
+}
+
+
+// Reorders a chain the way the renderer does when it uploads a mesh: triangles for the post-transform cache and
+// overdraw within each level, then vertices for fetch locality over all of them
+void UOptimizeChain(MeshChain& chain)
+{
+    const size_t vertexCount = chain.vertices.size() / MESH_VERTEX_FLOATS;
+    for (size_t level = 0; level < chain.levels.size(); ++level)
+    {
+        const MeshLodLevel& lod = chain.levels[level];
+        vector<uint32_t> levelIndices(chain.indices.begin() + lod.firstIndex, chain.indices.begin() + lod.firstIndex + lod.indexCount);
+        vector<uint32_t> clusters;
+        optimizeVertexCache(levelIndices, vertexCount, &clusters);
+        optimizeOverdraw(levelIndices, chain.vertices, clusters);
+        copy(levelIndices.begin(), levelIndices.end(), chain.indices.begin() + lod.firstIndex);
+    }
+    optimizeVertexFetch(chain.vertices, chain.indices);
+}
+
+
+// Writes every chain into the mesh file named by --pack, keeping the finest levels that fit
+bool UPackChains()
+{
+    auto start = chrono::steady_clock::now();
+    vector<MeshFileSource> sources(gChains.size());
+    vector<vector<MeshFileLod> > lods(gChains.size());
+    for (size_t i = 0; i < gChains.size(); ++i)
+    {
+        MeshChain& chain = gChains[i];
+        UOptimizeChain(chain);
+
+        const size_t levelCount = chain.levels.size() < MESH_FILE_MAX_LODS ? chain.levels.size() : MESH_FILE_MAX_LODS;
+        for (size_t level = 0; level < levelCount; ++level)
+        {
+            MeshFileLod lod = { chain.levels[level].firstIndex, chain.levels[level].indexCount, chain.levels[level].error, 0 };
+            lods[i].push_back(lod);
+        }
+
+        // Dropped levels are the coarsest, at the end of the indices
+        const MeshLodLevel& last = chain.levels[levelCount - 1];
+        sources[i].name = importMeshName(gSources[i]);
+        sources[i].vertices = chain.vertices.data();
+        sources[i].vertexCount = (uint32_t)(chain.vertices.size() / MESH_VERTEX_FLOATS);
+        sources[i].indices = chain.indices.data();
+        sources[i].indexCount = last.firstIndex + last.indexCount;
+        sources[i].lods = lods[i].data();
+        sources[i].lodCount = (uint32_t)levelCount;
+    }
+
+    if (!writeMeshFile(gPackPath.c_str(), sources.data(), sources.size()))
+        return false;
+    cout << "INFO: " << gPackPath << ": " << sources.size() << " mesh(es) in " << UMillisecondsSince(start) << " ms" << endl;
+    return true;
+}
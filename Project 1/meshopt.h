@@ -0,0 +1,309 @@
+#ifndef MESHOPT_H
+#define MESHOPT_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// Number of floats in one interleaved vertex: position (3), normal (3) and texture coordinate (2)
+const unsigned int MESH_VERTEX_FLOATS = 8;
+
+// FIFO post-transform cache size assumed by the cache optimizer and the ACMR report
+const unsigned int MESH_CACHE_SIZE = 16;
+
+// Bitwise copy of one interleaved vertex, used as the key when welding duplicates
+struct MeshVertexKey
+{
+    uint32_t bits[MESH_VERTEX_FLOATS];
+
+    bool operator==(const MeshVertexKey& other) const
+    {
+        return memcmp(bits, other.bits, sizeof(bits)) == 0;
+    }
+};
+
+// FNV-1a hash over the bits of a vertex key
+struct MeshVertexKeyHash
+{
+    size_t operator()(const MeshVertexKey& key) const
+    {
+        uint32_t hash = 2166136261u;
+        for (unsigned int i = 0; i < MESH_VERTEX_FLOATS; ++i)
+        {
+            hash ^= key.bits[i];
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+};
+
+// Welds identical position/normal/UV tuples of a flat triangle list into a compact vertex buffer.
+// outIndices receives one index per input vertex, so the triangle order is unchanged.
+inline void weldVertices(const float* verts, size_t vertexCount, std::vector<float>& outVertices, std::vector<uint32_t>& outIndices)
+{
+    std::unordered_map<MeshVertexKey, uint32_t, MeshVertexKeyHash> unique;
+    unique.reserve(vertexCount);
+
+    outVertices.clear();
+    outVertices.reserve(vertexCount * MESH_VERTEX_FLOATS);
+    outIndices.resize(vertexCount);
+
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        const float* vertex = verts + i * MESH_VERTEX_FLOATS;
+
+        MeshVertexKey key;
+        for (unsigned int j = 0; j < MESH_VERTEX_FLOATS; ++j)
+        {
+            float value = vertex[j] + 0.0f; // folds -0.0 into +0.0 so both weld together
+            memcpy(&key.bits[j], &value, sizeof(value));
+        }
+
+        uint32_t next = (uint32_t)(outVertices.size() / MESH_VERTEX_FLOATS);
+        std::pair<std::unordered_map<MeshVertexKey, uint32_t, MeshVertexKeyHash>::iterator, bool> inserted = unique.insert(std::make_pair(key, next));
+        if (inserted.second)
+            outVertices.insert(outVertices.end(), vertex, vertex + MESH_VERTEX_FLOATS);
+
+        outIndices[i] = inserted.first->second;
+    }
+}
+
+// Average cache miss ratio (transformed vertices per triangle) of a triangle list through a FIFO cache.
+// 0.5 is the ideal for large regular grids, 3.0 means every vertex is transformed for every triangle.
+inline float computeACMR(const std::vector<uint32_t>& indices, size_t vertexCount, unsigned int cacheSize = MESH_CACHE_SIZE)
+{
+    if (indices.size() < 3)
+        return 0.0f;
+
+    // A vertex is in the cache if it was pushed less than cacheSize misses ago
+    std::vector<size_t> pushedAt(vertexCount, 0);
+    size_t misses = 0;
+
+    for (size_t i = 0; i < indices.size(); ++i)
+    {
+        uint32_t v = indices[i];
+        if (pushedAt[v] == 0 || misses - pushedAt[v] >= cacheSize)
+        {
+            ++misses;
+            pushedAt[v] = misses;
+        }
+    }
+
+    return (float)misses / (float)(indices.size() / 3);
+}
+
+// Reorders triangles for post-transform cache locality (Tipsify, Sander et al. 2007).
+// When clusters is not null it receives the first triangle of every cluster that starts after a
+// cache flush; those are the boundaries optimizeOverdraw() is allowed to reorder across.
+inline void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, std::vector<uint32_t>* clusters = 0, unsigned int cacheSize = MESH_CACHE_SIZE)
+{
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // Vertex -> triangle adjacency in compressed row form
+    std::vector<uint32_t> live(vertexCount, 0);
+    for (size_t i = 0; i < indices.size(); ++i)
+        ++live[indices[i]];
+
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v)
+        offsets[v + 1] = offsets[v] + live[v];
+
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i)
+        adjacency[fill[indices[i]]++] = (uint32_t)(i / 3);
+
+    std::vector<uint32_t> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnd;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+
+    uint32_t timeStamp = cacheSize + 1;
+    size_t cursor = 0;
+    long fanning = 0;
+
+    if (clusters)
+    {
+        clusters->clear();
+        clusters->push_back(0);
+    }
+
+    while (fanning >= 0)
+    {
+        candidates.clear();
+
+        // Emit every remaining triangle around the fanning vertex
+        for (uint32_t a = offsets[fanning]; a < offsets[fanning + 1]; ++a)
+        {
+            uint32_t t = adjacency[a];
+            if (emitted[t])
+                continue;
+
+            for (int k = 0; k < 3; ++k)
+            {
+                uint32_t v = indices[t * 3 + k];
+                output.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                --live[v];
+
+                if (timeStamp - cacheTime[v] > cacheSize)
+                    cacheTime[v] = timeStamp++;
+            }
+            emitted[t] = true;
+        }
+
+        // Prefer the candidate that is still in the cache and will stay there while its fan is emitted
+        long next = -1;
+        long best = -1;
+        for (size_t c = 0; c < candidates.size(); ++c)
+        {
+            uint32_t v = candidates[c];
+            if (live[v] == 0)
+                continue;
+
+            long priority = 0;
+            if (timeStamp - cacheTime[v] + 2 * live[v] <= cacheSize)
+                priority = timeStamp - cacheTime[v];
+
+            if (priority > best)
+            {
+                best = priority;
+                next = v;
+            }
+        }
+
+        // Dead end: walk back through recently emitted vertices, then scan for any live vertex
+        while (next < 0 && !deadEnd.empty())
+        {
+            uint32_t v = deadEnd.back();
+            deadEnd.pop_back();
+            if (live[v] > 0)
+                next = v;
+        }
+
+        if (next < 0)
+        {
+            while (cursor < vertexCount && live[cursor] == 0)
+                ++cursor;
+
+            if (cursor < vertexCount)
+            {
+                next = (long)cursor;
+                if (clusters)
+                    clusters->push_back((uint32_t)(output.size() / 3));
+            }
+        }
+
+        fanning = next;
+    }
+
+    indices.swap(output);
+}
+
+// Reorders the clusters found by optimizeVertexCache() so outward-facing clusters are drawn first,
+// which lets early depth testing reject more of the fragments behind them.
+inline void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<float>& vertices, const std::vector<uint32_t>& clusters)
+{
+    const size_t triangleCount = indices.size() / 3;
+    const size_t clusterCount = clusters.size();
+    if (clusterCount < 2)
+        return;
+
+    // Mesh centroid, weighted by triangle area
+    float meshCentroid[3] = { 0.0f, 0.0f, 0.0f };
+    float meshArea = 0.0f;
+    std::vector<float> clusterData(clusterCount * 7, 0.0f); // centroid (3), area-weighted normal (3), area (1)
+
+    for (size_t c = 0; c < clusterCount; ++c)
+    {
+        size_t end = (c + 1 < clusterCount) ? clusters[c + 1] : triangleCount;
+        float* data = &clusterData[c * 7];
+
+        for (size_t t = clusters[c]; t < end; ++t)
+        {
+            const float* p0 = &vertices[indices[t * 3 + 0] * MESH_VERTEX_FLOATS];
+            const float* p1 = &vertices[indices[t * 3 + 1] * MESH_VERTEX_FLOATS];
+            const float* p2 = &vertices[indices[t * 3 + 2] * MESH_VERTEX_FLOATS];
+
+            float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+            float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+            float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+            float area = 0.5f * std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+            for (int k = 0; k < 3; ++k)
+            {
+                float center = (p0[k] + p1[k] + p2[k]) / 3.0f;
+                data[k] += center * area;
+                data[3 + k] += n[k] * 0.5f;
+                meshCentroid[k] += center * area;
+            }
+            data[6] += area;
+            meshArea += area;
+        }
+    }
+
+    if (meshArea <= 0.0f)
+        return;
+
+    for (int k = 0; k < 3; ++k)
+        meshCentroid[k] /= meshArea;
+
+    // Sort key: how far the cluster faces away from the mesh center
+    std::vector<std::pair<float, uint32_t> > order(clusterCount);
+    for (size_t c = 0; c < clusterCount; ++c)
+    {
+        const float* data = &clusterData[c * 7];
+        float key = 0.0f;
+        if (data[6] > 0.0f)
+        {
+            for (int k = 0; k < 3; ++k)
+                key += (data[k] / data[6] - meshCentroid[k]) * data[3 + k];
+        }
+        order[c] = std::make_pair(-key, (uint32_t)c);
+    }
+    std::stable_sort(order.begin(), order.end());
+
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+    for (size_t i = 0; i < clusterCount; ++i)
+    {
+        uint32_t c = order[i].second;
+        size_t end = (c + 1 < clusterCount) ? clusters[c + 1] : triangleCount;
+        output.insert(output.end(), indices.begin() + clusters[c] * 3, indices.begin() + end * 3);
+    }
+
+    indices.swap(output);
+}
+
+// Reorders vertices in the order the index buffer first references them, so vertex fetch walks
+// memory linearly. Vertices that are never referenced are dropped.
+inline void optimizeVertexFetch(std::vector<float>& vertices, std::vector<uint32_t>& indices)
+{
+    const size_t vertexCount = vertices.size() / MESH_VERTEX_FLOATS;
+    std::vector<uint32_t> remap(vertexCount, UINT32_MAX);
+    std::vector<float> output;
+    output.reserve(vertices.size());
+
+    for (size_t i = 0; i < indices.size(); ++i)
+    {
+        uint32_t v = indices[i];
+        if (remap[v] == UINT32_MAX)
+        {
+            remap[v] = (uint32_t)(output.size() / MESH_VERTEX_FLOATS);
+            output.insert(output.end(), vertices.begin() + v * MESH_VERTEX_FLOATS, vertices.begin() + (v + 1) * MESH_VERTEX_FLOATS);
+        }
+        indices[i] = remap[v];
+    }
+
+    vertices.swap(output);
+}
+
+#endif
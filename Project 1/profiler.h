@@ -0,0 +1,250 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <GL/glew.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// Frames whose queries are in flight at once; results are read PROFILER_FRAME_LATENCY frames after they were issued
+const int PROFILER_FRAME_LATENCY = 3;
+// Sections timed per frame; any further ones are ignored
+const int PROFILER_MAX_SECTIONS = 64;
+// Events kept for the trace; the oldest are overwritten first
+const size_t PROFILER_RING_CAPACITY = 16384;
+
+// One timed section of one frame, in microseconds since the profiler was initialized
+struct ProfileEvent
+{
+    const char* Name;       // Section name, must outlive the profiler (string literals)
+    uint64_t Frame;
+    int Depth;              // Nesting level of the section within its frame
+    double CpuStart;        // Time the GL commands of the section started being submitted
+    double CpuDuration;
+    double GpuStart;        // Time the GPU reached the section, moved onto the CPU clock
+    double GpuDuration;
+};
+
+// Times sections of each frame on the CPU and, through GL_TIMESTAMP queries, on the GPU.
+// Every frame writes its own set of queries and they are only read PROFILER_FRAME_LATENCY frames
+// later, after GL_QUERY_RESULT_AVAILABLE says so, so collecting results never waits on the GPU.
+// Finished sections go into a ring buffer that can be written out as a Chrome trace (chrome://tracing).
+class FrameProfiler
+{
+public:
+    bool Enabled;           // Every call is a no-op until this is set and Initialize() ran
+    uint64_t DroppedFrames; // Frames whose queries were still pending when their slot came round again
+
+    FrameProfiler() : Enabled(false), DroppedFrames(0), FrameIndex(0), Slot(0), Depth(0), RingHead(0), RingCount(0), GpuOffset(0.0)
+    {
+        for (int i = 0; i < PROFILER_FRAME_LATENCY; ++i)
+        {
+            Frames[i].Pending = false;
+            Frames[i].SectionCount = 0;
+        }
+    }
+
+    // creates the queries and lines the GPU clock up with the CPU one; needs a current context
+    void Initialize()
+    {
+        if (!Enabled)
+            return;
+
+        Queries.resize(PROFILER_FRAME_LATENCY * PROFILER_MAX_SECTIONS * 2);
+        glGenQueries((GLsizei)Queries.size(), Queries.data());
+        Ring.resize(PROFILER_RING_CAPACITY);
+
+        Start = std::chrono::steady_clock::now();
+        GLint64 gpuNow = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+        GpuOffset = CpuNow() - gpuNow / 1000.0;
+    }
+
+    void Destroy()
+    {
+        if (!Queries.empty())
+            glDeleteQueries((GLsizei)Queries.size(), Queries.data());
+        Queries.clear();
+    }
+
+    // collects the frame issued PROFILER_FRAME_LATENCY frames ago, then starts recording into its slot
+    void BeginFrame()
+    {
+        if (!Enabled)
+            return;
+
+        Slot = (int)(FrameIndex % PROFILER_FRAME_LATENCY);
+        Collect(Slot);
+
+        Frames[Slot].Frame = FrameIndex;
+        Frames[Slot].SectionCount = 0;
+        Frames[Slot].Pending = false;
+        Depth = 0;
+    }
+
+    void EndFrame()
+    {
+        if (!Enabled)
+            return;
+
+        Frames[Slot].Pending = Frames[Slot].SectionCount > 0;
+        ++FrameIndex;
+    }
+
+    // returns the section to pass to EndSection(), -1 when disabled or out of sections
+    int BeginSection(const char* name)
+    {
+        if (!Enabled || Frames[Slot].SectionCount == PROFILER_MAX_SECTIONS)
+            return -1;
+
+        int section = Frames[Slot].SectionCount++;
+        Section& s = Frames[Slot].Sections[section];
+        s.Name = name;
+        s.Depth = Depth++;
+        s.CpuStart = CpuNow();
+        glQueryCounter(Query(Slot, section, 0), GL_TIMESTAMP);
+        return section;
+    }
+
+    void EndSection(int section)
+    {
+        if (section < 0)
+            return;
+
+        glQueryCounter(Query(Slot, section, 1), GL_TIMESTAMP);
+        Frames[Slot].Sections[section].CpuEnd = CpuNow();
+        --Depth;
+    }
+
+    // waits for the frames still in flight and collects them, before writing a trace at exit
+    void Flush()
+    {
+        if (!Enabled)
+            return;
+
+        glFinish();
+        for (uint64_t i = 0; i < PROFILER_FRAME_LATENCY; ++i)
+            Collect((int)((FrameIndex + i) % PROFILER_FRAME_LATENCY));
+    }
+
+    // writes the buffered events as Chrome trace JSON, CPU submission and GPU execution on two tracks
+    bool WriteChromeTrace(const char* path) const
+    {
+        FILE* file = fopen(path, "w");
+        if (!file)
+            return false;
+
+        fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU submission\"}},\n");
+        fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}");
+
+        size_t first = (RingHead + PROFILER_RING_CAPACITY - RingCount) % PROFILER_RING_CAPACITY;
+        for (size_t i = 0; i < RingCount; ++i)
+        {
+            const ProfileEvent& e = Ring[(first + i) % PROFILER_RING_CAPACITY];
+            fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%llu}}",
+                e.Name, e.CpuStart, e.CpuDuration, (unsigned long long)e.Frame);
+            fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":1,\"tid\":2,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%llu}}",
+                e.Name, e.GpuStart, e.GpuDuration, (unsigned long long)e.Frame);
+        }
+
+        fprintf(file, "\n]}\n");
+        return fclose(file) == 0;
+    }
+
+    size_t EventCount() const
+    {
+        return RingCount;
+    }
+
+    // event i of the ring buffer, 0 being the oldest still kept
+    const ProfileEvent& Event(size_t i) const
+    {
+        return Ring[(RingHead + PROFILER_RING_CAPACITY - RingCount + i) % PROFILER_RING_CAPACITY];
+    }
+
+private:
+    struct Section
+    {
+        const char* Name;
+        int Depth;
+        double CpuStart;
+        double CpuEnd;
+    };
+
+    struct FrameRecord
+    {
+        uint64_t Frame;
+        bool Pending;       // Queries issued and not collected yet
+        int SectionCount;
+        Section Sections[PROFILER_MAX_SECTIONS];
+    };
+
+    FrameRecord Frames[PROFILER_FRAME_LATENCY];
+    std::vector<GLuint> Queries;    // [slot][section][begin, end]
+    uint64_t FrameIndex;
+    int Slot;
+    int Depth;
+
+    std::vector<ProfileEvent> Ring;
+    size_t RingHead;
+    size_t RingCount;
+
+    std::chrono::steady_clock::time_point Start;
+    double GpuOffset;               // CPU minus GPU clock, in microseconds
+
+    GLuint Query(int slot, int section, int end) const
+    {
+        return Queries[(slot * PROFILER_MAX_SECTIONS + section) * 2 + end];
+    }
+
+    double CpuNow() const
+    {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - Start).count();
+    }
+
+    // moves the results of a frame into the ring buffer when the GPU has them, drops the frame otherwise
+    void Collect(int slot)
+    {
+        FrameRecord& record = Frames[slot];
+        if (!record.Pending)
+            return;
+        record.Pending = false;
+
+        // Only check availability here: asking for a result that is not there yet would wait on the GPU
+        for (int i = 0; i < record.SectionCount; ++i)
+        {
+            GLint available = 0;
+            glGetQueryObjectiv(Query(slot, i, 1), GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+            {
+                ++DroppedFrames;
+                return;
+            }
+        }
+
+        for (int i = 0; i < record.SectionCount; ++i)
+        {
+            GLuint64 gpuBegin = 0, gpuEnd = 0;
+            glGetQueryObjectui64v(Query(slot, i, 0), GL_QUERY_RESULT, &gpuBegin);
+            glGetQueryObjectui64v(Query(slot, i, 1), GL_QUERY_RESULT, &gpuEnd);
+
+            ProfileEvent& e = Ring[RingHead];
+            e.Name = record.Sections[i].Name;
+            e.Frame = record.Frame;
+            e.Depth = record.Sections[i].Depth;
+            e.CpuStart = record.Sections[i].CpuStart;
+            e.CpuDuration = record.Sections[i].CpuEnd - record.Sections[i].CpuStart;
+            e.GpuStart = gpuBegin / 1000.0 + GpuOffset;
+            e.GpuDuration = (gpuEnd - gpuBegin) / 1000.0;
+
+            RingHead = (RingHead + 1) % PROFILER_RING_CAPACITY;
+            if (RingCount < PROFILER_RING_CAPACITY)
+                ++RingCount;
+        }
+    }
+};
+
+#endif
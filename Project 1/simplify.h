@@ -0,0 +1,581 @@
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include "meshopt.h"
+
+// Quadric error metric simplification (Garland and Heckbert 1997) of indexed meshes in the renderer's layout
+// (position, normal, texture coordinate). Edges collapse onto one of their two vertices, so every level of detail
+// indexes the source's vertex buffer and no attribute is ever interpolated. Vertices that share a position but
+// not their normal or UV (seams) move together, and open borders and seams only collapse along themselves.
+
+// Weight of the planes that hold border and seam edges in place, relative to the surface's own planes
+const double SIMPLIFY_EDGE_WEIGHT = 10.0;
+
+// Distance to a set of planes, squared and weighted by area: p^T Q p over p = (x, y, z, 1), upper triangle of Q
+struct SimplifyQuadric
+{
+    double a00, a01, a02, a03, a11, a12, a13, a22, a23, a33;
+    double weight;  // Area of the planes summed in, to turn the error back into a distance
+};
+
+// One side of an edge between two positions (a < b) as one triangle sees it: the vertices it uses at each end
+struct SimplifyEdge
+{
+    uint32_t a;
+    uint32_t b;
+    uint32_t vertexA;
+    uint32_t vertexB;
+    uint32_t triangle;
+};
+
+struct SimplifyEdgeLess
+{
+    bool operator()(const SimplifyEdge& x, const SimplifyEdge& y) const
+    {
+        return x.a != y.a ? x.a < y.a : x.b < y.b;
+    }
+};
+
+// Moving every vertex at one position onto the vertices at a neighboring position, and what it costs
+struct SimplifyCollapse
+{
+    uint32_t from;
+    uint32_t to;
+    float cost;
+};
+
+struct SimplifyCollapseLess
+{
+    bool operator()(const SimplifyCollapse& x, const SimplifyCollapse& y) const
+    {
+        return x.cost < y.cost;
+    }
+};
+
+// Bitwise position of a vertex, the key vertices are grouped by
+struct SimplifyPositionKey
+{
+    uint32_t bits[3];
+
+    bool operator==(const SimplifyPositionKey& other) const
+    {
+        return bits[0] == other.bits[0] && bits[1] == other.bits[1] && bits[2] == other.bits[2];
+    }
+};
+
+struct SimplifyPositionKeyHash
+{
+    size_t operator()(const SimplifyPositionKey& key) const
+    {
+        uint32_t hash = 2166136261u;
+        for (int i = 0; i < 3; ++i)
+        {
+            hash ^= key.bits[i];
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+};
+
+// How a position may move: anywhere, only along its border or its seam, or not at all
+enum SimplifyVertexKind
+{
+    SIMPLIFY_MANIFOLD,
+    SIMPLIFY_BORDER,
+    SIMPLIFY_SEAM,
+    SIMPLIFY_LOCKED
+};
+
+inline void quadricAddPlane(SimplifyQuadric& q, double a, double b, double c, double d, double weight)
+{
+    q.a00 += weight * a * a;
+    q.a01 += weight * a * b;
+    q.a02 += weight * a * c;
+    q.a03 += weight * a * d;
+    q.a11 += weight * b * b;
+    q.a12 += weight * b * c;
+    q.a13 += weight * b * d;
+    q.a22 += weight * c * c;
+    q.a23 += weight * c * d;
+    q.a33 += weight * d * d;
+}
+
+inline void quadricAdd(SimplifyQuadric& q, const SimplifyQuadric& other)
+{
+    q.a00 += other.a00;
+    q.a01 += other.a01;
+    q.a02 += other.a02;
+    q.a03 += other.a03;
+    q.a11 += other.a11;
+    q.a12 += other.a12;
+    q.a13 += other.a13;
+    q.a22 += other.a22;
+    q.a23 += other.a23;
+    q.a33 += other.a33;
+    q.weight += other.weight;
+}
+
+inline double quadricEvaluate(const SimplifyQuadric& q, const float* p)
+{
+    const double x = p[0], y = p[1], z = p[2];
+    const double error = q.a00 * x * x + 2.0 * q.a01 * x * y + 2.0 * q.a02 * x * z + 2.0 * q.a03 * x
+        + q.a11 * y * y + 2.0 * q.a12 * y * z + 2.0 * q.a13 * y
+        + q.a22 * z * z + 2.0 * q.a23 * z + q.a33;
+    return error > 0.0 ? error : 0.0;
+}
+
+// Cross product of the edges of the triangle a, b, c: its normal, twice its area long
+inline void simplifyTriangleNormal(const float* a, const float* b, const float* c, double* normal)
+{
+    const double e1[3] = { (double)b[0] - a[0], (double)b[1] - a[1], (double)b[2] - a[2] };
+    const double e2[3] = { (double)c[0] - a[0], (double)c[1] - a[1], (double)c[2] - a[2] };
+    normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+// Plane through the edge a-b at right angles to a triangle of normal n, added with a weight growing with the
+// edge's length so a long border resists as much as the surface around it
+inline void quadricAddEdge(SimplifyQuadric& q, const float* a, const float* b, const double* n)
+{
+    const double edge[3] = { (double)b[0] - a[0], (double)b[1] - a[1], (double)b[2] - a[2] };
+    double plane[3] = { edge[1] * n[2] - edge[2] * n[1], edge[2] * n[0] - edge[0] * n[2], edge[0] * n[1] - edge[1] * n[0] };
+    const double length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+    if (length == 0.0)
+        return;
+
+    plane[0] /= length;
+    plane[1] /= length;
+    plane[2] /= length;
+    const double d = -(plane[0] * a[0] + plane[1] * a[1] + plane[2] * a[2]);
+    quadricAddPlane(q, plane[0], plane[1], plane[2], d, SIMPLIFY_EDGE_WEIGHT * (edge[0] * edge[0] + edge[1] * edge[1] + edge[2] * edge[2]));
+}
+
+// Sorts the position edges of every triangle, so the sides of each edge are next to each other
+inline void simplifyCollectEdges(const std::vector<uint32_t>& indices, const std::vector<uint32_t>& positions, std::vector<SimplifyEdge>& edges)
+{
+    edges.resize(indices.size());
+    for (size_t t = 0; t < indices.size(); t += 3)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            const uint32_t v0 = indices[t + c];
+            const uint32_t v1 = indices[t + (c + 1) % 3];
+            SimplifyEdge& edge = edges[t + c];
+            const bool ordered = positions[v0] < positions[v1];
+            edge.a = ordered ? positions[v0] : positions[v1];
+            edge.b = ordered ? positions[v1] : positions[v0];
+            edge.vertexA = ordered ? v0 : v1;
+            edge.vertexB = ordered ? v1 : v0;
+            edge.triangle = (uint32_t)(t / 3);
+        }
+    }
+    std::sort(edges.begin(), edges.end(), SimplifyEdgeLess());
+}
+
+// Number of sides of the edge starting at edges[first]
+inline size_t simplifyEdgeSides(const std::vector<SimplifyEdge>& edges, size_t first)
+{
+    size_t count = 1;
+    while (first + count < edges.size() && edges[first + count].a == edges[first].a && edges[first + count].b == edges[first].b)
+        ++count;
+    return count;
+}
+
+// Kind of an edge from its sides: a border has one, a seam two that use different vertices, more than two lock it
+inline SimplifyVertexKind simplifyEdgeKind(const std::vector<SimplifyEdge>& edges, size_t first, size_t count)
+{
+    if (count == 1)
+        return SIMPLIFY_BORDER;
+    if (count > 2)
+        return SIMPLIFY_LOCKED;
+    const SimplifyEdge& x = edges[first];
+    const SimplifyEdge& y = edges[first + 1];
+    return x.vertexA != y.vertexA || x.vertexB != y.vertexB ? SIMPLIFY_SEAM : SIMPLIFY_MANIFOLD;
+}
+
+// Checks that moving position from onto position to keeps every seam: each vertex at from must meet exactly one
+// vertex at to in the triangles around from, which becomes its replacement (stored as pairs in mapping). Also
+// rejects the move when it would flip a triangle that survives it or turn it too far.
+inline bool simplifyCanCollapse(uint32_t from, uint32_t to, const float* vertices, const std::vector<uint32_t>& indices,
+    const std::vector<uint32_t>& positions, const std::vector<uint32_t>& triangleOffsets, const std::vector<uint32_t>& triangles,
+    std::vector<uint32_t>& mapping)
+{
+    mapping.clear();
+    const float* target = vertices + (size_t)to * MESH_VERTEX_FLOATS;
+
+    for (uint32_t i = triangleOffsets[from]; i < triangleOffsets[from + 1]; ++i)
+    {
+        const uint32_t* triangle = &indices[(size_t)triangles[i] * 3];
+        uint32_t fromVertex = 0, toVertex = UINT32_MAX;
+        int fromCorner = 0;
+        for (int c = 0; c < 3; ++c)
+        {
+            if (positions[triangle[c]] == from)
+            {
+                fromVertex = triangle[c];
+                fromCorner = c;
+            }
+            else if (positions[triangle[c]] == to)
+                toVertex = triangle[c];
+        }
+
+        size_t pair = 0;
+        while (pair < mapping.size() && mapping[pair] != fromVertex)
+            pair += 2;
+        if (pair == mapping.size())
+        {
+            mapping.push_back(fromVertex);
+            mapping.push_back(toVertex);
+        }
+        else if (mapping[pair + 1] == UINT32_MAX)
+            mapping[pair + 1] = toVertex;
+        else if (toVertex != UINT32_MAX && mapping[pair + 1] != toVertex)
+            return false;
+
+        // Triangles holding both ends disappear; the others must keep facing roughly the same way (within 75
+        // degrees), which also keeps slivers standing on their edge out of the result
+        if (toVertex != UINT32_MAX)
+            continue;
+
+        const float* corners[3];
+        for (int c = 0; c < 3; ++c)
+            corners[c] = vertices + (size_t)positions[triangle[c]] * MESH_VERTEX_FLOATS;
+        double before[3], after[3];
+        simplifyTriangleNormal(corners[0], corners[1], corners[2], before);
+        corners[fromCorner] = target;
+        simplifyTriangleNormal(corners[0], corners[1], corners[2], after);
+        const double dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+        const double lengths = (before[0] * before[0] + before[1] * before[1] + before[2] * before[2]) * (after[0] * after[0] + after[1] * after[1] + after[2] * after[2]);
+        if (dot <= 0.0 || dot * dot < 0.0625 * lengths)
+            return false;
+    }
+
+    // A vertex of from that meets no vertex of to would have nothing to become
+    for (size_t pair = 0; pair < mapping.size(); pair += 2)
+    {
+        if (mapping[pair + 1] == UINT32_MAX)
+            return false;
+    }
+    return true;
+}
+
+// Simplifies a triangle list until at most targetIndexCount indices remain or no edge can collapse any more.
+// vertices holds vertexCount vertices of MESH_VERTEX_FLOATS floats; outIndices refers to the same vertices.
+// Returns the largest distance a collapse moved the surface by, estimated from the quadrics, in object units.
+inline float simplifyMesh(const float* vertices, size_t vertexCount, const std::vector<uint32_t>& indices, size_t targetIndexCount, std::vector<uint32_t>& outIndices)
+{
+    outIndices = indices;
+    if (indices.size() <= targetIndexCount)
+        return 0.0f;
+
+    // First vertex at each position stands for all of them
+    std::vector<uint32_t> positions(vertexCount);
+    {
+        std::unordered_map<SimplifyPositionKey, uint32_t, SimplifyPositionKeyHash> unique;
+        unique.reserve(vertexCount);
+        for (size_t v = 0; v < vertexCount; ++v)
+        {
+            SimplifyPositionKey key;
+            for (int i = 0; i < 3; ++i)
+            {
+                float value = vertices[v * MESH_VERTEX_FLOATS + i] + 0.0f;   // -0 and +0 are one position
+                memcpy(&key.bits[i], &value, sizeof(value));
+            }
+            positions[v] = unique.insert(std::make_pair(key, (uint32_t)v)).first->second;
+        }
+    }
+
+    // Quadrics of every position: the planes of its triangles, then those holding its borders and seams in place
+    std::vector<SimplifyQuadric> quadrics(vertexCount);
+    memset(quadrics.data(), 0, quadrics.size() * sizeof(SimplifyQuadric));
+    for (size_t t = 0; t < indices.size(); t += 3)
+    {
+        const float* p[3];
+        for (int c = 0; c < 3; ++c)
+            p[c] = vertices + (size_t)positions[indices[t + c]] * MESH_VERTEX_FLOATS;
+        double n[3];
+        simplifyTriangleNormal(p[0], p[1], p[2], n);
+        const double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length == 0.0)
+            continue;
+
+        const double area = 0.5 * length;
+        const double d = -(n[0] * p[0][0] + n[1] * p[0][1] + n[2] * p[0][2]) / length;
+        for (int c = 0; c < 3; ++c)
+        {
+            SimplifyQuadric& q = quadrics[positions[indices[t + c]]];
+            quadricAddPlane(q, n[0] / length, n[1] / length, n[2] / length, d, area);
+            q.weight += area;
+        }
+    }
+
+    std::vector<SimplifyEdge> edges;
+    simplifyCollectEdges(indices, positions, edges);
+    for (size_t i = 0; i < edges.size();)
+    {
+        const size_t count = simplifyEdgeSides(edges, i);
+        const SimplifyVertexKind kind = simplifyEdgeKind(edges, i, count);
+        if (kind == SIMPLIFY_BORDER || kind == SIMPLIFY_SEAM)
+        {
+            const float* a = vertices + (size_t)edges[i].a * MESH_VERTEX_FLOATS;
+            const float* b = vertices + (size_t)edges[i].b * MESH_VERTEX_FLOATS;
+            for (size_t side = i; side < i + count; ++side)
+            {
+                const uint32_t* triangle = &indices[(size_t)edges[side].triangle * 3];
+                double n[3];
+                simplifyTriangleNormal(vertices + (size_t)positions[triangle[0]] * MESH_VERTEX_FLOATS,
+                    vertices + (size_t)positions[triangle[1]] * MESH_VERTEX_FLOATS, vertices + (size_t)positions[triangle[2]] * MESH_VERTEX_FLOATS, n);
+                quadricAddEdge(quadrics[edges[i].a], a, b, n);
+                quadricAddEdge(quadrics[edges[i].b], a, b, n);
+            }
+        }
+        i += count;
+    }
+
+    std::vector<unsigned char> kinds(vertexCount);
+    std::vector<uint32_t> borderEdges(vertexCount), seamEdges(vertexCount);
+    std::vector<SimplifyCollapse> collapses;
+    std::vector<uint32_t> triangleOffsets(vertexCount + 1), triangles;
+    std::vector<unsigned char> touched(vertexCount);
+    std::vector<uint32_t> remap(vertexCount);
+    std::vector<uint32_t> mapping;
+    const size_t targetTriangles = targetIndexCount / 3;
+    size_t triangleCount = outIndices.size() / 3;
+    double error = 0.0;
+
+    // Each pass collapses the cheapest edges whose neighborhoods do not overlap, then rebuilds what it needs
+    while (triangleCount > targetTriangles)
+    {
+        simplifyCollectEdges(outIndices, positions, edges);
+
+        // A position moves freely, along its two border (or seam) edges, or not at all where more meet
+        std::fill(kinds.begin(), kinds.end(), (unsigned char)SIMPLIFY_MANIFOLD);
+        std::fill(borderEdges.begin(), borderEdges.end(), 0u);
+        std::fill(seamEdges.begin(), seamEdges.end(), 0u);
+        for (size_t i = 0; i < edges.size();)
+        {
+            const size_t count = simplifyEdgeSides(edges, i);
+            const SimplifyVertexKind kind = simplifyEdgeKind(edges, i, count);
+            if (kind == SIMPLIFY_LOCKED)
+                kinds[edges[i].a] = kinds[edges[i].b] = SIMPLIFY_LOCKED;
+            else if (kind == SIMPLIFY_BORDER)
+                ++borderEdges[edges[i].a], ++borderEdges[edges[i].b];
+            else if (kind == SIMPLIFY_SEAM)
+                ++seamEdges[edges[i].a], ++seamEdges[edges[i].b];
+            i += count;
+        }
+        for (size_t v = 0; v < vertexCount; ++v)
+        {
+            if (kinds[v] == SIMPLIFY_LOCKED)
+                continue;
+            const uint32_t border = borderEdges[v], seam = seamEdges[v];
+            if ((border && seam) || (border != 0 && border != 2) || (seam != 0 && seam != 2))
+                kinds[v] = SIMPLIFY_LOCKED;
+            else if (border)
+                kinds[v] = SIMPLIFY_BORDER;
+            else if (seam)
+                kinds[v] = SIMPLIFY_SEAM;
+        }
+
+        // Both directions of every edge a position may move along, with the error of the merged quadric
+        collapses.clear();
+        for (size_t i = 0; i < edges.size();)
+        {
+            const size_t count = simplifyEdgeSides(edges, i);
+            const SimplifyVertexKind kind = simplifyEdgeKind(edges, i, count);
+            for (int direction = 0; direction < 2 && kind != SIMPLIFY_LOCKED; ++direction)
+            {
+                SimplifyCollapse collapse;
+                collapse.from = direction ? edges[i].b : edges[i].a;
+                collapse.to = direction ? edges[i].a : edges[i].b;
+                if (kinds[collapse.from] != SIMPLIFY_MANIFOLD && kinds[collapse.from] != kind)
+                    continue;
+
+                SimplifyQuadric q = quadrics[collapse.from];
+                quadricAdd(q, quadrics[collapse.to]);
+                collapse.cost = (float)(quadricEvaluate(q, vertices + (size_t)collapse.to * MESH_VERTEX_FLOATS) / (q.weight > 0.0 ? q.weight : 1.0));
+                collapses.push_back(collapse);
+            }
+            i += count;
+        }
+        std::sort(collapses.begin(), collapses.end(), SimplifyCollapseLess());
+
+        // Triangles around every position
+        std::fill(triangleOffsets.begin(), triangleOffsets.end(), 0u);
+        for (size_t i = 0; i < outIndices.size(); ++i)
+            ++triangleOffsets[positions[outIndices[i]] + 1];
+        for (size_t v = 0; v < vertexCount; ++v)
+            triangleOffsets[v + 1] += triangleOffsets[v];
+        triangles.resize(outIndices.size());
+        for (size_t i = 0; i < outIndices.size(); ++i)
+            triangles[triangleOffsets[positions[outIndices[i]]]++] = (uint32_t)(i / 3);
+        for (size_t v = vertexCount; v > 0; --v)
+            triangleOffsets[v] = triangleOffsets[v - 1];
+        triangleOffsets[0] = 0;
+
+        // Cheapest first; a collapse locks every position around the one it removes until the next pass
+        std::fill(touched.begin(), touched.end(), (unsigned char)0);
+        for (size_t v = 0; v < vertexCount; ++v)
+            remap[v] = (uint32_t)v;
+        size_t collapsed = 0;
+        for (size_t i = 0; i < collapses.size() && triangleCount > targetTriangles; ++i)
+        {
+            const SimplifyCollapse& collapse = collapses[i];
+            if (touched[collapse.from] || touched[collapse.to])
+                continue;
+            if (!simplifyCanCollapse(collapse.from, collapse.to, vertices, outIndices, positions, triangleOffsets, triangles, mapping))
+                continue;
+
+            for (size_t pair = 0; pair < mapping.size(); pair += 2)
+                remap[mapping[pair]] = mapping[pair + 1];
+            quadricAdd(quadrics[collapse.to], quadrics[collapse.from]);
+
+            for (uint32_t t = triangleOffsets[collapse.from]; t < triangleOffsets[collapse.from + 1]; ++t)
+            {
+                const uint32_t* triangle = &outIndices[(size_t)triangles[t] * 3];
+                bool removed = false;
+                for (int c = 0; c < 3; ++c)
+                {
+                    touched[positions[triangle[c]]] = 1;
+                    removed = removed || positions[triangle[c]] == collapse.to;
+                }
+                triangleCount -= removed ? 1 : 0;
+            }
+            error = std::max(error, (double)collapse.cost);
+            ++collapsed;
+        }
+        if (collapsed == 0)
+            break;
+
+        size_t write = 0;
+        for (size_t t = 0; t < outIndices.size(); t += 3)
+        {
+            const uint32_t a = remap[outIndices[t]], b = remap[outIndices[t + 1]], c = remap[outIndices[t + 2]];
+            if (positions[a] == positions[b] || positions[b] == positions[c] || positions[c] == positions[a])
+                continue;
+            outIndices[write++] = a;
+            outIndices[write++] = b;
+            outIndices[write++] = c;
+        }
+        outIndices.resize(write);
+        triangleCount = write / 3;
+    }
+
+    return (float)std::sqrt(error);
+}
+
+// Header of a cached level of detail chain (<source>.lods). The level table follows it, then the vertices
+// (MESH_VERTEX_FLOATS floats each) and the indices of every level, finest first.
+struct MeshLodHeader
+{
+    char magic[4];          // "LODS"
+    uint32_t version;
+    uint64_t sourceSize;    // Size and modification time of the source when the chain was built, to tell a stale cache
+    int64_t sourceTime;
+    uint32_t vertexCount;
+    uint32_t indexCount;    // Of all levels together
+    uint32_t levelCount;
+    uint32_t reserved;
+};
+
+struct MeshLodLevel
+{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float ratio;            // Triangles kept, as a share of the source's
+    float error;            // Distance the surface moved by, in object units
+};
+
+const uint32_t MESH_LOD_VERSION = 1;
+
+// Builds a chain of levels of detail from a welded mesh: the mesh itself, then one level per ratio (largest
+// first), each simplified from the one before. Levels stop once simplification no longer removes triangles.
+inline void buildMeshLods(const std::vector<float>& vertices, const std::vector<uint32_t>& indices, const float* ratios, size_t ratioCount,
+    std::vector<MeshLodLevel>& levels, std::vector<uint32_t>& lodIndices)
+{
+    const size_t vertexCount = vertices.size() / MESH_VERTEX_FLOATS;
+    MeshLodLevel level = { 0, (uint32_t)indices.size(), 1.0f, 0.0f };
+    levels.assign(1, level);
+    lodIndices = indices;
+
+    std::vector<uint32_t> previous = indices, simplified;
+    for (size_t r = 0; r < ratioCount; ++r)
+    {
+        const size_t target = (size_t)(indices.size() / 3 * ratios[r]) * 3;
+        const float error = simplifyMesh(vertices.data(), vertexCount, previous, target, simplified);
+        if (simplified.size() >= previous.size() || simplified.empty())
+            break;
+
+        level.firstIndex = (uint32_t)lodIndices.size();
+        level.indexCount = (uint32_t)simplified.size();
+        level.ratio = (float)simplified.size() / (float)indices.size();
+        level.error += error;   // Errors of successive levels add up, the simplifier only sees the level before
+        levels.push_back(level);
+        lodIndices.insert(lodIndices.end(), simplified.begin(), simplified.end());
+        previous.swap(simplified);
+    }
+}
+
+inline bool writeMeshLods(const char* path, const MeshLodHeader& header, const std::vector<MeshLodLevel>& levels, const std::vector<float>& vertices, const std::vector<uint32_t>& indices)
+{
+    FILE* file = fopen(path, "wb");
+    if (!file)
+        return false;
+
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(levels.data(), sizeof(MeshLodLevel), levels.size(), file) == levels.size()
+        && fwrite(vertices.data(), sizeof(float), vertices.size(), file) == vertices.size()
+        && fwrite(indices.data(), sizeof(uint32_t), indices.size(), file) == indices.size();
+    fclose(file);
+    return written;
+}
+
+// Reads and validates the header of a cached chain; false when the file is missing or not a chain
+inline bool readMeshLodHeader(const char* path, MeshLodHeader& header)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return false;
+
+    bool valid = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, "LODS", 4) == 0
+        && header.version == MESH_LOD_VERSION && header.levelCount > 0;
+    fclose(file);
+    return valid;
+}
+
+// Reads a whole cached chain; every level must lie inside the index data
+inline bool readMeshLods(const char* path, MeshLodHeader& header, std::vector<MeshLodLevel>& levels, std::vector<float>& vertices, std::vector<uint32_t>& indices)
+{
+    if (!readMeshLodHeader(path, header))
+        return false;
+
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return false;
+
+    levels.resize(header.levelCount);
+    vertices.resize((size_t)header.vertexCount * MESH_VERTEX_FLOATS);
+    indices.resize(header.indexCount);
+    bool valid = fseek(file, sizeof(MeshLodHeader), SEEK_SET) == 0
+        && fread(levels.data(), sizeof(MeshLodLevel), levels.size(), file) == levels.size()
+        && fread(vertices.data(), sizeof(float), vertices.size(), file) == vertices.size()
+        && fread(indices.data(), sizeof(uint32_t), indices.size(), file) == indices.size();
+    fclose(file);
+
+    for (size_t i = 0; i < levels.size() && valid; ++i)
+        valid = (uint64_t)levels[i].firstIndex + levels[i].indexCount <= header.indexCount;
+    for (size_t i = 0; i < indices.size() && valid; ++i)
+        valid = indices[i] < header.vertexCount;
+    return valid;
+}
+
+#endif
@@ -0,0 +1,1175 @@
+#include <iostream>         // cout
+#include <algorithm>        // sort, min, max
+#include <cstdlib>          // EXIT_SUCCESS, EXIT_FAILURE, strtof
+#include <cmath>            // fabs, sqrt
+#include <cstdio>           // fopen, fwrite, remove
+#include <cstring>          // memcmp, memcpy
+#include <map>              // map
+#include <string>           // string
+#include <utility>          // pair
+#include <vector>           // vector
+
+#include "meshopt.h"        // Vertex welding and cache/overdraw/fetch optimization
+#include "json.h"           // Scene file parser
+#include "meshfile.h"       // Binary mesh files
+#include "meshgen.h"        // Procedural meshes
+#include "simplify.h"       // Quadric error simplification
+#include "meshimport.h"     // OBJ and glTF importer
+#include "texturecompress.h" // BC1/BC3/BC7 encoders
+#include "frustum.h"        // SIMD view frustum culling
+#include "bvh.h"            // Bounding volume hierarchy
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+using namespace std; // Standard namespace
+
+// Checks of the CPU-side mesh, scene and file code. Every suite prints "TEST <name> passed" or one
+// "FAIL: ..." line per broken check; the program fails when any check does. Run one suite with
+// "tests <name>", or all of them without arguments.
+
+// Unnamed namespace
+namespace
+{
+    // Checks that failed in the current run
+    int gFailures = 0;
+    // Suite whose checks are running, for the failure messages
+    const char* gSuite = "";
+
+    // Triangle indices and their vertices in the renderer's layout
+    struct TestMesh
+    {
+        vector<float> vertices;
+        vector<uint32_t> indices;
+    };
+}
+
+/* User-defined Function prototypes */
+bool UCheck(bool condition, const char* what);
+void UGenerateShape(MeshShape shape, int segments, int rings, TestMesh& mesh);
+void UBuildGrid(int side, TestMesh& mesh);
+bool USameVertex(const float* a, const float* b);
+vector<uint32_t> USortedTriangles(const vector<uint32_t>& indices);
+bool UWriteTextFile(const char* path, const string& text);
+bool UWriteGlbFile(const char* path, const string& json, const vector<unsigned char>& bin);
+void UAppendBytes(vector<unsigned char>& bin, const void* data, size_t size);
+void UDecodeBC1Block(const unsigned char* in, unsigned char out[64]);
+void UDecodeBC3Block(const unsigned char* in, unsigned char out[64]);
+bool UDecodeBC7Block(const unsigned char* in, unsigned char out[64]);
+bool UDecodeBlock(uint32_t format, const unsigned char* in, unsigned char out[64]);
+int UBlockError(uint32_t format, const unsigned char block[64]);
+void UBuildRandomBounds(size_t objects, float side, CullBounds& bounds);
+void UCameraFrustum(Frustum& frustum);
+size_t UCullMismatches(const Frustum& frustum, const CullBounds& bounds, const vector<unsigned char>& visible, const vector<unsigned char>& reference);
+int URaycastLinear(const CullBounds& bounds, const float* origin, const float* direction, float& distance);
+void UTestMeshOptimization();
+void UTestJson();
+void UTestMeshFile();
+void UTestSimplification();
+void UTestObjImport();
+void UTestGlbImport();
+void UTestTextureCompression();
+void UTestFrustumCulling();
+void UTestBvh();
+
+
+int main(int argc, char* argv[])
+{
+    const char* names[] = { "meshopt", "json", "meshfile", "simplify", "obj", "glb", "texture", "frustum", "bvh" };
+    void (*suites[])() = { UTestMeshOptimization, UTestJson, UTestMeshFile, UTestSimplification, UTestObjImport, UTestGlbImport, UTestTextureCompression,
+        UTestFrustumCulling, UTestBvh };
+    const int suiteCount = sizeof(names) / sizeof(names[0]);
+
+    bool ran = false;
+    for (int s = 0; s < suiteCount; ++s)
+    {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc; ++i)
+            selected = selected || string(argv[i]) == names[s];
+        if (!selected)
+            continue;
+
+        const int failuresBefore = gFailures;
+        gSuite = names[s];
+        suites[s]();
+        ran = true;
+        if (gFailures == failuresBefore)
+            cout << "TEST " << names[s] << " passed" << endl;
+    }
+
+    if (!ran)
+    {
+        cout << "ERROR: no test suite named " << argv[1] << endl;
+        return EXIT_FAILURE;
+    }
+    return gFailures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+// Counts and reports a failed check; returns the condition so callers can skip checks that depend on it
+bool UCheck(bool condition, const char* what)
+{
+    if (!condition)
+    {
+        cout << "FAIL: " << gSuite << ": " << what << endl;
+        ++gFailures;
+    }
+    return condition;
+}
+
+
+void UGenerateShape(MeshShape shape, int segments, int rings, TestMesh& mesh)
+{
+    const MeshSize size = meshShapeSize(shape, segments, rings);
+    mesh.vertices.assign(size.vertices * MESH_VERTEX_FLOATS, 0.0f);
+    mesh.indices.assign(size.indices, 0);
+    MeshWriter writer = meshWriter(mesh.vertices.data(), mesh.indices.data());
+    generateMeshShape(writer, shape, segments, rings);
+}
+
+
+// Flat unit square in the xy plane facing +z, split into side x side quads
+void UBuildGrid(int side, TestMesh& mesh)
+{
+    mesh.vertices.clear();
+    mesh.indices.clear();
+    for (int y = 0; y <= side; ++y)
+    {
+        for (int x = 0; x <= side; ++x)
+        {
+            const float u = (float)x / side;
+            const float v = (float)y / side;
+            const float vertex[MESH_VERTEX_FLOATS] = { u, v, 0.0f, 0.0f, 0.0f, 1.0f, u, v };
+            mesh.vertices.insert(mesh.vertices.end(), vertex, vertex + MESH_VERTEX_FLOATS);
+        }
+    }
+    for (int y = 0; y < side; ++y)
+    {
+        for (int x = 0; x < side; ++x)
+        {
+            const uint32_t corner = (uint32_t)(y * (side + 1) + x);
+            const uint32_t quad[6] = { corner, corner + 1, corner + side + 2, corner, corner + side + 2, corner + side + 1 };
+            mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+        }
+    }
+}
+
+
+bool USameVertex(const float* a, const float* b)
+{
+    return memcmp(a, b, MESH_VERTEX_FLOATS * sizeof(float)) == 0;
+}
+
+
+// Triangles rotated to start at their smallest index (keeping their winding), then sorted, to compare two
+// orderings of the same triangles
+vector<uint32_t> USortedTriangles(const vector<uint32_t>& indices)
+{
+    vector<pair<uint32_t, pair<uint32_t, uint32_t> > > triangles;
+    for (size_t t = 0; t + 2 < indices.size(); t += 3)
+    {
+        uint32_t a = indices[t], b = indices[t + 1], c = indices[t + 2];
+        while (a > b || a > c)
+        {
+            const uint32_t first = a;
+            a = b;
+            b = c;
+            c = first;
+        }
+        triangles.push_back(make_pair(a, make_pair(b, c)));
+    }
+    sort(triangles.begin(), triangles.end());
+
+    vector<uint32_t> sorted;
+    for (size_t t = 0; t < triangles.size(); ++t)
+    {
+        sorted.push_back(triangles[t].first);
+        sorted.push_back(triangles[t].second.first);
+        sorted.push_back(triangles[t].second.second);
+    }
+    return sorted;
+}
+
+
+bool UWriteTextFile(const char* path, const string& text)
+{
+    FILE* file = fopen(path, "wb");
+    if (!file)
+        return false;
+    bool written = fwrite(text.data(), 1, text.size(), file) == text.size();
+    return fclose(file) == 0 && written;
+}
+
+
+// Binary glTF file of a JSON chunk and a binary chunk, both padded to 4 bytes
+bool UWriteGlbFile(const char* path, const string& json, const vector<unsigned char>& bin)
+{
+    string paddedJson = json;
+    while (paddedJson.size() % 4 != 0)
+        paddedJson += ' ';
+    vector<unsigned char> paddedBin = bin;
+    while (paddedBin.size() % 4 != 0)
+        paddedBin.push_back(0);
+
+    const uint32_t header[5] = { 0x46546C67u, 2, (uint32_t)(12 + 8 + paddedJson.size() + 8 + paddedBin.size()), (uint32_t)paddedJson.size(), 0x4E4F534Au };
+    const uint32_t binHeader[2] = { (uint32_t)paddedBin.size(), 0x004E4942u };
+    FILE* file = fopen(path, "wb");
+    if (!file)
+        return false;
+    bool written = fwrite(header, sizeof(header), 1, file) == 1
+        && fwrite(paddedJson.data(), 1, paddedJson.size(), file) == paddedJson.size()
+        && fwrite(binHeader, sizeof(binHeader), 1, file) == 1
+        && fwrite(paddedBin.data(), 1, paddedBin.size(), file) == paddedBin.size();
+    return fclose(file) == 0 && written;
+}
+
+
+void UAppendBytes(vector<unsigned char>& bin, const void* data, size_t size)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    bin.insert(bin.end(), bytes, bytes + size);
+}
+
+
+// BC1 block as the GPU decodes it: 5:6:5 endpoints widened by repeating their top bits, four colors when
+// color0 > color1, otherwise three and transparent black
+void UDecodeBC1Block(const unsigned char* in, unsigned char out[64])
+{
+    const uint32_t colors[2] = { (uint32_t)(in[0] | in[1] << 8), (uint32_t)(in[2] | in[3] << 8) };
+    int palette[4][4];
+    for (int i = 0; i < 2; ++i)
+    {
+        const int r = (colors[i] >> 11) & 31, g = (colors[i] >> 5) & 63, b = colors[i] & 31;
+        palette[i][0] = (r << 3) | (r >> 2);
+        palette[i][1] = (g << 2) | (g >> 4);
+        palette[i][2] = (b << 3) | (b >> 2);
+        palette[i][3] = 255;
+    }
+    for (int c = 0; c < 3; ++c)
+    {
+        if (colors[0] > colors[1])
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        else
+        {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+    palette[2][3] = 255;
+    palette[3][3] = colors[0] > colors[1] ? 255 : 0;
+
+    const uint32_t indices = (uint32_t)(in[4] | in[5] << 8 | in[6] << 16 | (uint32_t)in[7] << 24);
+    for (int p = 0; p < 16; ++p)
+        for (int c = 0; c < 4; ++c)
+            out[p * 4 + c] = (unsigned char)palette[(indices >> (p * 2)) & 3][c];
+}
+
+
+// BC3 block: eight alpha levels when alpha0 > alpha1, otherwise six and 0 and 255, 3-bit indices, then BC1 color
+void UDecodeBC3Block(const unsigned char* in, unsigned char out[64])
+{
+    UDecodeBC1Block(in + 8, out);
+
+    const int alpha0 = in[0], alpha1 = in[1];
+    int levels[8] = { alpha0, alpha1 };
+    if (alpha0 > alpha1)
+    {
+        for (int i = 1; i < 7; ++i)
+            levels[i + 1] = ((7 - i) * alpha0 + i * alpha1) / 7;
+    }
+    else
+    {
+        for (int i = 1; i < 5; ++i)
+            levels[i + 1] = ((5 - i) * alpha0 + i * alpha1) / 5;
+        levels[6] = 0;
+        levels[7] = 255;
+    }
+
+    uint64_t indices = 0;
+    for (int i = 0; i < 6; ++i)
+        indices |= (uint64_t)in[2 + i] << (i * 8);
+    for (int p = 0; p < 16; ++p)
+        out[p * 4 + 3] = (unsigned char)levels[(indices >> (p * 3)) & 7];
+}
+
+
+// BC7 block of mode 6 (the only mode the encoder writes): false for any other mode
+bool UDecodeBC7Block(const unsigned char* in, unsigned char out[64])
+{
+    static const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    int offset = 0;
+    uint32_t value = 0;
+    // Bits are read from the least significant bit of byte 0 on
+    #define UREADBITS(count) value = 0; for (int bit = 0; bit < (count); ++bit, ++offset) value |= (uint32_t)((in[offset / 8] >> (offset % 8)) & 1) << bit;
+
+    UREADBITS(7)
+    if (value != 1u << 6)
+        return false;
+
+    int endpoints[2][4];
+    for (int c = 0; c < 4; ++c)
+    {
+        for (int e = 0; e < 2; ++e)
+        {
+            UREADBITS(7)
+            endpoints[e][c] = (int)value << 1;
+        }
+    }
+    for (int e = 0; e < 2; ++e)
+    {
+        UREADBITS(1)
+        for (int c = 0; c < 4; ++c)
+            endpoints[e][c] |= (int)value;
+    }
+
+    for (int p = 0; p < 16; ++p)
+    {
+        // The anchor index (pixel 0) is stored without its top bit, which is 0
+        UREADBITS(p == 0 ? 3 : 4)
+        for (int c = 0; c < 4; ++c)
+            out[p * 4 + c] = (unsigned char)(((64 - weights[value]) * endpoints[0][c] + weights[value] * endpoints[1][c] + 32) >> 6);
+    }
+    #undef UREADBITS
+    return offset == 128;
+}
+
+
+bool UDecodeBlock(uint32_t format, const unsigned char* in, unsigned char out[64])
+{
+    if (format == TEXTURE_BC1)
+        UDecodeBC1Block(in, out);
+    else if (format == TEXTURE_BC3)
+        UDecodeBC3Block(in, out);
+    else
+        return UDecodeBC7Block(in, out);
+    return true;
+}
+
+
+// Largest channel difference between a block and its encoded and decoded copy; BC1 ignores alpha. -1 when the
+// block does not decode.
+int UBlockError(uint32_t format, const unsigned char block[64])
+{
+    unsigned char encoded[16], decoded[64];
+    if (format == TEXTURE_BC1)
+        encodeBC1Block(block, encoded);
+    else if (format == TEXTURE_BC3)
+        encodeBC3Block(block, encoded);
+    else
+        encodeBC7Block(block, encoded);
+    if (!UDecodeBlock(format, encoded, decoded))
+        return -1;
+
+    int error = 0;
+    for (int p = 0; p < 16; ++p)
+        for (int c = 0; c < (format == TEXTURE_BC1 ? 3 : 4); ++c)
+            error = max(error, abs(decoded[p * 4 + c] - block[p * 4 + c]));
+    return error;
+}
+
+
+// Boxes of up to 2 units scattered over a cube of the given side around the origin, deterministic from run to run
+void UBuildRandomBounds(size_t objects, float side, CullBounds& bounds)
+{
+    resizeCullBounds(bounds, objects);
+    unsigned int seed = 12345;
+    for (size_t i = 0; i < objects; ++i)
+    {
+        float values[6];
+        for (int v = 0; v < 6; ++v)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            values[v] = (seed >> 8) / 16777216.0f;
+        }
+        const float center[3] = { (values[0] - 0.5f) * side, (values[1] - 0.5f) * side, (values[2] - 0.5f) * side };
+        const float extent[3] = { values[3], values[4], values[5] };
+        setCullBounds(bounds, i, center, extent);
+    }
+}
+
+
+// The renderer's default camera and projection
+void UCameraFrustum(Frustum& frustum)
+{
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 1.0f, 3.0f), glm::vec3(0.0f, 1.0f, 2.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+    extractFrustum(glm::value_ptr(projection * view), frustum);
+}
+
+
+// Boxes two culling results disagree on, other than boxes touching a plane to within rounding (the tests
+// compute a box's corners in different orders, so those may fall either way)
+size_t UCullMismatches(const Frustum& frustum, const CullBounds& bounds, const vector<unsigned char>& visible, const vector<unsigned char>& reference)
+{
+    size_t mismatches = 0;
+    for (size_t i = 0; i < bounds.count; ++i)
+    {
+        if (visible[i] == reference[i])
+            continue;
+
+        bool touching = false;
+        for (int p = 0; p < 6; ++p)
+        {
+            const float scale = fabs(frustum.a[p]) + fabs(frustum.b[p]) + fabs(frustum.c[p]) + fabs(frustum.d[p]);
+            const float distance = frustum.a[p] * bounds.centerX[i] + frustum.b[p] * bounds.centerY[i] + frustum.c[p] * bounds.centerZ[i] + frustum.d[p] +
+                fabs(frustum.a[p]) * bounds.extentX[i] + fabs(frustum.b[p]) * bounds.extentY[i] + fabs(frustum.c[p]) * bounds.extentZ[i];
+            touching = touching || fabs(distance) <= 1e-5f * scale * (1.0f + fabs(bounds.centerX[i]) + fabs(bounds.centerY[i]) + fabs(bounds.centerZ[i]));
+        }
+        mismatches += !touching;
+    }
+    return mismatches;
+}
+
+
+// Nearest box a ray enters at a distance of 0 or more, by testing every box; -1 when none
+int URaycastLinear(const CullBounds& bounds, const float* origin, const float* direction, float& distance)
+{
+    const float* centers[3] = { bounds.centerX.data(), bounds.centerY.data(), bounds.centerZ.data() };
+    const float* extents[3] = { bounds.extentX.data(), bounds.extentY.data(), bounds.extentZ.data() };
+    int hit = -1;
+    distance = INFINITY;
+    for (size_t i = 0; i < bounds.count; ++i)
+    {
+        float tNear = 0.0f, tFar = INFINITY;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            float t0 = (centers[axis][i] - extents[axis][i] - origin[axis]) / direction[axis];
+            float t1 = (centers[axis][i] + extents[axis][i] - origin[axis]) / direction[axis];
+            if (t0 > t1)
+                swap(t0, t1);
+            tNear = fmax(tNear, t0);
+            tFar = fmin(tFar, t1);
+        }
+        if (tNear <= tFar && tNear < distance)
+        {
+            distance = tNear;
+            hit = (int)i;
+        }
+    }
+    return hit;
+}
+
+
+// Welding, ACMR and the three reorderings UCreateIndexedMesh runs
+void UTestMeshOptimization()
+{
+    // A generated cylinder, unwelded into a triangle list, welds back into unique vertices that reproduce every corner
+    TestMesh cylinder;
+    UGenerateShape(MESH_CYLINDER, 16, 4, cylinder);
+    vector<float> corners;
+    for (size_t i = 0; i < cylinder.indices.size(); ++i)
+        corners.insert(corners.end(), cylinder.vertices.begin() + cylinder.indices[i] * MESH_VERTEX_FLOATS, cylinder.vertices.begin() + (cylinder.indices[i] + 1) * MESH_VERTEX_FLOATS);
+
+    vector<float> welded;
+    vector<uint32_t> weldedIndices;
+    weldVertices(corners.data(), cylinder.indices.size(), welded, weldedIndices);
+    const size_t weldedCount = welded.size() / MESH_VERTEX_FLOATS;
+    UCheck(weldedIndices.size() == cylinder.indices.size(), "welding keeps one index per corner");
+    UCheck(weldedCount <= cylinder.vertices.size() / MESH_VERTEX_FLOATS, "welding leaves no more vertices than the generator wrote");
+
+    bool remapped = true;
+    for (size_t i = 0; i < weldedIndices.size() && remapped; ++i)
+        remapped = weldedIndices[i] < weldedCount && USameVertex(&welded[weldedIndices[i] * MESH_VERTEX_FLOATS], &corners[i * MESH_VERTEX_FLOATS]);
+    UCheck(remapped, "every welded index points at its corner's vertex");
+
+    bool unique = true;
+    for (size_t a = 0; a < weldedCount && unique; ++a)
+        for (size_t b = a + 1; b < weldedCount && unique; ++b)
+            unique = !USameVertex(&welded[a * MESH_VERTEX_FLOATS], &welded[b * MESH_VERTEX_FLOATS]);
+    UCheck(unique, "welded vertices are unique");
+
+    // ACMR: unshared triangles miss every time, a repeated triangle hits the second time
+    const uint32_t separate[9] = { 0, 1, 2, 3, 4, 5, 6, 7, 8 };
+    const uint32_t repeated[6] = { 0, 1, 2, 2, 1, 0 };
+    UCheck(computeACMR(vector<uint32_t>(separate, separate + 9), 9) == 3.0f, "ACMR of unshared triangles is 3");
+    UCheck(computeACMR(vector<uint32_t>(repeated, repeated + 6), 3) == 1.5f, "ACMR of a repeated triangle is 1.5");
+    UCheck(computeACMR(vector<uint32_t>(), 0) == 0.0f, "ACMR of no triangles is 0");
+
+    // Reordering a shuffled grid keeps its triangles and their winding, and lowers the ACMR
+    TestMesh grid;
+    UBuildGrid(32, grid);
+    const size_t gridVertices = grid.vertices.size() / MESH_VERTEX_FLOATS;
+    vector<uint32_t> shuffled;
+    for (size_t t = 0; t < grid.indices.size() / 3; ++t)
+    {
+        const size_t from = (t * 7919) % (grid.indices.size() / 3) * 3;
+        shuffled.insert(shuffled.end(), grid.indices.begin() + from, grid.indices.begin() + from + 3);
+    }
+    UCheck(USortedTriangles(shuffled) == USortedTriangles(grid.indices), "the shuffled grid holds the grid's triangles");
+
+    vector<uint32_t> optimized = shuffled;
+    vector<uint32_t> clusters;
+    optimizeVertexCache(optimized, gridVertices, &clusters);
+    UCheck(USortedTriangles(optimized) == USortedTriangles(shuffled), "cache optimization keeps every triangle and its winding");
+    UCheck(computeACMR(optimized, gridVertices) < computeACMR(shuffled, gridVertices), "cache optimization lowers the ACMR");
+    bool clustersValid = !clusters.empty() && clusters[0] == 0;
+    for (size_t c = 1; c < clusters.size() && clustersValid; ++c)
+        clustersValid = clusters[c] > clusters[c - 1] && clusters[c] < optimized.size() / 3;
+    UCheck(clustersValid, "clusters start at increasing triangles inside the mesh");
+
+    vector<uint32_t> sorted = optimized;
+    optimizeOverdraw(sorted, grid.vertices, clusters);
+    UCheck(USortedTriangles(sorted) == USortedTriangles(optimized), "overdraw sorting keeps every triangle and its winding");
+
+    // Fetch optimization numbers the vertices in order of first use and drops the ones no triangle uses
+    vector<float> fetchVertices = grid.vertices;
+    fetchVertices.insert(fetchVertices.end(), grid.vertices.begin(), grid.vertices.begin() + MESH_VERTEX_FLOATS);
+    vector<uint32_t> fetchIndices = sorted;
+    optimizeVertexFetch(fetchVertices, fetchIndices);
+    UCheck(fetchVertices.size() == grid.vertices.size(), "fetch optimization drops the unreferenced vertex");
+    uint32_t next = 0;
+    bool firstUse = fetchIndices.size() == sorted.size();
+    for (size_t i = 0; i < fetchIndices.size() && firstUse; ++i)
+    {
+        firstUse = fetchIndices[i] <= next && USameVertex(&fetchVertices[fetchIndices[i] * MESH_VERTEX_FLOATS], &grid.vertices[sorted[i] * MESH_VERTEX_FLOATS]);
+        if (fetchIndices[i] == next)
+            ++next;
+    }
+    UCheck(firstUse && next == gridVertices, "fetch optimization numbers vertices by first use and keeps every corner's vertex");
+}
+
+
+// Values, escapes and the errors of malformed documents
+void UTestJson()
+{
+    const string text =
+        "{\n"
+        "  \"name\": \"desk\\n\\\"scene\\\" \\u00e9\",\n"
+        "  \"count\": -1.5e2,\n"
+        "  \"flags\": [true, false, null],\n"
+        "  \"nested\": { \"empty\": [], \"object\": {} }\n"
+        "}\n";
+    JsonValue root;
+    string error;
+    if (UCheck(parseJson(text.data(), text.size(), root, error), "a valid document parses"))
+    {
+        UCheck(error.empty(), "a valid document leaves no error");
+        UCheck(root.type == JSON_OBJECT && root.members.size() == 4, "the root object holds its 4 members");
+        UCheck(root.members[0].first == "name" && root.members[3].first == "nested", "members keep the file's order");
+
+        const JsonValue* name = root.find("name");
+        UCheck(name && name->type == JSON_STRING && name->string == "desk\n\"scene\" \xc3\xa9", "escapes and \\u code points are decoded");
+        const JsonValue* count = root.find("count");
+        UCheck(count && count->type == JSON_NUMBER && count->number == -150.0, "numbers with exponents parse");
+        const JsonValue* flags = root.find("flags");
+        UCheck(flags && flags->type == JSON_ARRAY && flags->elements.size() == 3 && flags->elements[0].type == JSON_BOOLEAN && flags->elements[0].boolean
+            && flags->elements[1].type == JSON_BOOLEAN && !flags->elements[1].boolean && flags->elements[2].type == JSON_NULL, "literals parse");
+        const JsonValue* nested = root.find("nested");
+        UCheck(nested && nested->find("empty") && nested->find("empty")->type == JSON_ARRAY && nested->find("empty")->elements.empty()
+            && nested->find("object") && nested->find("object")->type == JSON_OBJECT, "empty arrays and objects parse");
+        UCheck(root.find("missing") == 0 && count && count->find("name") == 0, "find returns null for missing members and non-objects");
+    }
+
+    // Each malformed document fails with the error (and line) its first problem gives
+    const char* malformed[][2] = {
+        { "", "line 1: unexpected end of file" },
+        { "{\"a\": 1,}", "line 1: expected a member name" },
+        { "[1 2]", "line 1: expected ',' or ']' in array" },
+        { "{\"a\" 1}", "line 1: expected ':' after member name" },
+        { "{\"a\": 1 \"b\": 2}", "line 1: expected ',' or '}' in object" },
+        { "\"open", "line 1: unterminated string" },
+        { "\"bad \\q\"", "line 1: invalid escape in string" },
+        { "\"\\u12g4\"", "line 1: invalid \\u escape" },
+        { "[1.2.3]", "line 1: invalid number" },
+        { "{}\n\nx", "line 3: unexpected text after the document" },
+        { "{\n\"a\": @}", "line 2: unexpected character" }
+    };
+    for (size_t i = 0; i < sizeof(malformed) / sizeof(malformed[0]); ++i)
+    {
+        JsonValue value;
+        const bool parsed = parseJson(malformed[i][0], strlen(malformed[i][0]), value, error);
+        const string what = string("malformed document ") + to_string(i) + " fails with \"" + malformed[i][1] + "\" (got \"" + error + "\")";
+        UCheck(!parsed && error == malformed[i][1], what.c_str());
+    }
+
+    string deep(100, '[');
+    deep += string(100, ']');
+    JsonValue value;
+    UCheck(!parseJson(deep.data(), deep.size(), value, error) && error == "line 1: nested too deeply", "runaway nesting is refused");
+    UCheck(!readJsonFile("test_missing.json", value, error) && error == "cannot open file", "a missing file fails");
+}
+
+
+// Writing, mapping and validating a mesh file of two meshes
+void UTestMeshFile()
+{
+    const char* path = "test_meshes.bmesh";
+    TestMesh cylinder, box;
+    UGenerateShape(MESH_CYLINDER, 16, 2, cylinder);
+    UGenerateShape(MESH_BOX, 2, 1, box);
+
+    // The cylinder gets a second level: its first half of triangles
+    const uint32_t cylinderIndices = (uint32_t)cylinder.indices.size();
+    const uint32_t halfIndices = cylinderIndices / 6 * 3;
+    cylinder.indices.insert(cylinder.indices.end(), cylinder.indices.begin(), cylinder.indices.begin() + halfIndices);
+    const MeshFileLod cylinderLods[2] = { { 0, cylinderIndices, 0.0f, 0 }, { cylinderIndices, halfIndices, 0.25f, 0 } };
+    const MeshFileLod boxLod = { 0, (uint32_t)box.indices.size(), 0.0f, 0 };
+
+    MeshFileSource sources[2];
+    sources[0].name = "cylinder";
+    sources[0].vertices = cylinder.vertices.data();
+    sources[0].vertexCount = (uint32_t)(cylinder.vertices.size() / MESH_VERTEX_FLOATS);
+    sources[0].indices = cylinder.indices.data();
+    sources[0].indexCount = (uint32_t)cylinder.indices.size();
+    sources[0].lods = cylinderLods;
+    sources[0].lodCount = 2;
+    sources[1].name = "box";
+    sources[1].vertices = box.vertices.data();
+    sources[1].vertexCount = (uint32_t)(box.vertices.size() / MESH_VERTEX_FLOATS);
+    sources[1].indices = box.indices.data();
+    sources[1].indexCount = (uint32_t)box.indices.size();
+    sources[1].lods = &boxLod;
+    sources[1].lodCount = 1;
+    if (!UCheck(writeMeshFile(path, sources, 2), "the mesh file is written"))
+        return;
+
+    MeshFileMapping mapping;
+    if (!UCheck(mapMeshFile(path, mapping), "the mesh file maps"))
+        return;
+    if (UCheck(validateMeshFile(mapping.data, mapping.size), "the written file validates"))
+    {
+        const MeshFileHeader& header = *meshFileHeader(mapping.data);
+        UCheck(header.meshCount == 2 && header.attributeCount == 3 && header.vertexStride == MESH_VERTEX_FLOATS * sizeof(float), "the header describes 2 meshes of the renderer's layout");
+        UCheck(header.vertexOffset % MESH_FILE_ALIGNMENT == 0 && header.positionOffset % MESH_FILE_ALIGNMENT == 0 && header.indexOffset % MESH_FILE_ALIGNMENT == 0, "blobs are aligned");
+
+        const MeshFileAttribute* attributes = meshFileAttributes(mapping.data);
+        UCheck(attributes[0].location == 0 && attributes[0].components == 3 && attributes[1].offset == 3 * sizeof(float)
+            && attributes[2].components == 2 && attributes[2].offset == 6 * sizeof(float), "the attributes give position, normal and texture coordinate");
+
+        const float* vertices = (const float*)(mapping.data + header.vertexOffset);
+        const float* positions = (const float*)(mapping.data + header.positionOffset);
+        const uint32_t* indices = (const uint32_t*)(mapping.data + header.indexOffset);
+        const MeshFileMesh* meshes = meshFileMeshes(mapping.data);
+        for (int m = 0; m < 2; ++m)
+        {
+            const MeshFileMesh& mesh = meshes[m];
+            const MeshFileSource& source = sources[m];
+            UCheck(source.name == mesh.name && mesh.vertexCount == source.vertexCount && mesh.indexCount == source.indexCount && mesh.lodCount == source.lodCount, "the table keeps each mesh's name and counts");
+            UCheck(memcmp(mesh.lods, source.lods, source.lodCount * sizeof(MeshFileLod)) == 0, "the table keeps each mesh's levels");
+            UCheck(memcmp(vertices + (size_t)mesh.firstVertex * MESH_VERTEX_FLOATS, source.vertices, (size_t)source.vertexCount * MESH_VERTEX_FLOATS * sizeof(float)) == 0, "vertices round-trip");
+            UCheck(memcmp(indices + mesh.firstIndex, source.indices, (size_t)source.indexCount * sizeof(uint32_t)) == 0, "indices round-trip");
+
+            bool positionsMatch = true;
+            bool inBounds = true;
+            for (uint32_t v = 0; v < source.vertexCount; ++v)
+            {
+                const float* position = positions + ((size_t)mesh.firstVertex + v) * 3;
+                positionsMatch = positionsMatch && memcmp(position, source.vertices + (size_t)v * MESH_VERTEX_FLOATS, 3 * sizeof(float)) == 0;
+                for (int axis = 0; axis < 3; ++axis)
+                    inBounds = inBounds && position[axis] >= mesh.boundsMin[axis] && position[axis] <= mesh.boundsMax[axis];
+            }
+            UCheck(positionsMatch, "the position blob repeats each vertex's position");
+            UCheck(inBounds, "the bounding box holds every vertex");
+        }
+
+        // Truncated or retagged copies of the file are refused
+        vector<unsigned char> copy(mapping.data, mapping.data + mapping.size);
+        UCheck(!validateMeshFile(copy.data(), copy.size() - 4), "a truncated file is refused");
+        UCheck(!validateMeshFile(copy.data(), sizeof(MeshFileHeader) - 1), "a file shorter than its header is refused");
+        copy[0] = 'X';
+        UCheck(!validateMeshFile(copy.data(), copy.size()), "a file with the wrong magic is refused");
+        copy[0] = 'B';
+        MeshFileMesh* copyMeshes = (MeshFileMesh*)(copy.data() + ((const unsigned char*)meshes - mapping.data));
+        copyMeshes[1].lods[0].indexCount += 3;
+        UCheck(!validateMeshFile(copy.data(), copy.size()), "a level past its mesh's indices is refused");
+
+        // Blob sizes whose end offsets wrap around 64 bits, to a position blob ending at byte 52, are refused
+        copy.assign(mapping.data, mapping.data + mapping.size);
+        MeshFileHeader* copyHeader = (MeshFileHeader*)copy.data();
+        const uint64_t hugeVertexCount = (1ull << 59) - 1;
+        copyHeader->vertexBytes = hugeVertexCount * copyHeader->vertexStride;
+        copyHeader->positionBytes = hugeVertexCount * 3 * sizeof(float);
+        copyHeader->positionOffset = 52 - copyHeader->positionBytes;
+        copyMeshes = (MeshFileMesh*)(copy.data() + ((const unsigned char*)meshes - mapping.data));
+        copyMeshes[0].firstVertex = 4000000000u;
+        UCheck(!validateMeshFile(copy.data(), copy.size()), "blob ranges that wrap around are refused");
+    }
+    unmapMeshFile(mapping);
+    remove(path);
+
+    MeshFileMapping missing;
+    UCheck(!mapMeshFile("test_missing.bmesh", missing) && missing.data == 0, "a missing file does not map");
+}
+
+
+// Simplifying a closed torus keeps it closed; simplifying a flat square keeps its outline
+void UTestSimplification()
+{
+    // The generator's seam vertices only meet to within rounding; snapped to a grid, they share their position
+    // exactly like the vertices of a file do, and count as one vertex for the topology checks
+    TestMesh torus;
+    UGenerateShape(MESH_TORUS, 48, 24, torus);
+    const size_t vertexCount = torus.vertices.size() / MESH_VERTEX_FLOATS;
+    for (size_t v = 0; v < vertexCount; ++v)
+        for (int axis = 0; axis < 3; ++axis)
+            torus.vertices[v * MESH_VERTEX_FLOATS + axis] = roundf(torus.vertices[v * MESH_VERTEX_FLOATS + axis] * 4096.0f) / 4096.0f;
+    vector<uint32_t> position(vertexCount);
+    map<vector<float>, uint32_t> positionIds;
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        const vector<float> key(torus.vertices.begin() + v * MESH_VERTEX_FLOATS, torus.vertices.begin() + v * MESH_VERTEX_FLOATS + 3);
+        position[v] = positionIds.insert(make_pair(key, (uint32_t)positionIds.size())).first->second;
+    }
+
+    const size_t target = torus.indices.size() / 4 / 3 * 3;
+    vector<uint32_t> simplified;
+    const float error = simplifyMesh(torus.vertices.data(), vertexCount, torus.indices, target, simplified);
+    UCheck(!simplified.empty() && simplified.size() <= target && simplified.size() % 3 == 0, "the torus is simplified to at most a quarter of its triangles");
+    UCheck(simplified.size() > target / 2, "the torus is not simplified far past its target");
+    UCheck(error > 0.0f && error < 0.25f, "the error is positive and smaller than the tube");
+
+    bool inRange = true;
+    bool degenerate = false;
+    map<pair<uint32_t, uint32_t>, int> edges;
+    for (size_t t = 0; t + 2 < simplified.size(); t += 3)
+    {
+        uint32_t p[3];
+        for (int i = 0; i < 3; ++i)
+        {
+            inRange = inRange && simplified[t + i] < vertexCount;
+            p[i] = inRange ? position[simplified[t + i]] : 0;
+        }
+        degenerate = degenerate || p[0] == p[1] || p[1] == p[2] || p[2] == p[0];
+        for (int i = 0; i < 3; ++i)
+            ++edges[make_pair(min(p[i], p[(i + 1) % 3]), max(p[i], p[(i + 1) % 3]))];
+    }
+    UCheck(inRange, "simplified indices refer to the source vertices");
+    UCheck(!degenerate, "no simplified triangle is degenerate");
+    bool closed = true;
+    for (map<pair<uint32_t, uint32_t>, int>::const_iterator edge = edges.begin(); edge != edges.end(); ++edge)
+        closed = closed && edge->second == 2;
+    UCheck(closed, "every edge of the simplified torus still joins exactly two triangles");
+
+    // The square's outline only collapses along itself, so its area stays 1 and no triangle flips over
+    TestMesh grid;
+    UBuildGrid(16, grid);
+    vector<uint32_t> square;
+    simplifyMesh(grid.vertices.data(), grid.vertices.size() / MESH_VERTEX_FLOATS, grid.indices, grid.indices.size() / 8 / 3 * 3, square);
+    UCheck(square.size() < grid.indices.size() / 4, "the flat square simplifies well past a quarter of its triangles");
+    double area = 0.0;
+    bool facingUp = true;
+    for (size_t t = 0; t + 2 < square.size(); t += 3)
+    {
+        const float* a = &grid.vertices[square[t] * MESH_VERTEX_FLOATS];
+        const float* b = &grid.vertices[square[t + 1] * MESH_VERTEX_FLOATS];
+        const float* c = &grid.vertices[square[t + 2] * MESH_VERTEX_FLOATS];
+        const double cross = (double)(b[0] - a[0]) * (c[1] - a[1]) - (double)(b[1] - a[1]) * (c[0] - a[0]);
+        facingUp = facingUp && cross > 0.0;
+        area += cross / 2.0;
+    }
+    UCheck(facingUp, "no triangle of the square flips over");
+    UCheck(fabs(area - 1.0) < 1e-4, "the square keeps its area");
+
+    // A chain of levels gets coarser and less exact level after level
+    const float ratios[3] = { 0.5f, 0.25f, 0.125f };
+    vector<MeshLodLevel> levels;
+    vector<uint32_t> lodIndices;
+    buildMeshLods(torus.vertices, torus.indices, ratios, 3, levels, lodIndices);
+    UCheck(levels.size() == 4, "the torus gets a level per ratio");
+    bool chain = !levels.empty() && levels[0].firstIndex == 0 && levels[0].indexCount == torus.indices.size() && levels[0].error == 0.0f;
+    for (size_t level = 1; level < levels.size() && chain; ++level)
+    {
+        chain = levels[level].firstIndex == levels[level - 1].firstIndex + levels[level - 1].indexCount
+            && levels[level].indexCount < levels[level - 1].indexCount && levels[level].indexCount <= torus.indices.size() * ratios[level - 1]
+            && levels[level].error >= levels[level - 1].error;
+    }
+    UCheck(chain, "levels follow one another, each smaller and with no less error than the one before");
+    UCheck(!levels.empty() && lodIndices.size() == levels.back().firstIndex + levels.back().indexCount, "the level indices hold every level");
+}
+
+
+// Quads, negative indices, tabs, CRLF line ends and missing normals in OBJ files, and files the importer refuses
+void UTestObjImport()
+{
+    const char* path = "test_import.obj";
+    const string obj =
+        "# unit square and a triangle\r\n"
+        "v 0 0 0\r\n"
+        "v 1 0 0\r\n"
+        "v\t1 1 0\r\n"
+        "v 0 1 0\r\n"
+        "vt 0 0\r\n"
+        "vt 1 0\r\n"
+        "vt 1 1\r\n"
+        "vt 0 1\r\n"
+        "vn 0 0 1\r\n"
+        "o square\r\n"
+        "f 1/1/1 2/2/1 3/3/1 4/4/1\r\n"
+        "v 0 0 1\r\n"
+        "v 1 0 1\r\n"
+        "v 0 1 1\r\n"
+        "f\t-3 -2 -1\r\n";
+    ImportedMesh mesh;
+    if (UCheck(UWriteTextFile(path, obj) && importObj(path, mesh, 1), "the OBJ file imports"))
+    {
+        UCheck(mesh.name == "test_import", "the mesh is named after the file");
+        UCheck(mesh.indices.size() == 9, "the quad is split into two triangles and the triangle kept");
+        UCheck(mesh.vertices.size() == 7 * MESH_VERTEX_FLOATS, "every distinct position/texture coordinate/normal triple is one vertex");
+
+        bool positions = mesh.indices.size() == 9;
+        const float expected[9][3] = { { 0, 0, 0 }, { 1, 0, 0 }, { 1, 1, 0 }, { 0, 0, 0 }, { 1, 1, 0 }, { 0, 1, 0 }, { 0, 0, 1 }, { 1, 0, 1 }, { 0, 1, 1 } };
+        for (size_t i = 0; i < 9 && positions; ++i)
+            positions = memcmp(&mesh.vertices[mesh.indices[i] * MESH_VERTEX_FLOATS], expected[i], 3 * sizeof(float)) == 0;
+        UCheck(positions, "the fan and the negative indices select the right positions");
+
+        const float* corner = positions ? &mesh.vertices[mesh.indices[2] * MESH_VERTEX_FLOATS] : 0;
+        UCheck(corner && corner[5] == 1.0f && corner[6] == 1.0f && corner[7] == 1.0f, "normals and texture coordinates are kept");
+        const float* smooth = positions ? &mesh.vertices[mesh.indices[6] * MESH_VERTEX_FLOATS] : 0;
+        UCheck(smooth && fabs(smooth[3]) < 1e-6f && fabs(smooth[4]) < 1e-6f && fabs(smooth[5] - 1.0f) < 1e-6f, "faces without normals get smooth ones");
+    }
+
+    // The same file on several threads gives the same mesh
+    ImportedMesh threaded;
+    UCheck(importObj(path, threaded, 4) && threaded.vertices == mesh.vertices && threaded.indices == mesh.indices, "the thread count does not change the mesh");
+
+    const char* refused[][2] = {
+        { "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 4\n", "an index past the last position is refused" },
+        { "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 -4\n", "a negative index before the first position is refused" },
+        { "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 0 1 2\n", "index 0 is refused" },
+        { "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1/2 2/2 3/2\n", "a texture coordinate that does not exist is refused" },
+        { "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1/-1 2/-1 3/-1\n", "a relative texture coordinate in a file without any is refused" },
+        { "v 0 0 0\nv 1 0 0\nv 0 1 0\nvn 0 0 1\nf 1//-2 2//-2 3//-2\n", "a relative normal before the first one is refused" },
+        { "v 0 0 0\nv 1 0 0\nv 0 1 0\n", "a file without faces is refused" },
+        { "", "an empty file is refused" }
+    };
+    for (size_t i = 0; i < sizeof(refused) / sizeof(refused[0]); ++i)
+    {
+        ImportedMesh bad;
+        UCheck(UWriteTextFile(path, refused[i][0]) && !importObj(path, bad, 1), refused[i][1]);
+    }
+    remove(path);
+
+    ImportedMesh missing;
+    UCheck(!importObj("test_missing.obj", missing), "a missing file is refused");
+    UCheck(importMeshName("models/chair.obj") == "chair" && importMeshName("C:\\models\\lamp.shade.obj") == "lamp" && importMeshName(".hidden") == ".hidden", "mesh names drop the directory and extension");
+
+    // The number parser agrees with strtof to within a unit in the last place
+    const char* numbers[] = { "0", "-0.5", "3.14159265", "1e-7", "-2.5E+3", "123456789012345678901234", "0.000001234", ".5", "7." };
+    bool close = true;
+    for (size_t i = 0; i < sizeof(numbers) / sizeof(numbers[0]); ++i)
+    {
+        float value = 0.0f;
+        const char* end = importParseFloat(numbers[i], value);
+        const float reference = strtof(numbers[i], 0);
+        close = close && *end == 0 && (value == reference || value == nextafterf(reference, value));
+    }
+    UCheck(close, "importParseFloat matches strtof");
+}
+
+
+// A .glb file of a named mesh with 16-bit indices and no normals, an unnamed one, and a line primitive to skip
+void UTestGlbImport()
+{
+    const char* path = "test_import.glb";
+    const float positions[4][3] = { { 0, 0, 0 }, { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };
+    const float texCoords[4][2] = { { 0, 0 }, { 1, 0 }, { 0, 1 }, { 0.25f, 0.5f } };
+    const uint16_t indices[6] = { 0, 2, 1, 0, 1, 3 };
+    vector<unsigned char> bin;
+    UAppendBytes(bin, positions, sizeof(positions));
+    UAppendBytes(bin, texCoords, sizeof(texCoords));
+    UAppendBytes(bin, indices, sizeof(indices));
+
+    const string buffers = "\"asset\":{\"version\":\"2.0\"},\"buffers\":[{\"byteLength\":" + to_string(bin.size()) + "}],"
+        "\"bufferViews\":[{\"buffer\":0,\"byteOffset\":0,\"byteLength\":48},{\"buffer\":0,\"byteOffset\":48,\"byteLength\":32},{\"buffer\":0,\"byteOffset\":80,\"byteLength\":12}],"
+        "\"accessors\":[{\"bufferView\":0,\"componentType\":5126,\"count\":4,\"type\":\"VEC3\"},{\"bufferView\":1,\"componentType\":5126,\"count\":4,\"type\":\"VEC2\"},"
+        "{\"bufferView\":2,\"componentType\":5123,\"count\":6,\"type\":\"SCALAR\"},{\"bufferView\":0,\"componentType\":5126,\"count\":3,\"type\":\"VEC3\"}],";
+    const string json = "{" + buffers + "\"meshes\":["
+        "{\"name\":\"pyramid\",\"primitives\":[{\"attributes\":{\"POSITION\":0,\"TEXCOORD_0\":1},\"indices\":2},{\"attributes\":{\"POSITION\":0},\"indices\":2,\"mode\":1}]},"
+        "{\"primitives\":[{\"attributes\":{\"POSITION\":3}}]}]}";
+
+    vector<ImportedMesh> meshes;
+    if (UCheck(UWriteGlbFile(path, json, bin) && importGlb(path, meshes), "the .glb file imports") && UCheck(meshes.size() == 2, "both meshes are imported"))
+    {
+        const ImportedMesh& pyramid = meshes[0];
+        UCheck(pyramid.name == "pyramid" && meshes[1].name == "test_import 1", "meshes keep their name, or get the file's and their index");
+        UCheck(pyramid.indices.size() == 6 && pyramid.vertices.size() == 4 * MESH_VERTEX_FLOATS, "the line primitive is skipped");
+        bool same = pyramid.indices.size() == 6;
+        for (size_t i = 0; i < 6 && same; ++i)
+            same = pyramid.indices[i] == indices[i] && memcmp(&pyramid.vertices[pyramid.indices[i] * MESH_VERTEX_FLOATS], positions[indices[i]], 3 * sizeof(float)) == 0;
+        UCheck(same, "16-bit indices select their positions");
+        UCheck(pyramid.vertices.size() == 4 * MESH_VERTEX_FLOATS && pyramid.vertices[3 * MESH_VERTEX_FLOATS + 6] == 0.25f
+            && pyramid.vertices[3 * MESH_VERTEX_FLOATS + 7] == 0.5f && pyramid.vertices[2 * MESH_VERTEX_FLOATS + 7] == 0.0f, "texture coordinates are flipped to a bottom-left origin");
+
+        bool unitNormals = true;
+        for (size_t v = 0; v + MESH_VERTEX_FLOATS <= pyramid.vertices.size(); v += MESH_VERTEX_FLOATS)
+        {
+            const float* n = &pyramid.vertices[v + 3];
+            unitNormals = unitNormals && fabs(sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]) - 1.0f) < 1e-5f;
+        }
+        UCheck(unitNormals, "missing normals are smoothed to unit length");
+        UCheck(meshes[1].indices.size() == 3 && meshes[1].indices[2] == 2, "a primitive without indices draws its vertices in order");
+    }
+
+    // An index past the accessor, a wrong magic and a truncated file are refused
+    const uint16_t outOfRange[6] = { 0, 2, 1, 0, 1, 4 };
+    vector<unsigned char> badBin = bin;
+    memcpy(&badBin[80], outOfRange, sizeof(outOfRange));
+    meshes.clear();
+    UCheck(UWriteGlbFile(path, json, badBin) && !importGlb(path, meshes), "an index past the last vertex is refused");
+
+    meshes.clear();
+    UCheck(UWriteGlbFile(path, "{" + buffers + "\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":7}}]}]}", bin) && !importGlb(path, meshes), "a missing accessor is refused");
+
+    meshes.clear();
+    UCheck(UWriteGlbFile(path, json.substr(0, json.size() / 2), bin) && !importGlb(path, meshes), "a malformed JSON chunk is refused");
+
+    meshes.clear();
+    UCheck(UWriteTextFile(path, "glTX" + string(32, '\0')) && !importGlb(path, meshes), "a file with the wrong magic is refused");
+
+    meshes.clear();
+    UCheck(UWriteTextFile(path, "glTF") && !importGlb(path, meshes), "a truncated file is refused");
+    remove(path);
+
+    meshes.clear();
+    UCheck(!importMeshes("test_missing.glb", meshes) && meshes.empty(), "a missing file is refused");
+}
+
+
+// Each encoder's blocks decode, by the formats' specifications, to the solid and two-color blocks they were
+// given and to gradients within each format's precision; mip chains of any size have the right levels and sizes
+void UTestTextureCompression()
+{
+    const uint32_t formats[3] = { TEXTURE_BC1, TEXTURE_BC3, TEXTURE_BC7 };
+    const char* formatNames[3] = { "BC1", "BC3", "BC7" };
+    // Largest channel error of a 4x4 gradient spanning 0 to 120 in each channel
+    const int gradientTolerance[3] = { 16, 16, 6 };
+
+    // Colors every format stores exactly: 5:6:5 values widened like the GPU does for BC1, all channels of the
+    // same parity for BC7's shared p-bit
+    const unsigned char colors[4][4] = { { 0, 0, 0, 0 }, { 255, 255, 255, 255 }, { 132, 130, 66, 200 }, { 8, 12, 0, 16 } };
+
+    for (int f = 0; f < 3; ++f)
+    {
+        const uint32_t format = formats[f];
+        const string name = formatNames[f];
+        unsigned char block[64];
+
+        bool solid = true;
+        for (int k = 0; k < 4; ++k)
+        {
+            for (int p = 0; p < 16; ++p)
+                memcpy(block + p * 4, colors[k], 4);
+            solid = solid && UBlockError(format, block) == 0;
+        }
+        UCheck(solid, (name + " reproduces solid blocks exactly").c_str());
+
+        // Two colors in a checkerboard and in halves, each of them at the anchor pixel, so BC7's endpoint swap runs
+        bool twoColor = true;
+        for (int a = 0; a < 4; ++a)
+        {
+            for (int b = 0; b < 4; ++b)
+            {
+                if (a == b)
+                    continue;
+                for (int p = 0; p < 16; ++p)
+                    memcpy(block + p * 4, colors[(p + p / 4) % 2 ? b : a], 4);
+                twoColor = twoColor && UBlockError(format, block) == 0;
+                for (int p = 0; p < 16; ++p)
+                    memcpy(block + p * 4, colors[p < 8 ? a : b], 4);
+                twoColor = twoColor && UBlockError(format, block) == 0;
+            }
+        }
+        UCheck(twoColor, (name + " reproduces two-color blocks exactly").c_str());
+
+        // Gradients along x, y and the diagonal, in different directions per channel
+        bool gradient = true;
+        for (int direction = 0; direction < 3; ++direction)
+        {
+            for (int p = 0; p < 16; ++p)
+            {
+                const int x = p % 4, y = p / 4;
+                const int t = direction == 0 ? x * 3 : (direction == 1 ? y * 3 : (x + y) * 3 / 2);
+                block[p * 4 + 0] = (unsigned char)(t * 40 / 3);
+                block[p * 4 + 1] = (unsigned char)(120 - t * 40 / 3);
+                block[p * 4 + 2] = (unsigned char)(60 + t * 20 / 3);
+                block[p * 4 + 3] = (unsigned char)(255 - t * 40 / 3);
+            }
+            const int error = UBlockError(format, block);
+            gradient = gradient && error >= 0 && error <= gradientTolerance[f];
+        }
+        UCheck(gradient, (name + " reproduces gradients within its precision").c_str());
+
+        // Mip chains of images whose sides are not powers of two: one level per halving down to 1x1, each of
+        // whole blocks, and a solid image decodes to its color at every level
+        const int sizes[][2] = { { 13, 6 }, { 5, 1 }, { 1, 1 }, { 3, 7 }, { 100, 75 } };
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+        {
+            const int width = sizes[s][0], height = sizes[s][1];
+            vector<unsigned char> image((size_t)width * height * 4);
+            for (size_t p = 0; p < image.size(); p += 4)
+                memcpy(&image[p], colors[2], 4);
+
+            CompressedTextureHeader header;
+            vector<unsigned char> data;
+            compressTexture(image.data(), width, height, format, header, data);
+
+            uint32_t levels = 1;
+            while ((max(width, height) >> levels) > 0)
+                ++levels;
+            size_t expected = 0;
+            for (uint32_t level = 0; level < levels; ++level)
+                expected += (size_t)((max(width >> level, 1) + 3) / 4) * ((max(height >> level, 1) + 3) / 4) * compressedBlockBytes(format);
+            const string label = name + " " + to_string(width) + "x" + to_string(height);
+            UCheck(memcmp(header.magic, "BTEX", 4) == 0 && header.format == format && header.width == (uint32_t)width && header.height == (uint32_t)height,
+                (label + " gets its header").c_str());
+            UCheck(header.levels == levels, (label + " has a level per halving down to 1x1").c_str());
+            UCheck(data.size() == expected && compressedTextureSize(header) == expected, (label + " levels take whole blocks").c_str());
+
+            bool levelsSolid = data.size() == expected;
+            for (size_t offset = 0; offset < data.size() && levelsSolid; offset += compressedBlockBytes(format))
+            {
+                unsigned char decoded[64];
+                levelsSolid = UDecodeBlock(format, &data[offset], decoded);
+                for (int p = 0; p < 16 && levelsSolid; ++p)
+                    levelsSolid = memcmp(decoded + p * 4, colors[2], format == TEXTURE_BC1 ? 3 : 4) == 0;
+            }
+            UCheck(levelsSolid, (label + " decodes to its color at every level").c_str());
+        }
+    }
+}
+
+
+// The SIMD test (FRUSTUM_SIMD_WIDTH lanes in this build) agrees with the scalar one, whatever lies in the padding
+void UTestFrustumCulling()
+{
+    Frustum frustum;
+    UCameraFrustum(frustum);
+
+    const size_t counts[] = { 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 1000 };
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c)
+    {
+        const size_t count = counts[c];
+        CullBounds bounds;
+        UBuildRandomBounds(count, 12.0f, bounds);
+
+        // Padding boxes the camera would see, and flags past the end that must stay untouched
+        const float center[3] = { 0.0f, 1.0f, -5.0f }, extent[3] = { 1.0f, 1.0f, 1.0f };
+        for (size_t i = count; i < bounds.centerX.size(); ++i)
+            setCullBounds(bounds, i, center, extent);
+        vector<unsigned char> reference(count + FRUSTUM_BATCH, 7), visible(count + FRUSTUM_BATCH, 7);
+
+        const size_t nReference = cullBoundsScalar(frustum, bounds, reference.data());
+        const size_t nVisible = cullBounds(frustum, bounds, visible.data());
+        const string label = to_string(count) + " boxes";
+        UCheck(UCullMismatches(frustum, bounds, visible, reference) == 0, ("cullBounds agrees with cullBoundsScalar over " + label).c_str());
+
+        size_t counted = 0;
+        bool flags = true;
+        for (size_t i = 0; i < count; ++i)
+        {
+            flags = flags && visible[i] <= 1;
+            counted += visible[i];
+        }
+        for (size_t i = count; i < visible.size(); ++i)
+            flags = flags && visible[i] == 7 && reference[i] == 7;
+        UCheck(flags && counted == nVisible, ("cullBounds sets a 0 or 1 flag per box, none past the count, and returns their sum over " + label).c_str());
+        if (count == 1000)
+            UCheck(nReference > 0 && nReference < count && (nVisible > nReference ? nVisible - nReference : nReference - nVisible) <= 2, "the camera sees some but not all of the 1000 boxes");
+    }
+
+    // A box in front of the camera, one behind it and one past the far plane, with padding that is all visible
+    CullBounds bounds;
+    resizeCullBounds(bounds, 3);
+    const float front[3] = { 0.0f, 1.0f, -5.0f }, behind[3] = { 0.0f, 1.0f, 10.0f }, beyond[3] = { 0.0f, 1.0f, -200.0f }, extent[3] = { 0.5f, 0.5f, 0.5f };
+    setCullBounds(bounds, 0, front, extent);
+    setCullBounds(bounds, 1, behind, extent);
+    setCullBounds(bounds, 2, beyond, extent);
+    for (size_t i = 3; i < bounds.centerX.size(); ++i)
+        setCullBounds(bounds, i, front, extent);
+    unsigned char visible[3];
+    UCheck(cullBounds(frustum, bounds, visible) == 1 && visible[0] == 1 && visible[1] == 0 && visible[2] == 0, "only the box in front of the camera is visible");
+}
+
+
+// The hierarchy culls like the one-box-at-a-time test before and after objects move, and picks the nearest box
+void UTestBvh()
+{
+    Frustum frustum;
+    UCameraFrustum(frustum);
+
+    // Counts around the leaf size and a world large enough for every kind of node
+    const size_t counts[] = { 1, 3, 4, 5, 64, 5000 };
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c)
+    {
+        CullBounds bounds;
+        UBuildRandomBounds(counts[c], 10.0f * cbrt((float)counts[c]), bounds);
+        BoundingVolumeHierarchy bvh;
+        bvh.Build(bounds);
+
+        vector<unsigned char> reference(counts[c]), visible(counts[c], 2);
+        const size_t nReference = cullBoundsScalar(frustum, bounds, reference.data());
+        const size_t nVisible = bvh.Cull(frustum, visible.data());
+        const string label = to_string(counts[c]) + " objects";
+        UCheck(UCullMismatches(frustum, bounds, visible, reference) == 0, ("the hierarchy culls like cullBoundsScalar over " + label).c_str());
+        size_t counted = 0;
+        for (size_t i = 0; i < counts[c]; ++i)
+            counted += visible[i] == 1 ? 1 : (visible[i] == 0 ? 0 : 1000000);
+        UCheck(counted == nVisible, ("Cull sets every flag to 0 or 1 and returns the visible count over " + label).c_str());
+        if (counts[c] >= 64)
+            UCheck(nReference > 0 && nReference < counts[c], ("the camera sees some but not all of " + label).c_str());
+
+        // Move a tenth of the objects, some into the view and some out of it, refitting after each
+        for (size_t m = 0; m < (counts[c] + 9) / 10; ++m)
+        {
+            const size_t i = (m * 7919) % counts[c];
+            const float center[3] = { m % 2 ? 0.0f : bounds.centerX[i] + 3.0f, m % 2 ? 1.0f : bounds.centerY[i], m % 2 ? -5.0f - (float)m : bounds.centerZ[i] - 2.5f };
+            const float extent[3] = { bounds.extentX[i], bounds.extentY[i] * 2.0f, bounds.extentZ[i] };
+            setCullBounds(bounds, i, center, extent);
+            bvh.Refit((int)i, center, extent);
+        }
+        cullBoundsScalar(frustum, bounds, reference.data());
+        bvh.Cull(frustum, visible.data());
+        UCheck(UCullMismatches(frustum, bounds, visible, reference) == 0, ("the refitted hierarchy culls like cullBoundsScalar over " + label).c_str());
+
+        // Rays from the camera through a grid of window positions, and from inside the world along the axes
+        bool nearest = true;
+        for (int r = 0; r < 130 && nearest; ++r)
+        {
+            const float origin[3] = { 0.0f, 1.0f, 3.0f };
+            const float grid[3] = { (r % 10 - 4.5f) * 0.08f, (r / 10 % 10 - 4.5f) * 0.06f, -1.0f };
+            const float axes[3] = { r % 3 == 0 ? 1.0f : 0.0f, r % 3 == 1 ? -1.0f : 0.0f, r % 3 == 2 ? 1.0f : 0.0f };
+            const float* direction = r < 100 ? grid : axes;
+            float distance, linearDistance;
+            const int hit = bvh.Raycast(origin, direction, distance);
+            const int linearHit = URaycastLinear(bounds, origin, direction, linearDistance);
+            nearest = (hit < 0) == (linearHit < 0) && (hit < 0 || fabs(distance - linearDistance) <= 1e-4f * (1.0f + linearDistance));
+        }
+        UCheck(nearest, ("Raycast finds the nearest box over " + label).c_str());
+    }
+
+    // Three boxes in a row along -z: the nearest wins, a ray starting inside one hits it at 0, and a ray beside them misses
+    CullBounds row;
+    resizeCullBounds(row, 3);
+    const float extent[3] = { 0.5f, 0.5f, 0.5f };
+    const float far[3] = { 0.0f, 0.0f, -10.0f }, near[3] = { 0.0f, 0.0f, -4.0f }, middle[3] = { 0.0f, 0.0f, -7.0f };
+    setCullBounds(row, 0, far, extent);
+    setCullBounds(row, 1, near, extent);
+    setCullBounds(row, 2, middle, extent);
+    BoundingVolumeHierarchy bvh;
+    bvh.Build(row);
+    const float forward[3] = { 0.0f, 0.0f, -1.0f }, back[3] = { 0.0f, 0.0f, 1.0f };
+    const float origin[3] = { 0.0f, 0.0f, 0.0f }, inside[3] = { 0.0f, 0.25f, -7.0f }, beside[3] = { 2.0f, 0.0f, 0.0f };
+    float distance;
+    UCheck(bvh.Raycast(origin, forward, distance) == 1 && distance == 3.5f, "a ray hits the nearest of the boxes in its way");
+    UCheck(bvh.Raycast(inside, forward, distance) == 2 && distance == 0.0f, "a ray starting inside a box hits it at distance 0");
+    UCheck(bvh.Raycast(origin, back, distance) == -1 && distance == INFINITY, "a ray pointing away misses");
+    UCheck(bvh.Raycast(beside, forward, distance) == -1, "a ray beside the boxes misses");
+
+    // Moving the near box out of the way uncovers the middle one
+    const float aside[3] = { 5.0f, 0.0f, -4.0f };
+    bvh.Refit(1, aside, extent);
+    UCheck(bvh.Raycast(origin, forward, distance) == 2 && distance == 6.5f, "a refitted box no longer blocks the ray");
+    UCheck(bvh.Raycast(beside, forward, distance) == -1 && bvh.Raycast(aside, forward, distance) == 1, "a refitted box is hit where it moved to");
+
+    BoundingVolumeHierarchy empty;
+    CullBounds none;
+    resizeCullBounds(none, 0);
+    empty.Build(none);
+    unsigned char unused = 0;
+    UCheck(empty.Raycast(origin, forward, distance) == -1 && empty.Cull(frustum, &unused) == 0, "an empty hierarchy hits and shows nothing");
+}
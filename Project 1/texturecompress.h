@@ -0,0 +1,441 @@
+#ifndef TEXTURECOMPRESS_H
+#define TEXTURECOMPRESS_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// Block compressed formats written by the texture baker. Every format encodes 4x4 pixel blocks.
+enum TextureBlockFormat
+{
+    TEXTURE_BC1 = 1,    // RGB, 8 bytes per block (0.5 byte per pixel)
+    TEXTURE_BC3 = 3,    // RGBA, 16 bytes per block (1 byte per pixel)
+    TEXTURE_BC7 = 7     // RGBA, 16 bytes per block, mode 6 only (1 byte per pixel)
+};
+
+// Header of a baked texture file. The mip levels follow it, largest first, each as rows of blocks
+// starting from the bottom row of the image (OpenGL's orientation, so no flip is needed on load).
+struct CompressedTextureHeader
+{
+    char magic[4];      // "BTEX"
+    uint32_t version;
+    uint32_t format;    // TextureBlockFormat
+    uint32_t width;
+    uint32_t height;
+    uint32_t levels;
+};
+
+const uint32_t COMPRESSED_TEXTURE_VERSION = 1;
+
+inline size_t compressedBlockBytes(uint32_t format)
+{
+    return format == TEXTURE_BC1 ? 8 : 16;
+}
+
+// Bytes of one mip level; levels smaller than a block still take a whole block
+inline size_t compressedLevelSize(uint32_t format, uint32_t width, uint32_t height)
+{
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * compressedBlockBytes(format);
+}
+
+inline size_t compressedTextureSize(const CompressedTextureHeader& header)
+{
+    size_t size = 0;
+    for (uint32_t level = 0; level < header.levels; ++level)
+    {
+        uint32_t width = header.width >> level;
+        uint32_t height = header.height >> level;
+        size += compressedLevelSize(header.format, width ? width : 1, height ? height : 1);
+    }
+    return size;
+}
+
+// Halves an RGBA image with a 2x2 box filter; odd edges repeat their last row or column
+inline void downsampleImage(const unsigned char* source, int width, int height, unsigned char* destination)
+{
+    const int halfWidth = width > 1 ? width / 2 : 1;
+    const int halfHeight = height > 1 ? height / 2 : 1;
+
+    for (int j = 0; j < halfHeight; ++j)
+    {
+        int y0 = j * 2 < height ? j * 2 : height - 1;
+        int y1 = j * 2 + 1 < height ? j * 2 + 1 : height - 1;
+
+        for (int i = 0; i < halfWidth; ++i)
+        {
+            int x0 = i * 2 < width ? i * 2 : width - 1;
+            int x1 = i * 2 + 1 < width ? i * 2 + 1 : width - 1;
+
+            for (int c = 0; c < 4; ++c)
+            {
+                int sum = source[(y0 * width + x0) * 4 + c] + source[(y0 * width + x1) * 4 + c]
+                    + source[(y1 * width + x0) * 4 + c] + source[(y1 * width + x1) * 4 + c];
+                destination[(j * halfWidth + i) * 4 + c] = (unsigned char)((sum + 2) / 4);
+            }
+        }
+    }
+}
+
+inline bool imageHasAlpha(const unsigned char* rgba, size_t pixelCount)
+{
+    for (size_t i = 0; i < pixelCount; ++i)
+    {
+        if (rgba[i * 4 + 3] != 255)
+            return true;
+    }
+    return false;
+}
+
+// Finds the two pixels of a block at the ends of its principal axis (channels 0 to channelCount - 1)
+inline void findBlockEndpoints(const unsigned char block[64], int channelCount, float low[4], float high[4])
+{
+    float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int p = 0; p < 16; ++p)
+        for (int c = 0; c < channelCount; ++c)
+            mean[c] += block[p * 4 + c] / 16.0f;
+
+    float covariance[4][4] = {};
+    for (int p = 0; p < 16; ++p)
+        for (int a = 0; a < channelCount; ++a)
+            for (int b = 0; b < channelCount; ++b)
+                covariance[a][b] += (block[p * 4 + a] - mean[a]) * (block[p * 4 + b] - mean[b]);
+
+    // A few power iterations are enough to find the dominant direction of 16 points. The axis is kept at unit
+    // length, so mean + axis * t below lands on the pixels' own projections.
+    float axis[4] = { 0.5f, 0.5f, 0.5f, 0.5f };
+    for (int iteration = 0; iteration < 8; ++iteration)
+    {
+        float next[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        float length = 0.0f;
+        for (int a = 0; a < channelCount; ++a)
+        {
+            for (int b = 0; b < channelCount; ++b)
+                next[a] += covariance[a][b] * axis[b];
+            length += next[a] * next[a];
+        }
+        if (length == 0.0f)
+            break;
+        for (int a = 0; a < channelCount; ++a)
+            axis[a] = next[a] / std::sqrt(length);
+    }
+
+    float minimum = 1e30f;
+    float maximum = -1e30f;
+    for (int p = 0; p < 16; ++p)
+    {
+        float t = 0.0f;
+        for (int c = 0; c < channelCount; ++c)
+            t += (block[p * 4 + c] - mean[c]) * axis[c];
+        minimum = t < minimum ? t : minimum;
+        maximum = t > maximum ? t : maximum;
+    }
+
+    for (int c = 0; c < 4; ++c)
+    {
+        low[c] = c < channelCount ? mean[c] + axis[c] * minimum : 255.0f;
+        high[c] = c < channelCount ? mean[c] + axis[c] * maximum : 255.0f;
+        low[c] = low[c] < 0.0f ? 0.0f : (low[c] > 255.0f ? 255.0f : low[c]);
+        high[c] = high[c] < 0.0f ? 0.0f : (high[c] > 255.0f ? 255.0f : high[c]);
+    }
+}
+
+// Index of the palette entry closest to a pixel
+inline int nearestBlockColor(const unsigned char* pixel, const int palette[][4], int paletteSize, int channelCount)
+{
+    int best = 0;
+    int bestError = 0x7fffffff;
+    for (int i = 0; i < paletteSize; ++i)
+    {
+        int error = 0;
+        for (int c = 0; c < channelCount; ++c)
+            error += (pixel[c] - palette[i][c]) * (pixel[c] - palette[i][c]);
+        if (error < bestError)
+        {
+            bestError = error;
+            best = i;
+        }
+    }
+    return best;
+}
+
+// BC1 color block in four color mode (RGB of a 4x4 RGBA block)
+inline void encodeBC1Block(const unsigned char block[64], unsigned char out[8])
+{
+    float low[4], high[4];
+    findBlockEndpoints(block, 3, low, high);
+
+    uint16_t color0 = (uint16_t)(((int)(high[0] * 31.0f / 255.0f + 0.5f) << 11) | ((int)(high[1] * 63.0f / 255.0f + 0.5f) << 5) | (int)(high[2] * 31.0f / 255.0f + 0.5f));
+    uint16_t color1 = (uint16_t)(((int)(low[0] * 31.0f / 255.0f + 0.5f) << 11) | ((int)(low[1] * 63.0f / 255.0f + 0.5f) << 5) | (int)(low[2] * 31.0f / 255.0f + 0.5f));
+
+    // color0 > color1 selects four color mode
+    if (color0 < color1)
+    {
+        uint16_t swap = color0;
+        color0 = color1;
+        color1 = swap;
+    }
+
+    int palette[4][4];
+    const uint16_t colors[2] = { color0, color1 };
+    for (int i = 0; i < 2; ++i)
+    {
+        palette[i][0] = ((colors[i] >> 11) & 31) * 255 / 31;
+        palette[i][1] = ((colors[i] >> 5) & 63) * 255 / 63;
+        palette[i][2] = (colors[i] & 31) * 255 / 31;
+    }
+    for (int c = 0; c < 3; ++c)
+    {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    uint32_t indices = 0;
+    if (color0 != color1)
+    {
+        for (int p = 0; p < 16; ++p)
+            indices |= (uint32_t)nearestBlockColor(block + p * 4, palette, 4, 3) << (p * 2);
+    }
+
+    out[0] = (unsigned char)(color0 & 0xff);
+    out[1] = (unsigned char)(color0 >> 8);
+    out[2] = (unsigned char)(color1 & 0xff);
+    out[3] = (unsigned char)(color1 >> 8);
+    for (int i = 0; i < 4; ++i)
+        out[4 + i] = (unsigned char)(indices >> (i * 8));
+}
+
+// BC3 block: eight level alpha block followed by a BC1 color block
+inline void encodeBC3Block(const unsigned char block[64], unsigned char out[16])
+{
+    int alpha0 = 0;
+    int alpha1 = 255;
+    for (int p = 0; p < 16; ++p)
+    {
+        alpha0 = block[p * 4 + 3] > alpha0 ? block[p * 4 + 3] : alpha0;
+        alpha1 = block[p * 4 + 3] < alpha1 ? block[p * 4 + 3] : alpha1;
+    }
+
+    // alpha0 > alpha1 selects eight interpolated levels: 0 = alpha0, 1 = alpha1, 2..7 in between
+    int levels[8] = { alpha0, alpha1 };
+    for (int i = 1; i < 7; ++i)
+        levels[i + 1] = ((7 - i) * alpha0 + i * alpha1) / 7;
+
+    uint64_t indices = 0;
+    if (alpha0 != alpha1)
+    {
+        for (int p = 0; p < 16; ++p)
+        {
+            int best = 0;
+            for (int i = 1; i < 8; ++i)
+            {
+                if (abs(block[p * 4 + 3] - levels[i]) < abs(block[p * 4 + 3] - levels[best]))
+                    best = i;
+            }
+            indices |= (uint64_t)best << (p * 3);
+        }
+    }
+
+    out[0] = (unsigned char)alpha0;
+    out[1] = (unsigned char)alpha1;
+    for (int i = 0; i < 6; ++i)
+        out[2 + i] = (unsigned char)(indices >> (i * 8));
+
+    encodeBC1Block(block, out + 8);
+}
+
+// Writes the low bitCount bits of value at bit position offset of a 128-bit block
+inline void writeBlockBits(unsigned char out[16], int& offset, uint32_t value, int bitCount)
+{
+    for (int i = 0; i < bitCount; ++i, ++offset)
+    {
+        if (value & (1u << i))
+            out[offset / 8] |= (unsigned char)(1u << (offset % 8));
+    }
+}
+
+// BC7 mode 6 block: one RGBA subset, 7-bit endpoints with a p-bit each and 4-bit indices
+inline void encodeBC7Block(const unsigned char block[64], unsigned char out[16])
+{
+    static const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    float low[4], high[4];
+    findBlockEndpoints(block, 4, low, high);
+
+    // Quantize each endpoint to 7 bits per channel plus the p-bit that fits its channels best
+    int endpoints[2][4];
+    int pbits[2];
+    const float* source[2] = { low, high };
+    for (int e = 0; e < 2; ++e)
+    {
+        int bestError = 0x7fffffff;
+        for (int p = 0; p < 2; ++p)
+        {
+            int error = 0;
+            int candidate[4];
+            for (int c = 0; c < 4; ++c)
+            {
+                int value = (int)((source[e][c] - p) / 2.0f + 0.5f);
+                value = value < 0 ? 0 : (value > 127 ? 127 : value);
+                candidate[c] = value;
+                int decoded = (value << 1) | p;
+                error += (int)((decoded - source[e][c]) * (decoded - source[e][c]));
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                pbits[e] = p;
+                memcpy(endpoints[e], candidate, sizeof(candidate));
+            }
+        }
+    }
+
+    int palette[16][4];
+    for (int c = 0; c < 4; ++c)
+    {
+        int e0 = (endpoints[0][c] << 1) | pbits[0];
+        int e1 = (endpoints[1][c] << 1) | pbits[1];
+        for (int i = 0; i < 16; ++i)
+            palette[i][c] = ((64 - weights[i]) * e0 + weights[i] * e1 + 32) >> 6;
+    }
+
+    int indices[16];
+    for (int p = 0; p < 16; ++p)
+        indices[p] = nearestBlockColor(block + p * 4, palette, 16, 4);
+
+    // The first index is stored without its top bit, so it must be below 8: swap the endpoints otherwise
+    if (indices[0] >= 8)
+    {
+        for (int c = 0; c < 4; ++c)
+        {
+            int swap = endpoints[0][c];
+            endpoints[0][c] = endpoints[1][c];
+            endpoints[1][c] = swap;
+        }
+        int swap = pbits[0];
+        pbits[0] = pbits[1];
+        pbits[1] = swap;
+        for (int p = 0; p < 16; ++p)
+            indices[p] = 15 - indices[p];
+    }
+
+    memset(out, 0, 16);
+    int offset = 0;
+    writeBlockBits(out, offset, 1u << 6, 7);
+    for (int c = 0; c < 4; ++c)
+    {
+        writeBlockBits(out, offset, endpoints[0][c], 7);
+        writeBlockBits(out, offset, endpoints[1][c], 7);
+    }
+    writeBlockBits(out, offset, pbits[0], 1);
+    writeBlockBits(out, offset, pbits[1], 1);
+    writeBlockBits(out, offset, indices[0], 3);
+    for (int p = 1; p < 16; ++p)
+        writeBlockBits(out, offset, indices[p], 4);
+}
+
+// Compresses a whole RGBA image; blocks overhanging the edge repeat the last row and column
+inline void compressImage(const unsigned char* rgba, int width, int height, uint32_t format, unsigned char* out)
+{
+    const size_t blockBytes = compressedBlockBytes(format);
+    unsigned char block[64];
+
+    for (int by = 0; by < height; by += 4)
+    {
+        for (int bx = 0; bx < width; bx += 4)
+        {
+            for (int y = 0; y < 4; ++y)
+            {
+                int sy = by + y < height ? by + y : height - 1;
+                for (int x = 0; x < 4; ++x)
+                {
+                    int sx = bx + x < width ? bx + x : width - 1;
+                    memcpy(block + (y * 4 + x) * 4, rgba + ((size_t)sy * width + sx) * 4, 4);
+                }
+            }
+
+            if (format == TEXTURE_BC1)
+                encodeBC1Block(block, out);
+            else if (format == TEXTURE_BC3)
+                encodeBC3Block(block, out);
+            else
+                encodeBC7Block(block, out);
+            out += blockBytes;
+        }
+    }
+}
+
+// Compresses an image and its whole mip chain into header and data
+inline void compressTexture(const unsigned char* rgba, int width, int height, uint32_t format, CompressedTextureHeader& header, std::vector<unsigned char>& data)
+{
+    memcpy(header.magic, "BTEX", 4);
+    header.version = COMPRESSED_TEXTURE_VERSION;
+    header.format = format;
+    header.width = width;
+    header.height = height;
+    header.levels = 1;
+    while ((width >> header.levels) > 0 || (height >> header.levels) > 0)
+        ++header.levels;
+
+    data.resize(compressedTextureSize(header));
+
+    std::vector<unsigned char> level(rgba, rgba + (size_t)width * height * 4);
+    std::vector<unsigned char> next;
+    size_t offset = 0;
+
+    for (uint32_t i = 0; i < header.levels; ++i)
+    {
+        compressImage(level.data(), width, height, format, data.data() + offset);
+        offset += compressedLevelSize(format, width, height);
+
+        if (i + 1 < header.levels)
+        {
+            next.resize((size_t)(width > 1 ? width / 2 : 1) * (height > 1 ? height / 2 : 1) * 4);
+            downsampleImage(level.data(), width, height, next.data());
+            level.swap(next);
+            width = width > 1 ? width / 2 : 1;
+            height = height > 1 ? height / 2 : 1;
+        }
+    }
+}
+
+inline bool writeCompressedTexture(const char* path, const CompressedTextureHeader& header, const std::vector<unsigned char>& data)
+{
+    FILE* file = fopen(path, "wb");
+    if (!file)
+        return false;
+
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(data.data(), 1, data.size(), file) == data.size();
+    fclose(file);
+    return written;
+}
+
+// Reads and validates the header of a baked texture; false when the file is missing or not a baked texture
+inline bool readCompressedTextureHeader(const char* path, CompressedTextureHeader& header)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return false;
+
+    bool valid = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, "BTEX", 4) == 0
+        && header.version == COMPRESSED_TEXTURE_VERSION && header.levels > 0
+        && (header.format == TEXTURE_BC1 || header.format == TEXTURE_BC3 || header.format == TEXTURE_BC7);
+    fclose(file);
+    return valid;
+}
+
+// Reads the mip levels of a baked texture into destination, which holds compressedTextureSize() bytes
+inline bool readCompressedTextureData(const char* path, unsigned char* destination, size_t size)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return false;
+
+    bool valid = fseek(file, sizeof(CompressedTextureHeader), SEEK_SET) == 0 && fread(destination, 1, size, file) == size;
+    fclose(file);
+    return valid;
+}
+
+#endif